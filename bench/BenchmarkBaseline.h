@@ -0,0 +1,38 @@
+#ifndef BENCHMARKBASELINE_H
+#define BENCHMARKBASELINE_H
+
+// A benchmark fails if it runs this many times slower than its baseline.
+// Costs are relative to a reference timed in the same run, which takes out
+// most of the machine but not all of it, so allow for noise. Override with
+// -DBENCHMARK_SLOWDOWN_LIMIT=x.
+#ifndef BENCHMARK_SLOWDOWN_LIMIT
+#define BENCHMARK_SLOWDOWN_LIMIT 1.5
+#endif
+
+struct BenchmarkBaseline {
+  const char *name;
+  // Time per call over the time per call of referenceWork in bench.cpp
+  double relativeCost;
+  double allocationsPerCall;
+};
+
+/**
+ * Stored results for native_bench. Each run prints a "baseline:" line per
+ * benchmark in this format; paste them in here when a change is meant to
+ * move the numbers, taking the worst of a few runs.
+ */
+static const BenchmarkBaseline benchmarkBaselines[] = {
+    {"calculateSpeedInMilliHz", 0.598, 0},
+    {"calculatePositionByDegreeShift", 0.591, 0},
+    {"calculateTimeToCenterInSeconds", 0.288, 0},
+    {"calculateTimeToEndOfRunInSeconds", 0.279, 0},
+    {"RADynamic::onLoop", 0.359, 0},
+    {"MotionTrace::record", 0.291, 0},
+    {"encodeStatus", 0.13, 0},
+    {"decodeCommand", 0.136, 0},
+    {"parseJsonCommand", 4.2, 0},
+    {"Lx200Session::feed", 7.96, 0},
+    {"StatusDelta::encode", 94.2, 0},
+};
+
+#endif
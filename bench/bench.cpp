@@ -0,0 +1,546 @@
+#include "CommandMailbox.h"
+#include "DecDynamic.h"
+#include "DecStatic.h"
+#include "Logging.h"
+#include "Lx200Session.h"
+#include "MotionTrace.h"
+#include "MotorCommand.h"
+#include "PlatformProtocol.h"
+#include "RADynamic.h"
+#include "RAStatic.h"
+#include "StatusDelta.h"
+
+#include "Benchmark.h"
+#include "BenchmarkBaseline.h"
+#include "SimulatedTimerService.h"
+#include "StepperWrapper.h"
+#include <ArduinoJson.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <new>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <unity.h>
+
+// Heap allocations since start. Counted by the operator new below, so
+// benchmarks can check hot paths don't allocate.
+static unsigned long allocationCount = 0;
+
+void *operator new(size_t size) {
+  allocationCount++;
+  void *p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+// The operator new above gets its memory from malloc, so free is the right
+// pairing. GCC only sees a pointer from operator new going to free.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+#define BENCHMARK_ITERATIONS 200000
+// Each timing is the best of this many runs, to shed scheduler noise
+#define BENCHMARK_REPEATS 3
+
+struct BenchmarkResult {
+  double nsPerCall;
+  // nsPerCall over the reference work's, see BenchmarkBaseline.h
+  double relativeCost;
+  double allocationsPerCall;
+};
+
+// Fixed work that timings are compared against: FNV-1a over 64 bytes,
+// then a square root. A mix of integer, memory and floating point, like
+// the code under test.
+static uint8_t referenceBytes[64];
+uint32_t referenceWork(long i) {
+  referenceBytes[i & 63] = (uint8_t)i;
+  uint32_t hash = 2166136261u;
+  for (uint8_t b : referenceBytes)
+    hash = (hash ^ b) * 16777619u;
+  return hash + (uint32_t)std::sqrt((double)hash);
+}
+
+template <typename F> double bestNsPerCall(F fn) {
+  double best = benchmarkNsPerCall(fn, BENCHMARK_ITERATIONS);
+  for (int run = 1; run < BENCHMARK_REPEATS; run++) {
+    double ns = benchmarkNsPerCall(fn, BENCHMARK_ITERATIONS);
+    if (ns < best)
+      best = ns;
+  }
+  return best;
+}
+
+// Timed at startup, and again if a run looks noisy
+static double referenceNs = 0;
+
+/**
+ * Time fn and count what it allocates, without comparing to a baseline.
+ */
+template <typename F> BenchmarkResult measure(const char *name, F fn) {
+  unsigned long allocationsBefore = allocationCount;
+  for (long i = 0; i < BENCHMARK_ITERATIONS; i++) {
+    benchmarkSink = fn(i);
+  }
+  BenchmarkResult result;
+  result.allocationsPerCall =
+      (double)(allocationCount - allocationsBefore) / BENCHMARK_ITERATIONS;
+  result.nsPerCall = bestNsPerCall(fn);
+  result.relativeCost = result.nsPerCall / referenceNs;
+  log("baseline: {\"%s\", %.3g, %g},", name, result.relativeCost,
+      result.allocationsPerCall);
+  return result;
+}
+
+/**
+ * Time fn, count what it allocates, and compare both with the stored
+ * baseline. Time is compared relative to the reference work timed in the
+ * same run, so the baselines hold on any machine.
+ */
+template <typename F> BenchmarkResult benchmark(const char *name, F fn) {
+  BenchmarkResult result = measure(name, fn);
+
+  const BenchmarkBaseline *baseline = nullptr;
+  for (const BenchmarkBaseline &b : benchmarkBaselines) {
+    if (strcmp(b.name, name) == 0)
+      baseline = &b;
+  }
+  if (baseline == nullptr) {
+    TEST_FAIL_MESSAGE("No baseline stored for benchmark");
+    return result;
+  }
+  double limit = baseline->relativeCost * BENCHMARK_SLOWDOWN_LIMIT;
+  if (result.relativeCost > limit) {
+    // the machine may have been busy while the reference was timed
+    referenceNs = bestNsPerCall(referenceWork);
+    result.relativeCost = result.nsPerCall / referenceNs;
+  }
+  log("%s: %.1f ns/call, %.3gx reference (baseline %.3gx, %+.0f%%), "
+      "%g allocations/call (baseline %g)",
+      name, result.nsPerCall, result.relativeCost, baseline->relativeCost,
+      (result.relativeCost / baseline->relativeCost - 1) * 100,
+      result.allocationsPerCall, baseline->allocationsPerCall);
+  TEST_ASSERT_TRUE_MESSAGE(result.allocationsPerCall <=
+                               baseline->allocationsPerCall,
+                           "More allocations per call than baseline");
+  TEST_ASSERT_TRUE_MESSAGE(result.relativeCost <= limit,
+                           "Slower than baseline");
+  return result;
+}
+
+/**
+ * Log how much cheaper a replacement is than ArduinoJson for one packet,
+ * and check it is cheaper and doesn't allocate.
+ */
+void compareWithJson(const char *what, BenchmarkResult json,
+                     BenchmarkResult replacement) {
+  log("%s: %.1f ns, %g allocations; ArduinoJson %.1f ns, %g allocations "
+      "(%.0fx faster)",
+      what, replacement.nsPerCall, replacement.allocationsPerCall,
+      json.nsPerCall, json.allocationsPerCall,
+      json.nsPerCall / replacement.nsPerCall);
+  TEST_ASSERT_TRUE_MESSAGE(replacement.nsPerCall < json.nsPerCall,
+                           "Slower than ArduinoJson");
+  TEST_ASSERT_TRUE_MESSAGE(replacement.allocationsPerCall == 0,
+                           "Allocates");
+}
+
+// Steps the stub's queue holds: 32 entries at 3 a step, as at sidereal
+#define STUB_QUEUE_STEPS 10
+
+/**
+ * StepperWrapper with no timing, so onLoop timings are the loop alone. It
+ * keeps a step queue that run() drains, so streaming has to refill it.
+ */
+class StubStepper : public StepperWrapper {
+public:
+  int32_t position = 0;
+  int32_t queueEnd = 0;
+  bool streaming = false;
+  void moveTo(int32_t /*p*/, uint32_t /*s*/) override {}
+  void resetPosition(int32_t p) override {
+    position = p;
+    queueEnd = p;
+    streaming = false;
+  }
+  void stop() override { streaming = false; }
+  int32_t getPosition() override { return position; }
+  void setStepperSpeed(uint32_t /*s*/) override {}
+  uint32_t getStepperSpeed() override { return 0; }
+  void setAcceleration(unsigned long /*a*/) override {}
+  uint32_t queueSteps(uint32_t steps, uint32_t /*s*/,
+                      bool /*forward*/) override {
+    if (!streaming)
+      queueEnd = position;
+    streaming = true;
+    uint32_t space = STUB_QUEUE_STEPS - (position - queueEnd);
+    if (steps > space)
+      steps = space;
+    queueEnd -= steps;
+    return steps;
+  }
+  bool isStreaming() override { return streaming; }
+  int32_t getQueueEndPosition() override { return queueEnd; }
+  uint32_t getStreamUnderruns() override { return 0; }
+
+  // Take steps off the queue, as the step timer would
+  void run(int32_t steps) {
+    position -= steps;
+    if (position < queueEnd)
+      position = queueEnd;
+  }
+};
+
+RAStatic model;
+
+void bench_calculate_speed() {
+  double rate = model.getTrackingRateArcsSecondsSec();
+  benchmark("calculateSpeedInMilliHz", [&](long i) {
+    return model.calculateSpeedInMilliHz(i % 468000, rate);
+  });
+}
+
+void bench_position_by_degree_shift() {
+  benchmark("calculatePositionByDegreeShift", [&](long i) {
+    return model.calculatePositionByDegreeShift((i % 20) - 10.0, i % 468000);
+  });
+}
+
+void bench_time_to_center() {
+  benchmark("calculateTimeToCenterInSeconds", [&](long i) {
+    return (uint32_t)model.calculateTimeToCenterInSeconds(i % 468000);
+  });
+}
+
+void bench_time_to_end() {
+  benchmark("calculateTimeToEndOfRunInSeconds", [&](long i) {
+    return (uint32_t)model.calculateTimeToEndOfRunInSeconds(i % 468000);
+  });
+}
+
+void bench_ra_onloop() {
+  StubStepper stepper;
+  stepper.position = model.getLimitPosition();
+  RADynamic control(model);
+  control.setStepperWrapper(&stepper);
+  control.setTrackingMode(TRACKING_MODE_STREAM);
+  control.setTrackingOnOff(true);
+  // tracking, topping up the few steps taken since the last loop: the
+  // common loop on the platform
+  int32_t start = stepper.position;
+  benchmark("RADynamic::onLoop", [&](long /*i*/) {
+    stepper.run(3);
+    if (stepper.position < STUB_QUEUE_STEPS)
+      stepper.resetPosition(start);
+    return (uint32_t)control.onLoop();
+  });
+}
+
+void bench_motion_trace() {
+  SimulatedTimerService clock;
+  MotionTrace trace;
+  trace.setClock(&clock);
+  // left on all night, so this is paid on every stepper command
+  benchmark("MotionTrace::record", [&](long i) {
+    trace.record(AXIS_RA, MOTION_EVENT_MOVE_TO, i, 0, 30000000);
+    return trace.getRecorded();
+  });
+}
+
+PlatformStatus sampleStatus(long i) {
+  PlatformStatus status;
+  status.timeToCenter = 1800 - i % 3600;
+  status.timeToEnd = 3600 - i % 3600;
+  status.isTracking = true;
+  status.slewing = false;
+  status.guideMoveRate = 0.0041780746;
+  status.trackingRate = 15.041;
+  status.axisMoveRateMax = 2.5;
+  status.axisMoveRateMin = 0.0001;
+  status.generation = 1;
+  return status;
+}
+
+// Status broadcast every second, as UDPSender builds it
+void bench_status_encode() {
+  BenchmarkResult json = measure("status JSON encode", [&](long i) {
+    PlatformStatus status = sampleStatus(i);
+    const size_t capacity = JSON_OBJECT_SIZE(15);
+    DynamicJsonDocument doc(capacity);
+    doc["timeToCenter"] = status.timeToCenter;
+    doc["timeToEnd"] = status.timeToEnd;
+    doc["isTracking"] = status.isTracking;
+    doc["slewing"] = status.slewing;
+    doc["guideMoveRate"] = status.guideMoveRate;
+    doc["trackingRate"] = status.trackingRate;
+    doc["axisMoveRateMax"] = status.axisMoveRateMax;
+    doc["axisMoveRateMin"] = status.axisMoveRateMin;
+    doc["generation"] = status.generation;
+    std::string out;
+    serializeJson(doc, out);
+    out = "DSC:" + out;
+    return (uint32_t)out.size();
+  });
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+  BenchmarkResult binary = benchmark("encodeStatus", [&](long i) {
+    return (uint32_t)encodeStatus(sampleStatus(i), buffer, sizeof(buffer));
+  });
+  compareWithJson("Binary status encode", json, binary);
+}
+
+// DSC command, as UDPListener handles it
+void bench_command_decode() {
+  const char *jsonPacket = "EQ:{\"command\":\"moveaxispercentage\","
+                           "\"parameter1\":1,\"parameter2\":-42.5}";
+  BenchmarkResult json = measure("command JSON decode", [&](long /*i*/) {
+    std::string packet = jsonPacket;
+    size_t colon = packet.find(':');
+    if (packet.compare(0, colon, "EQ") != 0)
+      return (uint32_t)0;
+    const size_t capacity = JSON_OBJECT_SIZE(3) + 40;
+    StaticJsonDocument<capacity> doc;
+    if (deserializeJson(doc, packet.c_str() + colon + 1))
+      return (uint32_t)0;
+    if (!doc.containsKey("command") || !doc.containsKey("parameter1") ||
+        !doc.containsKey("parameter2"))
+      return (uint32_t)0;
+    std::string name = doc["command"].as<std::string>();
+    PlatformCommand command;
+    command.code = findPlatformCommand(name.c_str());
+    command.parameter1 = doc["parameter1"];
+    command.parameter2 = doc["parameter2"];
+    return (uint32_t)(command.code + command.parameter2);
+  });
+
+  PlatformCommand command;
+  command.code = PLATFORM_COMMAND_MOVE_AXIS_PERCENTAGE;
+  command.parameter1 = AXIS_DEC;
+  command.parameter2 = -42.5;
+  command.executeAtMicros = 0;
+  command.sequence = 0;
+  command.session = 0;
+  uint8_t packet[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t length = encodeCommand(command, packet, sizeof(packet));
+  BenchmarkResult binary = benchmark("decodeCommand", [&](long /*i*/) {
+    PlatformCommand decoded;
+    if (!isBinaryMessage(packet, length) ||
+        !decodeCommand(packet, length, decoded))
+      return (uint32_t)0;
+    return (uint32_t)(decoded.code + decoded.parameter2);
+  });
+  compareWithJson("Binary command decode", json, binary);
+
+  // same JSON, parsed in place without ArduinoJson
+  const char *body = jsonPacket + 3;
+  size_t bodyLength = strlen(body);
+  BenchmarkResult parsed = benchmark("parseJsonCommand", [&](long /*i*/) {
+    PlatformCommand decoded;
+    if (parseJsonCommand(body, bodyLength, decoded) != JSON_COMMAND_OK)
+      return (uint32_t)0;
+    return (uint32_t)(decoded.code + decoded.parameter2);
+  });
+  compareWithJson("JSON command parsed in place", json, parsed);
+}
+
+// A guiding session over an LX200 link: queries on connect, then pulses
+// on both axes and the odd nudge, as recorded from a capture program
+static const char *lx200Connect = ":GVP#:GVN#:GR#:GD#:RG#";
+static const char *lx200Guiding =
+    ":Mgn0250#:Mge0120#:Mgs0080#:Mgw0310#:RC#:Me#:Q#:RG#";
+#define LX200_GUIDING_COMMANDS 8
+#define LX200_LOOPBACK_REPEATS 20000
+// Read size, small enough that the mailbox is drained before it fills
+#define LX200_LOOPBACK_READ_BYTES 128
+
+// Parse one recorded guiding burst, with the drain that applies it
+void bench_lx200_feed() {
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  StubStepper raStepper;
+  raStepper.position = model.getMiddlePosition();
+  StubStepper decStepper;
+  decStepper.position = decModel.getMiddlePosition();
+  RADynamic ra(model);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  CommandMailbox mailbox(ra, dec);
+  Lx200Session session(model, decModel, mailbox);
+  size_t length = strlen(lx200Guiding);
+  benchmark("Lx200Session::feed", [&](long i) {
+    char reply[LX200_REPLY_BYTES];
+    uint32_t replyLength = session.feed((const uint8_t *)lx200Guiding,
+                                        length, i, reply, sizeof(reply));
+    return replyLength + mailbox.drain(i);
+  });
+}
+
+/**
+ * The recorded stream over a loopback TCP socket, as the platform reads
+ * it from AsyncTCP: a writer thread sends, this thread reads, parses and
+ * drains. Reports commands per second through the whole path.
+ */
+void bench_lx200_loopback() {
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  StubStepper raStepper;
+  raStepper.position = model.getMiddlePosition();
+  StubStepper decStepper;
+  decStepper.position = decModel.getMiddlePosition();
+  RADynamic ra(model);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  CommandMailbox mailbox(ra, dec);
+  Lx200Session session(model, decModel, mailbox);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0; // any free port
+  socklen_t addressLength = sizeof(address);
+  TEST_ASSERT_EQUAL_INT(
+      0, bind(listener, (sockaddr *)&address, sizeof(address)));
+  TEST_ASSERT_EQUAL_INT(0, listen(listener, 1));
+  getsockname(listener, (sockaddr *)&address, &addressLength);
+  int guider = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL_INT(
+      0, connect(guider, (sockaddr *)&address, sizeof(address)));
+  int platform = accept(listener, nullptr, nullptr);
+  TEST_ASSERT_TRUE(platform >= 0);
+
+  std::thread writer([guider]() {
+    send(guider, lx200Connect, strlen(lx200Connect), 0);
+    size_t length = strlen(lx200Guiding);
+    for (int i = 0; i < LX200_LOOPBACK_REPEATS; i++)
+      send(guider, lx200Guiding, length, 0);
+    shutdown(guider, SHUT_WR);
+  });
+
+  unsigned long allocationsBefore = allocationCount;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  uint8_t buffer[LX200_LOOPBACK_READ_BYTES];
+  size_t replies = 0;
+  ssize_t received;
+  while ((received = recv(platform, buffer, sizeof(buffer), 0)) > 0) {
+    char reply[LX200_REPLY_BYTES];
+    replies += session.feed(buffer, received, 0, reply, sizeof(reply));
+    mailbox.drain(0);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  unsigned long allocations = allocationCount - allocationsBefore;
+  writer.join();
+  close(platform);
+  close(guider);
+  close(listener);
+
+  uint32_t expected = 5 + LX200_GUIDING_COMMANDS * LX200_LOOPBACK_REPEATS;
+  log("LX200 loopback: %lu commands in %.3f s, %.0f commands/s",
+      (unsigned long)session.getCommands(), seconds,
+      session.getCommands() / seconds);
+  TEST_ASSERT_EQUAL_INT(expected, session.getCommands());
+  TEST_ASSERT_EQUAL_INT(0, session.getUnknown());
+  TEST_ASSERT_TRUE(replies > 0);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, mailbox.getCommandsDropped(),
+                                "Mailbox overflowed");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocations, "Receive path allocated");
+}
+
+// Field names of the web page status, see sampleStatus in EQWebServer.cpp
+#define WEB_STATUS_FIELDS 30
+static const char *webStatusNames[WEB_STATUS_FIELDS] = {
+    "raPosition", "decPosition", "velocity", "raRunbackSpeed",
+    "decRunbackSpeed", "raLeadToPivotDistance", "raLimitToMiddleDistance",
+    "decLeadToPivotDistance", "decLimitToMiddleDistance", "raGuideRate",
+    "acceleration", "nunChukMultiplier", "speedKernel", "trackingMode",
+    "statusInterval", "raStepsMM", "decStepsMM", "commandLatencyMaxMicros",
+    "commandsDropped", "commandsCoalesced", "commandsScheduled",
+    "pulseStartErrorMaxMicros", "pulseStopErrorMaxMicros", "logsDropped",
+    "udpCommandsAccepted", "udpDuplicates", "udpStale", "udpLost",
+    "udpRoundTripMicros", "udpRoundTripMaxMicros"};
+
+// The web page status, as /getStatus built it for each poll, and as
+// pushStatus builds it once for all browsers. A full snapshot, the worst
+// case: most pushes only carry the few fields that moved.
+void bench_web_status() {
+  BenchmarkResult json = measure("web status JSON", [&](long i) {
+    DynamicJsonDocument doc(JSON_OBJECT_SIZE(WEB_STATUS_FIELDS));
+    doc["raPosition"] = 12.5 + i * 0.001;
+    doc["decPosition"] = -3.25 + i * 0.001;
+    doc["velocity"] = 0.4 + i * 0.0001;
+    for (int field = 3; field < WEB_STATUS_FIELDS; field++)
+      doc[webStatusNames[field]] = (double)(field * 10 + (i & 1));
+    std::string out;
+    serializeJson(doc, out);
+    return (uint32_t)out.size();
+  });
+  StatusDelta status;
+  char out[STATUS_DELTA_JSON_BYTES];
+  BenchmarkResult delta = benchmark("StatusDelta::encode", [&](long i) {
+    status.begin();
+    status.set("raPosition", 12.5 + i * 0.001);
+    status.set("decPosition", -3.25 + i * 0.001);
+    status.set("velocity", 0.4 + i * 0.0001);
+    for (int field = 3; field < WEB_STATUS_FIELDS; field++)
+      status.set(webStatusNames[field], field * 10 + (i & 1));
+    return (uint32_t)status.encode(true, out, sizeof(out));
+  });
+  compareWithJson("Web status snapshot", json, delta);
+}
+
+void setup() {
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+  model.setRewindFastFowardSpeedInHz(30000);
+  referenceNs = bestNsPerCall(referenceWork);
+  log("reference: %.1f ns/call", referenceNs);
+
+  UNITY_BEGIN();
+  RUN_TEST(bench_calculate_speed);
+  RUN_TEST(bench_position_by_degree_shift);
+  RUN_TEST(bench_time_to_center);
+  RUN_TEST(bench_time_to_end);
+  RUN_TEST(bench_ra_onloop);
+  RUN_TEST(bench_motion_trace);
+  RUN_TEST(bench_status_encode);
+  RUN_TEST(bench_command_decode);
+  RUN_TEST(bench_lx200_feed);
+  RUN_TEST(bench_lx200_loopback);
+  RUN_TEST(bench_web_status);
+  UNITY_END();
+}
+
+void loop() {
+  // Do nothing here.
+}
+
+int main() {
+  setup();
+  return 0;
+}
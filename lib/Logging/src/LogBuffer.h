@@ -0,0 +1,108 @@
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Must be a power of two
+#define LOG_QUEUE_SIZE 64
+#define LOG_MAX_ARGS 8
+#define LOG_STRING_BYTES 64
+
+/**
+ * One log line, unformatted. Arguments are stored by type as read from
+ * the format string; %s arguments are copied into strings.
+ */
+struct LogRecord {
+  const char *fmt;
+  uint8_t level;
+  uint8_t module;
+  uint8_t argCount;
+  union {
+    long long i;
+    unsigned long long u;
+    double d;
+    const void *p;
+    uint16_t stringOffset;
+  } args[LOG_MAX_ARGS];
+  char strings[LOG_STRING_BYTES];
+};
+
+/**
+ * Bounded lock-free queue of log records for many producers (loop, web,
+ * UDP and timer tasks all log) and one consumer. Each slot carries a
+ * sequence number saying whether it is free to write or ready to read,
+ * so producers only contend on claiming a position. Full means drop.
+ */
+class LogBuffer {
+public:
+  LogBuffer() : enqueuePos(0), dequeuePos(0), dropped(0) {
+    for (uint32_t i = 0; i < LOG_QUEUE_SIZE; i++)
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /**
+   * Claim a slot to fill. Returns its index, or -1 (and counts a drop) if
+   * full. Must be followed by commit.
+   */
+  int claim() {
+    uint32_t pos = enqueuePos.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots[pos & (LOG_QUEUE_SIZE - 1)];
+      uint32_t seq = slot.sequence.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(seq - pos);
+      if (diff == 0) {
+        if (enqueuePos.compare_exchange_weak(pos, pos + 1,
+                                             std::memory_order_relaxed))
+          return pos & (LOG_QUEUE_SIZE - 1);
+        // lost the race, pos was reloaded
+      } else if (diff < 0) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return -1;
+      } else {
+        pos = enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void commit(int index) {
+    Slot &slot = slots[index];
+    uint32_t pos = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(pos + 1, std::memory_order_release);
+  }
+
+  // Consumer only. Index of the oldest ready record, or -1. Follow with
+  // release.
+  int peek() {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    int index = pos & (LOG_QUEUE_SIZE - 1);
+    uint32_t seq = slots[index].sequence.load(std::memory_order_acquire);
+    if ((int32_t)(seq - (pos + 1)) < 0)
+      return -1;
+    return index;
+  }
+
+  void release(int index) {
+    uint32_t pos = dequeuePos.load(std::memory_order_relaxed);
+    slots[index].sequence.store(pos + LOG_QUEUE_SIZE,
+                                std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_relaxed);
+  }
+
+  LogRecord &record(int index) { return slots[index].record; }
+
+  uint32_t getDropped() { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    LogRecord record;
+  };
+
+  Slot slots[LOG_QUEUE_SIZE];
+  std::atomic<uint32_t> enqueuePos;
+  std::atomic<uint32_t> dequeuePos;
+  std::atomic<uint32_t> dropped;
+};
+
+#endif
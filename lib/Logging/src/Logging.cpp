@@ -1,6 +1,9 @@
 #include "Logging.h"
+#include "LogBuffer.h"
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
+#include <strings.h>
 #include <iostream>
 
 #ifdef ARDUINO
@@ -9,22 +12,374 @@
 #endif
 bool webSerialReady;
 
+// Longest formatted line
+#define LOG_LINE_BYTES 256
+// How often the log task checks for lines
+#define LOG_TASK_PERIOD_MS 10
+#define LOG_TASK_STACK 4096
+#define LOG_TASK_PRIORITY 1
+
+LogBuffer logBuffer;
+std::atomic_flag logFlushing = ATOMIC_FLAG_INIT;
+bool logAutoFlush = true;
+
+std::atomic<uint8_t> logLevels[LOG_MODULE_COUNT];
+
+static const char *logModuleNames[LOG_MODULE_COUNT] = {
+    "Core", "Motor", "RA", "Dec", "UDP", "Web", "Net"};
+static const char *logLevelNames[LOG_LEVEL_NONE + 1] = {
+    "trace", "debug", "info", "warn", "error", "none"};
+
+// Runs before main, so logLevels is ready before any log call
+static struct LogLevelInit {
+  LogLevelInit() { setLogLevel(LOG_MODULE_COUNT, LOG_COMPILE_LEVEL); }
+} logLevelInit;
+
+enum LogArgType { ARG_NONE, ARG_SIGNED, ARG_UNSIGNED, ARG_DOUBLE,
+                  ARG_STRING, ARG_POINTER, ARG_UNSUPPORTED };
+
+struct LogSpec {
+  LogArgType type;
+  int longs; // number of l length modifiers
+  int stars; // int arguments taken by * width and precision
+  bool starPrecision; // the last star is the precision
+  int precision; // a written precision, or -1
+};
+
+/**
+ * Read one conversion spec, starting at its '%'. Returns the character
+ * after it. Capture and formatting both walk the format with this, so
+ * agree on argument types.
+ */
+static const char *parseSpec(const char *p, LogSpec &spec) {
+  p++; // %
+  spec.longs = 0;
+  spec.stars = 0;
+  spec.starPrecision = false;
+  spec.precision = -1;
+  while (*p && strchr("-+ #0", *p))
+    p++;
+  if (*p == '*') {
+    spec.stars++;
+    p++;
+  }
+  while (*p && strchr("0123456789", *p))
+    p++;
+  if (*p == '.') {
+    p++;
+    spec.precision = 0;
+    if (*p == '*') {
+      spec.stars++;
+      spec.starPrecision = true;
+      p++;
+    }
+    for (; *p && strchr("0123456789", *p); p++)
+      spec.precision = spec.precision * 10 + (*p - '0');
+  }
+  while (*p && strchr("hlLzjt", *p)) {
+    if (*p == 'l')
+      spec.longs++;
+    p++;
+  }
+  char c = *p;
+  if (c == 0) {
+    spec.type = ARG_UNSUPPORTED;
+    return p;
+  }
+  if (c == '%')
+    spec.type = ARG_NONE;
+  else if (strchr("dic", c))
+    spec.type = ARG_SIGNED;
+  else if (strchr("uxXo", c))
+    spec.type = ARG_UNSIGNED;
+  else if (strchr("fFeEgGaA", c))
+    spec.type = ARG_DOUBLE;
+  else if (c == 's')
+    spec.type = ARG_STRING;
+  else if (c == 'p')
+    spec.type = ARG_POINTER;
+  else
+    spec.type = ARG_UNSUPPORTED; // eg %n
+  return p + 1;
+}
+
+static void logRecord(int level, LogModule module, const char *fmt,
+                      va_list args) {
+  int index = logBuffer.claim();
+  if (index < 0)
+    return;
+  LogRecord &record = logBuffer.record(index);
+  record.fmt = fmt;
+  record.level = level;
+  record.module = module;
+  record.argCount = 0;
+  record.strings[LOG_STRING_BYTES - 1] = 0;
+  int stringsUsed = 0;
+
+  const char *p = fmt;
+  while (*p && record.argCount < LOG_MAX_ARGS) {
+    if (*p != '%') {
+      p++;
+      continue;
+    }
+    LogSpec spec;
+    p = parseSpec(p, spec);
+    if (spec.type == ARG_NONE)
+      continue;
+    if (spec.type == ARG_UNSUPPORTED)
+      break; // can't tell what comes next, format stops here
+    if (record.argCount + spec.stars >= LOG_MAX_ARGS)
+      break;
+    // * widths and precisions are ints before the value
+    int precision = spec.precision;
+    for (int star = 0; star < spec.stars; star++) {
+      int value = va_arg(args, int);
+      record.args[record.argCount++].i = value;
+      if (spec.starPrecision && star == spec.stars - 1)
+        precision = value;
+    }
+    auto &arg = record.args[record.argCount++];
+    switch (spec.type) {
+    case ARG_SIGNED:
+      if (spec.longs >= 2)
+        arg.i = va_arg(args, long long);
+      else if (spec.longs == 1)
+        arg.i = va_arg(args, long);
+      else
+        arg.i = va_arg(args, int);
+      break;
+    case ARG_UNSIGNED:
+      if (spec.longs >= 2)
+        arg.u = va_arg(args, unsigned long long);
+      else if (spec.longs == 1)
+        arg.u = va_arg(args, unsigned long);
+      else
+        arg.u = va_arg(args, unsigned int);
+      break;
+    case ARG_DOUBLE:
+      arg.d = va_arg(args, double);
+      break;
+    case ARG_POINTER:
+      arg.p = va_arg(args, void *);
+      break;
+    case ARG_STRING: {
+      // copy, the caller's string may be gone by the time we format
+      const char *s = va_arg(args, const char *);
+      if (s == nullptr)
+        s = "(null)";
+      if (stringsUsed >= LOG_STRING_BYTES - 1) {
+        arg.stringOffset = LOG_STRING_BYTES - 1; // out of room: empty
+        break;
+      }
+      // with a precision, s need not be terminated
+      int room = LOG_STRING_BYTES - 1 - stringsUsed;
+      if (precision >= 0 && precision < room)
+        room = precision;
+      int n = strnlen(s, room);
+      memcpy(record.strings + stringsUsed, s, n);
+      record.strings[stringsUsed + n] = 0;
+      arg.stringOffset = stringsUsed;
+      stringsUsed += n + 1;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  logBuffer.commit(index);
+
+#ifndef ARDUINO
+  if (logAutoFlush)
+    logFlush();
+#endif
+}
+
 void log(const char *fmt, ...) {
-  const int BUFFER_SIZE = 1024;
-  char buffer[BUFFER_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  logRecord(LOG_LEVEL_INFO, LOG_CORE, fmt, args);
+  va_end(args);
+}
 
+void logTagged(int level, LogModule module, const char *fmt, ...) {
   va_list args;
   va_start(args, fmt);
+  logRecord(level, module, fmt, args);
+  va_end(args);
+}
 
-  vsnprintf(buffer, BUFFER_SIZE, fmt, args); // Format the string
+void setLogLevel(LogModule module, int level) {
+  if (level < LOG_LEVEL_TRACE || level > LOG_LEVEL_NONE)
+    return;
+  for (int m = 0; m < LOG_MODULE_COUNT; m++)
+    if (module == LOG_MODULE_COUNT || module == m)
+      logLevels[m].store(level, std::memory_order_relaxed);
+}
 
-  va_end(args);
+int getLogLevel(LogModule module) {
+  return logLevels[module].load(std::memory_order_relaxed);
+}
+
+const char *getLogModuleName(LogModule module) {
+  return module < LOG_MODULE_COUNT ? logModuleNames[module] : "?";
+}
+
+const char *getLogLevelName(int level) {
+  return level >= LOG_LEVEL_TRACE && level <= LOG_LEVEL_NONE
+             ? logLevelNames[level]
+             : "?";
+}
+
+int findLogModule(const char *name) {
+  for (int m = 0; m < LOG_MODULE_COUNT; m++)
+    if (strcasecmp(name, logModuleNames[m]) == 0)
+      return m;
+  return -1;
+}
+
+int findLogLevel(const char *name) {
+  for (int l = LOG_LEVEL_TRACE; l <= LOG_LEVEL_NONE; l++)
+    if (strcasecmp(name, logLevelNames[l]) == 0)
+      return l;
+  return -1;
+}
+
+bool logPop(char *out, int size) {
+  int index = logBuffer.peek();
+  if (index < 0)
+    return false;
+  LogRecord &record = logBuffer.record(index);
+
+  // "RA: ", "RA warn: ", "error: ". Untagged info lines have no prefix.
+  int len = 0;
+  bool tagged = record.module != LOG_CORE;
+  bool serious = record.level >= LOG_LEVEL_WARN;
+  if (tagged || serious) {
+    len = snprintf(out, size, "%s%s%s: ",
+                   tagged ? logModuleNames[record.module] : "",
+                   tagged && serious ? " " : "",
+                   serious ? logLevelNames[record.level] : "");
+    if (len < 0)
+      len = 0;
+    if (len > size - 1)
+      len = size - 1;
+  }
+  int argIndex = 0;
+  const char *p = record.fmt;
+  while (*p && len < size - 1) {
+    if (*p != '%') {
+      out[len++] = *p++;
+      continue;
+    }
+    const char *specStart = p;
+    LogSpec spec;
+    p = parseSpec(p, spec);
+    if (spec.type == ARG_NONE) {
+      out[len++] = '%';
+      continue;
+    }
+    if (argIndex + spec.stars >= record.argCount)
+      break;
+    // the spec as written, with any * replaced by its captured value
+    char specText[32];
+    int specLength = 0;
+    const char *c = specStart;
+    for (; c < p; c++) {
+      int room = sizeof(specText) - specLength;
+      int n = *c == '*' ? snprintf(specText + specLength, room, "%d",
+                                   (int)record.args[argIndex++].i)
+                        : snprintf(specText + specLength, room, "%c", *c);
+      if (n < 0 || n >= room)
+        break;
+      specLength += n;
+    }
+    if (c < p)
+      break;
 
+    auto &arg = record.args[argIndex++];
+    char *dest = out + len;
+    int room = size - len;
+    int written = 0;
+    switch (spec.type) {
+    case ARG_SIGNED:
+      if (spec.longs >= 2)
+        written = snprintf(dest, room, specText, (long long)arg.i);
+      else if (spec.longs == 1)
+        written = snprintf(dest, room, specText, (long)arg.i);
+      else
+        written = snprintf(dest, room, specText, (int)arg.i);
+      break;
+    case ARG_UNSIGNED:
+      if (spec.longs >= 2)
+        written = snprintf(dest, room, specText, (unsigned long long)arg.u);
+      else if (spec.longs == 1)
+        written = snprintf(dest, room, specText, (unsigned long)arg.u);
+      else
+        written = snprintf(dest, room, specText, (unsigned int)arg.u);
+      break;
+    case ARG_DOUBLE:
+      written = snprintf(dest, room, specText, arg.d);
+      break;
+    case ARG_POINTER:
+      written = snprintf(dest, room, specText, arg.p);
+      break;
+    case ARG_STRING:
+      written = snprintf(dest, room, specText,
+                         record.strings + arg.stringOffset);
+      break;
+    default:
+      break;
+    }
+    if (written < 0)
+      break;
+    len += written;
+    if (len > size - 1)
+      len = size - 1;
+  }
+  out[len] = 0;
+  logBuffer.release(index);
+  return true;
+}
+
+uint32_t getLogsDropped() { return logBuffer.getDropped(); }
+
+void setLogAutoFlush(bool on) { logAutoFlush = on; }
+
+void logFlush() {
+  // one consumer at a time; if someone else is printing they'll get ours
+  if (logFlushing.test_and_set(std::memory_order_acquire))
+    return;
+  char line[LOG_LINE_BYTES];
+  while (logPop(line, LOG_LINE_BYTES)) {
 #ifdef ARDUINO
-  // If we're on an Arduino (or compatible) platform
-  Serial.println(buffer);
+    // If we're on an Arduino (or compatible) platform
+    Serial.println(line);
 #else
-  // For native environment
-  std::cout << buffer << std::endl; // Print to console
+    // For native environment
+    std::cout << line << std::endl; // Print to console
 #endif
+  }
+  logFlushing.clear(std::memory_order_release);
 }
+
+#ifdef ARDUINO
+static void logTask(void *arg) {
+  uint32_t reportedDropped = 0;
+  while (true) {
+    logFlush();
+    uint32_t dropped = logBuffer.getDropped();
+    if (dropped != reportedDropped) {
+      Serial.printf("(%u log lines dropped)\n", dropped - reportedDropped);
+      reportedDropped = dropped;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_TASK_PERIOD_MS));
+  }
+}
+
+void startLogTask() {
+  xTaskCreate(logTask, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY,
+              nullptr);
+}
+#else
+void startLogTask() {}
+#endif
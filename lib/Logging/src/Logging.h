@@ -1,8 +1,130 @@
 #ifndef LOGGING_H
 #define LOGGING_H
 
-void log(const char *fmt, ...);
+#include <atomic>
+#include <cstdint>
 
+// Log levels, least important first
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_NONE 5
 
-// void log(const std::string& str);
-#endif
\ No newline at end of file
+// LOG_ macros below this level compile to nothing, arguments included.
+// Set per env in platformio.ini.
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// Who is logging. Each module has its own runtime level.
+enum LogModule {
+  LOG_CORE = 0,
+  LOG_MOTOR,
+  LOG_RA,
+  LOG_DEC,
+  LOG_UDP,
+  LOG_WEB,
+  LOG_NET,
+  LOG_MODULE_COUNT
+};
+
+/**
+ * printf style logging that never blocks the caller. log() only copies
+ * the format pointer and arguments into a lock-free ring buffer; lines
+ * are formatted and printed later by a low priority task. If the buffer
+ * is full the line is dropped and counted.
+ *
+ * fmt must be a string literal (it is read after log returns). %s
+ * arguments are copied, up to LOG_STRING_BYTES per line; with a precision
+ * (%.*s) only that much is read, so the string needn't be terminated.
+ */
+void log(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Start the task that prints queued lines (ESP32 only)
+void startLogTask();
+
+// Format and print everything queued. Natively, log() does this itself.
+void logFlush();
+
+/**
+ * Format the oldest queued line into buffer. Returns false if nothing is
+ * queued. Only one caller at a time (the log task, or logFlush).
+ */
+bool logPop(char *buffer, int size);
+
+// Lines lost because the buffer was full
+uint32_t getLogsDropped();
+
+// Natively, whether log() flushes straight away. Tests turn this off to
+// look at the queue.
+void setLogAutoFlush(bool on);
+
+/**
+ * As log, but tagged with a level and module, which prefix the line.
+ * Use the LOG_ macros rather than calling this directly.
+ */
+void logTagged(int level, LogModule module, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// Runtime level per module. Starts at LOG_COMPILE_LEVEL, ie everything
+// compiled in is printed.
+extern std::atomic<uint8_t> logLevels[LOG_MODULE_COUNT];
+
+inline bool logEnabled(int level, LogModule module) {
+  return level >= logLevels[module].load(std::memory_order_relaxed);
+}
+
+// Lines below level are skipped for this module (LOG_MODULE_COUNT: all)
+void setLogLevel(LogModule module, int level);
+int getLogLevel(LogModule module);
+
+// Short names, eg "RA", and their reverse. Lookups return -1 if unknown.
+const char *getLogModuleName(LogModule module);
+const char *getLogLevelName(int level);
+int findLogModule(const char *name);
+int findLogLevel(const char *name);
+
+// Arguments are only evaluated if the line will be printed
+#define LOG_AT(level, module, ...)                                             \
+  do {                                                                         \
+    if (logEnabled(level, module))                                             \
+      logTagged(level, module, __VA_ARGS__);                                   \
+  } while (0)
+
+#define LOG_DISCARD(...)                                                       \
+  do {                                                                         \
+  } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(module, ...) LOG_AT(LOG_LEVEL_TRACE, module, __VA_ARGS__)
+#else
+#define LOG_TRACE(module, ...) LOG_DISCARD()
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(module, ...) LOG_AT(LOG_LEVEL_DEBUG, module, __VA_ARGS__)
+#else
+#define LOG_DEBUG(module, ...) LOG_DISCARD()
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(module, ...) LOG_AT(LOG_LEVEL_INFO, module, __VA_ARGS__)
+#else
+#define LOG_INFO(module, ...) LOG_DISCARD()
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(module, ...) LOG_AT(LOG_LEVEL_WARN, module, __VA_ARGS__)
+#else
+#define LOG_WARN(module, ...) LOG_DISCARD()
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(module, ...) LOG_AT(LOG_LEVEL_ERROR, module, __VA_ARGS__)
+#else
+#define LOG_ERROR(module, ...) LOG_DISCARD()
+#endif
+
+#endif
@@ -0,0 +1,691 @@
+#include "AlpacaTelescope.h"
+#include "Logging.h"
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+#define ALPACA_SERVER_NAME "FrankenDob Equatorial Platform"
+#define ALPACA_MANUFACTURER "jacrify"
+#define ALPACA_VERSION "1.0"
+
+// Alignment modes and drive rates, as ASCOM numbers them
+#define ALIGNMENT_POLAR 1
+#define DRIVE_SIDEREAL 0
+#define EQUATORIAL_OTHER 0
+
+enum AlpacaValueType {
+  VALUE_NONE = 0, // PUT, or an error
+  VALUE_BOOL,
+  VALUE_INT,
+  VALUE_DOUBLE,
+  VALUE_STRING,
+  VALUE_EMPTY_LIST,
+  VALUE_INT_LIST, // one element, intValue
+  VALUE_RATE_LIST // one range, doubleValue to maximum
+};
+
+struct AlpacaResult {
+  int status; // http, anything but 200 sends message as plain text
+  AlpacaError error;
+  const char *message;
+  AlpacaValueType type;
+  bool boolValue;
+  int intValue;
+  double doubleValue;
+  double maximum;
+  const char *stringValue;
+};
+
+enum AlpacaProperty {
+  // common to all devices
+  PROPERTY_ACTION,
+  PROPERTY_COMMAND_BLIND,
+  PROPERTY_COMMAND_BOOL,
+  PROPERTY_COMMAND_STRING,
+  PROPERTY_CONNECTED,
+  PROPERTY_DESCRIPTION,
+  PROPERTY_DRIVER_INFO,
+  PROPERTY_DRIVER_VERSION,
+  PROPERTY_INTERFACE_VERSION,
+  PROPERTY_NAME,
+  PROPERTY_SUPPORTED_ACTIONS,
+  // telescope
+  PROPERTY_ABORT_SLEW,
+  PROPERTY_ALIGNMENT_MODE,
+  PROPERTY_AT_HOME,
+  PROPERTY_AT_PARK,
+  PROPERTY_AXIS_RATES,
+  PROPERTY_CAN_FIND_HOME,
+  PROPERTY_CAN_MOVE_AXIS,
+  PROPERTY_CAN_PARK,
+  PROPERTY_CAN_PULSE_GUIDE,
+  PROPERTY_CAN_SET_DECLINATION_RATE,
+  PROPERTY_CAN_SET_GUIDE_RATES,
+  PROPERTY_CAN_SET_PARK,
+  PROPERTY_CAN_SET_PIER_SIDE,
+  PROPERTY_CAN_SET_RIGHT_ASCENSION_RATE,
+  PROPERTY_CAN_SET_TRACKING,
+  PROPERTY_CAN_SLEW,
+  PROPERTY_CAN_SLEW_ALT_AZ,
+  PROPERTY_CAN_SLEW_ALT_AZ_ASYNC,
+  PROPERTY_CAN_SLEW_ASYNC,
+  PROPERTY_CAN_SYNC,
+  PROPERTY_CAN_SYNC_ALT_AZ,
+  PROPERTY_CAN_UNPARK,
+  PROPERTY_DECLINATION_RATE,
+  PROPERTY_EQUATORIAL_SYSTEM,
+  PROPERTY_GUIDE_RATE_DECLINATION,
+  PROPERTY_GUIDE_RATE_RIGHT_ASCENSION,
+  PROPERTY_IS_PULSE_GUIDING,
+  PROPERTY_MOVE_AXIS,
+  PROPERTY_PULSE_GUIDE,
+  PROPERTY_RIGHT_ASCENSION_RATE,
+  PROPERTY_SLEWING,
+  PROPERTY_TRACKING,
+  PROPERTY_TRACKING_RATE,
+  PROPERTY_TRACKING_RATES
+};
+
+struct AlpacaMethod {
+  const char *name;
+  AlpacaProperty property;
+};
+
+static const AlpacaMethod alpacaMethods[] = {
+    {"action", PROPERTY_ACTION},
+    {"commandblind", PROPERTY_COMMAND_BLIND},
+    {"commandbool", PROPERTY_COMMAND_BOOL},
+    {"commandstring", PROPERTY_COMMAND_STRING},
+    {"connected", PROPERTY_CONNECTED},
+    {"description", PROPERTY_DESCRIPTION},
+    {"driverinfo", PROPERTY_DRIVER_INFO},
+    {"driverversion", PROPERTY_DRIVER_VERSION},
+    {"interfaceversion", PROPERTY_INTERFACE_VERSION},
+    {"name", PROPERTY_NAME},
+    {"supportedactions", PROPERTY_SUPPORTED_ACTIONS},
+    {"abortslew", PROPERTY_ABORT_SLEW},
+    {"alignmentmode", PROPERTY_ALIGNMENT_MODE},
+    {"athome", PROPERTY_AT_HOME},
+    {"atpark", PROPERTY_AT_PARK},
+    {"axisrates", PROPERTY_AXIS_RATES},
+    {"canfindhome", PROPERTY_CAN_FIND_HOME},
+    {"canmoveaxis", PROPERTY_CAN_MOVE_AXIS},
+    {"canpark", PROPERTY_CAN_PARK},
+    {"canpulseguide", PROPERTY_CAN_PULSE_GUIDE},
+    {"cansetdeclinationrate", PROPERTY_CAN_SET_DECLINATION_RATE},
+    {"cansetguiderates", PROPERTY_CAN_SET_GUIDE_RATES},
+    {"cansetpark", PROPERTY_CAN_SET_PARK},
+    {"cansetpierside", PROPERTY_CAN_SET_PIER_SIDE},
+    {"cansetrightascensionrate", PROPERTY_CAN_SET_RIGHT_ASCENSION_RATE},
+    {"cansettracking", PROPERTY_CAN_SET_TRACKING},
+    {"canslew", PROPERTY_CAN_SLEW},
+    {"canslewaltaz", PROPERTY_CAN_SLEW_ALT_AZ},
+    {"canslewaltazasync", PROPERTY_CAN_SLEW_ALT_AZ_ASYNC},
+    {"canslewasync", PROPERTY_CAN_SLEW_ASYNC},
+    {"cansync", PROPERTY_CAN_SYNC},
+    {"cansyncaltaz", PROPERTY_CAN_SYNC_ALT_AZ},
+    {"canunpark", PROPERTY_CAN_UNPARK},
+    {"declinationrate", PROPERTY_DECLINATION_RATE},
+    {"equatorialsystem", PROPERTY_EQUATORIAL_SYSTEM},
+    {"guideratedeclination", PROPERTY_GUIDE_RATE_DECLINATION},
+    {"guideraterightascension", PROPERTY_GUIDE_RATE_RIGHT_ASCENSION},
+    {"ispulseguiding", PROPERTY_IS_PULSE_GUIDING},
+    {"moveaxis", PROPERTY_MOVE_AXIS},
+    {"pulseguide", PROPERTY_PULSE_GUIDE},
+    {"rightascensionrate", PROPERTY_RIGHT_ASCENSION_RATE},
+    {"slewing", PROPERTY_SLEWING},
+    {"tracking", PROPERTY_TRACKING},
+    {"trackingrate", PROPERTY_TRACKING_RATE},
+    {"trackingrates", PROPERTY_TRACKING_RATES}};
+
+// Telescope methods needing sky coordinates, which the platform doesn't
+// know. Reported as not implemented rather than unknown.
+static const char *telescopeMethods[] = {
+    "altitude",          "aperturearea",
+    "aperturediameter",  "azimuth",
+    "declination",       "destinationsideofpier",
+    "doesrefraction",    "findhome",
+    "focallength",       "park",
+    "rightascension",    "setpark",
+    "sideofpier",        "siderealtime",
+    "siteelevation",     "sitelatitude",
+    "sitelongitude",     "slewsettletime",
+    "slewtoaltaz",       "slewtoaltazasync",
+    "slewtocoordinates", "slewtocoordinatesasync",
+    "slewtotarget",      "slewtotargetasync",
+    "synctoaltaz",       "synctocoordinates",
+    "synctotarget",      "targetdeclination",
+    "targetrightascension", "unpark",
+    "utcdate"};
+
+static int findProperty(const char *method) {
+  for (size_t i = 0; i < sizeof(alpacaMethods) / sizeof(alpacaMethods[0]);
+       i++) {
+    if (strcmp(method, alpacaMethods[i].name) == 0)
+      return alpacaMethods[i].property;
+  }
+  return -1;
+}
+
+static bool isTelescopeMethod(const char *method) {
+  for (size_t i = 0;
+       i < sizeof(telescopeMethods) / sizeof(telescopeMethods[0]); i++) {
+    if (strcmp(method, telescopeMethods[i]) == 0)
+      return true;
+  }
+  return false;
+}
+
+// Parameter names are case insensitive
+static const char *findParameter(const AlpacaParameter *parameters,
+                                 int count, const char *name) {
+  for (int i = 0; i < count; i++) {
+    if (strcasecmp(parameters[i].name, name) == 0)
+      return parameters[i].value;
+  }
+  return nullptr;
+}
+
+static bool parseLong(const char *text, long &value) {
+  if (text == nullptr || *text == 0)
+    return false;
+  char *end;
+  value = strtol(text, &end, 10);
+  return *end == 0;
+}
+
+static bool parseDouble(const char *text, double &value) {
+  if (text == nullptr || *text == 0)
+    return false;
+  char *end;
+  value = strtod(text, &end);
+  return *end == 0 && std::isfinite(value);
+}
+
+static bool parseBool(const char *text, bool &value) {
+  if (text == nullptr)
+    return false;
+  if (strcasecmp(text, "true") == 0) {
+    value = true;
+    return true;
+  }
+  if (strcasecmp(text, "false") == 0) {
+    value = false;
+    return true;
+  }
+  return false;
+}
+
+static void setBool(AlpacaResult &result, bool value) {
+  result.type = VALUE_BOOL;
+  result.boolValue = value;
+}
+
+static void setInt(AlpacaResult &result, int value) {
+  result.type = VALUE_INT;
+  result.intValue = value;
+}
+
+static void setDouble(AlpacaResult &result, double value) {
+  result.type = VALUE_DOUBLE;
+  result.doubleValue = value;
+}
+
+static void setString(AlpacaResult &result, const char *value) {
+  result.type = VALUE_STRING;
+  result.stringValue = value;
+}
+
+static void setError(AlpacaResult &result, AlpacaError error,
+                     const char *message) {
+  result.type = VALUE_NONE;
+  result.error = error;
+  result.message = message;
+}
+
+// Missing or unreadable parameters are an http error, not an Alpaca one
+static void setBadRequest(AlpacaResult &result, const char *message) {
+  result.status = 400;
+  result.message = message;
+}
+
+// snprintf onto the end of out. False once it's full.
+static bool append(char *out, size_t size, size_t &length, const char *format,
+                   ...) {
+  if (length >= size)
+    return false;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(out + length, size - length, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= size - length) {
+    length = size;
+    return false;
+  }
+  length += written;
+  return true;
+}
+
+// Echoed back, 0 if missing or unreadable
+static unsigned long getClientTransactionId(const AlpacaParameter *parameters,
+                                            int count) {
+  long id;
+  if (!parseLong(findParameter(parameters, count, "ClientTransactionID"),
+                 id) ||
+      id < 0)
+    return 0;
+  return id;
+}
+
+// Fields every response ends with, closing the object
+static size_t appendTail(char *out, size_t size, size_t length,
+                         unsigned long clientId, unsigned long serverId,
+                         AlpacaError error, const char *message) {
+  if (!append(out, size, length,
+              "\"ClientTransactionID\":%lu,\"ServerTransactionID\":%lu,"
+              "\"ErrorNumber\":%d,\"ErrorMessage\":\"%s\"}",
+              clientId, serverId, (int)error, message))
+    return 0;
+  return length;
+}
+
+AlpacaTelescope::AlpacaTelescope(RAStatic &raStatic, RADynamic &raDynamic,
+                                 DecStatic &decStatic, DecDynamic &decDynamic,
+                                 CommandMailbox &mailbox)
+    : raStatic(raStatic), raDynamic(raDynamic), decStatic(decStatic),
+      decDynamic(decDynamic), mailbox(mailbox), connected(false),
+      serverTransactionId(0), trackingPending(false),
+      trackingRequested(false), trackingRequestedMicros(0),
+      movePending(false), moveRequestedMicros(0), pulsePending(false),
+      pulseEndMicros(0) {}
+
+bool AlpacaTelescope::isConnected() { return connected; }
+
+MotorStatic &AlpacaTelescope::axisStatic(int axis) {
+  if (axis == AXIS_DEC)
+    return decStatic;
+  return raStatic;
+}
+
+void AlpacaTelescope::get(int property, const AlpacaParameter *parameters,
+                          int count, unsigned long nowMicros,
+                          AlpacaResult &result) {
+  long axis = -1;
+  switch (property) {
+  case PROPERTY_CONNECTED:
+    setBool(result, connected);
+    break;
+  case PROPERTY_DESCRIPTION:
+    setString(result, ALPACA_SERVER_NAME);
+    break;
+  case PROPERTY_DRIVER_INFO:
+    setString(result, "Platform firmware, guiding and moveaxis only");
+    break;
+  case PROPERTY_DRIVER_VERSION:
+    setString(result, ALPACA_VERSION);
+    break;
+  case PROPERTY_INTERFACE_VERSION:
+    setInt(result, ALPACA_INTERFACE_VERSION);
+    break;
+  case PROPERTY_NAME:
+    setString(result, ALPACA_SERVER_NAME);
+    break;
+  case PROPERTY_SUPPORTED_ACTIONS:
+    result.type = VALUE_EMPTY_LIST;
+    break;
+  case PROPERTY_ALIGNMENT_MODE:
+    setInt(result, ALIGNMENT_POLAR);
+    break;
+  case PROPERTY_AXIS_RATES:
+  case PROPERTY_CAN_MOVE_AXIS:
+    if (!parseLong(findParameter(parameters, count, "Axis"), axis)) {
+      setBadRequest(result, "Axis is missing or not a number");
+      break;
+    }
+    if (axis < 0 || axis > 2) {
+      setError(result, ALPACA_INVALID_VALUE, "Axis must be 0, 1 or 2");
+      break;
+    }
+    // no third axis
+    if (property == PROPERTY_CAN_MOVE_AXIS) {
+      setBool(result, axis != 2);
+    } else if (axis == 2) {
+      result.type = VALUE_EMPTY_LIST;
+    } else {
+      result.type = VALUE_RATE_LIST;
+      result.doubleValue = axisStatic(axis).getMinAxisMoveRateDegreesSec();
+      result.maximum = axisStatic(axis).getMaxAxisMoveRateDegreesSec();
+    }
+    break;
+  case PROPERTY_CAN_PULSE_GUIDE:
+  case PROPERTY_CAN_SET_TRACKING:
+    setBool(result, true);
+    break;
+  case PROPERTY_AT_HOME:
+  case PROPERTY_AT_PARK:
+  case PROPERTY_CAN_FIND_HOME:
+  case PROPERTY_CAN_PARK:
+  case PROPERTY_CAN_SET_DECLINATION_RATE:
+  case PROPERTY_CAN_SET_GUIDE_RATES:
+  case PROPERTY_CAN_SET_PARK:
+  case PROPERTY_CAN_SET_PIER_SIDE:
+  case PROPERTY_CAN_SET_RIGHT_ASCENSION_RATE:
+  case PROPERTY_CAN_SLEW:
+  case PROPERTY_CAN_SLEW_ALT_AZ:
+  case PROPERTY_CAN_SLEW_ALT_AZ_ASYNC:
+  case PROPERTY_CAN_SLEW_ASYNC:
+  case PROPERTY_CAN_SYNC:
+  case PROPERTY_CAN_SYNC_ALT_AZ:
+  case PROPERTY_CAN_UNPARK:
+    setBool(result, false);
+    break;
+  case PROPERTY_DECLINATION_RATE:
+  case PROPERTY_RIGHT_ASCENSION_RATE:
+    setDouble(result, 0);
+    break;
+  case PROPERTY_EQUATORIAL_SYSTEM:
+    setInt(result, EQUATORIAL_OTHER);
+    break;
+  case PROPERTY_GUIDE_RATE_DECLINATION:
+    setDouble(result, decStatic.getGuideRateDegreesSec());
+    break;
+  case PROPERTY_GUIDE_RATE_RIGHT_ASCENSION:
+    setDouble(result, raStatic.getGuideRateDegreesSec());
+    break;
+  case PROPERTY_IS_PULSE_GUIDING: {
+    bool guiding = raDynamic.isPulseGuideInProgress() ||
+                   decDynamic.isPulseGuideInProgress();
+    // a short pulse can start and finish between polls, so give up on
+    // seeing it once it would have ended
+    if (guiding || (long)(nowMicros - pulseEndMicros) >= 0)
+      pulsePending = false;
+    setBool(result, guiding || pulsePending);
+    break;
+  }
+  case PROPERTY_SLEWING: {
+    bool slewing = raDynamic.isSlewing() || decDynamic.isSlewing();
+    if (slewing || nowMicros - moveRequestedMicros >= ALPACA_PENDING_MICROS)
+      movePending = false;
+    setBool(result, slewing || movePending);
+    break;
+  }
+  case PROPERTY_TRACKING: {
+    bool tracking = raDynamic.isTrackingOn();
+    if (tracking == trackingRequested ||
+        nowMicros - trackingRequestedMicros >= ALPACA_PENDING_MICROS)
+      trackingPending = false;
+    setBool(result, trackingPending ? trackingRequested : tracking);
+    break;
+  }
+  case PROPERTY_TRACKING_RATE:
+    setInt(result, DRIVE_SIDEREAL);
+    break;
+  case PROPERTY_TRACKING_RATES:
+    result.type = VALUE_INT_LIST;
+    result.intValue = DRIVE_SIDEREAL;
+    break;
+  default:
+    setBadRequest(result, "Method must be called with PUT");
+    break;
+  }
+}
+
+void AlpacaTelescope::put(int property, const AlpacaParameter *parameters,
+                          int count, unsigned long nowMicros,
+                          AlpacaResult &result) {
+  bool on = false;
+  long axis, direction, duration = 0, rate;
+  double degreesPerSecond = 0;
+  switch (property) {
+  case PROPERTY_CONNECTED:
+    if (!parseBool(findParameter(parameters, count, "Connected"), on)) {
+      setBadRequest(result, "Connected is missing or not true or false");
+      return;
+    }
+    connected = on;
+    LOG_INFO(LOG_WEB, "Alpaca client %s",
+             on ? "connected" : "disconnected");
+    return;
+  case PROPERTY_ACTION:
+    setError(result, ALPACA_ACTION_NOT_IMPLEMENTED, "No actions supported");
+    return;
+  case PROPERTY_COMMAND_BLIND:
+  case PROPERTY_COMMAND_BOOL:
+  case PROPERTY_COMMAND_STRING:
+    setError(result, ALPACA_NOT_IMPLEMENTED, "Not implemented");
+    return;
+  case PROPERTY_ABORT_SLEW:
+  case PROPERTY_MOVE_AXIS:
+  case PROPERTY_PULSE_GUIDE:
+  case PROPERTY_TRACKING:
+    break; // below
+  case PROPERTY_TRACKING_RATE:
+    if (!parseLong(findParameter(parameters, count, "TrackingRate"), rate)) {
+      setBadRequest(result, "TrackingRate is missing or not a number");
+      return;
+    }
+    if (rate != DRIVE_SIDEREAL)
+      setError(result, ALPACA_INVALID_VALUE, "Only sidereal is supported");
+    return;
+  default:
+    setError(result, ALPACA_NOT_IMPLEMENTED, "Not implemented");
+    return;
+  }
+
+  if (!connected) {
+    setError(result, ALPACA_NOT_CONNECTED, "Not connected");
+    return;
+  }
+
+  // Movement, posted for the motor loop like any web command
+  MotorCommand commands[2];
+  int commandCount = 0;
+  switch (property) {
+  case PROPERTY_ABORT_SLEW:
+    // a zero rate stops moveaxis and gotos, and resumes tracking
+    commands[commandCount++] = MotorCommand::moveAxis(AXIS_RA, 0);
+    commands[commandCount++] = MotorCommand::moveAxis(AXIS_DEC, 0);
+    break;
+  case PROPERTY_MOVE_AXIS:
+    if (!parseLong(findParameter(parameters, count, "Axis"), axis) ||
+        !parseDouble(findParameter(parameters, count, "Rate"),
+                     degreesPerSecond)) {
+      setBadRequest(result, "Axis or Rate is missing or not a number");
+      return;
+    }
+    if (axis != AXIS_RA && axis != AXIS_DEC) {
+      setError(result, ALPACA_INVALID_VALUE, "Axis must be 0 or 1");
+      return;
+    }
+    if (fabs(degreesPerSecond) >
+        axisStatic(axis).getMaxAxisMoveRateDegreesSec()) {
+      setError(result, ALPACA_INVALID_VALUE, "Rate is above axisrates");
+      return;
+    }
+    // zero stops, anything else must be in the range axisrates gave
+    if (degreesPerSecond != 0 &&
+        fabs(degreesPerSecond) <
+            axisStatic(axis).getMinAxisMoveRateDegreesSec()) {
+      setError(result, ALPACA_INVALID_VALUE, "Rate is below axisrates");
+      return;
+    }
+    commands[commandCount++] = MotorCommand::moveAxis(axis, degreesPerSecond);
+    break;
+  case PROPERTY_PULSE_GUIDE:
+    if (!parseLong(findParameter(parameters, count, "Direction"),
+                   direction) ||
+        !parseLong(findParameter(parameters, count, "Duration"), duration)) {
+      setBadRequest(result, "Direction or Duration is missing or not a "
+                            "number");
+      return;
+    }
+    if (direction < 0 || direction > 3 || duration < 0) {
+      setError(result, ALPACA_INVALID_VALUE,
+               "Direction must be 0 to 3, Duration 0 or more");
+      return;
+    }
+    commands[commandCount++] = MotorCommand::pulseGuide(direction, duration);
+    break;
+  case PROPERTY_TRACKING:
+    if (!parseBool(findParameter(parameters, count, "Tracking"), on)) {
+      setBadRequest(result, "Tracking is missing or not true or false");
+      return;
+    }
+    commands[commandCount++] = MotorCommand::track(on);
+    break;
+  }
+  for (int i = 0; i < commandCount; i++) {
+    if (!mailbox.post(COMMAND_SOURCE_WEB, commands[i], nowMicros)) {
+      setError(result, ALPACA_UNSPECIFIED_ERROR, "Command queue full");
+      return;
+    }
+  }
+
+  switch (property) {
+  case PROPERTY_ABORT_SLEW:
+    movePending = false;
+    break;
+  case PROPERTY_MOVE_AXIS:
+    movePending = degreesPerSecond != 0;
+    moveRequestedMicros = nowMicros;
+    break;
+  case PROPERTY_PULSE_GUIDE:
+    pulsePending = true;
+    pulseEndMicros = nowMicros + duration * 1000 + ALPACA_PENDING_MICROS;
+    break;
+  case PROPERTY_TRACKING:
+    trackingPending = true;
+    trackingRequested = on;
+    trackingRequestedMicros = nowMicros;
+    break;
+  }
+}
+
+size_t AlpacaTelescope::format(const AlpacaResult &result,
+                               const AlpacaParameter *parameters, int count,
+                               char *out, size_t size) {
+  size_t length = 0;
+  bool fits = append(out, size, length, "{");
+  switch (result.type) {
+  case VALUE_NONE:
+    break;
+  case VALUE_BOOL:
+    fits = append(out, size, length, "\"Value\":%s,",
+                  result.boolValue ? "true" : "false");
+    break;
+  case VALUE_INT:
+    fits = append(out, size, length, "\"Value\":%d,", result.intValue);
+    break;
+  case VALUE_DOUBLE:
+    fits = append(out, size, length, "\"Value\":%.9g,", result.doubleValue);
+    break;
+  case VALUE_STRING:
+    fits = append(out, size, length, "\"Value\":\"%s\",",
+                  result.stringValue);
+    break;
+  case VALUE_EMPTY_LIST:
+    fits = append(out, size, length, "\"Value\":[],");
+    break;
+  case VALUE_INT_LIST:
+    fits = append(out, size, length, "\"Value\":[%d],", result.intValue);
+    break;
+  case VALUE_RATE_LIST:
+    fits = append(out, size, length,
+                  "\"Value\":[{\"Minimum\":%.9g,\"Maximum\":%.9g}],",
+                  result.doubleValue, result.maximum);
+    break;
+  }
+  if (!fits)
+    return 0;
+  return appendTail(out, size, length,
+                    getClientTransactionId(parameters, count),
+                    serverTransactionId, result.error, result.message);
+}
+
+size_t AlpacaTelescope::handle(const char *method, bool isPut,
+                               const AlpacaParameter *parameters, int count,
+                               unsigned long nowMicros, char *out,
+                               size_t size, int &status) {
+  serverTransactionId++;
+  AlpacaResult result;
+  result.status = 200;
+  result.error = ALPACA_OK;
+  result.message = "";
+  result.type = VALUE_NONE;
+
+  int property = findProperty(method);
+  if (property >= 0) {
+    if (isPut)
+      put(property, parameters, count, nowMicros, result);
+    else
+      get(property, parameters, count, nowMicros, result);
+  } else if (isTelescopeMethod(method)) {
+    // needs to know where the scope is pointing
+    setError(result, ALPACA_NOT_IMPLEMENTED, "Not implemented");
+  } else {
+    setBadRequest(result, "Unknown method");
+  }
+  if (result.error != ALPACA_OK)
+    LOG_DEBUG(LOG_WEB, "Alpaca %s failed: %s", method, result.message);
+
+  status = result.status;
+  if (status != 200) {
+    LOG_WARN(LOG_WEB, "Bad alpaca request %s: %s", method, result.message);
+    size_t length = 0;
+    return append(out, size, length, "%s", result.message) ? length : 0;
+  }
+  return format(result, parameters, count, out, size);
+}
+
+size_t AlpacaTelescope::getApiVersions(const AlpacaParameter *parameters,
+                                       int count, char *out, size_t size) {
+  size_t length = 0;
+  if (!append(out, size, length, "{\"Value\":[1],"))
+    return 0;
+  return appendTail(out, size, length,
+                    getClientTransactionId(parameters, count),
+                    ++serverTransactionId, ALPACA_OK, "");
+}
+
+size_t AlpacaTelescope::getDescription(const AlpacaParameter *parameters,
+                                       int count, char *out, size_t size) {
+  size_t length = 0;
+  if (!append(out, size, length,
+              "{\"Value\":{\"ServerName\":\"%s\",\"Manufacturer\":\"%s\","
+              "\"ManufacturerVersion\":\"%s\",\"Location\":\"\"},",
+              ALPACA_SERVER_NAME, ALPACA_MANUFACTURER, ALPACA_VERSION))
+    return 0;
+  return appendTail(out, size, length,
+                    getClientTransactionId(parameters, count),
+                    ++serverTransactionId, ALPACA_OK, "");
+}
+
+size_t AlpacaTelescope::getConfiguredDevices(
+    const AlpacaParameter *parameters, int count, const char *uniqueId,
+    char *out, size_t size) {
+  size_t length = 0;
+  if (!append(out, size, length,
+              "{\"Value\":[{\"DeviceName\":\"%s\",\"DeviceType\":"
+              "\"Telescope\",\"DeviceNumber\":0,\"UniqueID\":\"%s\"}],",
+              ALPACA_SERVER_NAME, uniqueId))
+    return 0;
+  return appendTail(out, size, length,
+                    getClientTransactionId(parameters, count),
+                    ++serverTransactionId, ALPACA_OK, "");
+}
+
+bool isAlpacaDiscovery(const uint8_t *data, size_t length) {
+  size_t messageLength = strlen(ALPACA_DISCOVERY_MESSAGE);
+  return length >= messageLength &&
+         memcmp(data, ALPACA_DISCOVERY_MESSAGE, messageLength) == 0;
+}
+
+size_t encodeAlpacaDiscoveryResponse(char *out, size_t size) {
+  size_t length = 0;
+  return append(out, size, length, "{\"AlpacaPort\":%d}", ALPACA_PORT)
+             ? length
+             : 0;
+}
@@ -0,0 +1,117 @@
+#ifndef __ALPACATELESCOPE_H__
+#define __ALPACATELESCOPE_H__
+
+#include "CommandMailbox.h"
+#include "DecDynamic.h"
+#include "DecStatic.h"
+#include "RADynamic.h"
+#include "RAStatic.h"
+#include <cstddef>
+#include <cstdint>
+
+// Alpaca discovery: clients broadcast ALPACA_DISCOVERY_MESSAGE to this
+// port, and are told the port the REST api is on
+#define ALPACA_DISCOVERY_PORT 32227
+#define ALPACA_DISCOVERY_MESSAGE "alpacadiscovery1"
+#define ALPACA_PORT 80
+#define ALPACA_API_PREFIX "/api/v1/telescope/0/"
+#define ALPACA_INTERFACE_VERSION 3
+// Parameters looked at per request, query and form together
+#define ALPACA_MAX_PARAMETERS 8
+// Room for any response body
+#define ALPACA_RESPONSE_BYTES 320
+// Posted commands apply on the next motor loop. Until then tracking,
+// slewing and ispulseguiding report what was asked for, for this long
+// at most.
+#define ALPACA_PENDING_MICROS 200000
+
+enum AlpacaError {
+  ALPACA_OK = 0,
+  ALPACA_NOT_IMPLEMENTED = 0x400,
+  ALPACA_INVALID_VALUE = 0x401,
+  ALPACA_NOT_CONNECTED = 0x407,
+  ALPACA_ACTION_NOT_IMPLEMENTED = 0x40C,
+  ALPACA_UNSPECIFIED_ERROR = 0x500
+};
+
+// Value and error for one request, see AlpacaTelescope.cpp
+struct AlpacaResult;
+
+// A query string or form field, as the web server parsed it
+struct AlpacaParameter {
+  const char *name;
+  const char *value;
+};
+
+/**
+ * ASCOM Alpaca Telescope device 0, so guiding software can drive the
+ * platform directly rather than through a DSC.
+ *
+ * handle takes the method (the last part of the url) and parameters, and
+ * writes the JSON response. Movement (moveaxis, pulseguide, tracking,
+ * abortslew) is posted to the mailbox like any web command; state is read
+ * from RADynamic/DecDynamic. Anything needing sky coordinates is not
+ * implemented: the platform doesn't know where it's pointing.
+ *
+ * Not thread safe: call from the web server task only.
+ */
+class AlpacaTelescope {
+public:
+  AlpacaTelescope(RAStatic &raStatic, RADynamic &raDynamic,
+                  DecStatic &decStatic, DecDynamic &decDynamic,
+                  CommandMailbox &mailbox);
+
+  /**
+   * Handle /api/v1/telescope/0/<method>. Returns the length of the body
+   * written to out, 0 if it didn't fit. status is the http status: 400
+   * (with a plain text body) for an unknown method or missing or
+   * unreadable parameter, else 200 with any Alpaca error in the JSON.
+   */
+  size_t handle(const char *method, bool isPut,
+                const AlpacaParameter *parameters, int count,
+                unsigned long nowMicros, char *out, size_t size,
+                int &status);
+
+  // /management/... responses. uniqueId identifies this platform.
+  size_t getApiVersions(const AlpacaParameter *parameters, int count,
+                        char *out, size_t size);
+  size_t getDescription(const AlpacaParameter *parameters, int count,
+                        char *out, size_t size);
+  size_t getConfiguredDevices(const AlpacaParameter *parameters, int count,
+                              const char *uniqueId, char *out, size_t size);
+
+  bool isConnected();
+
+private:
+  void get(int property, const AlpacaParameter *parameters, int count,
+           unsigned long nowMicros, AlpacaResult &result);
+  void put(int property, const AlpacaParameter *parameters, int count,
+           unsigned long nowMicros, AlpacaResult &result);
+  MotorStatic &axisStatic(int axis);
+  size_t format(const AlpacaResult &result, const AlpacaParameter *parameters,
+                int count, char *out, size_t size);
+
+  RAStatic &raStatic;
+  RADynamic &raDynamic;
+  DecStatic &decStatic;
+  DecDynamic &decDynamic;
+  CommandMailbox &mailbox;
+  bool connected;
+  uint32_t serverTransactionId;
+  // Asked for but maybe not applied yet, see ALPACA_PENDING_MICROS
+  bool trackingPending;
+  bool trackingRequested;
+  unsigned long trackingRequestedMicros;
+  bool movePending;
+  unsigned long moveRequestedMicros;
+  bool pulsePending;
+  unsigned long pulseEndMicros;
+};
+
+// True if a packet on ALPACA_DISCOVERY_PORT is a discovery request
+bool isAlpacaDiscovery(const uint8_t *data, size_t length);
+
+// Reply to a discovery request. Returns bytes written, 0 if too small.
+size_t encodeAlpacaDiscoveryResponse(char *out, size_t size);
+
+#endif // __ALPACATELESCOPE_H__
@@ -0,0 +1,18 @@
+#ifndef __CLOCK_H__
+#define __CLOCK_H__
+
+#include <cstdint>
+
+/**
+ * Source of time for the motor loop. On the ESP32 this is esp_timer, so
+ * matches Arduino micros()/millis(). Native tests use a simulated clock,
+ * so loop timing can be run faster than real time.
+ */
+class Clock {
+public:
+  virtual ~Clock() {}
+  virtual uint64_t nowMicros() = 0;
+  unsigned long nowMillis() { return nowMicros() / 1000; }
+};
+
+#endif // __CLOCK_H__
@@ -0,0 +1,275 @@
+#include "CommandDispatch.h"
+#include "Logging.h"
+#include <cmath>
+#include <cstring>
+
+#define JSON_COMMAND_PREFIX "EQ:"
+
+typedef AckResult (*CommandHandler)(CommandMailbox &mailbox,
+                                    const PlatformCommand &command,
+                                    unsigned long nowMicros);
+
+// Every UDP command is posted with the time it was sent for, if any
+static AckResult post(CommandMailbox &mailbox, MotorCommand motorCommand,
+                      const PlatformCommand &command, unsigned long now) {
+  motorCommand.executeAtMicros = command.executeAtMicros;
+  return mailbox.post(COMMAND_SOURCE_UDP, motorCommand, now) ? ACK_ACCEPTED
+                                                             : ACK_BUSY;
+}
+
+// Both or neither, so a full queue can't leave one axis moved
+static AckResult postPair(CommandMailbox &mailbox, MotorCommand first,
+                          MotorCommand second, const PlatformCommand &command,
+                          unsigned long now) {
+  if (!mailbox.hasRoom(COMMAND_SOURCE_UDP, 2))
+    return ACK_BUSY;
+  AckResult result = post(mailbox, first, command, now);
+  if (result != ACK_ACCEPTED)
+    return result;
+  return post(mailbox, second, command, now);
+}
+
+// Parameters arrive as floats, so check them before they're converted
+static bool isInRange(double parameter, double min, double max) {
+  return std::isfinite(parameter) && parameter >= min && parameter <= max;
+}
+
+static bool isAxis(double parameter) {
+  return parameter == AXIS_RA || parameter == AXIS_DEC;
+}
+
+static AckResult handleHome(CommandMailbox &mailbox,
+                            const PlatformCommand &command,
+                            unsigned long now) {
+  return postPair(mailbox, MotorCommand::gotoStart(AXIS_RA),
+                  MotorCommand::gotoMiddle(AXIS_DEC), command, now);
+}
+
+static AckResult handlePark(CommandMailbox &mailbox,
+                            const PlatformCommand &command,
+                            unsigned long now) {
+  return postPair(mailbox, MotorCommand::gotoEnd(AXIS_RA),
+                  MotorCommand::gotoMiddle(AXIS_DEC), command, now);
+}
+
+static AckResult handleTrack(CommandMailbox &mailbox,
+                             const PlatformCommand &command,
+                             unsigned long now) {
+  if (!std::isfinite(command.parameter1))
+    return ACK_REJECTED;
+  return post(mailbox,
+              MotorCommand::track(command.parameter1 > 0 ? true : false),
+              command, now);
+}
+
+static AckResult handleMoveAxis(CommandMailbox &mailbox,
+                                const PlatformCommand &command,
+                                unsigned long now) {
+  if (!isAxis(command.parameter1) || !std::isfinite(command.parameter2))
+    return ACK_REJECTED;
+  return post(mailbox,
+              MotorCommand::moveAxis(command.parameter1, command.parameter2),
+              command, now);
+}
+
+static AckResult handleSlewByDegrees(CommandMailbox &mailbox,
+                                     const PlatformCommand &command,
+                                     unsigned long now) {
+  if (!isAxis(command.parameter1) || !std::isfinite(command.parameter2))
+    return ACK_REJECTED;
+  return post(
+      mailbox,
+      MotorCommand::slewByDegrees(command.parameter1, command.parameter2),
+      command, now);
+}
+
+static AckResult handleMoveAxisPercentage(CommandMailbox &mailbox,
+                                          const PlatformCommand &command,
+                                          unsigned long now) {
+  LOG_DEBUG(LOG_UDP, "Move axis percentage received %f %f",
+            command.parameter1, command.parameter2);
+  if (!isAxis(command.parameter1) ||
+      !isInRange(command.parameter2, -100, 100))
+    return ACK_REJECTED;
+  return post(mailbox,
+              MotorCommand::moveAxisPercentage(command.parameter1,
+                                               command.parameter2),
+              command, now);
+}
+
+static AckResult handlePulseGuide(CommandMailbox &mailbox,
+                                  const PlatformCommand &command,
+                                  unsigned long now) {
+  if (!isInRange(command.parameter1, 0, 3) ||
+      command.parameter1 != std::floor(command.parameter1)) {
+    LOG_WARN(LOG_UDP, "Unknown pulseguide direction %f", command.parameter1);
+    return ACK_REJECTED;
+  }
+  if (!isInRange(command.parameter2, 0, DSC_MAX_PULSE_MILLIS)) {
+    LOG_WARN(LOG_UDP, "Bad pulseguide duration %f", command.parameter2);
+    return ACK_REJECTED;
+  }
+  return post(mailbox,
+              MotorCommand::pulseGuide(command.parameter1, command.parameter2),
+              command, now);
+}
+
+// Indexed by PlatformCommandCode
+static const CommandHandler commandHandlers[PLATFORM_COMMAND_COUNT] = {
+    nullptr,
+    handleHome,
+    handlePark,
+    handleTrack,
+    handleMoveAxis,
+    handleSlewByDegrees,
+    handleMoveAxisPercentage,
+    handlePulseGuide};
+
+AckResult dispatchPlatformCommand(CommandMailbox &mailbox,
+                                  const PlatformCommand &command,
+                                  unsigned long nowMicros) {
+  if (command.code <= PLATFORM_COMMAND_NONE ||
+      command.code >= PLATFORM_COMMAND_COUNT)
+    return ACK_REJECTED;
+  return commandHandlers[command.code](mailbox, command, nowMicros);
+}
+
+// Ack in the protocol the command came in
+static void ack(DscSender *sender, bool json, uint32_t sequence,
+                AckResult result) {
+  if (sender == nullptr)
+    return;
+  sender->replyLength =
+      json ? encodeJsonAck(sequence, result, sender->reply,
+                           sizeof(sender->reply))
+           : encodeAck(sequence, result, sender->reply, sizeof(sender->reply));
+}
+
+// Drop repeats and stragglers, convert a timed command to our clock, post
+// and ack. The sequence only counts as seen once the command is posted,
+// so one that's rejected or finds the queue full can be resent.
+static DscPacketResult handleCommand(PlatformCommand &command, bool json,
+                                     CommandMailbox &mailbox,
+                                     uint64_t nowMicros, DscSender *sender) {
+  bool windowed = command.sequence != 0 && sender != nullptr &&
+                  sender->window != nullptr;
+  if (windowed) {
+    SequenceResult order =
+        sender->window->classify(sender->address, sender->port,
+                                 command.sequence, nowMicros, command.session);
+    if (order != SEQUENCE_ACCEPTED) {
+      LOG_DEBUG(LOG_UDP, "Dropping %s %s, sequence %lu",
+                order == SEQUENCE_DUPLICATE ? "duplicate" : "stale",
+                getPlatformCommandName(command.code),
+                (unsigned long)command.sequence);
+      ack(sender, json, command.sequence,
+          order == SEQUENCE_DUPLICATE ? ACK_DUPLICATE : ACK_STALE);
+      return DSC_PACKET_DROPPED;
+    }
+  }
+  if (command.executeAtMicros != 0) {
+    // timed in the sender's clock
+    uint64_t localMicros;
+    if (sender == nullptr || sender->clockSync == nullptr ||
+        !sender->clockSync->toLocalMicros(sender->address, sender->port,
+                                          command.executeAtMicros,
+                                          nowMicros, localMicros)) {
+      // running it now would be at the wrong time, so the DSC must resend
+      LOG_WARN(LOG_UDP, "Timed %s from unsynced dsc, rejected",
+               getPlatformCommandName(command.code));
+      if (command.sequence != 0)
+        ack(sender, json, command.sequence, ACK_UNSYNCED);
+      return DSC_PACKET_REJECTED;
+    }
+    command.executeAtMicros = localMicros;
+  }
+  AckResult result = dispatchPlatformCommand(mailbox, command, nowMicros);
+  if (windowed && result == ACK_ACCEPTED)
+    sender->window->record(sender->address, sender->port, command.sequence,
+                           nowMicros, command.session);
+  if (command.sequence != 0)
+    ack(sender, json, command.sequence, result);
+  if (result == ACK_BUSY)
+    return DSC_PACKET_DROPPED;
+  return result == ACK_ACCEPTED ? DSC_PACKET_COMMAND : DSC_PACKET_REJECTED;
+}
+
+static DscPacketResult handleBinaryPacket(const uint8_t *data, size_t length,
+                                          CommandMailbox &mailbox,
+                                          uint64_t nowMicros,
+                                          DscSender *sender) {
+  int type = getMessageType(data, length);
+  if (type == PROTOCOL_STATUS)
+    return DSC_PACKET_IGNORED; // our own broadcast
+  if (type == PROTOCOL_HELLO)
+    return DSC_PACKET_HELLO;
+  if (type == PROTOCOL_SUBSCRIBE)
+    return DSC_PACKET_SUBSCRIBE; // needs the sender's address
+  if (type == PROTOCOL_TIME_REQUEST) {
+    TimeRequest request;
+    if (sender == nullptr || sender->clockSync == nullptr ||
+        !decodeTimeRequest(data, length, request))
+      return DSC_PACKET_REJECTED;
+    TimeResponse response;
+    sender->clockSync->handleRequest(sender->address, sender->port, request,
+                                     nowMicros, response);
+    sender->replyLength = encodeTimeResponse(response, sender->reply,
+                                             sizeof(sender->reply));
+    return DSC_PACKET_TIME_REQUEST;
+  }
+  PlatformCommand command;
+  if (!decodeCommand(data, length, command)) {
+    LOG_WARN(LOG_UDP, "Bad binary message, version %d type %d",
+             length > 1 ? data[1] : 0, length > 2 ? data[2] : 0);
+    return DSC_PACKET_REJECTED;
+  }
+  LOG_TRACE(LOG_UDP, "Got binary %s from dsc",
+            getPlatformCommandName(command.code));
+  return handleCommand(command, false, mailbox, nowMicros, sender);
+}
+
+DscPacketResult handleDscPacket(const uint8_t *data, size_t length,
+                                CommandMailbox &mailbox, uint64_t nowMicros,
+                                DscSender *sender) {
+  if (sender != nullptr)
+    sender->replyLength = 0;
+  if (isBinaryMessage(data, length))
+    return handleBinaryPacket(data, length, mailbox, nowMicros, sender);
+
+  // Our own "DSC:" status broadcasts arrive here too
+  size_t prefixLength = strlen(JSON_COMMAND_PREFIX);
+  if (length < prefixLength ||
+      memcmp(data, JSON_COMMAND_PREFIX, prefixLength) != 0) {
+    LOG_WARN(LOG_UDP, "Message has bad starting chars");
+    return DSC_PACKET_REJECTED;
+  }
+  LOG_TRACE(LOG_UDP, "Got payload from dsc");
+
+  const char *json = (const char *)data + prefixLength;
+  size_t jsonLength = length - prefixLength;
+  PlatformCommand command;
+  switch (parseJsonCommand(json, jsonLength, command)) {
+  case JSON_COMMAND_OK:
+    break;
+  case JSON_COMMAND_BAD_JSON:
+    LOG_WARN(LOG_UDP, "Failed to parse payload %.*s", (int)jsonLength, json);
+    return DSC_PACKET_REJECTED;
+  case JSON_COMMAND_MISSING_FIELDS:
+    LOG_WARN(LOG_UDP, "Payload missing required fields.");
+    if (command.sequence != 0)
+      ack(sender, true, command.sequence, ACK_REJECTED);
+    return DSC_PACKET_REJECTED;
+  case JSON_COMMAND_BAD_FIELD:
+    LOG_WARN(LOG_UDP, "Bad sequence or session in %.*s", (int)jsonLength,
+             json);
+    if (command.sequence != 0)
+      ack(sender, true, command.sequence, ACK_REJECTED);
+    return DSC_PACKET_REJECTED;
+  case JSON_COMMAND_UNKNOWN:
+    LOG_WARN(LOG_UDP, "Unknown command in %.*s", (int)jsonLength, json);
+    if (command.sequence != 0)
+      ack(sender, true, command.sequence, ACK_REJECTED);
+    return DSC_PACKET_REJECTED;
+  }
+  return handleCommand(command, true, mailbox, nowMicros, sender);
+}
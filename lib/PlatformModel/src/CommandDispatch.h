@@ -0,0 +1,66 @@
+#ifndef __COMMANDDISPATCH_H__
+#define __COMMANDDISPATCH_H__
+
+#include "ClockSync.h"
+#include "CommandMailbox.h"
+#include "CommandWindow.h"
+#include "PlatformProtocol.h"
+#include <cstddef>
+#include <cstdint>
+
+enum DscPacketResult {
+  DSC_PACKET_COMMAND = 0,  // posted to the mailbox
+  DSC_PACKET_HELLO,        // binary hello, no command
+  DSC_PACKET_SUBSCRIBE,    // position stream request, for the caller
+  DSC_PACKET_TIME_REQUEST, // clock sync request, answered in the reply
+  DSC_PACKET_DROPPED,      // duplicate, out of order or no room: acked,
+                           // not posted
+  DSC_PACKET_IGNORED,      // eg our own status broadcast
+  DSC_PACKET_REJECTED      // bad or unknown, logged
+};
+
+// Room for any reply: binary, or a "DSC:" JSON ack
+#define DSC_REPLY_BYTES 64
+// Longest pulseguide accepted from a DSC
+#define DSC_MAX_PULSE_MILLIS 60000
+
+/**
+ * Where a packet came from, for the per-DSC state: clock offsets for timed
+ * commands and the window over sequence numbers. Either can be null.
+ * Anything to send back (time response, ack) is left in reply.
+ */
+struct DscSender {
+  uint32_t address; // IPv4, as the network stack stores it
+  uint16_t port;
+  ClockSync *clockSync;
+  CommandWindow *window;
+  uint8_t reply[DSC_REPLY_BYTES];
+  size_t replyLength; // 0 for nothing to send
+};
+
+/**
+ * Post a DSC command, from either protocol, to the motor loop. Looked up
+ * in a table of handlers by command code. Returns the ack: rejected if the
+ * command or its parameters are bad, busy if the queue had no room for
+ * it, in which case nothing was posted. A timed command's executeAtMicros
+ * must already be in the loop clock.
+ */
+AckResult dispatchPlatformCommand(CommandMailbox &mailbox,
+                                  const PlatformCommand &command,
+                                  unsigned long nowMicros);
+
+/**
+ * Whole receive path for a packet on the DSC port: binary or "EQ:" JSON,
+ * parsed from the packet buffer and posted. Doesn't allocate, as the
+ * nunchuk streams moveaxispercentage through here.
+ *
+ * Timed commands are converted with the sender's clock offset, and
+ * rejected if it hasn't synced (or there's no sender). Commands with a
+ * sequence number are checked against the sender's window and acked, and
+ * only enter it once posted.
+ */
+DscPacketResult handleDscPacket(const uint8_t *data, size_t length,
+                                CommandMailbox &mailbox, uint64_t nowMicros,
+                                DscSender *sender = nullptr);
+
+#endif // __COMMANDDISPATCH_H__
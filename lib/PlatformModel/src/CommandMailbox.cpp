@@ -0,0 +1,231 @@
+#include "CommandMailbox.h"
+#include "Logging.h"
+
+CommandMailbox::CommandMailbox(RADynamic &ra, DecDynamic &dec)
+    : raDynamic(ra), decDynamic(dec), scheduledCount(0),
+      commandsScheduled(0) {
+  for (int source = 0; source < COMMAND_SOURCE_COUNT; source++)
+    nextSequence[source] = 0;
+}
+
+// Time until a command is due, negative if late. The loop clock is 32 bits
+// on the ESP32, so compare the low halves.
+static int32_t microsUntil(const MotorCommand &command,
+                           unsigned long nowMicros) {
+  return (int32_t)((uint32_t)command.executeAtMicros - (uint32_t)nowMicros);
+}
+
+static bool isDue(const MotorCommand &command, unsigned long nowMicros) {
+  if (command.executeAtMicros == 0)
+    return true;
+  int32_t lead =
+      command.type == MOTOR_COMMAND_PULSE_GUIDE ? COMMAND_PULSE_LEAD_MICROS : 0;
+  return microsUntil(command, nowMicros) <= lead;
+}
+
+// Posted before other by the same source. Sequences wrap, so compare the
+// difference.
+static bool isBefore(const MotorCommand &command, const MotorCommand &other) {
+  return (int32_t)(command.sequence - other.sequence) < 0;
+}
+
+static bool isRateCommand(const MotorCommand &command) {
+  return command.executeAtMicros == 0 &&
+         (command.type == MOTOR_COMMAND_MOVE_AXIS ||
+          command.type == MOTOR_COMMAND_MOVE_AXIS_PERCENTAGE) &&
+         (command.axis == AXIS_RA || command.axis == AXIS_DEC);
+}
+
+bool CommandMailbox::post(CommandSource source, MotorCommand command,
+                          unsigned long nowMicros) {
+  command.postedMicros = nowMicros;
+  command.sequence = nextSequence[source]++;
+  if (command.executeAtMicros != 0 &&
+      (microsUntil(command, nowMicros) <= 0 ||
+       microsUntil(command, nowMicros) > COMMAND_MAX_SCHEDULE_MICROS)) {
+    if (microsUntil(command, nowMicros) > 0)
+      LOG_WARN(LOG_MOTOR, "Command %d timed too far ahead, running now",
+               command.type);
+    command.executeAtMicros = 0;
+  }
+  if (isRateCommand(command)) {
+    rates[source][command.axis].write(command);
+    return true;
+  }
+  if (!queues[source].push(command)) {
+    LOG_WARN(LOG_MOTOR, "Command queue %d full, dropping command %d", source,
+             command.type);
+    return false;
+  }
+  return true;
+}
+
+bool CommandMailbox::hasRoom(CommandSource source, uint32_t count) {
+  // loop only ever makes more room, so this can't go stale the wrong way
+  return COMMAND_QUEUE_SIZE - queues[source].size() >= count;
+}
+
+int CommandMailbox::drain(unsigned long nowMicros) {
+  // held commands were posted before anything still queued
+  int applied = applyScheduled(nowMicros);
+  MotorCommand command;
+  for (int source = 0; source < COMMAND_SOURCE_COUNT; source++) {
+    // Count the queue before taking rates. A rate posted before one of
+    // the counted commands is then sure to be taken with them, rather
+    // than left for the next drain and applied after them.
+    uint32_t queued = queues[source].size();
+    MotorCommand rate[2];
+    bool haveRate[2];
+    for (int a = 0; a < 2; a++)
+      haveRate[a] = rates[source][a].take(rate[a]);
+
+    while (queues[source].peek(command)) {
+      // Past the count, only take commands posted before a rate we hold:
+      // a later one may have a rate posted before it that we don't
+      if (queued > 0) {
+        queued--;
+      } else if (!(haveRate[0] && isBefore(command, rate[0])) &&
+                 !(haveRate[1] && isBefore(command, rate[1]))) {
+        break;
+      }
+      queues[source].pop(command);
+      for (int a = 0; a < 2; a++) {
+        if (haveRate[a] && isBefore(rate[a], command)) {
+          applyPosted(rate[a], nowMicros);
+          applied++;
+          haveRate[a] = false;
+        }
+      }
+      applied += applyOrHold(command, nowMicros);
+    }
+    for (int a = 0; a < 2; a++) {
+      if (haveRate[a]) {
+        applyPosted(rate[a], nowMicros);
+        applied++;
+      }
+    }
+  }
+  return applied;
+}
+
+int CommandMailbox::applyOrHold(const MotorCommand &command,
+                                unsigned long nowMicros) {
+  if (isDue(command, nowMicros)) {
+    applyPosted(command, nowMicros);
+    return 1;
+  }
+  if (scheduledCount == COMMAND_SCHEDULE_SIZE) {
+    LOG_WARN(LOG_MOTOR, "Too many timed commands, running %d now",
+             command.type);
+    MotorCommand now = command;
+    now.executeAtMicros = 0;
+    applyPosted(now, nowMicros);
+    return 1;
+  }
+  scheduled[scheduledCount++] = command;
+  commandsScheduled++;
+  return 0;
+}
+
+int CommandMailbox::applyScheduled(unsigned long nowMicros) {
+  int applied = 0;
+  int kept = 0;
+  for (int i = 0; i < scheduledCount; i++) {
+    if (isDue(scheduled[i], nowMicros)) {
+      applyPosted(scheduled[i], nowMicros);
+      applied++;
+    } else {
+      scheduled[kept++] = scheduled[i];
+    }
+  }
+  scheduledCount = kept;
+  return applied;
+}
+
+void CommandMailbox::applyPosted(const MotorCommand &command,
+                                 unsigned long nowMicros) {
+  apply(command);
+  if (command.executeAtMicros == 0) {
+    latency.record(nowMicros - command.postedMicros);
+    return;
+  }
+  // for a timed command, how late it was (pulses are handed over early)
+  int32_t late = -microsUntil(command, nowMicros);
+  latency.record(late > 0 ? late : 0);
+}
+
+MotorDynamic &CommandMailbox::axis(int axis) {
+  if (axis == AXIS_DEC)
+    return decDynamic;
+  return raDynamic;
+}
+
+void CommandMailbox::apply(const MotorCommand &command) {
+  switch (command.type) {
+  case MOTOR_COMMAND_GOTO_START:
+    axis(command.axis).gotoStart();
+    break;
+  case MOTOR_COMMAND_GOTO_MIDDLE:
+    axis(command.axis).gotoMiddle();
+    break;
+  case MOTOR_COMMAND_GOTO_END:
+    axis(command.axis).gotoEndish();
+    break;
+  case MOTOR_COMMAND_TRACK:
+    raDynamic.setTrackingOnOff(command.value > 0);
+    break;
+  case MOTOR_COMMAND_TRACKING_MODE:
+    raDynamic.setTrackingMode((TrackingMode)(int)command.value);
+    break;
+  case MOTOR_COMMAND_MOVE_AXIS:
+    axis(command.axis).moveAxis(command.value);
+    break;
+  case MOTOR_COMMAND_MOVE_AXIS_PERCENTAGE:
+    axis(command.axis).moveAxisPercentage(command.value);
+    break;
+  case MOTOR_COMMAND_SLEW_BY_DEGREES:
+    axis(command.axis).slewByDegrees(command.value);
+    break;
+  case MOTOR_COMMAND_PULSE_GUIDE:
+    axis(command.axis).setNextPulseStartMicros(command.executeAtMicros);
+    axis(command.axis).pulseGuide(command.direction, command.durationMillis);
+    // not left behind for a later pulse if this one was ignored
+    axis(command.axis).setNextPulseStartMicros(0);
+    break;
+  default:
+    LOG_ERROR(LOG_MOTOR, "Unknown command type %d", command.type);
+  }
+}
+
+unsigned long CommandMailbox::getLastLatencyMicros() {
+  return latency.getLast();
+}
+
+unsigned long CommandMailbox::getMaxLatencyMicros() { return latency.getMax(); }
+
+unsigned long CommandMailbox::getAverageLatencyMicros() {
+  return latency.getAverage();
+}
+
+unsigned long CommandMailbox::getCommandsApplied() {
+  return latency.getCount();
+}
+
+uint32_t CommandMailbox::getCommandsDropped() {
+  uint32_t dropped = 0;
+  for (int source = 0; source < COMMAND_SOURCE_COUNT; source++) {
+    dropped += queues[source].getDropped();
+  }
+  return dropped;
+}
+
+uint32_t CommandMailbox::getCommandsCoalesced() {
+  uint32_t coalesced = 0;
+  for (int source = 0; source < COMMAND_SOURCE_COUNT; source++) {
+    for (int a = 0; a < 2; a++)
+      coalesced += rates[source][a].getOverwritten();
+  }
+  return coalesced;
+}
+
+uint32_t CommandMailbox::getCommandsScheduled() { return commandsScheduled; }
@@ -0,0 +1,100 @@
+#ifndef __COMMANDMAILBOX_H__
+#define __COMMANDMAILBOX_H__
+
+#include "DecDynamic.h"
+#include "LatestValue.h"
+#include "MotorCommand.h"
+#include "RADynamic.h"
+#include "SPSCQueue.h"
+#include "TimingStats.h"
+#include <cstdint>
+
+// Commands each source can have waiting. Must be a power of two.
+#define COMMAND_QUEUE_SIZE 16
+// Timed commands that can be waiting for their time
+#define COMMAND_SCHEDULE_SIZE 8
+// Furthest ahead a command can be timed. Later ones run on arrival.
+#define COMMAND_MAX_SCHEDULE_MICROS 10000000
+// Timed pulses this close to their time are handed to the axis pulse
+// timer, which starts them on time rather than on the next loop
+#define COMMAND_PULSE_LEAD_MICROS 50000
+
+/**
+ * Where commands come from. Each source posts from its own task, so gets
+ * its own queue to keep every queue single producer.
+ */
+enum CommandSource {
+  COMMAND_SOURCE_UDP = 0, // AsyncUDP task
+  COMMAND_SOURCE_WEB = 1, // AsyncTCP task: web ui, alpaca and LX200
+  COMMAND_SOURCE_COUNT
+};
+
+/**
+ * Hands external commands over to the motion loop.
+ *
+ * Network callbacks run on their own tasks, while MotorDynamic state is
+ * updated from loop. Rather than call into RADynamic/DecDynamic directly,
+ * callbacks post a MotorCommand here, and loop drains and applies them at
+ * a single point, so dynamic state is only ever touched from one task.
+ *
+ * Continuous rate commands (moveAxis, moveAxisPercentage) don't queue: each
+ * source keeps only the latest per axis, applied once per drain, so a
+ * nunchuk streaming updates costs one motor update per loop however fast
+ * packets arrive. Rates still apply in order with the source's other
+ * commands.
+ *
+ * A command with executeAtMicros set is held until then, so a DSC can
+ * have a slew or pulse start at an instant it chose. Other commands go
+ * by it. Held commands apply on the first loop at or after their time,
+ * except pulses, which start from the axis pulse timer on the microsecond.
+ */
+class CommandMailbox {
+public:
+  CommandMailbox(RADynamic &ra, DecDynamic &dec);
+
+  // Called from the source's task. Returns false if its queue is full.
+  bool post(CommandSource source, MotorCommand command,
+            unsigned long nowMicros);
+  // Called from the source's task. Whether count more commands would
+  // queue, so ones that go together can be posted whole or not at all.
+  bool hasRoom(CommandSource source, uint32_t count);
+
+  // Called from loop. Applies everything waiting, returns how many.
+  int drain(unsigned long nowMicros);
+
+  // Time from post to apply
+  unsigned long getLastLatencyMicros();
+  unsigned long getMaxLatencyMicros();
+  unsigned long getAverageLatencyMicros();
+  unsigned long getCommandsApplied();
+  // Commands lost because a queue was full
+  uint32_t getCommandsDropped();
+  // Rate commands replaced by a newer one before being applied
+  uint32_t getCommandsCoalesced();
+  // Timed commands held for their time
+  uint32_t getCommandsScheduled();
+
+private:
+  void apply(const MotorCommand &command);
+  void applyPosted(const MotorCommand &command, unsigned long nowMicros);
+  // Apply, or hold if it's timed for later. Returns how many applied.
+  int applyOrHold(const MotorCommand &command, unsigned long nowMicros);
+  int applyScheduled(unsigned long nowMicros);
+  MotorDynamic &axis(int axis);
+
+  RADynamic &raDynamic;
+  DecDynamic &decDynamic;
+  SPSCQueue<MotorCommand, COMMAND_QUEUE_SIZE> queues[COMMAND_SOURCE_COUNT];
+  // Latest rate command per source, per axis
+  LatestValue<MotorCommand> rates[COMMAND_SOURCE_COUNT][2];
+  // Next sequence for each source. Only touched by that source's task.
+  uint32_t nextSequence[COMMAND_SOURCE_COUNT];
+  // Timed commands waiting. Only touched from loop.
+  MotorCommand scheduled[COMMAND_SCHEDULE_SIZE];
+  int scheduledCount;
+  uint32_t commandsScheduled;
+
+  TimingStats latency;
+};
+
+#endif // __COMMANDMAILBOX_H__
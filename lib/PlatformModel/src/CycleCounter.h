@@ -0,0 +1,29 @@
+#ifndef __CYCLECOUNTER_H__
+#define __CYCLECOUNTER_H__
+
+#include <cstdint>
+
+/**
+ * Cheapest timestamp available, for timing code in place. On the ESP32
+ * this is the CPU cycle counter (wraps every ~18s at 240MHz, so only
+ * good for short intervals). Natively it is a nanosecond clock.
+ */
+#ifdef ARDUINO
+#include <Arduino.h>
+
+inline uint32_t readCycleCounter() { return ESP.getCycleCount(); }
+inline uint32_t cyclesPerMicrosecond() { return getCpuFrequencyMhz(); }
+
+#else
+#include <chrono>
+
+inline uint32_t readCycleCounter() {
+  return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+inline uint32_t cyclesPerMicrosecond() { return 1000; }
+
+#endif
+
+#endif // __CYCLECOUNTER_H__
@@ -2,7 +2,9 @@
 #include "Logging.h"
 #include <cmath>
 
-DecDynamic::DecDynamic(DecStatic &m) : MotorDynamic(m), model(m) {}
+DecDynamic::DecDynamic(DecStatic &m) : MotorDynamic(m), model(m) {
+  logModule = LOG_DEC;
+}
 
 void DecDynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
   // Direction is either  0 = guideNorth, 1 = guideSouth.
@@ -16,7 +18,8 @@ void DecDynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
   // NOTE: this assumes target speed will be positive
   if (direction == 0) { // north: go up {}
     targetSpeedInArcSecsSec = model.getGuideRateArcSecondsSecond();
-    log("N guide rate arc seconds %lf ", targetSpeedInArcSecsSec);
+    LOG_TRACE(LOG_DEC, "N guide rate arc seconds %lf ",
+              targetSpeedInArcSecsSec);
     targetPosition = 0;
 
   } else {
@@ -24,10 +27,10 @@ void DecDynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
       targetPosition = model.getLimitPosition();
       targetSpeedInArcSecsSec = -model.getGuideRateArcSecondsSecond();
 
-      log("S guide rate arc seconds %lf ",
-                              targetSpeedInArcSecsSec);
+      LOG_TRACE(LOG_DEC, "S guide rate arc seconds %lf ",
+                targetSpeedInArcSecsSec);
     } else {
-      log("Error: unexpected direction passed %d", direction);
+      LOG_ERROR(LOG_DEC, "Unexpected direction passed %d", direction);
       return;
     }
   }
@@ -37,15 +40,16 @@ void DecDynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
 
   pulseGuideDurationMillis = pulseDurationInMilliseconds;
   speedBeforePulseMHz = 0;
-  log("Pulseguiding %s for %ld ms at speed %lu",
-      direction == 0 ? "North" : "South", pulseDurationInMilliseconds,
-      targetSpeedInMilliHz);
+  LOG_DEBUG(LOG_DEC, "Pulseguiding %s for %ld ms at speed %lu",
+            direction == 0 ? "North" : "South", pulseDurationInMilliseconds,
+            (unsigned long)targetSpeedInMilliHz);
+  schedulePulse();
 }
 
 void DecDynamic::moveAxis(double degreesPerSecond) {
-  log("Incoming movexis command speed %lf", degreesPerSecond);
+  LOG_DEBUG(LOG_DEC, "Incoming movexis command speed %lf", degreesPerSecond);
   if (degreesPerSecond == 0) {
-    log("Move axis target is 0 ");
+    LOG_DEBUG(LOG_DEC, "Move axis target is 0 ");
     isExecutingMove = false; // loop should perform stop / resume track
     return;
   }
@@ -54,7 +58,8 @@ void DecDynamic::moveAxis(double degreesPerSecond) {
 
   targetSpeedInMilliHz = model.calculateSpeedInMilliHz(
       stepperWrapper->getPosition(), 3600.0 * fabs(degreesPerSecond));
-  log("Move axis target speed millihz %lu", targetSpeedInMilliHz);
+  LOG_DEBUG(LOG_DEC, "Move axis target speed millihz %lu",
+            (unsigned long)targetSpeedInMilliHz);
 
   isExecutingMove = true;
   isMoveQueued = true;
@@ -72,7 +77,7 @@ void DecDynamic::moveAxis(double degreesPerSecond) {
  * as a % of tracking rate.
  */
 void DecDynamic::moveAxisPercentage(int percentage) {
-  log("Received moveaxispercentage with value %d", percentage);
+  LOG_DEBUG(LOG_DEC, "Received moveaxispercentage with value %d", percentage);
   if (percentage == 0) {
     moveAxis(0);
     return;
@@ -80,7 +85,7 @@ void DecDynamic::moveAxisPercentage(int percentage) {
   double degreesPerSecond = model.getNunChukMultiplier() *
                             model.getGuideRateDegreesSec() *
                             (double)percentage / 100.0;
-  log("Moving axis with %lf degrees sec", degreesPerSecond);
+  LOG_DEBUG(LOG_DEC, "Moving axis with %lf degrees sec", degreesPerSecond);
 
   moveAxis(degreesPerSecond);
 };
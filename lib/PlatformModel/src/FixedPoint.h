@@ -0,0 +1,177 @@
+#ifndef __FIXEDPOINT_H__
+#define __FIXEDPOINT_H__
+
+#include <cstdint>
+
+/**
+ * Signed Q-format fixed point number, stored in 64 bits with FracBits
+ * fractional bits. Used as a numeric backend for TangentGeometry so the
+ * platform math can run without soft-float doubles.
+ *
+ * All arithmetic is integer only: multiply and divide use 32 bit halves so
+ * no 128 bit type is needed. atan and tan are done with CORDIC, and are
+ * accurate to roughly FracBits bits for angles within +-1.7 radians.
+ *
+ * The default Q33.30 holds step positions and speeds in millihz while
+ * still resolving a second of sidereal motion.
+ */
+template <int FracBits> class FixedPoint {
+  static_assert(FracBits > 0 && FracBits <= 32,
+                "FixedPoint supports 1 to 32 fractional bits");
+
+public:
+  FixedPoint() : raw(0) {}
+  FixedPoint(int v) : raw((int64_t)v << FracBits) {}
+  FixedPoint(long v) : raw((int64_t)v << FracBits) {}
+  FixedPoint(double v) : raw((int64_t)(v * (double)(1LL << FracBits))) {}
+  FixedPoint(float v) : raw((int64_t)(v * (float)(1LL << FracBits))) {}
+
+  static FixedPoint fromRaw(int64_t r) {
+    FixedPoint f;
+    f.raw = r;
+    return f;
+  }
+  int64_t getRaw() const { return raw; }
+
+  double toDouble() const { return (double)raw / (double)(1LL << FracBits); }
+
+  explicit operator double() const { return toDouble(); }
+  explicit operator float() const { return (float)toDouble(); }
+  explicit operator int64_t() const {
+    // truncate towards zero, like a double cast
+    return raw < 0 ? -((-raw) >> FracBits) : raw >> FracBits;
+  }
+  explicit operator int32_t() const { return (int32_t)(int64_t)(*this); }
+  explicit operator uint32_t() const { return (uint32_t)(int64_t)(*this); }
+
+  FixedPoint operator-() const { return fromRaw(-raw); }
+  FixedPoint operator+(FixedPoint o) const { return fromRaw(raw + o.raw); }
+  FixedPoint operator-(FixedPoint o) const { return fromRaw(raw - o.raw); }
+  FixedPoint operator*(FixedPoint o) const { return fromRaw(mul(raw, o.raw)); }
+  FixedPoint operator/(FixedPoint o) const { return fromRaw(div(raw, o.raw)); }
+  FixedPoint &operator+=(FixedPoint o) {
+    raw += o.raw;
+    return *this;
+  }
+  FixedPoint &operator-=(FixedPoint o) {
+    raw -= o.raw;
+    return *this;
+  }
+
+  bool operator<(FixedPoint o) const { return raw < o.raw; }
+  bool operator>(FixedPoint o) const { return raw > o.raw; }
+  bool operator<=(FixedPoint o) const { return raw <= o.raw; }
+  bool operator>=(FixedPoint o) const { return raw >= o.raw; }
+  bool operator==(FixedPoint o) const { return raw == o.raw; }
+  bool operator!=(FixedPoint o) const { return raw != o.raw; }
+
+  friend FixedPoint atan(FixedPoint v) {
+    // CORDIC vectoring: rotate (1, v) onto the x axis, summing the angle.
+    int64_t x = 1LL << FracBits;
+    int64_t y = v.raw;
+    int64_t z = 0;
+    for (int i = 0; i < FracBits; i++) {
+      int64_t dx = y >> i;
+      int64_t dy = x >> i;
+      if (y > 0) {
+        x += dx;
+        y -= dy;
+        z += cordicAngle(i);
+      } else {
+        x -= dx;
+        y += dy;
+        z -= cordicAngle(i);
+      }
+    }
+    return fromRaw(z);
+  }
+
+  friend FixedPoint tan(FixedPoint angle) {
+    // CORDIC rotation: rotate (1, 0) by angle. CORDIC gain scales x and y
+    // equally so cancels in y/x.
+    int64_t x = 1LL << FracBits;
+    int64_t y = 0;
+    int64_t z = angle.raw;
+    for (int i = 0; i < FracBits; i++) {
+      int64_t dx = y >> i;
+      int64_t dy = x >> i;
+      if (z >= 0) {
+        x -= dx;
+        y += dy;
+        z -= cordicAngle(i);
+      } else {
+        x += dx;
+        y -= dy;
+        z += cordicAngle(i);
+      }
+    }
+    return fromRaw(div(y, x));
+  }
+
+private:
+  int64_t raw;
+
+  // atan(2^-i) in Q32
+  static int64_t cordicAngle(int i) {
+    static const int64_t anglesQ32[33] = {
+        3373259426LL, 1991351318LL, 1052175346LL, 534100635LL, 268086748LL,
+        134174063LL,  67103403LL,   33553749LL,   16777131LL,  8388597LL,
+        4194303LL,    2097152LL,    1048576LL,    524288LL,    262144LL,
+        131072LL,     65536LL,      32768LL,      16384LL,     8192LL,
+        4096LL,       2048LL,       1024LL,       512LL,       256LL,
+        128LL,        64LL,         32LL,         16LL,        8LL,
+        4LL,          2LL,          1LL};
+    return anglesQ32[i] >> (32 - FracBits);
+  }
+
+  // (a * b) >> FracBits using 32 bit halves.
+  static int64_t mul(int64_t a, int64_t b) {
+    bool negative = (a < 0) != (b < 0);
+    uint64_t ua = a < 0 ? -(uint64_t)a : a;
+    uint64_t ub = b < 0 ? -(uint64_t)b : b;
+
+    uint64_t al = ua & 0xFFFFFFFFULL, ah = ua >> 32;
+    uint64_t bl = ub & 0xFFFFFFFFULL, bh = ub >> 32;
+
+    uint64_t lo = al * bl;
+    uint64_t mid1 = ah * bl;
+    uint64_t mid2 = al * bh;
+    uint64_t hi = ah * bh;
+
+    uint64_t mid = mid1 + (lo >> 32);
+    uint64_t carry = mid < mid1 ? 1 : 0;
+    uint64_t midSum = mid + mid2;
+    carry += midSum < mid ? 1 : 0;
+
+    uint64_t low64 = (midSum << 32) | (lo & 0xFFFFFFFFULL);
+    uint64_t high64 = hi + (midSum >> 32) + (carry << 32);
+
+    uint64_t result = (low64 >> FracBits) | (high64 << (64 - FracBits));
+    return negative ? -(int64_t)result : (int64_t)result;
+  }
+
+  // (a << FracBits) / b, by long division on the fractional bits.
+  static int64_t div(int64_t a, int64_t b) {
+    if (b == 0)
+      return a < 0 ? INT64_MIN : INT64_MAX;
+    bool negative = (a < 0) != (b < 0);
+    uint64_t ua = a < 0 ? -(uint64_t)a : a;
+    uint64_t ub = b < 0 ? -(uint64_t)b : b;
+
+    uint64_t quotient = ua / ub;
+    uint64_t remainder = ua % ub;
+    for (int i = 0; i < FracBits; i++) {
+      remainder <<= 1;
+      quotient <<= 1;
+      if (remainder >= ub) {
+        remainder -= ub;
+        quotient |= 1;
+      }
+    }
+    return negative ? -(int64_t)quotient : (int64_t)quotient;
+  }
+};
+
+typedef FixedPoint<30> PlatformFixed;
+
+#endif // __FIXEDPOINT_H__
@@ -0,0 +1,28 @@
+#ifndef __INPUTSOURCE_H__
+#define __INPUTSOURCE_H__
+
+// Physical buttons and switches read by MotorUnit
+enum PlatformInput {
+  BUTTON_FAST_FORWARD = 0,
+  BUTTON_REWIND,
+  BUTTON_PLAY,
+  LIMIT_SWITCH_RA,
+  LIMIT_SWITCH_DEC,
+  PLATFORM_INPUT_COUNT
+};
+
+/**
+ * Debounced button and limit switch state. Hides pin wiring (eg which
+ * switches are active low) from MotorUnit, and lets native tests press
+ * buttons.
+ */
+class InputSource {
+public:
+  virtual ~InputSource() {}
+  // Sample all inputs. Changes are reported until the next update.
+  virtual void update() = 0;
+  virtual bool justPushed(PlatformInput input) = 0;
+  virtual bool justReleased(PlatformInput input) = 0;
+};
+
+#endif // __INPUTSOURCE_H__
@@ -0,0 +1,93 @@
+#ifndef __LATENCYHISTOGRAM_H__
+#define __LATENCYHISTOGRAM_H__
+
+#include <cstdint>
+
+// One bucket per power of two, enough for any uint32_t
+#define LATENCY_HISTOGRAM_BUCKETS 33
+
+/**
+ * Fixed size, log scale histogram of latencies. Bucket 0 holds zeros,
+ * bucket i holds values from 2^(i-1) up to 2^i - 1. Recording is a few
+ * instructions and never allocates, so it can sit in the main loop and
+ * in network handlers.
+ *
+ * Each histogram should only be recorded to from one task. Readers on
+ * other tasks (eg /metrics) may see a record half applied, which is fine
+ * for monitoring.
+ */
+class LatencyHistogram {
+public:
+  LatencyHistogram() { reset(); }
+
+  void record(uint32_t value) {
+    buckets[bucketFor(value)]++;
+    if (value > max)
+      max = value;
+    count++;
+  }
+
+  void reset() {
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+      buckets[i] = 0;
+    max = 0;
+    count = 0;
+  }
+
+  uint32_t getCount() { return count; }
+  uint32_t getMax() { return max; }
+  uint32_t getBucketCount(int bucket) { return buckets[bucket]; }
+
+  // Number of buckets up to the last one holding anything
+  int getUsedBuckets() {
+    int used = LATENCY_HISTOGRAM_BUCKETS;
+    while (used > 0 && buckets[used - 1] == 0)
+      used--;
+    return used;
+  }
+
+  /**
+   * Upper bound of the bucket holding the given fraction (0-1) of
+   * records, eg 0.99 for p99. Capped at the max seen.
+   */
+  uint32_t getPercentile(double fraction) {
+    if (count == 0)
+      return 0;
+    uint32_t wanted = (uint32_t)(fraction * count + 0.5);
+    if (wanted < 1)
+      wanted = 1;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+      seen += buckets[i];
+      if (seen >= wanted) {
+        uint32_t bound = bucketUpperBound(i);
+        return bound < max ? bound : max;
+      }
+    }
+    return max;
+  }
+
+  static int bucketFor(uint32_t value) {
+    int bucket = 0;
+    while (value != 0) {
+      value >>= 1;
+      bucket++;
+    }
+    return bucket;
+  }
+
+  static uint32_t bucketUpperBound(int bucket) {
+    if (bucket == 0)
+      return 0;
+    if (bucket >= 32)
+      return UINT32_MAX;
+    return (1UL << bucket) - 1;
+  }
+
+private:
+  uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+  uint32_t max;
+  uint32_t count;
+};
+
+#endif // __LATENCYHISTOGRAM_H__
@@ -0,0 +1,58 @@
+#ifndef __LATESTVALUE_H__
+#define __LATESTVALUE_H__
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Holds only the latest value written, for one producer thread and one
+ * consumer thread. Writing over a value the consumer hasn't taken yet
+ * replaces it (and counts it as overwritten), so a fast producer can't
+ * make the consumer do more than one update per take.
+ *
+ * Triple buffered: the producer fills its own slot then swaps it into the
+ * middle, and the consumer swaps the middle out. Neither side ever waits
+ * or retries, and nothing allocates.
+ */
+template <typename T> class LatestValue {
+public:
+  LatestValue() : back(0), middle(1), front(2), overwritten(0) {}
+
+  // Producer only
+  void write(const T &value) {
+    slots[back] = value;
+    uint8_t previous =
+        middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    if (previous & FRESH)
+      overwritten.fetch_add(1, std::memory_order_relaxed);
+    back = previous & INDEX;
+  }
+
+  // Consumer only. False if nothing has been written since the last take.
+  bool take(T &value) {
+    // only take clears FRESH, so it can't go away before the exchange
+    if (!(middle.load(std::memory_order_relaxed) & FRESH))
+      return false;
+    uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & INDEX;
+    value = slots[front];
+    return true;
+  }
+
+  // Values replaced before the consumer took them
+  uint32_t getOverwritten() {
+    return overwritten.load(std::memory_order_relaxed);
+  }
+
+private:
+  static const uint8_t INDEX = 0x03;
+  static const uint8_t FRESH = 0x04;
+
+  T slots[3];
+  uint8_t back;                // producer's slot
+  std::atomic<uint8_t> middle; // handed over, plus FRESH if not taken
+  uint8_t front;               // consumer's slot
+  std::atomic<uint32_t> overwritten;
+};
+
+#endif // __LATESTVALUE_H__
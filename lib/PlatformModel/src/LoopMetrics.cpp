@@ -0,0 +1,46 @@
+#include "LoopMetrics.h"
+
+const char *LoopMetrics::getName(LoopMetric metric) {
+  switch (metric) {
+  case METRIC_LOOP_PERIOD:
+    return "loopPeriod";
+  case METRIC_BROADCAST_STATUS:
+    return "broadcastStatus";
+  case METRIC_MOTOR_UNIT:
+    return "motorUnit";
+  case METRIC_RA_DYNAMIC:
+    return "raDynamic";
+  case METRIC_DEC_DYNAMIC:
+    return "decDynamic";
+  case METRIC_WEB_STATUS:
+    return "webStatus";
+  case METRIC_WEB_HANDLER:
+    return "webHandler";
+  case METRIC_UDP_HANDLER:
+    return "udpHandler";
+  case METRIC_POSITION_STREAM:
+    return "positionStream";
+  case METRIC_ALPACA_HANDLER:
+    return "alpacaHandler";
+  case METRIC_ALPACA_DISCOVERY:
+    return "alpacaDiscovery";
+  case METRIC_LX200_HANDLER:
+    return "lx200Handler";
+  case METRIC_WEB_PUSH:
+    return "webPush";
+  default:
+    return "unknown";
+  }
+}
+
+void LoopMetrics::recordSince(LoopMetric metric, uint32_t start) {
+  // unsigned subtraction copes with the counter wrapping
+  uint32_t cycles = readCycleCounter() - start;
+  uint64_t ns = (uint64_t)cycles * 1000 / cyclesPerMicrosecond();
+  histograms[metric].record(ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns);
+}
+
+void LoopMetrics::reset() {
+  for (int i = 0; i < METRIC_COUNT; i++)
+    histograms[i].reset();
+}
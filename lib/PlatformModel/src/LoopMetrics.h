@@ -0,0 +1,57 @@
+#ifndef __LOOPMETRICS_H__
+#define __LOOPMETRICS_H__
+
+#include "CycleCounter.h"
+#include "LatencyHistogram.h"
+
+// What gets timed. Histograms are in nanoseconds.
+enum LoopMetric {
+  METRIC_LOOP_PERIOD = 0, // start of one main loop to the next
+  METRIC_BROADCAST_STATUS,
+  METRIC_MOTOR_UNIT,
+  METRIC_RA_DYNAMIC,
+  METRIC_DEC_DYNAMIC,
+  METRIC_WEB_STATUS,  // /getStatus, polled
+  METRIC_WEB_HANDLER, // every other web handler
+  METRIC_UDP_HANDLER,
+  METRIC_POSITION_STREAM,
+  METRIC_ALPACA_HANDLER,   // alpaca api, on the AsyncTCP task
+  METRIC_ALPACA_DISCOVERY, // alpaca discovery, on the AsyncUDP task
+  METRIC_LX200_HANDLER,
+  METRIC_WEB_PUSH, // status pushed to the web pages, see pushStatus
+  METRIC_COUNT
+};
+
+/**
+ * Latency histograms for the main loop and network handlers, served from
+ * /metrics. Shows worst case loop latency without a serial console.
+ */
+class LoopMetrics {
+public:
+  LatencyHistogram &get(LoopMetric metric) { return histograms[metric]; }
+  static const char *getName(LoopMetric metric);
+
+  // Record cycles elapsed since start
+  void recordSince(LoopMetric metric, uint32_t start);
+  void reset();
+
+private:
+  LatencyHistogram histograms[METRIC_COUNT];
+};
+
+/**
+ * Times its own scope into a metric.
+ */
+class MetricTimer {
+public:
+  MetricTimer(LoopMetrics &m, LoopMetric which)
+      : metrics(m), metric(which), start(readCycleCounter()) {}
+  ~MetricTimer() { metrics.recordSince(metric, start); }
+
+private:
+  LoopMetrics &metrics;
+  LoopMetric metric;
+  uint32_t start;
+};
+
+#endif // __LOOPMETRICS_H__
@@ -0,0 +1,225 @@
+#include "Lx200Session.h"
+#include "Logging.h"
+#include <cstring>
+
+#define LX200_ACK 0x06
+#define LX200_PRODUCT "FrankenDob#"
+#define LX200_VERSION "1.0#"
+
+Lx200Session::Lx200Session(RAStatic &raStatic, DecStatic &decStatic,
+                           CommandMailbox &mailbox)
+    : raStatic(raStatic), decStatic(decStatic), mailbox(mailbox),
+      commands(0), unknown(0) {
+  reset();
+}
+
+void Lx200Session::reset() {
+  commandLength = 0;
+  inCommand = false;
+  overflow = false;
+  rate = LX200_RATE_CENTER;
+  moving[AXIS_RA] = false;
+  moving[AXIS_DEC] = false;
+}
+
+Lx200Rate Lx200Session::getRate() { return rate; }
+
+uint32_t Lx200Session::getCommands() { return commands; }
+
+uint32_t Lx200Session::getUnknown() { return unknown; }
+
+// Append a reply if it fits
+static void addReply(const char *text, char *reply, size_t size,
+                     size_t &replyLength) {
+  size_t length = strlen(text);
+  if (replyLength + length > size) {
+    LOG_WARN(LOG_NET, "LX200 reply dropped, buffer full");
+    return;
+  }
+  memcpy(reply + replyLength, text, length);
+  replyLength += length;
+}
+
+// Direction letter as a pulseguide direction, -1 if not one
+static int parseDirection(char c) {
+  switch (c) {
+  case 'n':
+    return 0;
+  case 's':
+    return 1;
+  case 'e':
+    return 2;
+  case 'w':
+    return 3;
+  default:
+    return -1;
+  }
+}
+
+static int directionAxis(int direction) {
+  return direction < 2 ? AXIS_DEC : AXIS_RA;
+}
+
+// Sign of a moveAxis rate that moves as a pulse in this direction does
+static int directionSign(int direction) {
+  // north pulses drive dec towards 0, east ones slow ra tracking
+  return direction == 0 || direction == 3 ? -1 : 1;
+}
+
+size_t Lx200Session::feed(const uint8_t *data, size_t length,
+                          unsigned long nowMicros, char *reply,
+                          size_t size) {
+  size_t replyLength = 0;
+  for (size_t i = 0; i < length; i++) {
+    char c = data[i];
+    if (!inCommand) {
+      if (c == ':') {
+        inCommand = true;
+        commandLength = 0;
+        overflow = false;
+      } else if (c == LX200_ACK) {
+        addReply("P", reply, size, replyLength);
+        commands++;
+      }
+      // anything else between commands is noise
+      continue;
+    }
+    if (c == '#') {
+      inCommand = false;
+      if (overflow) {
+        unknown++;
+        continue;
+      }
+      execute(nowMicros, reply, size, replyLength);
+      continue;
+    }
+    if (c == ':') {
+      // last one never finished, start again
+      commandLength = 0;
+      overflow = false;
+      continue;
+    }
+    if (commandLength < LX200_COMMAND_BYTES)
+      command[commandLength++] = c;
+    else
+      overflow = true;
+  }
+  return replyLength;
+}
+
+double Lx200Session::getRateDegreesSec(int axis) {
+  MotorStatic *model = &raStatic;
+  if (axis == AXIS_DEC)
+    model = &decStatic;
+  double maximum = model->getMaxAxisMoveRateDegreesSec();
+  double degreesPerSecond;
+  switch (rate) {
+  case LX200_RATE_GUIDE:
+    return model->getGuideRateDegreesSec();
+  case LX200_RATE_CENTER:
+    degreesPerSecond =
+        LX200_CENTER_RATE_SIDEREAL * raStatic.getTrackingRateDegreesSec();
+    break;
+  case LX200_RATE_FIND:
+    degreesPerSecond =
+        LX200_FIND_RATE_SIDEREAL * raStatic.getTrackingRateDegreesSec();
+    break;
+  default:
+    degreesPerSecond = maximum;
+    break;
+  }
+  return degreesPerSecond < maximum ? degreesPerSecond : maximum;
+}
+
+void Lx200Session::move(int axis, int sign, unsigned long nowMicros) {
+  mailbox.post(COMMAND_SOURCE_WEB,
+               MotorCommand::moveAxis(axis, sign * getRateDegreesSec(axis)),
+               nowMicros);
+  moving[axis] = true;
+}
+
+void Lx200Session::stop(int axis, unsigned long nowMicros) {
+  mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::moveAxis(axis, 0),
+               nowMicros);
+  moving[axis] = false;
+}
+
+void Lx200Session::disconnect(unsigned long nowMicros) {
+  for (int axis = AXIS_RA; axis <= AXIS_DEC; axis++) {
+    if (moving[axis]) {
+      LOG_INFO(LOG_NET, "LX200 client gone while moving, stopping axis %d",
+               axis);
+      stop(axis, nowMicros);
+    }
+  }
+  reset();
+}
+
+void Lx200Session::execute(unsigned long nowMicros, char *reply, size_t size,
+                           size_t &replyLength) {
+  const char *c = command;
+  int length = commandLength;
+  int direction = length >= 2 ? parseDirection(c[1]) : -1;
+  bool handled = true;
+
+  if (length >= 4 && c[0] == 'M' && c[1] == 'g') {
+    // :Mg[nsew]DDDD#
+    direction = parseDirection(c[2]);
+    long duration = 0;
+    for (int i = 3; i < length && handled; i++) {
+      if (c[i] < '0' || c[i] > '9')
+        handled = false;
+      duration = duration * 10 + (c[i] - '0');
+    }
+    if (direction < 0 || length > 8)
+      handled = false;
+    if (handled)
+      mailbox.post(COMMAND_SOURCE_WEB,
+                   MotorCommand::pulseGuide(direction, duration), nowMicros);
+  } else if (length == 2 && c[0] == 'M' && direction >= 0) {
+    move(directionAxis(direction), directionSign(direction), nowMicros);
+  } else if (length == 1 && c[0] == 'Q') {
+    stop(AXIS_RA, nowMicros);
+    stop(AXIS_DEC, nowMicros);
+  } else if (length == 2 && c[0] == 'Q' && direction >= 0) {
+    stop(directionAxis(direction), nowMicros);
+  } else if (length == 2 && c[0] == 'R') {
+    switch (c[1]) {
+    case 'G':
+      rate = LX200_RATE_GUIDE;
+      break;
+    case 'C':
+      rate = LX200_RATE_CENTER;
+      break;
+    case 'M':
+      rate = LX200_RATE_FIND;
+      break;
+    case 'S':
+      rate = LX200_RATE_SLEW;
+      break;
+    default:
+      handled = false;
+    }
+  } else if (length == 2 && c[0] == 'T' && (c[1] == 'e' || c[1] == 'd')) {
+    mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::track(c[1] == 'e'),
+                 nowMicros);
+    addReply("1", reply, size, replyLength);
+  } else if (length == 3 && memcmp(c, "GVP", 3) == 0) {
+    addReply(LX200_PRODUCT, reply, size, replyLength);
+  } else if (length == 3 && memcmp(c, "GVN", 3) == 0) {
+    addReply(LX200_VERSION, reply, size, replyLength);
+  } else if (length == 2 && memcmp(c, "GR", 2) == 0) {
+    addReply("00:00:00#", reply, size, replyLength);
+  } else if (length == 2 && memcmp(c, "GD", 2) == 0) {
+    addReply("+00*00:00#", reply, size, replyLength);
+  } else {
+    handled = false;
+  }
+
+  if (handled) {
+    commands++;
+  } else {
+    unknown++;
+    LOG_DEBUG(LOG_NET, "Skipping LX200 command :%.*s#", length, c);
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef __LX200SESSION_H__
+#define __LX200SESSION_H__
+
+#include "CommandMailbox.h"
+#include "DecStatic.h"
+#include "RAStatic.h"
+#include <cstddef>
+#include <cstdint>
+
+// TCP port guiders and planetarium apps expect an LX200 bridge on
+#define LX200_PORT 4030
+// Longest command between ':' and '#' we look at. Longer ones are dropped.
+#define LX200_COMMAND_BYTES 16
+// Room for the replies to one read. Only queries reply, and clients wait
+// for each answer, so this is plenty.
+#define LX200_REPLY_BYTES 64
+// :RC# and :RM# rates, in multiples of sidereal. :RS# is the axis maximum.
+#define LX200_CENTER_RATE_SIDEREAL 8
+#define LX200_FIND_RATE_SIDEREAL 64
+
+enum Lx200Rate {
+  LX200_RATE_GUIDE = 0, // :RG#
+  LX200_RATE_CENTER,    // :RC#
+  LX200_RATE_FIND,      // :RM#
+  LX200_RATE_SLEW       // :RS#
+};
+
+/**
+ * One client's Meade LX200 connection, for guiding over TCP: the subset
+ * capture programs use to pulse guide and nudge (:Mg, :M, :Q, :R), plus
+ * the queries they send on connect.
+ *
+ *   :Mg[nsew]DDDD#  pulse guide for DDDD ms
+ *   :M[nsew]#       move at the current rate until :Q#
+ *   :Q#  :Q[nsew]#  stop both axes, or one
+ *   :RG# :RC# :RM# :RS#  guide, center, find or slew rate for :M
+ *   :Te# :Td#       tracking on, off (replies 1)
+ *   :GVP# :GVN#     product name, version
+ *   :GR# :GD#       RA and Dec. The platform doesn't know where it's
+ *                   pointing, so zero, for clients that insist on asking.
+ *   ACK (0x06)      alignment: P for polar
+ *
+ * Bytes are fed as they arrive, in any split; commands are parsed in a
+ * fixed buffer and posted to the mailbox, so a session never allocates.
+ * Unknown commands are skipped. North and east are the directions a north
+ * or east pulse moves each axis.
+ *
+ * Not thread safe: one task feeds it (AsyncTCP on the platform).
+ */
+class Lx200Session {
+public:
+  Lx200Session(RAStatic &raStatic, DecStatic &decStatic,
+               CommandMailbox &mailbox);
+
+  // Ready for a new connection
+  void reset();
+
+  /**
+   * Parse received bytes, posting commands. Replies to any queries are
+   * written to reply; returns their length. Replies that don't fit in
+   * size are dropped.
+   */
+  size_t feed(const uint8_t *data, size_t length, unsigned long nowMicros,
+              char *reply, size_t size);
+
+  // The client went away: stop any :M move it left running
+  void disconnect(unsigned long nowMicros);
+
+  Lx200Rate getRate();
+  // Commands handled, and ones skipped as unknown, since construction
+  uint32_t getCommands();
+  uint32_t getUnknown();
+
+private:
+  void execute(unsigned long nowMicros, char *reply, size_t size,
+               size_t &replyLength);
+  void move(int axis, int sign, unsigned long nowMicros);
+  void stop(int axis, unsigned long nowMicros);
+  double getRateDegreesSec(int axis);
+
+  RAStatic &raStatic;
+  DecStatic &decStatic;
+  CommandMailbox &mailbox;
+
+  char command[LX200_COMMAND_BYTES];
+  int commandLength;
+  bool inCommand;
+  bool overflow;
+  Lx200Rate rate;
+  // Axes moving from :M, so a disconnect can stop them
+  bool moving[2];
+  uint32_t commands;
+  uint32_t unknown;
+};
+
+#endif // __LX200SESSION_H__
@@ -0,0 +1,143 @@
+#include "MotionTrace.h"
+#include <cstring>
+
+MotionTrace::MotionTrace() {
+  clock = nullptr;
+  reset();
+}
+
+void MotionTrace::setClock(Clock *c) { clock = c; }
+
+void MotionTrace::reset() {
+  next.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < MOTION_TRACE_EVENTS; i++)
+    slots[i].stamp.store(0, std::memory_order_relaxed);
+}
+
+void MotionTrace::record(uint8_t axis, MotionEventType type,
+                         int32_t position, int32_t target,
+                         uint32_t speedInMilliHz) {
+  uint32_t sequence = next.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[sequence & (MOTION_TRACE_EVENTS - 1)];
+  // mark as being written before touching the event
+  slot.stamp.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  MotionEvent &event = slot.event;
+  event.timeMicros = clock != nullptr ? (uint32_t)clock->nowMicros() : 0;
+  event.sequence = sequence;
+  event.position = position;
+  event.target = target;
+  event.speedInMilliHz = speedInMilliHz;
+  event.axis = axis;
+  event.type = type;
+  slot.stamp.store(sequence + 1, std::memory_order_release);
+}
+
+uint32_t MotionTrace::getRecorded() {
+  return next.load(std::memory_order_acquire);
+}
+
+bool MotionTrace::read(uint32_t sequence, MotionEvent &event) {
+  Slot &slot = slots[sequence & (MOTION_TRACE_EVENTS - 1)];
+  if (slot.stamp.load(std::memory_order_acquire) != sequence + 1)
+    return false;
+  event = slot.event;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // a writer may have started on the slot while we copied
+  return slot.stamp.load(std::memory_order_relaxed) == sequence + 1;
+}
+
+static void putU16(uint8_t *out, uint16_t v) {
+  out[0] = v;
+  out[1] = v >> 8;
+}
+
+static void putU32(uint8_t *out, uint32_t v) {
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+static uint32_t getU32(const uint8_t *in) {
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+         ((uint32_t)in[3] << 24);
+}
+
+void encodeMotionTraceHeader(uint8_t *out, uint32_t count, uint32_t first) {
+  memcpy(out, MOTION_TRACE_MAGIC, 4);
+  putU16(out + 4, MOTION_TRACE_VERSION);
+  putU16(out + 6, MOTION_TRACE_RECORD_BYTES);
+  putU32(out + 8, count);
+  putU32(out + 12, first);
+}
+
+void encodeMotionEvent(const MotionEvent &event, uint8_t *out) {
+  putU32(out, event.timeMicros);
+  putU32(out + 4, event.sequence);
+  putU32(out + 8, (uint32_t)event.position);
+  putU32(out + 12, (uint32_t)event.target);
+  putU32(out + 16, event.speedInMilliHz);
+  out[20] = event.axis;
+  out[21] = event.type;
+  putU16(out + 22, 0);
+}
+
+void decodeMotionEvent(const uint8_t *in, MotionEvent &event) {
+  event.timeMicros = getU32(in);
+  event.sequence = getU32(in + 4);
+  event.position = (int32_t)getU32(in + 8);
+  event.target = (int32_t)getU32(in + 12);
+  event.speedInMilliHz = getU32(in + 16);
+  event.axis = in[20];
+  event.type = in[21];
+}
+
+MotionTraceReader::MotionTraceReader(MotionTrace &t) : trace(t) {
+  uint32_t recorded = trace.getRecorded();
+  first = recorded > MOTION_TRACE_EVENTS ? recorded - MOTION_TRACE_EVENTS : 0;
+  count = recorded - first;
+}
+
+size_t MotionTraceReader::getSize() {
+  return MOTION_TRACE_HEADER_BYTES + (size_t)count * MOTION_TRACE_RECORD_BYTES;
+}
+
+size_t MotionTraceReader::read(uint8_t *buffer, size_t maxLen,
+                               size_t offset) {
+  size_t size = getSize();
+  size_t written = 0;
+  uint8_t piece[MOTION_TRACE_RECORD_BYTES];
+  while (written < maxLen && offset < size) {
+    // encode whichever header or record covers offset, copy what fits
+    size_t pieceStart;
+    size_t pieceLength;
+    if (offset < MOTION_TRACE_HEADER_BYTES) {
+      encodeMotionTraceHeader(piece, count, first);
+      pieceStart = 0;
+      pieceLength = MOTION_TRACE_HEADER_BYTES;
+    } else {
+      size_t index =
+          (offset - MOTION_TRACE_HEADER_BYTES) / MOTION_TRACE_RECORD_BYTES;
+      MotionEvent event;
+      uint32_t sequence = first + index;
+      if (!trace.read(sequence, event)) {
+        memset(&event, 0, sizeof(event));
+        event.sequence = sequence;
+        event.type = MOTION_EVENT_LOST;
+      }
+      encodeMotionEvent(event, piece);
+      pieceStart =
+          MOTION_TRACE_HEADER_BYTES + index * MOTION_TRACE_RECORD_BYTES;
+      pieceLength = MOTION_TRACE_RECORD_BYTES;
+    }
+    size_t from = offset - pieceStart;
+    size_t n = pieceLength - from;
+    if (n > maxLen - written)
+      n = maxLen - written;
+    memcpy(buffer + written, piece + from, n);
+    written += n;
+    offset += n;
+  }
+  return written;
+}
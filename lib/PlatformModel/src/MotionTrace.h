@@ -0,0 +1,115 @@
+#ifndef __MOTIONTRACE_H__
+#define __MOTIONTRACE_H__
+
+#include "Clock.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Events kept. Must be a power of two. 24 bytes each.
+#define MOTION_TRACE_EVENTS 1024
+
+// Download layout, all little endian. Header then MOTION_TRACE_EVENTS
+// or fewer records, oldest first.
+#define MOTION_TRACE_MAGIC "EQTR"
+#define MOTION_TRACE_VERSION 1
+#define MOTION_TRACE_HEADER_BYTES 16
+#define MOTION_TRACE_RECORD_BYTES 24
+
+// Axis for events that aren't about one axis (eg buttons)
+#define MOTION_TRACE_NO_AXIS 255
+
+enum MotionEventType {
+  MOTION_EVENT_LOST = 0,         // overwritten while being downloaded
+  MOTION_EVENT_MOVE_TO,          // stepper move (target, speed)
+  MOTION_EVENT_SET_SPEED,        // stepper speed change, no new target
+  MOTION_EVENT_STREAM,           // stepper queueing steps at speed
+  MOTION_EVENT_STOP,             // stepper decelerating to stop
+  MOTION_EVENT_RESET_POSITION,   // stepper position set to target
+  MOTION_EVENT_GOTO,             // axis given a new target
+  MOTION_EVENT_ARRIVED,          // axis reached its target
+  MOTION_EVENT_LIMIT_HIT,
+  MOTION_EVENT_LIMIT_RELEASED,
+  MOTION_EVENT_PULSE_START,      // target is duration in ms
+  MOTION_EVENT_PULSE_END,
+  MOTION_EVENT_PULSE_CANCEL,
+  MOTION_EVENT_BUTTON_PUSHED,    // position is the PlatformInput, target
+                                 // the RA position
+  MOTION_EVENT_BUTTON_RELEASED,
+  MOTION_EVENT_TYPE_COUNT
+};
+
+struct MotionEvent {
+  uint32_t timeMicros; // wraps every ~71 minutes, decoder unwraps
+  uint32_t sequence;
+  int32_t position;
+  int32_t target;
+  uint32_t speedInMilliHz;
+  uint8_t axis;
+  uint8_t type;
+};
+
+/**
+ * Records motion events into a fixed RAM ring, so a bad night can be
+ * downloaded (/trace) and replayed after the fact. Recording is a clock
+ * read and a handful of stores, so it stays on all the time; the oldest
+ * events are overwritten.
+ *
+ * Safe to record from several tasks (loop and pulse timers). Readers
+ * check each slot's sequence so a slot rewritten mid read shows up as
+ * MOTION_EVENT_LOST rather than garbage.
+ */
+class MotionTrace {
+public:
+  MotionTrace();
+  void setClock(Clock *clock);
+
+  void record(uint8_t axis, MotionEventType type, int32_t position,
+              int32_t target, uint32_t speedInMilliHz);
+
+  // Total ever recorded, including overwritten
+  uint32_t getRecorded();
+
+  // Copy out event with this sequence. False if overwritten or not yet
+  // recorded.
+  bool read(uint32_t sequence, MotionEvent &event);
+
+  void reset();
+
+private:
+  struct Slot {
+    // sequence + 1 once written, 0 while being written
+    std::atomic<uint32_t> stamp;
+    MotionEvent event;
+  };
+
+  Clock *clock;
+  std::atomic<uint32_t> next;
+  Slot slots[MOTION_TRACE_EVENTS];
+};
+
+/**
+ * Streams a snapshot of a trace in the download layout, a piece at a
+ * time, so the web server doesn't need a copy of the whole buffer.
+ */
+class MotionTraceReader {
+public:
+  explicit MotionTraceReader(MotionTrace &trace);
+
+  size_t getSize();
+  // Fill buffer with up to maxLen bytes starting at offset. Returns bytes
+  // written, 0 at the end.
+  size_t read(uint8_t *buffer, size_t maxLen, size_t offset);
+
+private:
+  MotionTrace &trace;
+  uint32_t first;
+  uint32_t count;
+};
+
+// Fixed layout encoding, shared by the reader and host side decoder
+void encodeMotionTraceHeader(uint8_t *out, uint32_t count, uint32_t first);
+void encodeMotionEvent(const MotionEvent &event, uint8_t *out);
+void decodeMotionEvent(const uint8_t *in, MotionEvent &event);
+
+#endif // __MOTIONTRACE_H__
@@ -0,0 +1,167 @@
+#include "MotionTraceDecoder.h"
+#include "MotorCommand.h"
+#include <cstdio>
+#include <cstring>
+
+static const char *motionEventNames[MOTION_EVENT_TYPE_COUNT] = {
+    "lost",       "moveTo",        "setSpeed",   "stream",
+    "stop",       "resetPosition", "goto",       "arrived",
+    "limitHit",   "limitReleased", "pulseStart", "pulseEnd",
+    "pulseCancel", "buttonPushed", "buttonReleased"};
+
+const char *getMotionEventName(int type) {
+  if (type < 0 || type >= MOTION_EVENT_TYPE_COUNT)
+    return "unknown";
+  return motionEventNames[type];
+}
+
+static const char *axisName(int axis) {
+  if (axis == AXIS_RA)
+    return "RA";
+  if (axis == AXIS_DEC)
+    return "Dec";
+  return "Inputs";
+}
+
+bool decodeMotionTrace(const uint8_t *data, size_t size,
+                       std::vector<MotionEvent> &events) {
+  events.clear();
+  if (size < MOTION_TRACE_HEADER_BYTES ||
+      memcmp(data, MOTION_TRACE_MAGIC, 4) != 0)
+    return false;
+  int version = data[4] | (data[5] << 8);
+  int recordBytes = data[6] | (data[7] << 8);
+  if (version != MOTION_TRACE_VERSION ||
+      recordBytes != MOTION_TRACE_RECORD_BYTES)
+    return false;
+  uint32_t count = (uint32_t)data[8] | ((uint32_t)data[9] << 8) |
+                   ((uint32_t)data[10] << 16) | ((uint32_t)data[11] << 24);
+  // a truncated download still gives the events that made it
+  size_t available = (size - MOTION_TRACE_HEADER_BYTES) / recordBytes;
+  if (count > available)
+    count = available;
+  events.resize(count);
+  for (uint32_t i = 0; i < count; i++)
+    decodeMotionEvent(data + MOTION_TRACE_HEADER_BYTES + i * recordBytes,
+                      events[i]);
+  return true;
+}
+
+std::vector<uint64_t>
+unwrapMotionTraceTimes(const std::vector<MotionEvent> &events) {
+  std::vector<uint64_t> times(events.size());
+  uint64_t base = 0;
+  uint32_t start = 0;
+  uint32_t previous = 0;
+  bool started = false;
+  for (size_t i = 0; i < events.size(); i++) {
+    if (events[i].type == MOTION_EVENT_LOST) {
+      times[i] = i > 0 ? times[i - 1] : 0;
+      continue;
+    }
+    uint32_t t = events[i].timeMicros;
+    if (!started) {
+      start = t;
+      previous = t;
+      started = true;
+    }
+    // Events from different tasks can be a little out of order, so only
+    // a big jump backwards is a wrap
+    if (t < previous && previous - t > 0x80000000u)
+      base += 0x100000000ull;
+    previous = t;
+    times[i] = base + t - start;
+  }
+  return times;
+}
+
+std::string motionTraceToCsv(const std::vector<MotionEvent> &events) {
+  std::vector<uint64_t> times = unwrapMotionTraceTimes(events);
+  std::string csv = "timeMicros,sequence,axis,event,position,target,"
+                    "speedMilliHz\n";
+  char line[160];
+  for (size_t i = 0; i < events.size(); i++) {
+    const MotionEvent &e = events[i];
+    snprintf(line, sizeof(line), "%llu,%u,%s,%s,%ld,%ld,%lu\n",
+             (unsigned long long)times[i], (unsigned)e.sequence,
+             axisName(e.axis), getMotionEventName(e.type), (long)e.position,
+             (long)e.target, (unsigned long)e.speedInMilliHz);
+    csv += line;
+  }
+  return csv;
+}
+
+// Chrome thread id for an axis
+static int axisThread(int axis) {
+  return axis == AXIS_RA || axis == AXIS_DEC ? axis : 2;
+}
+
+std::string motionTraceToChromeJson(const std::vector<MotionEvent> &events) {
+  std::vector<uint64_t> times = unwrapMotionTraceTimes(events);
+  std::string json = "{\"traceEvents\":[";
+  char line[320];
+  // name the rows
+  for (int tid = 0; tid < 3; tid++) {
+    snprintf(line, sizeof(line),
+             "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+             "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+             tid == 0 ? "" : ",", tid,
+             axisName(tid == 2 ? MOTION_TRACE_NO_AXIS : tid));
+    json += line;
+  }
+  bool pulsing[2] = {false, false};
+  for (size_t i = 0; i < events.size(); i++) {
+    const MotionEvent &e = events[i];
+    if (e.type == MOTION_EVENT_LOST)
+      continue;
+    unsigned long long ts = times[i];
+    int tid = axisThread(e.axis);
+    snprintf(line, sizeof(line),
+             ",{\"name\":\"%s\",\"cat\":\"motion\",\"ph\":\"i\",\"s\":\"t\","
+             "\"ts\":%llu,\"pid\":1,\"tid\":%d,\"args\":{\"position\":%ld,"
+             "\"target\":%ld,\"speedMilliHz\":%lu}}",
+             getMotionEventName(e.type), ts, tid, (long)e.position,
+             (long)e.target, (unsigned long)e.speedInMilliHz);
+    json += line;
+    if (tid == 2)
+      continue;
+
+    // pulses as spans
+    if (e.type == MOTION_EVENT_PULSE_START && !pulsing[tid]) {
+      snprintf(line, sizeof(line),
+               ",{\"name\":\"pulse\",\"ph\":\"B\",\"ts\":%llu,\"pid\":1,"
+               "\"tid\":%d}",
+               ts, tid);
+      json += line;
+      pulsing[tid] = true;
+    } else if ((e.type == MOTION_EVENT_PULSE_END ||
+                e.type == MOTION_EVENT_PULSE_CANCEL) &&
+               pulsing[tid]) {
+      snprintf(line, sizeof(line),
+               ",{\"name\":\"pulse\",\"ph\":\"E\",\"ts\":%llu,\"pid\":1,"
+               "\"tid\":%d}",
+               ts, tid);
+      json += line;
+      pulsing[tid] = false;
+    }
+
+    // stepper speed and position as counters
+    if (e.type == MOTION_EVENT_MOVE_TO || e.type == MOTION_EVENT_SET_SPEED ||
+        e.type == MOTION_EVENT_STREAM || e.type == MOTION_EVENT_STOP) {
+      snprintf(line, sizeof(line),
+               ",{\"name\":\"%s speed\",\"ph\":\"C\",\"ts\":%llu,\"pid\":1,"
+               "\"args\":{\"milliHz\":%lu}}",
+               axisName(e.axis), ts,
+               e.type == MOTION_EVENT_STOP ? 0ul
+                                           : (unsigned long)e.speedInMilliHz);
+      json += line;
+    }
+    snprintf(line, sizeof(line),
+             ",{\"name\":\"%s position\",\"ph\":\"C\",\"ts\":%llu,\"pid\":1,"
+             "\"args\":{\"steps\":%ld}}",
+             axisName(e.axis), ts, (long)e.position);
+    json += line;
+  }
+  json += "]}\n";
+  return json;
+}
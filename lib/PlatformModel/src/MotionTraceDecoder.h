@@ -0,0 +1,27 @@
+#ifndef __MOTIONTRACEDECODER_H__
+#define __MOTIONTRACEDECODER_H__
+
+#include "MotionTrace.h"
+#include <string>
+#include <vector>
+
+/**
+ * Host side of MotionTrace: turns a /trace download into CSV, or Chrome
+ * trace event JSON (load in chrome://tracing or ui.perfetto.dev). Used by
+ * tools/decode_trace.cpp and the native tests.
+ */
+
+// Parse a download. False if it isn't a trace this version understands.
+bool decodeMotionTrace(const uint8_t *data, size_t size,
+                       std::vector<MotionEvent> &events);
+
+// Microseconds since the first event, with 32 bit clock wraps undone
+std::vector<uint64_t>
+unwrapMotionTraceTimes(const std::vector<MotionEvent> &events);
+
+const char *getMotionEventName(int type);
+
+std::string motionTraceToCsv(const std::vector<MotionEvent> &events);
+std::string motionTraceToChromeJson(const std::vector<MotionEvent> &events);
+
+#endif // __MOTIONTRACEDECODER_H__
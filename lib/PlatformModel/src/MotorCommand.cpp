@@ -0,0 +1,56 @@
+#include "MotorCommand.h"
+
+static MotorCommand makeCommand(MotorCommandType type, int axis,
+                                double value) {
+  MotorCommand c;
+  c.type = type;
+  c.axis = axis;
+  c.direction = 0;
+  c.value = value;
+  c.durationMillis = 0;
+  c.postedMicros = 0;
+  c.sequence = 0;
+  c.executeAtMicros = 0;
+  return c;
+}
+
+MotorCommand MotorCommand::gotoStart(int axis) {
+  return makeCommand(MOTOR_COMMAND_GOTO_START, axis, 0);
+}
+
+MotorCommand MotorCommand::gotoMiddle(int axis) {
+  return makeCommand(MOTOR_COMMAND_GOTO_MIDDLE, axis, 0);
+}
+
+MotorCommand MotorCommand::gotoEnd(int axis) {
+  return makeCommand(MOTOR_COMMAND_GOTO_END, axis, 0);
+}
+
+MotorCommand MotorCommand::track(bool on) {
+  return makeCommand(MOTOR_COMMAND_TRACK, AXIS_RA, on ? 1 : 0);
+}
+
+MotorCommand MotorCommand::moveAxis(int axis, double degreesPerSecond) {
+  return makeCommand(MOTOR_COMMAND_MOVE_AXIS, axis, degreesPerSecond);
+}
+
+MotorCommand MotorCommand::moveAxisPercentage(int axis, double percentage) {
+  return makeCommand(MOTOR_COMMAND_MOVE_AXIS_PERCENTAGE, axis, percentage);
+}
+
+MotorCommand MotorCommand::slewByDegrees(int axis, double degrees) {
+  return makeCommand(MOTOR_COMMAND_SLEW_BY_DEGREES, axis, degrees);
+}
+
+// East/west guide RA, north/south guide dec.
+MotorCommand MotorCommand::pulseGuide(int direction, long durationMillis) {
+  MotorCommand c = makeCommand(MOTOR_COMMAND_PULSE_GUIDE,
+                               direction >= 2 ? AXIS_RA : AXIS_DEC, 0);
+  c.direction = direction;
+  c.durationMillis = durationMillis;
+  return c;
+}
+
+MotorCommand MotorCommand::trackingMode(int mode) {
+  return makeCommand(MOTOR_COMMAND_TRACKING_MODE, AXIS_RA, mode);
+}
@@ -0,0 +1,51 @@
+#ifndef __MOTORCOMMAND_H__
+#define __MOTORCOMMAND_H__
+
+#include <cstdint>
+
+// Axis numbers, as used by alpaca
+#define AXIS_RA 0
+#define AXIS_DEC 1
+
+enum MotorCommandType {
+  MOTOR_COMMAND_GOTO_START,
+  MOTOR_COMMAND_GOTO_MIDDLE,
+  MOTOR_COMMAND_GOTO_END,
+  MOTOR_COMMAND_TRACK,                // value > 0 turns tracking on
+  MOTOR_COMMAND_MOVE_AXIS,            // value is degrees per second
+  MOTOR_COMMAND_MOVE_AXIS_PERCENTAGE, // value is -100 to 100
+  MOTOR_COMMAND_SLEW_BY_DEGREES,      // value is degrees
+  MOTOR_COMMAND_PULSE_GUIDE,          // direction and durationMillis
+  MOTOR_COMMAND_TRACKING_MODE         // value is a TrackingMode
+};
+
+/**
+ * An external command (web ui, network) for the motion loop. Plain data so
+ * it can be copied through a CommandMailbox between tasks.
+ */
+struct MotorCommand {
+  MotorCommandType type;
+  int axis;
+  // Pulseguide direction: 0 = north, 1 = south, 2 = east, 3 = west
+  int direction;
+  double value;
+  long durationMillis;
+  // Set by the mailbox when posted, for latency stats
+  unsigned long postedMicros;
+  // Set by the mailbox when posted, orders commands from one source
+  uint32_t sequence;
+  // When to apply it, in loop clock micros. 0 for as soon as possible.
+  uint64_t executeAtMicros;
+
+  static MotorCommand gotoStart(int axis);
+  static MotorCommand gotoMiddle(int axis);
+  static MotorCommand gotoEnd(int axis);
+  static MotorCommand track(bool on);
+  static MotorCommand moveAxis(int axis, double degreesPerSecond);
+  static MotorCommand moveAxisPercentage(int axis, double percentage);
+  static MotorCommand slewByDegrees(int axis, double degrees);
+  static MotorCommand pulseGuide(int direction, long durationMillis);
+  static MotorCommand trackingMode(int mode);
+};
+
+#endif // __MOTORCOMMAND_H__
@@ -9,29 +9,15 @@ bool MotorDynamic::isSafetyModeOn() { return safetyMode; }
 
 long MotorDynamic::onLoop() {
 
-  // If pulse guide is in progress, then exit.
-  if (isPulseGuiding) {
-    return 0;
-  }
-
-  // Pulseguide command has been queued. Apply new motor
-  // speed, and ask client to call back after pulseguide milliseconds.
-  // Second call should fall through and resume tracking speed.
-  if (pulseGuideDurationMillis > 0) {
-    stepperWrapper->setStepperSpeed(targetSpeedInMilliHz);
-    stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
-    long delay = pulseGuideDurationMillis;
-    pulseGuideDurationMillis = 0;
-    isPulseGuiding = true;
-    log("Returning after pulse");
-    return delay; // caller will call back right after delay.
-  }
-
+  // Limit switch is handled first, even mid pulse: a pulse is abandoned
+  // rather than let it drive into the limit.
   // when limit hit, turn around and move towards end
   if (limitJustHit) {
     limitJustHit = false;
     isMoveQueued=false;
-    log("Limit is hit. Moving off limit switch");
+    cancelPulse();
+    LOG_INFO(logModule, "Limit is hit. Moving off limit switch");
+    traceEvent(MOTION_EVENT_LIMIT_HIT, 0);
     stepperWrapper->moveTo(0, model.getRewindFastFowardSpeedInMilliHz() /
                                   SAFETY_RATIO);
     return 0;
@@ -42,12 +28,36 @@ long MotorDynamic::onLoop() {
     isExecutingMove = false;
     limitJustReleased = false;
     safetyMode = false;
-    log("Limit is released. Resetting position");
+    cancelPulse();
+    LOG_INFO(logModule, "Limit is released. Resetting position");
+    traceEvent(MOTION_EVENT_LIMIT_RELEASED, model.getLimitPosition());
     // this should stop motor and reset
     stepperWrapper->resetPosition(model.getLimitPosition());
     return 0;
   }
 
+  applyPulseTimers();
+
+  // If pulse guide is in progress, then exit.
+  if (isPulseGuiding) {
+    return 0;
+  }
+
+  // Pulseguide command has been queued. Apply new motor
+  // speed, and ask client to call back after pulseguide milliseconds.
+  // Second call should fall through and resume tracking speed.
+  // With a timer service the pulse is already on its way from a timer.
+  if (pulseGuideDurationMillis > 0 && timerService == nullptr) {
+    stepperWrapper->setStepperSpeed(targetSpeedInMilliHz);
+    stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
+    long delay = pulseGuideDurationMillis;
+    pulseGuideDurationMillis = 0;
+    isPulseGuiding = true;
+    traceEvent(MOTION_EVENT_PULSE_START, delay);
+    LOG_DEBUG(logModule, "Returning after pulse");
+    return delay; // caller will call back right after delay.
+  }
+
   // handle limit switch
 
   // // If we were moving towards limit switch, we should stop.
@@ -68,10 +78,11 @@ long MotorDynamic::onLoop() {
   int32_t pos = stepperWrapper->getPosition();
 
   if (isMoveQueued) {
-    log("In loop, and move is queued. Pos is %ld and target is %ld", pos,
-        targetPosition);
+    LOG_TRACE(logModule,
+              "In loop, and move is queued. Pos is %ld and target is %ld",
+              (long)pos, (long)targetPosition);
     if (pos != targetPosition) {
-      log("Pushing queued move to motor");
+      LOG_DEBUG(logModule, "Pushing queued move to motor");
       stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
       isMoveQueued = false;
     }
@@ -87,22 +98,26 @@ long MotorDynamic::onLoop() {
     // assume the move is a move towards the safety.
     // Set new position and much lower speed
     if (pos == model.getLimitSwitchSafetyStandoffPosition()) {
-      log("Standoff position (%ld) reached. Slowing down to find limit", pos);
+      LOG_INFO(logModule,
+               "Standoff position (%ld) reached. Slowing down to find limit",
+               (long)pos);
       targetPosition = INT32_MAX;
       targetSpeedInMilliHz =
           model.getRewindFastFowardSpeedInMilliHz() / SAFETY_RATIO;
+      traceEvent(MOTION_EVENT_GOTO, targetPosition);
       stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
       return 0;
     }
     // we've arrived. Move gets stopped below.
-    log("Arrived at target position %ld", pos);
+    LOG_INFO(logModule, "Arrived at target position %ld", (long)pos);
+    traceEvent(MOTION_EVENT_ARRIVED, targetPosition);
     isExecutingMove = false;
     isMoveQueued = false;
     stopMove = true;
   }
 
   if (stopMove) {
-    log("Stopmove flipped");
+    LOG_TRACE(logModule, "Stopmove flipped");
     stopMove = false;
   }
   // log("Stop or track fallthrough");
@@ -117,8 +132,9 @@ void MotorDynamic::gotoMiddle() {
   targetPosition = model.getMiddlePosition();
 
   targetSpeedInMilliHz = model.getRewindFastFowardSpeedInMilliHz();
-  log("goto middle: target %ld speed %lu", targetPosition,
-      targetSpeedInMilliHz);
+  LOG_INFO(logModule, "goto middle: target %ld speed %lu",
+           (long)targetPosition, (unsigned long)targetSpeedInMilliHz);
+  traceEvent(MOTION_EVENT_GOTO, targetPosition);
   isExecutingMove = true;
   isMoveQueued = true;
 }
@@ -128,7 +144,9 @@ void MotorDynamic::gotoEndish() {
   targetPosition = model.getGotoEndPosition();
 
   targetSpeedInMilliHz = model.getRewindFastFowardSpeedInMilliHz();
-  log("goto end: target %ld speed:%lu", targetPosition, targetSpeedInMilliHz);
+  LOG_INFO(logModule, "goto end: target %ld speed:%lu", (long)targetPosition,
+           (unsigned long)targetSpeedInMilliHz);
+  traceEvent(MOTION_EVENT_GOTO, targetPosition);
   isExecutingMove = true;
   isMoveQueued = true;
 }
@@ -136,7 +154,7 @@ void MotorDynamic::gotoEndish() {
 void MotorDynamic::gotoStart() {
   // should run until limit switch hit
   targetPosition = model.getLimitSwitchSafetyStandoffPosition();
-  log("goto start: target %ld ", targetPosition);
+  LOG_INFO(logModule, "goto start: target %ld ", (long)targetPosition);
   // int32_t limitPos = model.getLimitPosition();
   // when limit not known, find it slowly
   if (safetyMode)
@@ -144,6 +162,7 @@ void MotorDynamic::gotoStart() {
         model.getRewindFastFowardSpeedInMilliHz() / SAFETY_RATIO;
   else
     targetSpeedInMilliHz = model.getRewindFastFowardSpeedInMilliHz();
+  traceEvent(MOTION_EVENT_GOTO, targetPosition);
   isExecutingMove = true;
   isMoveQueued = true;
 }
@@ -166,13 +185,149 @@ MotorDynamic::MotorDynamic(MotorStatic &m) : model(m) {
   isPulseGuiding = false;
   limitJustReleased=false;
   limitJustHit=false;
+  safetyMode = false;
+  logModule = LOG_MOTOR;
+  stepperWrapper = nullptr;
+  timerService = nullptr;
+  motionTrace = nullptr;
+  traceAxis = MOTION_TRACE_NO_AXIS;
+  pulseStartTimer = -1;
+  pulseStopTimer = -1;
+  nextPulseStartMicros = 0;
+  pulseRequestedMicros = 0;
+  pulseStopDueMicros = 0;
+  pulseStartFired = false;
+  pulseStopFired = false;
+}
+
+void MotorDynamic::setTimerService(TimerService *timers) {
+  timerService = timers;
+  pulseStartTimer = timers->createTimer(pulseStartCallback, this, "pulseStart");
+  pulseStopTimer = timers->createTimer(pulseStopCallback, this, "pulseStop");
+  if (pulseStartTimer < 0 || pulseStopTimer < 0) {
+    LOG_WARN(logModule,
+             "Could not create pulse timers, pulses will be timed by loop");
+    timerService = nullptr;
+  }
+}
+
+void MotorDynamic::setMotionTrace(MotionTrace *trace, uint8_t axis) {
+  motionTrace = trace;
+  traceAxis = axis;
+}
+
+void MotorDynamic::traceEvent(MotionEventType type, int32_t target) {
+  if (motionTrace == nullptr || stepperWrapper == nullptr)
+    return;
+  motionTrace->record(traceAxis, type, stepperWrapper->getPosition(), target,
+                      targetSpeedInMilliHz);
+}
+
+TimingStats &MotorDynamic::getPulseStartErrorStats() { return pulseStartError; }
+
+TimingStats &MotorDynamic::getPulseStopErrorStats() { return pulseStopError; }
+
+void MotorDynamic::setNextPulseStartMicros(uint64_t startMicros) {
+  nextPulseStartMicros = startMicros;
+}
+
+void MotorDynamic::schedulePulse() {
+  uint64_t startMicros = nextPulseStartMicros;
+  nextPulseStartMicros = 0;
+  if (timerService == nullptr || pulseGuideDurationMillis <= 0)
+    return;
+  uint64_t now = timerService->nowMicros();
+  uint64_t delay = startMicros > now ? startMicros - now : 0;
+  // start error is measured from when it was asked to start
+  pulseRequestedMicros = now + delay;
+  pulseSpeedInMilliHz = targetSpeedInMilliHz;
+  pulseTargetPosition = targetPosition;
+  // A new pulse replaces one in progress, as the loop path does.
+  timerService->stop(pulseStopTimer);
+  pulseStopFired = false;
+  if (delay == 0) {
+    // already on the loop, so no need to wait for a timer
+    timerService->stop(pulseStartTimer);
+    pulseStartFired = false;
+    startTimedPulse();
+    return;
+  }
+  timerService->startOnce(pulseStartTimer, delay);
+}
+
+// Timer callbacks run on the timer task, so only flag the loop
+void MotorDynamic::pulseStartCallback(void *arg) {
+  ((MotorDynamic *)arg)->pulseStartFired = true;
+}
+
+void MotorDynamic::pulseStopCallback(void *arg) {
+  ((MotorDynamic *)arg)->pulseStopFired = true;
+}
+
+void MotorDynamic::applyPulseTimers() {
+  if (timerService == nullptr)
+    return;
+  bool startFired = pulseStartFired.exchange(false);
+  bool stopFired = pulseStopFired.exchange(false);
+  if (!startFired && !stopFired)
+    return;
+  uint64_t now = timerService->nowMicros();
+  // A timer can fire just as its pulse is cancelled or replaced, so only
+  // act once the pulse we have is due. Its own timer is still to come.
+  if (startFired && pulseGuideDurationMillis > 0 &&
+      now >= pulseRequestedMicros)
+    startTimedPulse();
+  if (stopFired && isPulseGuiding && now >= pulseStopDueMicros) {
+    stopPulse();
+    pulseStopError.record(now - pulseStopDueMicros);
+  }
+}
+
+void MotorDynamic::startTimedPulse() {
+  uint64_t now = timerService->nowMicros();
+  long duration = pulseGuideDurationMillis;
+  if (duration <= 0)
+    return; // cancelled before timer fired
+  pulseGuideDurationMillis = 0;
+  stepperWrapper->setStepperSpeed(pulseSpeedInMilliHz);
+  stepperWrapper->moveTo(pulseTargetPosition, pulseSpeedInMilliHz);
+  isPulseGuiding = true;
+  traceEvent(MOTION_EVENT_PULSE_START, duration);
+  // duration runs from when the pulse actually started
+  pulseStopDueMicros = now + (uint64_t)duration * 1000;
+  timerService->startOnce(pulseStopTimer, (uint64_t)duration * 1000);
+  pulseStartError.record(now - pulseRequestedMicros);
+}
+
+bool MotorDynamic::isPulseGuideInProgress() {
+  return isPulseGuiding || pulseGuideDurationMillis > 0;
+}
+
+void MotorDynamic::cancelPulse() {
+  if (timerService != nullptr) {
+    timerService->stop(pulseStartTimer);
+    timerService->stop(pulseStopTimer);
+    pulseStartFired = false;
+    pulseStopFired = false;
+  }
+  if (isPulseGuiding || pulseGuideDurationMillis > 0) {
+    LOG_DEBUG(logModule, "Pulse guide cancelled");
+    traceEvent(MOTION_EVENT_PULSE_CANCEL, targetPosition);
+  }
+  pulseGuideDurationMillis = 0;
+  isPulseGuiding = false;
 }
 
 void MotorDynamic::stopPulse() {
-  log("Setting speed to %ld", speedBeforePulseMHz);
+  // may have been cancelled (eg by limit) since it was started
+  if (!isPulseGuiding)
+    return;
+  LOG_DEBUG(logModule, "Setting speed to %lu",
+            (unsigned long)speedBeforePulseMHz);
   stepperWrapper->setStepperSpeed(speedBeforePulseMHz);
   isPulseGuiding = false;
   stopMove = true;
+  traceEvent(MOTION_EVENT_PULSE_END, targetPosition);
 }
 
 void MotorDynamic::stop() {
@@ -184,13 +339,15 @@ void MotorDynamic::stop() {
  * Caclulates target position
  * */
 void MotorDynamic::slewByDegrees(double degreesToSlew) {
-  log("Incoming slewByDegrees command, degrees to slew is  %lf", degreesToSlew);
+  LOG_INFO(logModule, "Incoming slewByDegrees command, degrees to slew is  %lf",
+           degreesToSlew);
 
   targetPosition = model.calculatePositionByDegreeShift(
       degreesToSlew, stepperWrapper->getPosition());
   isExecutingMove = true;
   isMoveQueued = true;
   targetSpeedInMilliHz = model.getRewindFastFowardSpeedInMilliHz();
+  traceEvent(MOTION_EVENT_GOTO, targetPosition);
 }
 
 bool MotorDynamic::isSlewing() { return isExecutingMove; }
\ No newline at end of file
@@ -1,8 +1,13 @@
 #ifndef __MOTORDYNAMIC_H__
 #define __MOTORDYNAMIC_H__
 
+#include "Logging.h"
+#include "MotionTrace.h"
 #include "MotorStatic.h"
 #include "StepperWrapper.h"
+#include "TimerService.h"
+#include "TimingStats.h"
+#include <atomic>
 #include <cstdint>
 
 //run at half speed when looking for limit
@@ -81,11 +86,28 @@ public:
   // Extneral commands
 
   /**
-   * Resets speed to whatever it was before pulse. Called from isr so needs to
-   * be fast
+   * Resets speed to whatever it was before pulse. Does nothing if the pulse
+   * has already been cancelled.
    */
   void stopPulse();
 
+  /**
+   * Start or stop a pulse its timer has flagged. Timer callbacks never
+   * touch the stepper, as it isn't safe to drive from two tasks, so call
+   * this from loop as often as it runs.
+   */
+  void applyPulseTimers();
+
+  // True from pulseGuide until the pulse has stopped
+  bool isPulseGuideInProgress();
+
+  /**
+   * Start the next pulseguide at this time (timer service clock) rather
+   * than straight away. Ignored without a timer service; a time already
+   * past starts it now.
+   */
+  void setNextPulseStartMicros(uint64_t startMicros);
+
   /**
    * Slew forward or back on ra axis by a number of degrees
    */
@@ -104,12 +126,44 @@ public:
 
   void setStepperWrapper(StepperWrapper *wrapper);
 
+  /**
+   * With a timer service, pulseguides start and stop when one shot timers
+   * fire rather than on the recalc period, so aren't stretched by it (see
+   * applyPulseTimers). Without one, onLoop hands back the pulse duration
+   * as before.
+   */
+  void setTimerService(TimerService *timers);
+
+  // Record goto, arrival, limit and pulse events for this axis. Null
+  // turns it off.
+  void setMotionTrace(MotionTrace *trace, uint8_t axis);
+
+  // How late pulses started after being requested, and stopped after
+  // their duration. Only recorded when timed by the timer service.
+  TimingStats &getPulseStartErrorStats();
+  TimingStats &getPulseStopErrorStats();
+
   int32_t getTargetPosition();
   uint32_t getTargetSpeedInMilliHz();
 
   // Output
 
 protected:
+  /**
+   * Called by subclass pulseGuide once target speed and duration are set.
+   * Kicks off the pulse from a timer if there is a timer service.
+   */
+  void schedulePulse();
+
+  // Abandon any queued or running pulse without restoring speed
+  void cancelPulse();
+
+  // Module shared code logs under, set by the subclass
+  LogModule logModule;
+
+  // Record an event at the current stepper position, if tracing
+  void traceEvent(MotionEventType type, int32_t target);
+
   bool limitJustHit;
   bool limitJustReleased;
 
@@ -130,6 +184,31 @@ protected:
   long pulseGuideDurationMillis;
 
   uint32_t speedBeforePulseMHz;
+
+  // Null if pulses are timed by loop
+  TimerService *timerService;
+
+private:
+  static void pulseStartCallback(void *arg);
+  static void pulseStopCallback(void *arg);
+  void startTimedPulse();
+
+  MotionTrace *motionTrace;
+  uint8_t traceAxis;
+  int pulseStartTimer;
+  int pulseStopTimer;
+  uint64_t pulseRequestedMicros;
+  uint64_t nextPulseStartMicros;
+  // Pulse speed and target as at pulseGuide, as loop can change the
+  // targets before a delayed pulse starts
+  uint32_t pulseSpeedInMilliHz;
+  int32_t pulseTargetPosition;
+  uint64_t pulseStopDueMicros;
+  // Set by the timer callbacks, cleared by loop
+  std::atomic<bool> pulseStartFired;
+  std::atomic<bool> pulseStopFired;
+  TimingStats pulseStartError;
+  TimingStats pulseStopError;
 };
 
 #endif // __MOTORDYNAMIC_H__
\ No newline at end of file
@@ -10,27 +10,19 @@ using namespace std;
 MotorStatic::MotorStatic() {
   // how far back from limt switch to slow down in mm
   limitSwitchSafetyStandoffMM = 2;
+  geometryVersion = 1;
+  speedTableVersion = 0; // forces build on first lookup
+  geometryBuiltVersion = 0;
+  speedKernel = SPEED_KERNEL_FINITE_DIFFERENCE;
+  speedTableEntries = 0;
 }
 
 uint32_t
 MotorStatic::calculatePositionByDegreeShift(double degreesToMove,
                                             int32_t stepperCurrentPosition) {
   int32_t middle = getMiddlePosition();
-  double stepsFromMiddle = (double)(stepperCurrentPosition - middle);
-  double stepsPerMM = getStepsPerMM();
-  double distanceFromCenterInMM = stepsFromMiddle / stepsPerMM;
-
-  // tan(angle)=o/r
-  double angleMovedFromCenterRadians =
-      atan(distanceFromCenterInMM / screwToPivotInMM);
-
-  double radiansToMove = degreesToMove * M_PI / 180.0;
-
-  double targetRadians = angleMovedFromCenterRadians + radiansToMove;
-  // o=tan(angle)*r
-
-  double targetDistanceFromCenterInMM = tan(targetRadians) * screwToPivotInMM;
-  uint32_t targetStepsFromMiddle = targetDistanceFromCenterInMM * stepsPerMM;
+  int32_t targetStepsFromMiddle = getGeometry().stepsFromMiddleAfterShift(
+      stepperCurrentPosition - middle, degreesToMove);
 
   int32_t targetPosition = middle + targetStepsFromMiddle;
   if (targetPosition < 0)
@@ -58,6 +50,7 @@ int32_t MotorStatic::getMiddlePosition() {
 
 void MotorStatic::setLimitSwitchToMiddleDistance(int pos) {
   limitSwitchToMiddleDistance = pos;
+  geometryVersion++;
 }
 
 int MotorStatic::getLimitSwitchToMiddleDistance() {
@@ -108,53 +101,98 @@ void MotorStatic::setBaseGuideRateInArcSecondsSecond(double d) {
   baseGuideRateInArcSecondsSecond = d;
 }
 
-void MotorStatic::setScrewToPivotInMM(double d) { screwToPivotInMM = d; }
+void MotorStatic::setScrewToPivotInMM(double d) {
+  screwToPivotInMM = d;
+  geometryVersion++;
+}
 
 double MotorStatic::getScrewToPivotInMM() { return screwToPivotInMM; }
 
 uint32_t
 MotorStatic::calculateSpeedInMilliHz(int stepperCurrentPosition,
                                      double desiredArcSecondsPerSecond) {
-
   int middle = getMiddlePosition();
-  double stepsFromMiddle = (double)(middle - stepperCurrentPosition);
-
-  double distanceFromCenterInMM = stepsFromMiddle / stepsPerMM;
-
-  double absoluteAngleMovedAtThisPoint =
-      atan(distanceFromCenterInMM / screwToPivotInMM);
-
-  double radiansPerSecond =
-      desiredArcSecondsPerSecond * (M_PI / 180.0 / 3600.0);
-
-  double absoluteAngleAfterOneMoreSecond =
-      absoluteAngleMovedAtThisPoint + radiansPerSecond;
-
-  double distanceAlongRodAfterOneMoreSecond =
-      screwToPivotInMM * tan(absoluteAngleAfterOneMoreSecond);
-
-  double threadDistancePerSecond =
-      distanceAlongRodAfterOneMoreSecond - distanceFromCenterInMM;
-
-  double numberOfTurnsPerSecondOfRod =
-      threadDistancePerSecond / threadedRodPitch;
-
-  double numberOfTurnsPerSecondOfStepper =
-      numberOfTurnsPerSecondOfRod * rodStepperRatio;
-
-  double numberOfStepsPerSecondInMiddle =
-      numberOfTurnsPerSecondOfStepper * stepperStepsPerRevolution * microsteps;
-
-  double stepperSpeedInHertz = numberOfStepsPerSecondInMiddle;
-  uint32_t stepperSpeedInMilliHertz = stepperSpeedInHertz * 1000;
-  return stepperSpeedInMilliHertz;
+  if (speedKernel == SPEED_KERNEL_ANALYTIC) {
+    return getGeometry().analyticSpeedInMilliHz(
+        middle - stepperCurrentPosition, desiredArcSecondsPerSecond);
+  }
+  return getGeometry().speedInMilliHz(middle - stepperCurrentPosition,
+                                      desiredArcSecondsPerSecond);
+}
+
+void MotorStatic::setSpeedKernel(SpeedKernel k) {
+  speedKernel = k;
+  geometryVersion++; // speed table depends on kernel
+  LOG_INFO(LOG_MOTOR, "Speed kernel set to %s",
+           k == SPEED_KERNEL_ANALYTIC ? "analytic" : "finite difference");
+}
+
+SpeedKernel MotorStatic::getSpeedKernel() { return speedKernel; }
+
+TangentGeometry<PlatformScalar> &MotorStatic::getGeometry() {
+  uint32_t version = geometryVersion;
+  if (geometryBuiltVersion != version) {
+    configureGeometry(geometry);
+    geometryBuiltVersion = version;
+  }
+  return geometry;
+}
+
+void MotorStatic::buildSpeedTable(double desiredArcSecondsPerSecond) {
+  uint32_t version = geometryVersion;
+  // One entry per mm, unless the run is too long for the table.
+  int mmPerEntry = 1 + (limitSwitchToEndDistance - 1) / (SPEED_TABLE_SIZE - 1);
+  double stepsPerEntry = mmPerEntry * stepsPerMM;
+
+  // Evenly spaced up to the limit, and one on it
+  speedTableEntries =
+      (limitSwitchToEndDistance + mmPerEntry - 1) / mmPerEntry + 1;
+  for (int i = 0; i < speedTableEntries - 1; i++) {
+    speedTable[i] = calculateSpeedInMilliHz(i * stepsPerEntry,
+                                            desiredArcSecondsPerSecond);
+  }
+  int32_t limit = getLimitPosition();
+  speedTable[speedTableEntries - 1] =
+      calculateSpeedInMilliHz(limit, desiredArcSecondsPerSecond);
+  speedTableEntriesPerStep = 1.0 / stepsPerEntry;
+  speedTableTailStart = (speedTableEntries - 2) * stepsPerEntry;
+  speedTableTailEntriesPerStep = 1.0 / (limit - speedTableTailStart);
+  speedTableRate = desiredArcSecondsPerSecond;
+  speedTableVersion = version;
+  LOG_DEBUG(LOG_MOTOR, "Speed table built with %d entries", speedTableEntries);
+}
+
+uint32_t MotorStatic::lookupSpeedInMilliHz(int32_t stepperCurrentPosition,
+                                           double desiredArcSecondsPerSecond) {
+  if (speedTableVersion != geometryVersion ||
+      speedTableRate != desiredArcSecondsPerSecond) {
+    buildSpeedTable(desiredArcSecondsPerSecond);
+  }
+
+  if (stepperCurrentPosition < 0 ||
+      stepperCurrentPosition > getLimitPosition()) {
+    return calculateSpeedInMilliHz(stepperCurrentPosition,
+                                   desiredArcSecondsPerSecond);
+  }
+
+  float index = stepperCurrentPosition * speedTableEntriesPerStep;
+  int lower = (int)index;
+  float fraction = index - lower;
+  if (lower >= speedTableEntries - 2) {
+    lower = speedTableEntries - 2;
+    fraction = (stepperCurrentPosition - speedTableTailStart) *
+               speedTableTailEntriesPerStep;
+  }
+  float speed = speedTable[lower] +
+                (speedTable[lower + 1] - speedTable[lower]) * fraction;
+  return speed;
 }
 
 void MotorStatic::setGuideRateMultiplier(double d) {
   guideRateMultiplier = d;
   guideRateInArcSecondsSecond = sideRealArcSecondsPerSec * d;
-  log("guide rate set: %lf arc secs per sec, or %lf x sidereal",
-      guideRateInArcSecondsSecond, guideRateMultiplier);
+  LOG_INFO(LOG_MOTOR, "guide rate set: %lf arc secs per sec, or %lf x sidereal",
+           guideRateInArcSecondsSecond, guideRateMultiplier);
 }
 
 double MotorStatic::getGuideRateMultiplier() { return guideRateMultiplier; }
@@ -1,6 +1,8 @@
 #ifndef __MOTORSTATIC_H__
 #define __MOTORSTATIC_H__
 
+#include "TangentGeometry.h"
+#include <atomic>
 #include <cstdint>
 
 // Represents the static attributes of the an axis
@@ -9,6 +11,18 @@
 // the motor
 
 #define sideRealArcSecondsPerSec 15.041
+
+// Max number of entries in the speed lookup table. Entries are spaced
+// at whole mm along the run, with the last at the limit, so this covers a
+// 255mm run at 1mm spacing.
+#define SPEED_TABLE_SIZE 256
+
+// How calculateSpeedInMilliHz works out speed. See TangentGeometry.
+enum SpeedKernel {
+  SPEED_KERNEL_FINITE_DIFFERENCE = 0, // angle one second from now
+  SPEED_KERNEL_ANALYTIC = 1           // derivative of r*tan(angle), no trig
+};
+
 class MotorStatic {
 public:
   /**
@@ -93,7 +107,61 @@ public:
   uint32_t calculateSpeedInMilliHz(int stepperCurrentPosition,
                                    double desiredArcSecondsPerSecond);
 
+  /**
+   * Choose how speed is calculated. Can be changed at any time; the speed
+   * table is rebuilt with the new kernel on next lookup.
+   */
+  void setSpeedKernel(SpeedKernel k);
+  SpeedKernel getSpeedKernel();
+
+  /**
+   * Table backed version of calculateSpeedInMilliHz, for use in the
+   * tracking loop where the rate does not change.
+   * Speeds are precomputed at each whole mm of the run (wider on long
+   * runs), plus the limit itself, and linearly interpolated, so a lookup
+   * costs no trig. The table is rebuilt lazily
+   * when the geometry or the requested rate changes.
+   * Positions outside the run fall back to the exact calculation.
+   */
+  uint32_t lookupSpeedInMilliHz(int32_t stepperCurrentPosition,
+                                double desiredArcSecondsPerSecond);
+
+  /**
+   * Set up tangent math in any numeric backend from this axis' geometry.
+   * The model itself uses PlatformScalar; this lets other backends be
+   * compared against it.
+   */
+  template <typename T> void configureGeometry(TangentGeometry<T> &g) {
+    g.setup(screwToPivotInMM, stepsPerMM, threadedRodPitch, rodStepperRatio,
+            stepperStepsPerRevolution, microsteps);
+  }
+
 protected:
+  // Bumped whenever a setter changes the geometry, so anything derived
+  // from it (eg speed table) knows to rebuild. Setters run on the web
+  // task, so builders read it before they start and stamp with that: a
+  // change made mid build then forces another.
+  std::atomic<uint32_t> geometryVersion;
+
+  void buildSpeedTable(double desiredArcSecondsPerSecond);
+
+  // Tangent math in the build's numeric backend, set up from the
+  // current geometry.
+  TangentGeometry<PlatformScalar> &getGeometry();
+  TangentGeometry<PlatformScalar> geometry;
+  uint32_t geometryBuiltVersion;
+
+  SpeedKernel speedKernel;
+
+  float speedTable[SPEED_TABLE_SIZE]; // millihz
+  int speedTableEntries;
+  float speedTableEntriesPerStep;
+  // The last gap runs to the limit, so can be shorter than the rest
+  float speedTableTailStart; // steps
+  float speedTableTailEntriesPerStep;
+  double speedTableRate;
+  uint32_t speedTableVersion;
+
  double guideRateMultiplier;
   double screwToPivotInMM;
   double rodStepperRatio;
@@ -0,0 +1,257 @@
+#include "MotorUnit.h"
+
+#include "Logging.h"
+#include "RADynamic.h"
+#include "RAStatic.h"
+
+MotorUnit::MotorUnit(RAStatic &rs, RADynamic &rd, DecStatic &ds, DecDynamic &dd,
+                     CommandMailbox &m, LoopMetrics &lm)
+    : raStatic(rs), raDynamic(rd), decStatic(ds), decDynamic(dd), mailbox(m),
+      metrics(lm) {
+  acceleration = 0;
+  raStepper = nullptr;
+  decStepper = nullptr;
+  inputs = nullptr;
+  clock = nullptr;
+  motionTrace = nullptr;
+  lastButtonAndSpeedCalc = 0;
+  raPulseGuideUntil = 0;
+  decPulseGuideUntil = 0;
+}
+
+void MotorUnit::setup(StepperWrapper *ra, StepperWrapper *dec,
+                      InputSource *i, Clock *c) {
+  raStepper = ra;
+  decStepper = dec;
+  inputs = i;
+  clock = c;
+  lastButtonAndSpeedCalc = 0;
+  raPulseGuideUntil = 0;
+  decPulseGuideUntil = 0;
+}
+
+void MotorUnit::setMotionTrace(MotionTrace *trace) {
+  motionTrace = trace;
+  raDynamic.setMotionTrace(trace, AXIS_RA);
+  decDynamic.setMotionTrace(trace, AXIS_DEC);
+}
+
+void MotorUnit::traceInputs() {
+  if (motionTrace == nullptr)
+    return;
+  int32_t pos = raStepper->getPosition();
+  for (int i = 0; i < PLATFORM_INPUT_COUNT; i++) {
+    PlatformInput input = (PlatformInput)i;
+    if (inputs->justPushed(input))
+      motionTrace->record(MOTION_TRACE_NO_AXIS, MOTION_EVENT_BUTTON_PUSHED,
+                          input, pos, 0);
+    else if (inputs->justReleased(input))
+      motionTrace->record(MOTION_TRACE_NO_AXIS, MOTION_EVENT_BUTTON_RELEASED,
+                          input, pos, 0);
+  }
+}
+
+// this returns false if rewind has been pushed, as that takes precedence
+bool MotorUnit::isFastForwardJustReleased() {
+  return inputs->justReleased(BUTTON_FAST_FORWARD) &&
+         !inputs->justPushed(BUTTON_FAST_FORWARD);
+}
+
+// this returns false if fast forward has been pushed, as that takes precedence
+bool MotorUnit::isRewindJustReleased() {
+  return inputs->justReleased(BUTTON_REWIND) &&
+         !inputs->justPushed(BUTTON_FAST_FORWARD);
+}
+
+// double degreesPerSecondToArcSecondsPerSecond(double degreesPerSecond) {
+//   return degreesPerSecond * 3600.0;
+// }
+
+void MotorUnit::applyPulseTimers() {
+  raDynamic.applyPulseTimers();
+  decDynamic.applyPulseTimers();
+}
+
+void MotorUnit::onLoop() {
+  // Apply web/network commands. This is the only place they touch the
+  // dynamic state, so they can't race the rest of the loop.
+  mailbox.drain(clock->nowMicros());
+  applyPulseTimers();
+
+  // stepper only holds ~80ms of tracking steps, so top up every loop
+  raDynamic.fillStepQueue();
+
+  unsigned long now = clock->nowMillis();
+  // Loop timed pulses (only used if there are no pulse timers). Each axis
+  // has its own deadline, and the rest of the loop keeps running.
+  if (raPulseGuideUntil != 0 && now > raPulseGuideUntil) {
+    // stops the pulse and resets back to original speed
+    // we do this here to minise time overrun
+    raDynamic.stopPulse();
+    LOG_DEBUG(LOG_RA,
+              "Pulse guide ended. Delta in milliseconds from requested "
+              "duration was %ld",
+              now - raPulseGuideUntil);
+    raPulseGuideUntil = 0;
+    lastButtonAndSpeedCalc = 0; // force recalc below
+  }
+
+  if (decPulseGuideUntil != 0 && now > decPulseGuideUntil) {
+    decDynamic.stopPulse();
+    LOG_DEBUG(LOG_DEC,
+              "Pulse guide ended. Delta in milliseconds from requested "
+              "duration was %ld",
+              now - decPulseGuideUntil);
+    decPulseGuideUntil = 0;
+    lastButtonAndSpeedCalc = 0; // force recalc below
+  }
+
+  if ((now - lastButtonAndSpeedCalc) > BUTTONANDRECALCPERIOD) {
+    lastButtonAndSpeedCalc = now;
+
+    inputs->update();
+    traceInputs();
+
+    if (inputs->justPushed(LIMIT_SWITCH_DEC)) {
+      decDynamic.setLimitJustHit();
+    } else if (inputs->justReleased(LIMIT_SWITCH_DEC)) {
+      decDynamic.setLimitJustReleased();
+    }
+
+    if (inputs->justPushed(LIMIT_SWITCH_RA)) {
+      raDynamic.setLimitJustHit();
+    } else if (inputs->justReleased(LIMIT_SWITCH_RA)) {
+      raDynamic.setLimitJustReleased();
+    }
+
+    // when ff pushed, goto middle if we are less than halfway. Otherwise go to
+    // end
+    int32_t pos = raStepper->getPosition();
+
+    if (inputs->justPushed(BUTTON_FAST_FORWARD)) {
+      if (pos <= raStatic.getMiddlePosition()) {
+        raDynamic.gotoEndish();
+        decDynamic.gotoMiddle();
+      } else {
+        raDynamic.gotoMiddle();
+        decDynamic.gotoMiddle();
+      }
+    }
+    if (isFastForwardJustReleased()) {
+      raDynamic.stop();
+      decDynamic.stop();
+    }
+
+    if (inputs->justPushed(BUTTON_REWIND)) {
+
+      if (raDynamic.isSafetyModeOn() || pos >= raStatic.getMiddlePosition()) {
+        raDynamic.gotoStart();
+        decDynamic.gotoMiddle();
+      } else {
+        raDynamic.gotoMiddle();
+        decDynamic.gotoMiddle();
+      }
+    }
+    //TODO bug here? If FF pushed in same cycle, it doesn't do anything?
+    if (isRewindJustReleased()) {
+      raDynamic.stop();
+      decDynamic.stop();
+    }
+    if (inputs->justPushed(BUTTON_PLAY)) {
+      raDynamic.setTrackingOnOff(true);
+    }
+    if (inputs->justReleased(BUTTON_PLAY)) {
+      raDynamic.setTrackingOnOff(false);
+    }
+
+
+    uint32_t start = readCycleCounter();
+    long rd = raDynamic.onLoop();
+    metrics.recordSince(METRIC_RA_DYNAMIC, start);
+    // handle pulseguide delay
+    if (rd > 0) {
+      raPulseGuideUntil = clock->nowMillis() + rd;
+    }
+
+    start = readCycleCounter();
+    long dd = decDynamic.onLoop();
+    metrics.recordSince(METRIC_DEC_DYNAMIC, start);
+    // handle pulseguide delay
+    if (dd > 0) {
+      decPulseGuideUntil = clock->nowMillis() + dd;
+    }
+  }
+}
+
+double MotorUnit::getVelocityInMMPerMinute() {
+  double speedInMHz =
+      (double)raStepper
+          ->getStepperSpeed(); //  rastepper->getCurrentSpeedInMilliHz();
+  double speedInHz = speedInMHz / 1000.0;
+  double speedInMMPerSecond = speedInHz / raStatic.getStepsPerMM();
+  double speedInMMPerMinute = speedInMMPerSecond * 60.0;
+  return speedInMMPerMinute;
+}
+
+unsigned long MotorUnit::getAcceleration() { return acceleration; }
+
+TrackingMode MotorUnit::getTrackingMode() {
+  return raDynamic.getTrackingMode();
+}
+
+unsigned long MotorUnit::getPulseStartErrorMaxMicros() {
+  unsigned long ra = raDynamic.getPulseStartErrorStats().getMax();
+  unsigned long dec = decDynamic.getPulseStartErrorStats().getMax();
+  return ra > dec ? ra : dec;
+}
+
+unsigned long MotorUnit::getPulseStopErrorMaxMicros() {
+  unsigned long ra = raDynamic.getPulseStopErrorStats().getMax();
+  unsigned long dec = decDynamic.getPulseStopErrorStats().getMax();
+  return ra > dec ? ra : dec;
+}
+
+void MotorUnit::setAcceleration(unsigned long a) {
+  acceleration = a;
+  if (raStepper != nullptr) {
+    raStepper->setAcceleration(a);
+    decStepper->setAcceleration(a);
+  }
+}
+double MotorUnit::getRaPositionInMM() {
+  return ((double)raStepper->getPosition()) / raStatic.getStepsPerMM();
+}
+
+double MotorUnit::getDecPositionInMM() {
+  return ((double)decStepper->getPosition()) / decStatic.getStepsPerMM();
+}
+
+// Stepper speed, negative if heading for a lower position
+static int32_t signedSpeed(StepperWrapper *stepper, MotorDynamic &dynamic,
+                           int32_t position) {
+  int32_t heading = stepper->isStreaming() ? stepper->getQueueEndPosition()
+                                           : dynamic.getTargetPosition();
+  int32_t speed = stepper->getStepperSpeed();
+  return heading < position ? -speed : speed;
+}
+
+PlatformPosition MotorUnit::getPlatformPosition() {
+  PlatformPosition p;
+  p.timeMicros = clock->nowMicros();
+  p.raPosition = raStepper->getPosition();
+  p.decPosition = decStepper->getPosition();
+  p.raSpeedInMilliHz = signedSpeed(raStepper, raDynamic, p.raPosition);
+  p.decSpeedInMilliHz = signedSpeed(decStepper, decDynamic, p.decPosition);
+  p.flags = 0;
+  if (raDynamic.isTrackingOn())
+    p.flags |= POSITION_FLAG_TRACKING;
+  if (raDynamic.isSlewing())
+    p.flags |= POSITION_FLAG_RA_SLEWING;
+  if (decDynamic.isSlewing())
+    p.flags |= POSITION_FLAG_DEC_SLEWING;
+  if (raDynamic.isPulseGuideInProgress())
+    p.flags |= POSITION_FLAG_RA_PULSE;
+  if (decDynamic.isPulseGuideInProgress())
+    p.flags |= POSITION_FLAG_DEC_PULSE;
+  return p;
+}
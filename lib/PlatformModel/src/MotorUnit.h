@@ -0,0 +1,82 @@
+#ifndef MOTORUNIT_H
+#define MOTORUNIT_H
+
+#include "Clock.h"
+#include "CommandMailbox.h"
+#include "DecDynamic.h"
+#include "DecStatic.h"
+#include "InputSource.h"
+#include "LoopMetrics.h"
+#include "MotionTrace.h"
+#include "PlatformProtocol.h"
+#include "RADynamic.h"
+#include "RAStatic.h"
+#include "StepperWrapper.h"
+
+// How often we run the button check and calculation.
+// Half of this timen is the average delay to starrt a pulseguide
+#define BUTTONANDRECALCPERIOD 250
+
+/**
+ * Runs the main motor loop: applies queued commands, reads buttons and
+ * limit switches, and drives both axes.
+ *
+ * Has no direct hardware access. Steppers, inputs and time are passed to
+ * setup, so the same loop runs on the ESP32 (see MotorHardware) and
+ * against simulated hardware in native tests.
+ */
+class MotorUnit {
+public:
+  MotorUnit(RAStatic &rastatic, RADynamic &radynamic, DecStatic &decstatic,
+            DecDynamic &decdynamic, CommandMailbox &mailbox,
+            LoopMetrics &metrics);
+
+  void setup(StepperWrapper *raStepper, StepperWrapper *decStepper,
+             InputSource *inputs, Clock *clock);
+  void onLoop();
+  // Start or stop pulses whose timers have fired. onLoop does this too;
+  // call it between loops to act on them sooner.
+  void applyPulseTimers();
+
+  // Record button presses here, and pass on to both axes. Null turns
+  // tracing off.
+  void setMotionTrace(MotionTrace *trace);
+
+  double getRaPositionInMM();
+  double getDecPositionInMM();
+  // Positions, signed speeds and state now, for the position stream.
+  // Call from loop.
+  PlatformPosition getPlatformPosition();
+  double getVelocityInMMPerMinute();
+  unsigned long getAcceleration();
+  TrackingMode getTrackingMode();
+  // Worst pulseguide timing error over both axes, see MotorDynamic
+  unsigned long getPulseStartErrorMaxMicros();
+  unsigned long getPulseStopErrorMaxMicros();
+  void setAcceleration(unsigned long a);
+
+private:
+  RAStatic &raStatic;
+  RADynamic &raDynamic;
+  DecStatic &decStatic;
+  DecDynamic &decDynamic;
+  CommandMailbox &mailbox;
+  LoopMetrics &metrics;
+  unsigned long acceleration;
+
+  StepperWrapper *raStepper;
+  StepperWrapper *decStepper;
+  InputSource *inputs;
+  Clock *clock;
+  MotionTrace *motionTrace;
+
+  unsigned long lastButtonAndSpeedCalc;
+  unsigned long raPulseGuideUntil;  // absolute time in millis to pulseguide until
+  unsigned long decPulseGuideUntil; // absolute time in millis to pulseguide until
+
+  bool isFastForwardJustReleased();
+  bool isRewindJustReleased();
+  void traceInputs();
+};
+
+#endif
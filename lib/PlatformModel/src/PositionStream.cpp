@@ -0,0 +1,85 @@
+#include "PositionStream.h"
+#include "Logging.h"
+
+PositionStream::PositionStream() : rejected(0) {
+  for (int i = 0; i < POSITION_STREAM_MAX_SUBSCRIBERS; i++)
+    subscribers[i].active = false;
+}
+
+bool PositionStream::subscribe(uint32_t address, uint16_t port,
+                               uint8_t rateHz, unsigned long nowMillis) {
+  Request request = {address, port, rateHz, nowMillis};
+  return requests.push(request);
+}
+
+void PositionStream::apply(const Request &request) {
+  PositionSubscriber *slot = nullptr;
+  for (int i = 0; i < POSITION_STREAM_MAX_SUBSCRIBERS; i++) {
+    PositionSubscriber &s = subscribers[i];
+    if (s.active && s.address == request.address && s.port == request.port)
+      slot = &s;
+  }
+  if (request.rateHz == 0) {
+    if (slot != nullptr)
+      slot->active = false;
+    return;
+  }
+  if (slot == nullptr) {
+    for (int i = 0; i < POSITION_STREAM_MAX_SUBSCRIBERS && !slot; i++) {
+      if (!subscribers[i].active)
+        slot = &subscribers[i];
+    }
+    if (slot == nullptr) {
+      rejected++;
+      LOG_WARN(LOG_UDP, "Position stream full, ignoring subscriber");
+      return;
+    }
+    slot->address = request.address;
+    slot->port = request.port;
+    slot->active = true;
+    // first position goes out straight away
+    slot->lastSentMillis = request.millis - 1000;
+    LOG_INFO(LOG_UDP, "Position stream subscriber at %d Hz", request.rateHz);
+  }
+  uint8_t rateHz = request.rateHz > POSITION_STREAM_MAX_HZ
+                       ? POSITION_STREAM_MAX_HZ
+                       : request.rateHz;
+  slot->intervalMillis = 1000 / rateHz;
+  slot->renewedMillis = request.millis;
+}
+
+int PositionStream::collectDue(unsigned long nowMillis,
+                               PositionSubscriber *due) {
+  Request request;
+  while (requests.pop(request))
+    apply(request);
+
+  int count = 0;
+  for (int i = 0; i < POSITION_STREAM_MAX_SUBSCRIBERS; i++) {
+    PositionSubscriber &s = subscribers[i];
+    if (!s.active)
+      continue;
+    // millis() is 32 bits on the ESP32, so wrap the same way everywhere
+    if ((uint32_t)(nowMillis - s.renewedMillis) >=
+        POSITION_STREAM_TIMEOUT_MILLIS) {
+      s.active = false;
+      continue;
+    }
+    if ((uint32_t)(nowMillis - s.lastSentMillis) >= s.intervalMillis) {
+      s.lastSentMillis = nowMillis;
+      due[count++] = s;
+    }
+  }
+  return count;
+}
+
+int PositionStream::getSubscriberCount() {
+  int count = 0;
+  for (int i = 0; i < POSITION_STREAM_MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i].active)
+      count++;
+  }
+  return count;
+}
+
+uint32_t PositionStream::getRejected() { return rejected; }
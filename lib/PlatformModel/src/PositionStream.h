@@ -0,0 +1,66 @@
+#ifndef __POSITIONSTREAM_H__
+#define __POSITIONSTREAM_H__
+
+#include "SPSCQueue.h"
+#include <cstdint>
+
+// Peers that can be streamed to at once
+#define POSITION_STREAM_MAX_SUBSCRIBERS 4
+// Fastest rate a subscriber gets, whatever it asks for
+#define POSITION_STREAM_MAX_HZ 20
+// Subscriptions lapse unless renewed this often
+#define POSITION_STREAM_TIMEOUT_MILLIS 30000
+
+struct PositionSubscriber {
+  uint32_t address; // IPv4, as the network stack stores it
+  uint16_t port;
+  unsigned long intervalMillis;
+  unsigned long lastSentMillis;
+  unsigned long renewedMillis;
+  bool active;
+};
+
+/**
+ * Who gets the position stream, and when.
+ *
+ * Subscriptions arrive on the network task and are handed to the loop
+ * through a queue, so the table is only touched from loop. Each
+ * subscriber is held to its own rate (at most POSITION_STREAM_MAX_HZ), and
+ * there are at most POSITION_STREAM_MAX_SUBSCRIBERS, so the stream's cost
+ * per loop is bounded however many peers ask.
+ */
+class PositionStream {
+public:
+  PositionStream();
+
+  // Network task. rateHz 0 unsubscribes. False if requests are coming in
+  // faster than loop takes them.
+  bool subscribe(uint32_t address, uint16_t port, uint8_t rateHz,
+                 unsigned long nowMillis);
+
+  // Loop. Copies subscribers due a position now into due (room for
+  // POSITION_STREAM_MAX_SUBSCRIBERS) and counts them as sent. Returns how
+  // many.
+  int collectDue(unsigned long nowMillis, PositionSubscriber *due);
+
+  // Loop
+  int getSubscriberCount();
+  // Subscriptions turned away because the table was full
+  uint32_t getRejected();
+
+private:
+  struct Request {
+    uint32_t address;
+    uint16_t port;
+    uint8_t rateHz;
+    unsigned long millis;
+  };
+
+  void apply(const Request &request);
+
+  SPSCQueue<Request, 8> requests;
+  PositionSubscriber subscribers[POSITION_STREAM_MAX_SUBSCRIBERS];
+  uint32_t rejected;
+};
+
+#endif // __POSITIONSTREAM_H__
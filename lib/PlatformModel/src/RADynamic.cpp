@@ -4,28 +4,178 @@
 
 void RADynamic::setTrackingOnOff(bool t) {
   trackingOn = t;
+  trackingSegment = -1;
+  catchUpSteps = 0;
   stopMove = true;
 }
 
 bool RADynamic::isTrackingOn() { return trackingOn; }
 
+void RADynamic::setTrackingMode(TrackingMode mode) {
+  trackingMode = mode;
+  trackingSegment = -1;
+  catchUpSteps = 0;
+  const char *name = "continuous";
+  if (mode == TRACKING_MODE_SCHEDULE)
+    name = "schedule";
+  if (mode == TRACKING_MODE_STREAM)
+    name = "stream";
+  LOG_INFO(LOG_RA, "Tracking mode set to %s", name);
+}
+
+TrackingMode RADynamic::getTrackingMode() { return trackingMode; }
+
+/**
+ * Only touch the motor when we move into a new segment, or something else
+ * (a move, pulseguide or stop) has changed the motor speed since we last
+ * set it.
+ */
+void RADynamic::trackBySchedule(int32_t pos) {
+  int segment = model.findTrackingSegment(pos);
+  if (segment < 0) {
+    // off the schedule, eg past limit. Fall back to calculating.
+    trackingSegment = -1;
+    targetPosition = 0;
+    targetSpeedInMilliHz = model.calculateTrackingSpeedInMilliHz(pos);
+    stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
+    return;
+  }
+  uint32_t speed = model.getTrackingSegment(segment).speedInMilliHz;
+  if (segment == trackingSegment &&
+      trackingScheduleVersion == model.getScheduleVersion() &&
+      stepperWrapper->getStepperSpeed() == trackingStepperSpeed) {
+    return;
+  }
+  trackingSegment = segment;
+  trackingScheduleVersion = model.getScheduleVersion();
+  targetPosition = 0;
+  targetSpeedInMilliHz = speed;
+  stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
+  // Stepper may round the speed, so remember what it reports rather than
+  // what we asked for.
+  trackingStepperSpeed = stepperWrapper->getStepperSpeed();
+}
+
+void RADynamic::fillStepQueue() {
+  // Only top up a stream we started. If anything else has taken over the
+  // motor (pulseguide, move) leave it be: stopOrTrack restarts streaming.
+  if (trackingOn && trackingMode == TRACKING_MODE_STREAM &&
+      stepperWrapper->isStreaming()) {
+    catchUpAfterUnderrun();
+    queueTrackingSteps();
+  }
+}
+
+/**
+ * The queue only holds ~85ms at sidereal (see StepQueue.h), so a loop
+ * stall longer than that runs it dry and the motor stops while the sky
+ * doesn't. Streaming carries on from where the motor stopped; with a
+ * clock we also work out how many steps were missed, to make them up.
+ * Running at k times tracking speed gains k - 1 steps in every k.
+ */
+void RADynamic::catchUpAfterUnderrun() {
+  // a stream queued to the end of the run empties without running dry
+  if (stepperWrapper->getQueueEndPosition() <= 0)
+    return;
+  uint32_t underruns = stepperWrapper->getStreamUnderruns();
+  if (underruns == streamUnderruns)
+    return;
+  streamUnderruns = underruns;
+  if (timerService == nullptr) {
+    LOG_WARN(LOG_RA, "Step queue ran dry, tracking has fallen behind");
+    return;
+  }
+  uint64_t now = timerService->nowMicros();
+  uint64_t lostMicros = now > streamDryMicros ? now - streamDryMicros : 0;
+  uint32_t missed = lostMicros * targetSpeedInMilliHz / 1000000000ull;
+  catchUpSteps +=
+      missed * STREAM_CATCH_UP_RATIO / (STREAM_CATCH_UP_RATIO - 1);
+  LOG_WARN(LOG_RA, "Step queue ran dry for %lu ms, catching up %lu steps",
+           (unsigned long)(lostMicros / 1000), (unsigned long)missed);
+}
+
+void RADynamic::addToStreamTime(uint32_t steps, uint32_t speedInMilliHz) {
+  if (timerService != nullptr && speedInMilliHz > 0)
+    streamDryMicros += (uint64_t)steps * 1000000000ull / speedInMilliHz;
+}
+
+/**
+ * Queue steps from the end of the queue towards 0. The run is split into
+ * fixed chunks, each at the tracking speed for its middle, so a chunk is
+ * queued at the same speed even if it goes in over several calls. Any
+ * catch up steps go first.
+ */
+void RADynamic::queueTrackingSteps() {
+  // if a move is still running, streaming will cut in from where we are
+  bool streaming = stepperWrapper->isStreaming();
+  int32_t queueEnd = streaming ? stepperWrapper->getQueueEndPosition()
+                               : stepperWrapper->getPosition();
+  if (timerService != nullptr) {
+    uint64_t now = timerService->nowMicros();
+    if (!streaming || streamDryMicros < now)
+      streamDryMicros = now;
+  }
+  while (catchUpSteps > 0 && queueEnd > 0) {
+    uint32_t steps = catchUpSteps < (uint32_t)queueEnd ? catchUpSteps
+                                                       : (uint32_t)queueEnd;
+    uint32_t speed = model.calculateTrackingSpeedInMilliHz(queueEnd) *
+                     STREAM_CATCH_UP_RATIO;
+    uint32_t queued = stepperWrapper->queueSteps(steps, speed, false);
+    addToStreamTime(queued, speed);
+    catchUpSteps -= queued;
+    queueEnd -= queued;
+    if (queued < steps)
+      return; // full
+  }
+  while (queueEnd > 0) {
+    int32_t chunkBottom =
+        (queueEnd - 1) / STREAM_CHUNK_STEPS * STREAM_CHUNK_STEPS;
+    uint32_t steps = queueEnd - chunkBottom;
+    uint32_t speed = model.calculateTrackingSpeedInMilliHz(
+        chunkBottom + STREAM_CHUNK_STEPS / 2);
+    uint32_t queued = stepperWrapper->queueSteps(steps, speed, false);
+    if (queued > 0) {
+      targetPosition = 0;
+      targetSpeedInMilliHz = speed;
+    }
+    addToStreamTime(queued, speed);
+    queueEnd -= queued;
+    if (queued < steps)
+      return; // full
+  }
+}
+
 void RADynamic::stopOrTrack(int32_t pos) {
   if (trackingOn) {
-    if (pos > 0) {
+    if (trackingMode == TRACKING_MODE_STREAM && pos > 0) {
+      queueTrackingSteps();
+    } else if (trackingMode == TRACKING_MODE_SCHEDULE && pos > 0) {
+      trackBySchedule(pos);
+    } else if (pos > 0) {
       targetPosition = 0;
       targetSpeedInMilliHz = model.calculateTrackingSpeedInMilliHz(pos);
       stepperWrapper->moveTo(targetPosition, targetSpeedInMilliHz);
     } else {
       stepperWrapper->stop();
       trackingOn = false; // turn off at end of run.
+      trackingSegment = -1;
     }
   } else {
     stepperWrapper->stop();
+    trackingSegment = -1;
   }
 }
 
 RADynamic::RADynamic(RAStatic &m) : MotorDynamic(m), model(m) {
+  logModule = LOG_RA;
   trackingOn = false;
+  trackingMode = TRACKING_MODE_CONTINUOUS;
+  trackingSegment = -1;
+  trackingScheduleVersion = 0;
+  trackingStepperSpeed = 0;
+  streamUnderruns = 0;
+  streamDryMicros = 0;
+  catchUpSteps = 0;
 }
 
 void RADynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
@@ -35,33 +185,38 @@ void RADynamic::pulseGuide(int direction, long pulseDurationInMilliseconds) {
     // If 2 then returned value will be higher than stepperCurrentPosition
     // If 3 then return value will be lower.
     double targetSpeedInArcSecsSec = model.getTrackingRateArcsSecondsSec();
-    log("Target guide rate arc seconds %lf ", targetSpeedInArcSecsSec);
-    log("Model RA guide rate %lf ", model.getGuideRateArcSecondsSecond());
+    LOG_TRACE(LOG_RA, "Target guide rate arc seconds %lf ",
+              targetSpeedInArcSecsSec);
+    LOG_TRACE(LOG_RA, "Model guide rate %lf ",
+              model.getGuideRateArcSecondsSecond());
     // NOTE: this assumes target speed will be positive
     if (direction == 3) { // west: go faster {}
       targetSpeedInArcSecsSec += model.getGuideRateArcSecondsSecond();
-      log("Adjusted W guide rate arc seconds %lf ", targetSpeedInArcSecsSec);
+      LOG_TRACE(LOG_RA, "Adjusted W guide rate arc seconds %lf ",
+                targetSpeedInArcSecsSec);
     }
     if (direction == 2) { // east: go slower
       targetSpeedInArcSecsSec -= model.getGuideRateArcSecondsSecond();
-      log("Adjusted E guide rate arc seconds %lf ", targetSpeedInArcSecsSec);
+      LOG_TRACE(LOG_RA, "Adjusted E guide rate arc seconds %lf ",
+                targetSpeedInArcSecsSec);
     }
     targetSpeedInMilliHz = model.calculateSpeedInMilliHz(
         stepperWrapper->getPosition(), targetSpeedInArcSecsSec);
 
     pulseGuideDurationMillis = pulseDurationInMilliseconds;
     speedBeforePulseMHz = stepperWrapper->getStepperSpeed();
-    log("Pulseguiding %s for %ld ms at speed %lu",
-        direction == 3 ? "West" : "East", pulseDurationInMilliseconds,
-        targetSpeedInMilliHz);
+    LOG_DEBUG(LOG_RA, "Pulseguiding %s for %ld ms at speed %lu",
+              direction == 3 ? "West" : "East", pulseDurationInMilliseconds,
+              (unsigned long)targetSpeedInMilliHz);
+    schedulePulse();
   }
 }
 
 void RADynamic::moveAxis(double degreesPerSecond) {
 
-  log("Incoming movexis command speed %lf", degreesPerSecond);
+  LOG_DEBUG(LOG_RA, "Incoming movexis command speed %lf", degreesPerSecond);
   if (degreesPerSecond == 0) {
-    log("Move axis target is 0 ");
+    LOG_DEBUG(LOG_RA, "Move axis target is 0 ");
     isExecutingMove = false; // loop should perform stop / resume track
     return;
   }
@@ -75,7 +230,8 @@ void RADynamic::moveAxis(double degreesPerSecond) {
   }
   targetSpeedInMilliHz = model.calculateSpeedInMilliHz(
       stepperWrapper->getPosition(), 3600.0 * fabs(degreesPerSecond));
-  log("Move axis target speed millihz %lu", targetSpeedInMilliHz);
+  LOG_DEBUG(LOG_RA, "Move axis target speed millihz %lu",
+            (unsigned long)targetSpeedInMilliHz);
 
   isExecutingMove = true;
   isMoveQueued = true;
@@ -93,7 +249,7 @@ void RADynamic::moveAxis(double degreesPerSecond) {
  * as a % of tracking rate.
  */
 void RADynamic::moveAxisPercentage(int percentage) {
-  log("Received moveaxispercentage with value %d", percentage);
+  LOG_DEBUG(LOG_RA, "Received moveaxispercentage with value %d", percentage);
   if (percentage == 0) {
     moveAxis(0);
     return;
@@ -101,7 +257,7 @@ void RADynamic::moveAxisPercentage(int percentage) {
   double degreesPerSecond = model.getNunChukMultiplier() *
                             model.getTrackingRateDegreesSec() *
                             (double)percentage / 100.0;
-  log("Moving axis with %lf degrees sec", degreesPerSecond);
+  LOG_DEBUG(LOG_RA, "Moving axis with %lf degrees sec", degreesPerSecond);
 
   moveAxis(degreesPerSecond);
 };
@@ -5,6 +5,25 @@
 #include "StepperWrapper.h"
 #include <cstdint>
 
+// How tracking speed is applied to the motor.
+enum TrackingMode {
+  // Recalculate speed on every loop
+  TRACKING_MODE_CONTINUOUS = 0,
+  // Follow the model's speed schedule, only changing speed at segment
+  // boundaries
+  TRACKING_MODE_SCHEDULE = 1,
+  // Queue steps ahead into the stepper's own command queue, so speed
+  // changes are timed by the step generator rather than the loop
+  TRACKING_MODE_STREAM = 2
+};
+
+// Streamed tracking queues steps in chunks of this size, each at the
+// speed for the middle of the chunk.
+#define STREAM_CHUNK_STEPS 256
+// After the stream runs dry, make up the missed steps at this multiple of
+// tracking speed
+#define STREAM_CATCH_UP_RATIO 2
+
 /** Responsible for the dynamic state of the platform.
  * Handles the following:
  * - what to do when external commands (webui/network) received
@@ -31,13 +50,43 @@ public:
   void setTrackingOnOff(bool tracking);
   bool isTrackingOn();
 
+  void setTrackingMode(TrackingMode mode);
+  TrackingMode getTrackingMode();
+
+  /**
+   * When streaming, top up the stepper's queue. Cheap, and needs to be
+   * called more often than the stepper can empty its queue (about 85ms
+   * at sidereal), so is called every loop rather than every recalc.
+   * If the queue has run dry anyway, catches up the steps missed.
+   */
+  void fillStepQueue();
+
   // Get run time until platform is centered
   double getTimeToCenterInSeconds();
   // Get time left to run
   double getTimeToEndOfRunInSeconds();
 
 private:
+  void trackBySchedule(int32_t pos);
+  void queueTrackingSteps();
+  void catchUpAfterUnderrun();
+  // Move streamDryMicros on by the time these steps take to run
+  void addToStreamTime(uint32_t steps, uint32_t speedInMilliHz);
+
   bool trackingOn;
+  TrackingMode trackingMode;
+
+  // Schedule segment last sent to the motor, -1 if none
+  int trackingSegment;
+  uint32_t trackingScheduleVersion;
+  // Speed the stepper reported after we last set it
+  uint32_t trackingStepperSpeed;
+  // Stream underruns already caught up
+  uint32_t streamUnderruns;
+  // When the queued steps will have run, if there is a timer service
+  uint64_t streamDryMicros;
+  // Missed steps still to queue at catch up speed
+  uint32_t catchUpSteps;
   RAStatic &model;
 };
 
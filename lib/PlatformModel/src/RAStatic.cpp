@@ -13,10 +13,6 @@ using namespace std;
 // 10 mm=approx 5 minutes
 #define END_STANDOFF_MM 10
 
-const double fullRotation =
-    2 * M_PI; // M_PI is the value for pi from the cmath library
-const double fullRotationTimeInSeconds = 24 * 60 * 60;
-
 // double raGuideRateInArcSecondsSecond;
 // double raGuideRateMultiplier;
 // double raGuideRateDegreesSec;
@@ -33,9 +29,15 @@ RAStatic::RAStatic() : MotorStatic() {
    stepsPerMM =
       (stepperStepsPerRevolution * microsteps * teethOnRodPulley) /
       (teethOnStepperPulley * threadedRodPitch);
-  log("RA  steps per MM: %lf", stepsPerMM);
+  LOG_DEBUG(LOG_RA, "Steps per MM: %lf", stepsPerMM);
   rodStepperRatio = (double)teethOnRodPulley / (double)teethOnStepperPulley;
-  log("RA rod stepper ratio: %lf", rodStepperRatio);
+  LOG_DEBUG(LOG_RA, "Rod stepper ratio: %lf", rodStepperRatio);
+
+  scheduleSegments = 0;
+  scheduleGeometryVersion = 0; // forces build on first lookup
+  scheduleVersion = 0;
+  scheduleErrorBound = DEFAULT_SCHEDULE_ERROR_ARCSECONDS;
+  scheduleMaxError = 0;
 }
 
 double
@@ -52,25 +54,12 @@ RAStatic::calculateTimeToCenterInSeconds(int32_t stepperCurrentPosition) {
   int middle = getMiddlePosition();
   // note this calculation is the other way around from
   // calculateSpeedInMilliHz:
-  double stepsFromMiddle = (double)(stepperCurrentPosition - middle);
-  double stepsPerMM = getStepsPerMM();
-  double distanceFromCenterInMM = stepsFromMiddle / stepsPerMM;
-
-  double absoluteAngleMovedAtThisPoint =
-      atan(distanceFromCenterInMM / screwToPivotInMM);
-
-  double fractionMoved = absoluteAngleMovedAtThisPoint / fullRotation;
-
-  // 24 hours = 86400 seconds
-  double fullRotationTimeInSeconds = 24 * 60 * 60;
-
-  double secondsMoved = fractionMoved * fullRotationTimeInSeconds;
-  return secondsMoved;
+  return getGeometry().secondsFromCenter(stepperCurrentPosition - middle);
 }
 
 uint32_t RAStatic::calculateTrackingSpeedInMilliHz(int stepperCurrentPosition) {
-  return calculateSpeedInMilliHz(stepperCurrentPosition,
-                                 getTrackingRateArcsSecondsSec());
+  return lookupSpeedInMilliHz(stepperCurrentPosition,
+                              getTrackingRateArcsSecondsSec());
 }
 
 int32_t RAStatic::getGotoEndPosition() { return stepsPerMM * END_STANDOFF_MM; }
@@ -82,3 +71,169 @@ double RAStatic::getTrackingRateArcsSecondsSec() {
 double RAStatic::getTrackingRateDegreesSec() {
   return sideRealArcSecondsPerSec / 3600.0;
 }
+
+void RAStatic::setScheduleErrorBoundInArcSeconds(double arcSeconds) {
+  scheduleErrorBound = arcSeconds;
+  scheduleGeometryVersion = 0; // rebuild on next lookup
+}
+
+double RAStatic::getScheduleErrorBoundInArcSeconds() {
+  return scheduleErrorBound;
+}
+
+double RAStatic::getScheduleMaxErrorInArcSeconds() {
+  if (scheduleGeometryVersion != geometryVersion) {
+    buildSpeedSchedule();
+  }
+  return scheduleMaxError;
+}
+
+uint32_t RAStatic::getScheduleVersion() { return scheduleVersion; }
+
+int RAStatic::getTrackingSegmentCount() {
+  if (scheduleGeometryVersion != geometryVersion) {
+    buildSpeedSchedule();
+  }
+  return scheduleSegments;
+}
+
+const SpeedSegment &RAStatic::getTrackingSegment(int index) {
+  return schedule[index];
+}
+
+int RAStatic::findTrackingSegment(int32_t stepperCurrentPosition) {
+  if (scheduleGeometryVersion != geometryVersion) {
+    buildSpeedSchedule();
+  }
+  if (scheduleSegments == 0 ||
+      stepperCurrentPosition > schedule[0].startPosition ||
+      stepperCurrentPosition <= schedule[scheduleSegments - 1].endPosition) {
+    return -1;
+  }
+  // segments are in descending position order
+  int low = 0;
+  int high = scheduleSegments - 1;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (stepperCurrentPosition > schedule[mid].endPosition) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
+
+// Platform angle at a stepper position. Increases as tracking runs towards 0.
+double RAStatic::angleAtPosition(int32_t stepperPosition) {
+  return (double)getGeometry().angleFromCenterInRadians(getMiddlePosition() -
+                                                        stepperPosition);
+}
+
+// Constant speed that covers the segment in exactly the time the sky takes
+// to turn through it, so error is back to zero at each segment end.
+uint32_t RAStatic::segmentSpeedInMilliHz(int32_t start, int32_t end) {
+  double radiansPerSecond =
+      getTrackingRateArcsSecondsSec() * M_PI / 180.0 / 3600.0;
+  double seconds =
+      (angleAtPosition(end) - angleAtPosition(start)) / radiansPerSecond;
+  return (uint32_t)((start - end) * 1000.0 / seconds + 0.5);
+}
+
+// Size of the second derivative of atan(x / r), the platform angle at x mm
+// from the middle
+static double angleCurvature(double x, double r) {
+  double squares = r * r + x * x;
+  return 2 * r * fabs(x) / (squares * squares);
+}
+
+// Bound on the difference between platform angle and sky angle while
+// running the segment at a constant speed. Position moves linearly with
+// time, so the sky angle is a straight line through the platform angle at
+// both ends, give or take rounding of the speed. A straight line through
+// the ends of a curve stays within length^2 / 8 of it times its steepest
+// curvature; rounding adds at most the drift it builds up by the end.
+double RAStatic::segmentErrorInArcSeconds(int32_t start, int32_t end,
+                                          uint32_t speedInMilliHz) {
+  double radiansPerSecond =
+      getTrackingRateArcsSecondsSec() * M_PI / 180.0 / 3600.0;
+  double r = screwToPivotInMM;
+  double startMM = (getMiddlePosition() - start) / stepsPerMM;
+  double endMM = (getMiddlePosition() - end) / stepsPerMM;
+
+  // curvature peaks at +-r/sqrt(3), and falls away either side
+  double peak = r / sqrt(3.0);
+  double curvature =
+      fmax(angleCurvature(startMM, r), angleCurvature(endMM, r));
+  if ((startMM < peak && endMM > peak) || (startMM < -peak && endMM > -peak))
+    curvature = angleCurvature(peak, r);
+  double lengthMM = endMM - startMM;
+  double chordError = lengthMM * lengthMM / 8 * curvature;
+
+  double seconds = (start - end) / (speedInMilliHz / 1000.0);
+  double angle = atan(endMM / r) - atan(startMM / r);
+  double driftError = fabs(seconds * radiansPerSecond - angle);
+  return (chordError + driftError) * 180.0 / M_PI * 3600.0;
+}
+
+void RAStatic::buildSpeedSchedule() {
+  uint32_t version = geometryVersion;
+  // Segments never get shorter than 1mm, so a tiny bound can't blow the
+  // table.
+  int32_t minLength = stepsPerMM;
+  int32_t start = getLimitPosition();
+  scheduleSegments = 0;
+  scheduleMaxError = 0;
+
+  while (start > 0 && scheduleSegments < SPEED_SCHEDULE_SIZE) {
+    int32_t goodEnd = start > minLength ? start - minLength : 0;
+    int32_t badEnd = -1;
+
+    // Double segment length until the bound is broken...
+    int32_t length = minLength;
+    while (goodEnd > 0) {
+      length *= 2;
+      int32_t end = start > length ? start - length : 0;
+      if (segmentErrorInArcSeconds(start, end,
+                                   segmentSpeedInMilliHz(start, end)) <=
+          scheduleErrorBound) {
+        goodEnd = end;
+      } else {
+        badEnd = end;
+        break;
+      }
+    }
+    // ...then bisect down to the step.
+    while (badEnd >= 0 && goodEnd - badEnd > 1) {
+      int32_t end = badEnd + (goodEnd - badEnd) / 2;
+      if (segmentErrorInArcSeconds(start, end,
+                                   segmentSpeedInMilliHz(start, end)) <=
+          scheduleErrorBound) {
+        goodEnd = end;
+      } else {
+        badEnd = end;
+      }
+    }
+
+    SpeedSegment &segment = schedule[scheduleSegments++];
+    segment.startPosition = start;
+    segment.endPosition = goodEnd;
+    segment.speedInMilliHz = segmentSpeedInMilliHz(start, goodEnd);
+    double error =
+        segmentErrorInArcSeconds(start, goodEnd, segment.speedInMilliHz);
+    if (error > scheduleMaxError)
+      scheduleMaxError = error;
+    start = goodEnd;
+  }
+
+  if (start > 0) {
+    LOG_WARN(LOG_RA,
+             "Speed schedule full. Positions below %ld are not scheduled",
+             (long)start);
+  }
+  scheduleGeometryVersion = version;
+  scheduleVersion++;
+  LOG_INFO(LOG_RA,
+           "Speed schedule built with %d segments, max error %lf arc seconds",
+           scheduleSegments, scheduleMaxError);
+}
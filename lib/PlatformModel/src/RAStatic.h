@@ -4,6 +4,23 @@
 #include "MotorStatic.h"
 #include <cstdint>
 
+// Max number of segments in the tracking speed schedule.
+#define SPEED_SCHEDULE_SIZE 128
+
+// Default bound on tracking error from running each schedule segment at a
+// constant speed.
+#define DEFAULT_SCHEDULE_ERROR_ARCSECONDS 1.0
+
+/**
+ * A stretch of the run tracked at one constant speed. Tracking runs from
+ * startPosition down to endPosition (start is the higher position).
+ */
+struct SpeedSegment {
+  int32_t startPosition;
+  int32_t endPosition;
+  uint32_t speedInMilliHz;
+};
+
 // Represents the static attributes of the platform.
 // Use to perform calculations using intrinsic platform attributes
 // Exposes methods to change some of those attributes (eg circle radius)
@@ -23,7 +40,10 @@ public:
    */
   int32_t getGotoEndPosition() override;
 
-  /** Convenience method to calculate motor sidereal tracking */
+  /**
+   * Convenience method to calculate motor sidereal tracking.
+   * Uses the speed lookup table, so is cheap enough to call every loop.
+   */
   uint32_t calculateTrackingSpeedInMilliHz(int stepperCurrentPosition);
 
   // Calculates runtime to center based on sidreal rate
@@ -35,7 +55,41 @@ public:
   double getTrackingRateArcsSecondsSec();
   double getTrackingRateDegreesSec();
 
+  /**
+   * The whole run, from limit down to 0, as a list of constant speed
+   * segments at sidereal rate. Segments are sized so that running each at
+   * a constant speed keeps tracking error under the error bound. The
+   * schedule is rebuilt lazily when geometry or the bound changes.
+   *
+   * Returns index of the segment containing the position, or -1 if the
+   * position is outside the run.
+   */
+  int findTrackingSegment(int32_t stepperCurrentPosition);
+  const SpeedSegment &getTrackingSegment(int index);
+  int getTrackingSegmentCount();
+
+  void setScheduleErrorBoundInArcSeconds(double arcSeconds);
+  double getScheduleErrorBoundInArcSeconds();
+  // Largest segment error bound in the schedule
+  double getScheduleMaxErrorInArcSeconds();
+
+  // Bumped whenever the schedule is rebuilt
+  uint32_t getScheduleVersion();
+
 private:
+  void buildSpeedSchedule();
+  double segmentErrorInArcSeconds(int32_t start, int32_t end,
+                                  uint32_t speedInMilliHz);
+  uint32_t segmentSpeedInMilliHz(int32_t start, int32_t end);
+  double angleAtPosition(int32_t stepperPosition);
+
+  SpeedSegment schedule[SPEED_SCHEDULE_SIZE];
+  int scheduleSegments;
+  uint32_t scheduleGeometryVersion;
+  uint32_t scheduleVersion;
+  double scheduleErrorBound;
+  double scheduleMaxError;
+
   double guideRateMultiplier;
 };
 
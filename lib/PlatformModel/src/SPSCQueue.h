@@ -0,0 +1,72 @@
+#ifndef __SPSCQUEUE_H__
+#define __SPSCQUEUE_H__
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Fixed size lock-free queue for one producer thread and one consumer
+ * thread. Nothing blocks and nothing allocates: push fails (and counts a
+ * drop) when full, pop fails when empty.
+ *
+ * head is only written by the producer and tail by the consumer, so the
+ * only ordering needed is release on write / acquire on read of each.
+ * Counters run freely and wrap, so Size must be a power of two.
+ */
+template <typename T, uint32_t Size> class SPSCQueue {
+  static_assert(Size > 0 && (Size & (Size - 1)) == 0,
+                "SPSCQueue size must be a power of two");
+
+public:
+  SPSCQueue() : head(0), tail(0), dropped(0) {}
+
+  // Producer only
+  bool push(const T &item) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= Size) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    items[h & (Size - 1)] = item;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  bool pop(T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t & (Size - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Reads the next item without taking it.
+  bool peek(T &item) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) {
+      return false;
+    }
+    item = items[t & (Size - 1)];
+    return true;
+  }
+
+  // Either side. Only a snapshot, as the other side may be running.
+  uint32_t size() {
+    return head.load(std::memory_order_acquire) -
+           tail.load(std::memory_order_acquire);
+  }
+
+  // Number of pushes rejected because the queue was full
+  uint32_t getDropped() { return dropped.load(std::memory_order_relaxed); }
+
+private:
+  T items[Size];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+  std::atomic<uint32_t> dropped;
+};
+
+#endif // __SPSCQUEUE_H__
@@ -0,0 +1,34 @@
+#include "SimulatedInputSource.h"
+
+SimulatedInputSource::SimulatedInputSource() {
+  for (int i = 0; i < PLATFORM_INPUT_COUNT; i++) {
+    pressed[i] = false;
+    sampled[i] = false;
+    changed[i] = false;
+  }
+}
+
+void SimulatedInputSource::update() {
+  for (int i = 0; i < PLATFORM_INPUT_COUNT; i++) {
+    changed[i] = pressed[i] != sampled[i];
+    sampled[i] = pressed[i];
+  }
+}
+
+bool SimulatedInputSource::justPushed(PlatformInput input) {
+  return changed[input] && sampled[input];
+}
+
+bool SimulatedInputSource::justReleased(PlatformInput input) {
+  return changed[input] && !sampled[input];
+}
+
+void SimulatedInputSource::press(PlatformInput input) { pressed[input] = true; }
+
+void SimulatedInputSource::release(PlatformInput input) {
+  pressed[input] = false;
+}
+
+bool SimulatedInputSource::isPressed(PlatformInput input) {
+  return pressed[input];
+}
@@ -0,0 +1,28 @@
+#ifndef __SIMULATEDINPUTSOURCE_H__
+#define __SIMULATEDINPUTSOURCE_H__
+
+#include "InputSource.h"
+
+/**
+ * InputSource for native tests. press/release change the input, which
+ * MotorUnit sees as pushed/released on its next update.
+ */
+class SimulatedInputSource : public InputSource {
+public:
+  SimulatedInputSource();
+
+  void update() override;
+  bool justPushed(PlatformInput input) override;
+  bool justReleased(PlatformInput input) override;
+
+  void press(PlatformInput input);
+  void release(PlatformInput input);
+  bool isPressed(PlatformInput input);
+
+private:
+  bool pressed[PLATFORM_INPUT_COUNT];
+  bool sampled[PLATFORM_INPUT_COUNT];
+  bool changed[PLATFORM_INPUT_COUNT];
+};
+
+#endif // __SIMULATEDINPUTSOURCE_H__
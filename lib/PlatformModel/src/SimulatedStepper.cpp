@@ -0,0 +1,337 @@
+#include "SimulatedStepper.h"
+#include <cmath>
+
+// Only cut straight over to streaming (no decel) from below this speed
+#define SIMULATED_STREAM_TAKEOVER_STEPS_PER_SECOND 1000.0
+
+SimulatedStepper::SimulatedStepper(Clock &c) : clock(c) {
+  lastMicros = clock.nowMicros();
+  mode = IDLE;
+  position = 0;
+  physicalOffset = 0;
+  speed = 0;
+  acceleration = 1000;
+  targetPosition = 0;
+  speedInMillihz = 0;
+  queueHead = 0;
+  queueCount = 0;
+  streamSpeedInMillihz = 0;
+  streamUnderruns = 0;
+  streamDry = false;
+}
+
+void SimulatedStepper::advance() {
+  uint64_t now = clock.nowMicros();
+  if (now <= lastMicros)
+    return;
+  double seconds = (now - lastMicros) / 1000000.0;
+  lastMicros = now;
+
+  if (mode == STREAMING) {
+    advanceStream(seconds);
+    return;
+  }
+  // ramps are run phase by phase, so land exactly on targets and speeds
+  while (seconds > 0 && mode != IDLE) {
+    seconds -= advanceMove(seconds);
+  }
+}
+
+void SimulatedStepper::runPhase(double a, double seconds) {
+  position += speed * seconds + a * seconds * seconds / 2;
+  speed += a * seconds;
+}
+
+/**
+ * Runs the move until it changes phase (speeding up, cruising, slowing
+ * down), or for seconds if that is sooner. Acceleration is constant
+ * within a phase, so each phase is solved exactly. Returns the time run.
+ */
+double SimulatedStepper::advanceMove(double seconds) {
+  double maxSpeed = speedInMillihz / 1000.0;
+  if (mode == STOPPING || maxSpeed <= 0) {
+    double direction = speed >= 0 ? 1 : -1;
+    double t = fabs(speed) / acceleration;
+    if (t > seconds) {
+      runPhase(-direction * acceleration, seconds);
+      return seconds;
+    }
+    runPhase(-direction * acceleration, t);
+    speed = 0;
+    mode = IDLE;
+    return t;
+  }
+
+  double distance = targetPosition - position;
+  double direction = distance >= 0 ? 1 : -1;
+  double remaining = fabs(distance);
+  // speed towards the target
+  double s = speed * direction;
+
+  if (s < 0) {
+    // heading away, eg target changed: stop, then come back
+    double t = -s / acceleration;
+    if (t > seconds) {
+      runPhase(direction * acceleration, seconds);
+      return seconds;
+    }
+    runPhase(direction * acceleration, t);
+    speed = 0;
+    return t;
+  }
+
+  double stoppingDistance = s * s / (2 * acceleration);
+  if (s > 0 && stoppingDistance >= remaining - SIMULATED_POSITION_EPSILON) {
+    // slow down to land on the target. Rounding can leave the stopping
+    // distance a touch over, so use whatever deceleration lands exactly.
+    double deceleration =
+        remaining > 0 ? s * s / (2 * remaining) : acceleration;
+    bool overshoot = deceleration > acceleration * 1.001;
+    if (overshoot) {
+      // can't stop in time (target moved): overshoot, then come back
+      deceleration = acceleration;
+    }
+    double t = s / deceleration;
+    if (t > seconds) {
+      runPhase(-direction * deceleration, seconds);
+      return seconds;
+    }
+    runPhase(-direction * deceleration, t);
+    speed = 0;
+    if (!overshoot) {
+      position = targetPosition;
+      mode = IDLE;
+    }
+    return t;
+  }
+  if (remaining < SIMULATED_POSITION_EPSILON) {
+    // stopped on target
+    position = targetPosition;
+    mode = IDLE;
+    return 0;
+  }
+
+  if (s < maxSpeed - SIMULATED_SPEED_EPSILON) {
+    // speed up, to full speed or until it is time to slow down
+    double peak = sqrt(acceleration * remaining + s * s / 2);
+    double phaseEndSpeed = peak < maxSpeed ? peak : maxSpeed;
+    double t = (phaseEndSpeed - s) / acceleration;
+    if (t > seconds) {
+      runPhase(direction * acceleration, seconds);
+      return seconds;
+    }
+    runPhase(direction * acceleration, t);
+    speed = direction * phaseEndSpeed;
+    return t;
+  }
+  if (s > maxSpeed + SIMULATED_SPEED_EPSILON) {
+    // speed lowered mid move
+    double t = (s - maxSpeed) / acceleration;
+    if (t > seconds) {
+      runPhase(-direction * acceleration, seconds);
+      return seconds;
+    }
+    runPhase(-direction * acceleration, t);
+    speed = direction * maxSpeed;
+    return t;
+  }
+
+  // cruise until it is time to slow down
+  double t = (remaining - stoppingDistance) / s;
+  if (t > seconds)
+    t = seconds;
+  position += speed * t;
+  return t;
+}
+
+void SimulatedStepper::advanceStream(double seconds) {
+  while (seconds > 0 && queueCount > 0) {
+    QueueEntry &e = queue[queueHead];
+    double stepsPerSecond = e.speedInMillihz / 1000.0;
+    double entrySeconds = e.steps / stepsPerSecond;
+    double direction = e.forward ? 1 : -1;
+    if (entrySeconds > seconds) {
+      double steps = seconds * stepsPerSecond;
+      position += direction * steps;
+      e.steps -= steps;
+      speed = direction * stepsPerSecond;
+      return;
+    }
+    position += direction * e.steps;
+    seconds -= entrySeconds;
+    queueHead = (queueHead + 1) % STEP_QUEUE_LEN;
+    queueCount--;
+  }
+  // ran dry
+  position = round(position);
+  speed = 0;
+}
+
+void SimulatedStepper::forceStop() {
+  queueCount = 0;
+  queueHead = 0;
+  speed = 0;
+  position = round(position);
+  mode = IDLE;
+}
+
+void SimulatedStepper::moveTo(int32_t p, uint32_t s) {
+  advance();
+  if (mode == STREAMING)
+    forceStop();
+  // Stepper does weird stuff at very slow speeds. Treat these as stops
+  if (s < SIMULATED_MIN_SPEED_MILLIHZ) {
+    if (mode != IDLE)
+      mode = STOPPING;
+    return;
+  }
+  speedInMillihz = s;
+  targetPosition = p;
+  mode = MOVING;
+}
+
+void SimulatedStepper::resetPosition(int32_t p) {
+  advance();
+  forceStop();
+  physicalOffset += position - p;
+  position = p;
+}
+
+void SimulatedStepper::stop() {
+  advance();
+  if (mode == STREAMING)
+    forceStop();
+  if (mode == MOVING)
+    mode = STOPPING;
+}
+
+int32_t SimulatedStepper::getPosition() {
+  advance();
+  return (int32_t)round(position);
+}
+
+void SimulatedStepper::setStepperSpeed(uint32_t s) {
+  advance();
+  if (mode == STREAMING)
+    forceStop();
+  speedInMillihz = s;
+}
+
+uint32_t SimulatedStepper::getStepperSpeed() {
+  if (mode == STREAMING)
+    return streamSpeedInMillihz;
+  return speedInMillihz;
+}
+
+void SimulatedStepper::setAcceleration(unsigned long a) {
+  advance();
+  acceleration = a;
+}
+
+double SimulatedStepper::queuedSteps() {
+  double total = 0;
+  for (int i = 0; i < queueCount; i++) {
+    QueueEntry &e = queue[(queueHead + i) % STEP_QUEUE_LEN];
+    total += e.forward ? e.steps : -e.steps;
+  }
+  return total;
+}
+
+uint32_t SimulatedStepper::queueSteps(uint32_t steps, uint32_t s,
+                                      bool forward) {
+  advance();
+  if (mode == MOVING || mode == STOPPING) {
+    // as ConcreteStepperWrapper: slow down first if going fast
+    if (fabs(speed) > SIMULATED_STREAM_TAKEOVER_STEPS_PER_SECOND) {
+      mode = STOPPING;
+      return 0;
+    }
+    forceStop();
+  }
+  if (s == 0)
+    return 0;
+
+  // as ConcreteStepperWrapper: fill the queue an entry (or slow step) at a
+  // time until it is full
+  uint32_t perStep = stepQueueEntriesPerStep(stepQueueTicks(s));
+  uint32_t used = queueEntries();
+  uint32_t queued = 0;
+  while (queued < steps && used + perStep <= STEP_QUEUE_LEN) {
+    uint32_t n = 1;
+    if (perStep == 1) {
+      n = steps - queued;
+      if (n > STEP_QUEUE_MAX_ENTRY_STEPS)
+        n = STEP_QUEUE_MAX_ENTRY_STEPS;
+    }
+    QueueEntry &e = queue[(queueHead + queueCount) % STEP_QUEUE_LEN];
+    e.steps = n;
+    e.speedInMillihz = s;
+    e.forward = forward;
+    e.entriesPerStep = perStep;
+    queueCount++;
+    used += perStep;
+    queued += n;
+  }
+  if (queued > 0) {
+    mode = STREAMING;
+    streamDry = false;
+    streamSpeedInMillihz = s;
+  }
+  return queued;
+}
+
+uint32_t SimulatedStepper::queueEntries() {
+  uint32_t total = 0;
+  for (int i = 0; i < queueCount; i++) {
+    QueueEntry &e = queue[(queueHead + i) % STEP_QUEUE_LEN];
+    if (e.entriesPerStep == 1)
+      total++;
+    else // pauses of a step part run have already left the queue
+      total += (uint32_t)ceil(e.steps * e.entriesPerStep);
+  }
+  return total;
+}
+
+bool SimulatedStepper::isStreaming() {
+  advance();
+  return mode == STREAMING;
+}
+
+uint32_t SimulatedStepper::getStreamUnderruns() {
+  // as ConcreteStepperWrapper: an empty queue mid stream is an underrun
+  advance();
+  if (mode == STREAMING && !streamDry && queueCount == 0) {
+    streamDry = true;
+    streamUnderruns++;
+  }
+  return streamUnderruns;
+}
+
+int32_t SimulatedStepper::getQueueEndPosition() {
+  advance();
+  if (mode == STREAMING)
+    return (int32_t)round(position + queuedSteps());
+  if (mode == MOVING)
+    return targetPosition;
+  return (int32_t)round(position);
+}
+
+double SimulatedStepper::getCurrentSpeedInStepsPerSecond() {
+  advance();
+  return speed;
+}
+
+bool SimulatedStepper::isRunning() {
+  advance();
+  return speed != 0 || mode == MOVING;
+}
+
+int32_t SimulatedStepper::getPhysicalPosition() {
+  advance();
+  return (int32_t)round(position + physicalOffset);
+}
+
+void SimulatedStepper::setPhysicalPosition(int32_t p) {
+  resetPosition(p);
+  physicalOffset = 0;
+}
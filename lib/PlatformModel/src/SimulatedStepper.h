@@ -0,0 +1,102 @@
+#ifndef __SIMULATEDSTEPPER_H__
+#define __SIMULATEDSTEPPER_H__
+
+#include "Clock.h"
+#include "StepQueue.h"
+#include "StepperWrapper.h"
+#include <cstdint>
+
+// Slowest move the stepper will run, as ConcreteStepperWrapper
+#define SIMULATED_MIN_SPEED_MILLIHZ 300
+// Tolerances when deciding which phase of a move we are in
+#define SIMULATED_POSITION_EPSILON 1e-6
+#define SIMULATED_SPEED_EPSILON 1e-9
+
+/**
+ * StepperWrapper against a simulated motor, for native tests. Models the
+ * FastAccelStepper behaviour the platform relies on: moveTo ramps up to
+ * speed and down onto the target at the set acceleration, stop ramps
+ * down, resetPosition (forceStopAndNewPosition) stops dead, and streamed
+ * steps run at their queued speed. The stream queue holds as many entries
+ * as FastAccelStepper's, at as many entries a step (see StepQueue.h), so
+ * runs dry as soon as the real one would.
+ *
+ * Time comes from a Clock; the motor catches up to the clock whenever it
+ * is called. Ramps are solved exactly rather than stepped, so trajectories
+ * (time to limit, overshoot, tracking error) don't depend on how often
+ * the test calls in.
+ */
+class SimulatedStepper : public StepperWrapper {
+public:
+  SimulatedStepper(Clock &clock);
+
+  void moveTo(int32_t position, uint32_t speedInMillihz) override;
+  void resetPosition(int32_t position) override;
+  void stop() override;
+  int32_t getPosition() override;
+  void setStepperSpeed(uint32_t speedInMillihz) override;
+  uint32_t getStepperSpeed() override;
+  void setAcceleration(unsigned long a) override;
+
+  uint32_t queueSteps(uint32_t steps, uint32_t speedInMillihz,
+                      bool forward) override;
+  bool isStreaming() override;
+  int32_t getQueueEndPosition() override;
+  uint32_t getStreamUnderruns() override;
+
+  // Current speed in steps per second, negative when counting down
+  double getCurrentSpeedInStepsPerSecond();
+  /**
+   * Where the platform really is, in steps. resetPosition only changes
+   * what the stepper thinks its position is, so this is what limit
+   * switches should be checked against.
+   */
+  int32_t getPhysicalPosition();
+  // Place the platform, with the stepper position matching
+  void setPhysicalPosition(int32_t position);
+  bool isRunning();
+
+private:
+  enum Mode { IDLE, MOVING, STOPPING, STREAMING };
+
+  // Steps queued as one command: up to 255 steps of one entry each, or a
+  // single slow step and its pauses
+  struct QueueEntry {
+    double steps; // left to run
+    uint32_t speedInMillihz;
+    bool forward;
+    uint32_t entriesPerStep;
+  };
+
+  // Run the motor up to the clock
+  void advance();
+  double advanceMove(double seconds);
+  // Constant acceleration a for seconds
+  void runPhase(double a, double seconds);
+  void advanceStream(double seconds);
+  // Drop any stream and stop dead, as FastAccelStepper forceStop
+  void forceStop();
+  double queuedSteps();
+  // Queue entries still to run, as FastAccelStepper queueEntries
+  uint32_t queueEntries();
+
+  Clock &clock;
+  uint64_t lastMicros;
+  Mode mode;
+  double position;
+  // physical position minus stepper position
+  double physicalOffset;
+  double speed;
+  double acceleration;
+  int32_t targetPosition;
+  uint32_t speedInMillihz;
+
+  QueueEntry queue[STEP_QUEUE_LEN];
+  int queueHead;
+  int queueCount;
+  uint32_t streamSpeedInMillihz;
+  uint32_t streamUnderruns;
+  bool streamDry;
+};
+
+#endif // __SIMULATEDSTEPPER_H__
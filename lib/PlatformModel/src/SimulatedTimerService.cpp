@@ -0,0 +1,74 @@
+#include "SimulatedTimerService.h"
+
+SimulatedTimerService::SimulatedTimerService() {
+  timerCount = 0;
+  now = 0;
+  dispatchLatency = 0;
+  woken = false;
+}
+
+int SimulatedTimerService::createTimer(TimerCallback callback, void *arg,
+                                       const char * /*name*/) {
+  if (timerCount >= SIMULATED_TIMER_COUNT)
+    return -1;
+  SimulatedTimer &t = timers[timerCount];
+  t.callback = callback;
+  t.arg = arg;
+  t.dueMicros = 0;
+  t.running = false;
+  return timerCount++;
+}
+
+void SimulatedTimerService::startOnce(int timer, uint64_t delayMicros) {
+  timers[timer].dueMicros = now + delayMicros + dispatchLatency;
+  timers[timer].running = true;
+}
+
+void SimulatedTimerService::stop(int timer) { timers[timer].running = false; }
+
+uint64_t SimulatedTimerService::nowMicros() { return now; }
+
+void SimulatedTimerService::setDispatchLatencyMicros(uint64_t micros) {
+  dispatchLatency = micros;
+}
+
+int SimulatedTimerService::nextDue(uint64_t byMicros) {
+  int next = -1;
+  for (int i = 0; i < timerCount; i++) {
+    if (timers[i].running && timers[i].dueMicros <= byMicros &&
+        (next < 0 || timers[i].dueMicros < timers[next].dueMicros)) {
+      next = i;
+    }
+  }
+  return next;
+}
+
+void SimulatedTimerService::fire(int timer) {
+  if (timers[timer].dueMicros > now)
+    now = timers[timer].dueMicros;
+  timers[timer].running = false;
+  timers[timer].callback(timers[timer].arg);
+  woken = true;
+}
+
+void SimulatedTimerService::advanceMicros(uint64_t micros) {
+  uint64_t target = now + micros;
+  // Callbacks may start timers, so look again after each one.
+  for (int next = nextDue(target); next >= 0; next = nextDue(target))
+    fire(next);
+  now = target;
+}
+
+bool SimulatedTimerService::sleepUntilTimer(uint64_t deadlineMicros) {
+  if (!woken) {
+    int next = nextDue(deadlineMicros);
+    if (next < 0) {
+      if (deadlineMicros > now)
+        now = deadlineMicros;
+      return false;
+    }
+    fire(next);
+  }
+  woken = false;
+  return true;
+}
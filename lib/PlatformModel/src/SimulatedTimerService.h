@@ -0,0 +1,47 @@
+#ifndef __SIMULATEDTIMERSERVICE_H__
+#define __SIMULATEDTIMERSERVICE_H__
+
+#include "TimerService.h"
+
+#define SIMULATED_TIMER_COUNT 8
+
+/**
+ * TimerService against a simulated clock, for native tests. Time only
+ * moves when advanceMicros is called; timers due along the way fire in
+ * order, with the clock set to when they fire.
+ */
+class SimulatedTimerService : public TimerService {
+public:
+  SimulatedTimerService();
+
+  int createTimer(TimerCallback callback, void *arg,
+                  const char *name) override;
+  void startOnce(int timer, uint64_t delayMicros) override;
+  void stop(int timer) override;
+  bool sleepUntilTimer(uint64_t deadlineMicros) override;
+  uint64_t nowMicros() override;
+
+  void advanceMicros(uint64_t micros);
+  // Simulate callbacks running late, eg behind a busy timer task
+  void setDispatchLatencyMicros(uint64_t micros);
+
+private:
+  struct SimulatedTimer {
+    TimerCallback callback;
+    void *arg;
+    uint64_t dueMicros;
+    bool running;
+  };
+  // Earliest running timer due by then, or -1
+  int nextDue(uint64_t byMicros);
+  void fire(int timer);
+
+  SimulatedTimer timers[SIMULATED_TIMER_COUNT];
+  int timerCount;
+  uint64_t now;
+  uint64_t dispatchLatency;
+  // a timer fired since sleepUntilTimer last returned
+  bool woken;
+};
+
+#endif // __SIMULATEDTIMERSERVICE_H__
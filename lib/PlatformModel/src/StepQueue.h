@@ -0,0 +1,43 @@
+#ifndef __STEPQUEUE_H__
+#define __STEPQUEUE_H__
+
+#include <cstdint>
+
+/**
+ * Shape of FastAccelStepper's command queue on the ESP32, which streamed
+ * steps (StepperWrapper::queueSteps) go into. ConcreteStepperWrapper fills
+ * the real queue with it, and SimulatedStepper models the same queue, so
+ * the simulation runs dry when the hardware would.
+ */
+
+// Entries in the queue (FastAccelStepper QUEUE_LEN)
+#define STEP_QUEUE_LEN 32
+// Step timer rate (FastAccelStepper TICKS_PER_S)
+#define STEP_QUEUE_TICKS_PER_S 16000000
+// Longest period one entry can hold, in ticks (16 bit)
+#define STEP_QUEUE_MAX_ENTRY_TICKS 65535
+// Most steps one entry can hold
+#define STEP_QUEUE_MAX_ENTRY_STEPS 255
+// Ticks given to the step itself when a slow step is split into pauses
+#define STEP_QUEUE_SLOW_STEP_TICKS 32768
+
+// Step period at this speed, in ticks
+inline uint32_t stepQueueTicks(uint32_t speedInMillihz) {
+  return (uint64_t)STEP_QUEUE_TICKS_PER_S * 1000 / speedInMillihz;
+}
+
+/**
+ * Entries one step takes at this period. Up to 4ms (65535 ticks) it is
+ * one entry for up to 255 steps; slower steps (sidereal tracking is ~8ms)
+ * are queued one at a time as a step followed by pauses. That is 3
+ * entries a step at sidereal, so the queue only holds ~85ms of tracking.
+ */
+inline uint32_t stepQueueEntriesPerStep(uint32_t ticks) {
+  if (ticks <= STEP_QUEUE_MAX_ENTRY_TICKS)
+    return 1;
+  uint32_t pauseTicks = ticks - STEP_QUEUE_SLOW_STEP_TICKS;
+  return 1 + (pauseTicks + STEP_QUEUE_MAX_ENTRY_TICKS - 1) /
+                 STEP_QUEUE_MAX_ENTRY_TICKS;
+}
+
+#endif // __STEPQUEUE_H__
@@ -16,5 +16,24 @@ public:
   virtual void setStepperSpeed(uint32_t speedInMillihz) = 0;
   virtual uint32_t getStepperSpeed() = 0;
   virtual void setAcceleration(unsigned long a) = 0;
+
+  /**
+   * Streamed stepping. Queues steps at a constant speed behind whatever is
+   * already queued, for the step generator to run with no further calls.
+   * Queues as many as fit and returns how many were queued, which may be
+   * 0 (eg queue full, or a move is still slowing down).
+   * Any other motor command (moveTo, stop etc) drops the queue.
+   */
+  virtual uint32_t queueSteps(uint32_t steps, uint32_t speedInMillihz,
+                              bool forward) = 0;
+  // True while running steps from queueSteps
+  virtual bool isStreaming() = 0;
+  // Position once everything queued has run
+  virtual int32_t getQueueEndPosition() = 0;
+  /**
+   * Times a stream has run dry before it was topped up. The motor stops
+   * until the next queueSteps, so each one costs tracking time.
+   */
+  virtual uint32_t getStreamUnderruns() = 0;
 };
 #endif // __STEPPERWRAPPER_H__
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef __TIMERSERVICE_H__
+#define __TIMERSERVICE_H__
+
+#include "Clock.h"
+#include <cstdint>
+
+typedef void (*TimerCallback)(void *arg);
+
+/**
+ * One shot high resolution timers, on top of the clock they run against.
+ * Lets MotorDynamic time pulseguides off the main loop: on the ESP32 this
+ * is esp_timer, in native tests a simulated clock.
+ *
+ * Callbacks run outside the main loop (esp_timer task), so must be short
+ * and must not touch anything the loop does: set a flag, and have the loop
+ * pick it up when sleepUntilTimer wakes it.
+ */
+class TimerService : public Clock {
+public:
+  // Returns a timer id, or -1 if no more timers can be created.
+  virtual int createTimer(TimerCallback callback, void *arg,
+                          const char *name) = 0;
+  // Fire callback once after delayMicros. Restarts it if already running.
+  virtual void startOnce(int timer, uint64_t delayMicros) = 0;
+  virtual void stop(int timer) = 0;
+  // Sleep until deadlineMicros. Returns true early if a timer fires first,
+  // or has fired since the last call, false once the deadline is reached.
+  virtual bool sleepUntilTimer(uint64_t deadlineMicros) = 0;
+};
+
+#endif // __TIMERSERVICE_H__
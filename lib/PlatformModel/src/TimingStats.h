@@ -0,0 +1,38 @@
+#ifndef __TIMINGSTATS_H__
+#define __TIMINGSTATS_H__
+
+/**
+ * Running last/max/average of a timing error or latency, in microseconds.
+ */
+class TimingStats {
+public:
+  TimingStats() { reset(); }
+
+  void record(unsigned long micros) {
+    last = micros;
+    if (micros > max)
+      max = micros;
+    total += micros;
+    count++;
+  }
+
+  void reset() {
+    last = 0;
+    max = 0;
+    total = 0;
+    count = 0;
+  }
+
+  unsigned long getLast() { return last; }
+  unsigned long getMax() { return max; }
+  unsigned long getAverage() { return count == 0 ? 0 : total / count; }
+  unsigned long getCount() { return count; }
+
+private:
+  unsigned long last;
+  unsigned long max;
+  unsigned long long total;
+  unsigned long count;
+};
+
+#endif // __TIMINGSTATS_H__
@@ -0,0 +1,172 @@
+#include "ClockSync.h"
+
+bool computeClockSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3,
+                        ClockSample &sample) {
+  // the clocks have different epochs, but each difference is small
+  int64_t roundTrip = (int64_t)(t3 - t0) - (int64_t)(t2 - t1);
+  if ((int64_t)(t3 - t0) < 0 || (int64_t)(t2 - t1) < 0 || roundTrip < 0 ||
+      roundTrip > CLOCK_SYNC_MAX_ROUND_TRIP_MICROS)
+    return false;
+  sample.offsetMicros = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2;
+  sample.roundTripMicros = roundTrip;
+  return true;
+}
+
+ClockFilter::ClockFilter() { reset(); }
+
+void ClockFilter::reset() {
+  count = 0;
+  next = 0;
+}
+
+void ClockFilter::add(const ClockSample &sample) {
+  samples[next] = sample;
+  next = (next + 1) % CLOCK_SYNC_SAMPLES;
+  if (count < CLOCK_SYNC_SAMPLES)
+    count++;
+}
+
+bool ClockFilter::getEstimate(ClockSample &estimate) {
+  if (count == 0)
+    return false;
+  estimate = samples[0];
+  for (int i = 1; i < count; i++) {
+    if (samples[i].roundTripMicros < estimate.roundTripMicros)
+      estimate = samples[i];
+  }
+  return true;
+}
+
+ClockSyncClient::ClockSyncClient() : lastSendMicros(0), lastReceiveMicros(0) {}
+
+void ClockSyncClient::makeRequest(uint64_t nowMicros, TimeRequest &request) {
+  request.sendMicros = nowMicros;
+  request.previousSendMicros = lastSendMicros;
+  request.previousReceiveMicros = lastReceiveMicros;
+  lastSendMicros = nowMicros;
+  lastReceiveMicros = 0;
+}
+
+bool ClockSyncClient::handleResponse(const TimeResponse &response,
+                                     uint64_t nowMicros) {
+  if (response.requestSendMicros != lastSendMicros || lastReceiveMicros != 0)
+    return false; // late, duplicate or not ours
+  lastReceiveMicros = nowMicros;
+  ClockSample sample;
+  if (!computeClockSample(lastSendMicros, response.receiveMicros,
+                          response.replyMicros, nowMicros, sample))
+    return false;
+  filter.add(sample);
+  return true;
+}
+
+bool ClockSyncClient::getEstimate(ClockSample &estimate) {
+  return filter.getEstimate(estimate);
+}
+
+bool ClockSyncClient::toPlatformMicros(uint64_t localMicros,
+                                       uint64_t &platformMicros) {
+  ClockSample estimate;
+  if (!filter.getEstimate(estimate))
+    return false;
+  platformMicros = localMicros + estimate.offsetMicros;
+  return true;
+}
+
+ClockSync::ClockSync()
+    : roundTripLast(0), roundTripAverage(0), roundTripMax(0) {
+  for (int i = 0; i < CLOCK_SYNC_MAX_PEERS; i++)
+    peers[i].active = false;
+}
+
+ClockSync::Peer *ClockSync::findPeer(uint32_t address, uint16_t port) {
+  for (int i = 0; i < CLOCK_SYNC_MAX_PEERS; i++) {
+    if (peers[i].active && peers[i].address == address &&
+        peers[i].port == port)
+      return &peers[i];
+  }
+  return nullptr;
+}
+
+void ClockSync::handleRequest(uint32_t address, uint16_t port,
+                              const TimeRequest &request, uint64_t nowMicros,
+                              TimeResponse &response) {
+  Peer *peer = findPeer(address, port);
+  if (peer == nullptr) {
+    // a free slot, else the peer heard from least recently
+    peer = &peers[0];
+    for (int i = 0; i < CLOCK_SYNC_MAX_PEERS && peer->active; i++) {
+      if (!peers[i].active ||
+          peers[i].lastReceiveMicros < peer->lastReceiveMicros)
+        peer = &peers[i];
+    }
+    peer->address = address;
+    peer->port = port;
+    peer->active = true;
+    peer->lastRequestSendMicros = 0;
+    peer->lastSampleMicros = 0;
+    peer->filter.reset();
+  } else if (request.previousReceiveMicros != 0 &&
+             request.previousSendMicros == peer->lastRequestSendMicros) {
+    // the peer's receive time completes our last exchange
+    ClockSample sample;
+    if (computeClockSample(peer->lastRequestSendMicros,
+                           peer->lastReceiveMicros, peer->lastReplyMicros,
+                           request.previousReceiveMicros, sample)) {
+      peer->filter.add(sample);
+      peer->lastSampleMicros = nowMicros;
+      recordRoundTrip(sample.roundTripMicros);
+    }
+  }
+  // answered straight away, so receive and reply are the same instant
+  peer->lastRequestSendMicros = request.sendMicros;
+  peer->lastReceiveMicros = nowMicros;
+  peer->lastReplyMicros = nowMicros;
+  response.requestSendMicros = request.sendMicros;
+  response.receiveMicros = nowMicros;
+  response.replyMicros = nowMicros;
+}
+
+bool ClockSync::getEstimate(uint32_t address, uint16_t port,
+                            uint64_t nowMicros, ClockSample &estimate) {
+  Peer *peer = findPeer(address, port);
+  if (peer == nullptr ||
+      nowMicros - peer->lastSampleMicros > CLOCK_SYNC_TIMEOUT_MICROS)
+    return false;
+  return peer->filter.getEstimate(estimate);
+}
+
+bool ClockSync::toLocalMicros(uint32_t address, uint16_t port,
+                              uint64_t peerMicros, uint64_t nowMicros,
+                              uint64_t &localMicros) {
+  ClockSample estimate;
+  if (!getEstimate(address, port, nowMicros, estimate))
+    return false;
+  // offset is ours minus the peer's
+  localMicros = peerMicros + estimate.offsetMicros;
+  return true;
+}
+
+int ClockSync::getPeerCount() {
+  int count = 0;
+  for (int i = 0; i < CLOCK_SYNC_MAX_PEERS; i++) {
+    if (peers[i].active)
+      count++;
+  }
+  return count;
+}
+
+void ClockSync::recordRoundTrip(uint32_t micros) {
+  roundTripLast = micros;
+  uint32_t average = roundTripAverage;
+  roundTripAverage =
+      average == 0 ? micros : average + ((int32_t)(micros - average)) / 8;
+  if (micros > roundTripMax)
+    roundTripMax = micros;
+}
+
+uint32_t ClockSync::getRoundTripLastMicros() { return roundTripLast; }
+
+uint32_t ClockSync::getRoundTripAverageMicros() { return roundTripAverage; }
+
+uint32_t ClockSync::getRoundTripMaxMicros() { return roundTripMax; }
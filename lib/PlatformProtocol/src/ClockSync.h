@@ -0,0 +1,125 @@
+#ifndef __CLOCKSYNC_H__
+#define __CLOCKSYNC_H__
+
+#include "PlatformProtocol.h"
+#include <atomic>
+#include <cstdint>
+
+// Samples the estimate is picked from
+#define CLOCK_SYNC_SAMPLES 8
+// Peers the platform keeps an estimate for
+#define CLOCK_SYNC_MAX_PEERS 4
+// Exchanges slower than this say too little about the offset to keep
+#define CLOCK_SYNC_MAX_ROUND_TRIP_MICROS 500000
+// An estimate with no new sample for this long is dropped, as the clocks
+// will have drifted
+#define CLOCK_SYNC_TIMEOUT_MICROS 60000000ull
+
+struct ClockSample {
+  // Add to the requester's clock to get the responder's
+  int64_t offsetMicros;
+  int64_t roundTripMicros;
+};
+
+/**
+ * One exchange, as NTP: t0 requester send, t1 responder receive, t2
+ * responder send, t3 requester receive, each in its own clock. False if
+ * the times don't make sense or the round trip was too slow.
+ */
+bool computeClockSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3,
+                        ClockSample &sample);
+
+/**
+ * Keeps the last few samples and picks the one with the shortest round
+ * trip: its offset has the least queueing delay in it.
+ */
+class ClockFilter {
+public:
+  ClockFilter();
+  void add(const ClockSample &sample);
+  // False until there's a sample
+  bool getEstimate(ClockSample &estimate);
+  void reset();
+
+private:
+  ClockSample samples[CLOCK_SYNC_SAMPLES];
+  int count;
+  int next;
+};
+
+/**
+ * DSC end of the exchange. Send makeRequest's request, feed the response
+ * to handleResponse, then use toPlatformMicros to time commands.
+ */
+class ClockSyncClient {
+public:
+  ClockSyncClient();
+
+  void makeRequest(uint64_t nowMicros, TimeRequest &request);
+  // False if it isn't the answer to the last request, or is unusable
+  bool handleResponse(const TimeResponse &response, uint64_t nowMicros);
+
+  bool getEstimate(ClockSample &estimate);
+  // False until synced
+  bool toPlatformMicros(uint64_t localMicros, uint64_t &platformMicros);
+
+private:
+  ClockFilter filter;
+  uint64_t lastSendMicros;
+  uint64_t lastReceiveMicros;
+};
+
+/**
+ * Platform end. Answers time requests, and from the times each DSC passes
+ * back learns that DSC's offset, so commands timed in its clock can be
+ * run at the right moment in ours.
+ *
+ * Only used from the network task, except the round trip stats.
+ */
+class ClockSync {
+public:
+  ClockSync();
+
+  // Fill in the response to a request received at nowMicros
+  void handleRequest(uint32_t address, uint16_t port,
+                     const TimeRequest &request, uint64_t nowMicros,
+                     TimeResponse &response);
+
+  // Offset and round trip for a peer. False if it hasn't synced lately.
+  bool getEstimate(uint32_t address, uint16_t port, uint64_t nowMicros,
+                   ClockSample &estimate);
+  bool toLocalMicros(uint32_t address, uint16_t port, uint64_t peerMicros,
+                     uint64_t nowMicros, uint64_t &localMicros);
+
+  int getPeerCount();
+
+  // Round trips of every exchange, any peer. Average is smoothed as TCP
+  // does (1/8 of each new sample), so follows the link as it changes.
+  uint32_t getRoundTripLastMicros();
+  uint32_t getRoundTripAverageMicros();
+  uint32_t getRoundTripMaxMicros();
+
+private:
+  struct Peer {
+    uint32_t address;
+    uint16_t port;
+    bool active;
+    // Our side of the last exchange, to pair with the peer's receive time
+    uint64_t lastRequestSendMicros;
+    uint64_t lastReceiveMicros;
+    uint64_t lastReplyMicros;
+    uint64_t lastSampleMicros;
+    ClockFilter filter;
+  };
+
+  Peer *findPeer(uint32_t address, uint16_t port);
+
+  void recordRoundTrip(uint32_t micros);
+
+  Peer peers[CLOCK_SYNC_MAX_PEERS];
+  std::atomic<uint32_t> roundTripLast;
+  std::atomic<uint32_t> roundTripAverage;
+  std::atomic<uint32_t> roundTripMax;
+};
+
+#endif // __CLOCKSYNC_H__
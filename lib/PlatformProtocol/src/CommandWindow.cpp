@@ -0,0 +1,155 @@
+#include "CommandWindow.h"
+
+CommandWindow::CommandWindow()
+    : accepted(0), duplicates(0), stale(0), lost(0) {
+  for (int i = 0; i < COMMAND_WINDOW_MAX_PEERS; i++)
+    peers[i].active = false;
+}
+
+// Zero bits among count bits of bits, starting at bit from
+static int zeroBits(uint64_t bits, int from, int count) {
+  if (count <= 0)
+    return 0;
+  uint64_t mask = count >= COMMAND_WINDOW_BITS ? ~0ull : (1ull << count) - 1;
+  return count - __builtin_popcountll((bits >> from) & mask);
+}
+
+CommandWindow::Peer *CommandWindow::findPeer(uint32_t address, uint16_t port,
+                                             uint64_t nowMicros) {
+  for (int i = 0; i < COMMAND_WINDOW_MAX_PEERS; i++) {
+    Peer &peer = peers[i];
+    if (peer.active &&
+        nowMicros - peer.lastMicros > COMMAND_WINDOW_TIMEOUT_MICROS)
+      peer.active = false;
+    if (peer.active && peer.address == address && peer.port == port)
+      return &peer;
+  }
+  return nullptr;
+}
+
+CommandWindow::Peer *CommandWindow::claimPeer(uint32_t address, uint16_t port,
+                                              uint64_t nowMicros) {
+  Peer *found = findPeer(address, port, nowMicros);
+  if (found != nullptr)
+    return found;
+  Peer *oldest = &peers[0];
+  for (int i = 0; i < COMMAND_WINDOW_MAX_PEERS; i++) {
+    Peer &peer = peers[i];
+    if (oldest->active &&
+        (!peer.active || peer.lastMicros < oldest->lastMicros))
+      oldest = &peer;
+  }
+  oldest->address = address;
+  oldest->port = port;
+  oldest->active = false; // no sequence yet
+  oldest->newest = 0;
+  oldest->seen = 0;
+  oldest->span = 0;
+  oldest->retiredCount = 0;
+  oldest->nextRetired = 0;
+  return oldest;
+}
+
+// New peer, or one that restarted. Nothing before this is missing.
+bool CommandWindow::restarted(const Peer &peer, uint32_t sequence,
+                              uint32_t session) {
+  // sequences wrap, so compare the difference
+  int32_t ahead = (int32_t)(sequence - peer.newest);
+  return !peer.active || session != peer.session ||
+         ahead < -COMMAND_WINDOW_RESTART_GAP;
+}
+
+bool CommandWindow::isRetired(const Peer &peer, uint32_t session) {
+  for (int i = 0; i < peer.retiredCount; i++)
+    if (peer.retired[i] == session)
+      return true;
+  return false;
+}
+
+SequenceResult CommandWindow::check(uint32_t address, uint16_t port,
+                                    uint32_t sequence, uint64_t nowMicros,
+                                    uint32_t session) {
+  SequenceResult result =
+      classify(address, port, sequence, nowMicros, session);
+  if (result == SEQUENCE_ACCEPTED)
+    record(address, port, sequence, nowMicros, session);
+  return result;
+}
+
+SequenceResult CommandWindow::classify(uint32_t address, uint16_t port,
+                                       uint32_t sequence, uint64_t nowMicros,
+                                       uint32_t session) {
+  Peer *peer = findPeer(address, port, nowMicros);
+  if (peer != nullptr && session != peer->session &&
+      isRetired(*peer, session)) {
+    // a straggler from before the DSC restarted
+    stale++;
+    return SEQUENCE_STALE;
+  }
+  if (peer == nullptr || restarted(*peer, sequence, session))
+    return SEQUENCE_ACCEPTED;
+  peer->lastMicros = nowMicros;
+  int32_t ahead = (int32_t)(sequence - peer->newest);
+  if (ahead > 0)
+    return SEQUENCE_ACCEPTED;
+  int behind = -ahead;
+  if (behind < peer->span) {
+    uint64_t bit = 1ull << behind;
+    if (peer->seen & bit) {
+      duplicates++;
+      return SEQUENCE_DUPLICATE;
+    }
+    // arrived, just too late to apply, so not lost
+    peer->seen |= bit;
+  }
+  stale++;
+  return SEQUENCE_STALE;
+}
+
+void CommandWindow::record(uint32_t address, uint16_t port, uint32_t sequence,
+                           uint64_t nowMicros, uint32_t session) {
+  Peer *peer = claimPeer(address, port, nowMicros);
+  peer->lastMicros = nowMicros;
+  if (restarted(*peer, sequence, session)) {
+    if (peer->active && session != peer->session) {
+      peer->retired[peer->nextRetired] = peer->session;
+      peer->nextRetired =
+          (peer->nextRetired + 1) % COMMAND_WINDOW_RETIRED_SESSIONS;
+      if (peer->retiredCount < COMMAND_WINDOW_RETIRED_SESSIONS)
+        peer->retiredCount++;
+    }
+    peer->active = true;
+    peer->session = session;
+    peer->newest = sequence;
+    peer->seen = 1;
+    peer->span = 1;
+    accepted++;
+    return;
+  }
+  int32_t ahead = (int32_t)(sequence - peer->newest);
+  if (ahead <= 0)
+    return; // classify wouldn't have accepted it
+  // sequences that slide out of the window without arriving are lost
+  if (ahead >= COMMAND_WINDOW_BITS) {
+    lost += zeroBits(peer->seen, 0, peer->span) +
+            (ahead - COMMAND_WINDOW_BITS);
+    peer->seen = 1;
+  } else {
+    int kept = COMMAND_WINDOW_BITS - ahead;
+    lost += zeroBits(peer->seen, kept, peer->span - kept);
+    peer->seen = (peer->seen << ahead) | 1;
+  }
+  peer->span += ahead;
+  if (peer->span > COMMAND_WINDOW_BITS)
+    peer->span = COMMAND_WINDOW_BITS;
+  peer->newest = sequence;
+  accepted++;
+}
+
+uint32_t CommandWindow::getAccepted() { return accepted; }
+
+uint32_t CommandWindow::getDuplicates() { return duplicates; }
+
+uint32_t CommandWindow::getStale() { return stale; }
+
+uint32_t CommandWindow::getLost() { return lost; }
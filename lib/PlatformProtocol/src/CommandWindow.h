@@ -0,0 +1,98 @@
+#ifndef __COMMANDWINDOW_H__
+#define __COMMANDWINDOW_H__
+
+#include <atomic>
+#include <cstdint>
+
+// Sequences remembered behind the newest, for telling duplicates from
+// late arrivals and counting losses
+#define COMMAND_WINDOW_BITS 64
+// Peers tracked at once
+#define COMMAND_WINDOW_MAX_PEERS 4
+// A quiet peer is forgotten, so a restarted DSC that sends no session
+// starts afresh
+#define COMMAND_WINDOW_TIMEOUT_MICROS 30000000ull
+// A sequence this far behind is a sender that restarted, not a late packet
+#define COMMAND_WINDOW_RESTART_GAP 1024
+// Sessions a peer has moved on from, whose late packets are stale
+#define COMMAND_WINDOW_RETIRED_SESSIONS 4
+
+enum SequenceResult {
+  SEQUENCE_ACCEPTED = 0,
+  SEQUENCE_DUPLICATE, // seen already
+  SEQUENCE_STALE      // older than one already applied
+};
+
+/**
+ * Sliding window over each DSC's command sequence numbers, so a
+ * duplicated or reordered packet isn't applied twice or out of order.
+ * Only sequences newer than the newest so far are accepted; as in IPsec
+ * replay protection, a bitmap of the last COMMAND_WINDOW_BITS says which
+ * older ones arrived, so a sequence that never did is counted lost once
+ * the window moves past it.
+ *
+ * A DSC that restarts numbers from 1 again. If it sends a session, a new
+ * one starts a new window straight away; without, only a long jump back
+ * or going quiet for COMMAND_WINDOW_TIMEOUT_MICROS does. The sessions it
+ * moved on from are remembered, so a late packet from one is stale
+ * rather than restarting the window again.
+ *
+ * check both classifies a sequence and records it if accepted. A caller
+ * that might still fail to apply an accepted one calls classify, then
+ * record once it has, so a resend isn't taken for a duplicate.
+ *
+ * These are called from the network task; the counters can be read from
+ * anywhere.
+ */
+class CommandWindow {
+public:
+  CommandWindow();
+
+  SequenceResult check(uint32_t address, uint16_t port, uint32_t sequence,
+                       uint64_t nowMicros, uint32_t session = 0);
+  // Duplicates and stale ones are counted, but nothing is accepted
+  SequenceResult classify(uint32_t address, uint16_t port, uint32_t sequence,
+                          uint64_t nowMicros, uint32_t session = 0);
+  // Take a sequence classify accepted as the newest
+  void record(uint32_t address, uint16_t port, uint32_t sequence,
+              uint64_t nowMicros, uint32_t session = 0);
+
+  uint32_t getAccepted();
+  uint32_t getDuplicates();
+  uint32_t getStale();
+  uint32_t getLost();
+
+private:
+  struct Peer {
+    uint32_t address;
+    uint16_t port;
+    bool active;
+    uint32_t session;
+    uint32_t newest;
+    // bit n set if newest - n has arrived
+    uint64_t seen;
+    // bits of seen in use: sequences from the peer's first, up to the
+    // window size
+    int span;
+    // last few sessions replaced, oldest overwritten first
+    uint32_t retired[COMMAND_WINDOW_RETIRED_SESSIONS];
+    int retiredCount;
+    int nextRetired;
+    uint64_t lastMicros;
+  };
+
+  // Null if the peer has no window, or went quiet
+  Peer *findPeer(uint32_t address, uint16_t port, uint64_t nowMicros);
+  // Finds the peer, or makes room for it
+  Peer *claimPeer(uint32_t address, uint16_t port, uint64_t nowMicros);
+  bool restarted(const Peer &peer, uint32_t sequence, uint32_t session);
+  bool isRetired(const Peer &peer, uint32_t session);
+
+  Peer peers[COMMAND_WINDOW_MAX_PEERS];
+  std::atomic<uint32_t> accepted;
+  std::atomic<uint32_t> duplicates;
+  std::atomic<uint32_t> stale;
+  std::atomic<uint32_t> lost;
+};
+
+#endif // __COMMANDWINDOW_H__
@@ -0,0 +1,515 @@
+#include "PlatformProtocol.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Indexed by PlatformCommandCode
+static const char *commandNames[PLATFORM_COMMAND_COUNT] = {
+    "",
+    "home",
+    "park",
+    "track",
+    "moveaxis",
+    "slewbydegrees",
+    "moveaxispercentage",
+    "pulseguide"};
+
+// Indexed by AckResult
+static const char *ackResultNames[] = {
+    "accepted", "duplicate", "stale", "rejected", "busy", "unsynced"};
+
+static void putU32(uint8_t *out, uint32_t v) {
+  out[0] = v;
+  out[1] = v >> 8;
+  out[2] = v >> 16;
+  out[3] = v >> 24;
+}
+
+static uint32_t getU32(const uint8_t *in) {
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) |
+         ((uint32_t)in[3] << 24);
+}
+
+static void putU64(uint8_t *out, uint64_t v) {
+  putU32(out, (uint32_t)v);
+  putU32(out + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t getU64(const uint8_t *in) {
+  return (uint64_t)getU32(in) | ((uint64_t)getU32(in + 4) << 32);
+}
+
+static void putFloat(uint8_t *out, double value) {
+  float f = (float)value;
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  putU32(out, bits);
+}
+
+static double getFloat(const uint8_t *in) {
+  uint32_t bits = getU32(in);
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+static void putDouble(uint8_t *out, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  putU64(out, bits);
+}
+
+static double getDouble(const uint8_t *in) {
+  uint64_t bits = getU64(in);
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static void putHeader(uint8_t *out, ProtocolMessageType type, uint8_t extra) {
+  out[0] = PROTOCOL_MAGIC;
+  out[1] = PROTOCOL_VERSION;
+  out[2] = type;
+  out[3] = extra;
+}
+
+bool isBinaryMessage(const uint8_t *data, size_t length) {
+  return length > 0 && data[0] == PROTOCOL_MAGIC;
+}
+
+int getMessageType(const uint8_t *data, size_t length) {
+  if (length < PROTOCOL_HEADER_BYTES || data[0] != PROTOCOL_MAGIC ||
+      data[1] != PROTOCOL_VERSION)
+    return 0;
+  return data[2];
+}
+
+size_t encodeStatus(const PlatformStatus &status, uint8_t *out,
+                    size_t size) {
+  if (size < PROTOCOL_STATUS_BYTES)
+    return 0;
+  uint8_t flags = 0;
+  if (status.isTracking)
+    flags |= STATUS_FLAG_TRACKING;
+  if (status.slewing)
+    flags |= STATUS_FLAG_SLEWING;
+  putHeader(out, PROTOCOL_STATUS, flags);
+  putFloat(out + 4, status.timeToCenter);
+  putFloat(out + 8, status.timeToEnd);
+  putFloat(out + 12, status.guideMoveRate);
+  putFloat(out + 16, status.trackingRate);
+  putFloat(out + 20, status.axisMoveRateMax);
+  putFloat(out + 24, status.axisMoveRateMin);
+  putU32(out + 28, status.generation);
+  return PROTOCOL_STATUS_BYTES;
+}
+
+bool decodeStatus(const uint8_t *data, size_t length,
+                  PlatformStatus &status) {
+  if (getMessageType(data, length) != PROTOCOL_STATUS ||
+      length < PROTOCOL_STATUS_BYTES)
+    return false;
+  status.isTracking = data[3] & STATUS_FLAG_TRACKING;
+  status.slewing = data[3] & STATUS_FLAG_SLEWING;
+  status.timeToCenter = getFloat(data + 4);
+  status.timeToEnd = getFloat(data + 8);
+  status.guideMoveRate = getFloat(data + 12);
+  status.trackingRate = getFloat(data + 16);
+  status.axisMoveRateMax = getFloat(data + 20);
+  status.axisMoveRateMin = getFloat(data + 24);
+  status.generation = getU32(data + 28);
+  return true;
+}
+
+size_t encodeCommand(const PlatformCommand &command, uint8_t *out,
+                     size_t size) {
+  bool timed = command.executeAtMicros != 0;
+  size_t length =
+      timed ? PROTOCOL_TIMED_COMMAND_BYTES : PROTOCOL_COMMAND_BYTES;
+  size_t sequenceLength = 0;
+  if (command.sequence != 0)
+    sequenceLength = PROTOCOL_SEQUENCE_BYTES +
+                     (command.session != 0 ? PROTOCOL_SESSION_BYTES : 0);
+  if (size < length + sequenceLength)
+    return 0;
+  putHeader(out, timed ? PROTOCOL_TIMED_COMMAND : PROTOCOL_COMMAND,
+            command.code);
+  putDouble(out + 4, command.parameter1);
+  putDouble(out + 12, command.parameter2);
+  if (timed)
+    putU64(out + 20, command.executeAtMicros);
+  if (command.sequence == 0)
+    return length;
+  putU32(out + length, command.sequence);
+  if (command.session != 0)
+    putU32(out + length + PROTOCOL_SEQUENCE_BYTES, command.session);
+  return length + sequenceLength;
+}
+
+bool decodeCommand(const uint8_t *data, size_t length,
+                   PlatformCommand &command) {
+  int type = getMessageType(data, length);
+  size_t fixed = type == PROTOCOL_TIMED_COMMAND ? PROTOCOL_TIMED_COMMAND_BYTES
+                                                : PROTOCOL_COMMAND_BYTES;
+  if ((type != PROTOCOL_COMMAND && type != PROTOCOL_TIMED_COMMAND) ||
+      length < fixed)
+    return false;
+  if (data[3] == PLATFORM_COMMAND_NONE || data[3] >= PLATFORM_COMMAND_COUNT)
+    return false;
+  command.code = (PlatformCommandCode)data[3];
+  command.parameter1 = getDouble(data + 4);
+  command.parameter2 = getDouble(data + 12);
+  command.executeAtMicros = type == PROTOCOL_TIMED_COMMAND ? getU64(data + 20)
+                                                           : 0;
+  command.sequence = length >= fixed + PROTOCOL_SEQUENCE_BYTES
+                         ? getU32(data + fixed)
+                         : 0;
+  size_t withSession =
+      fixed + PROTOCOL_SEQUENCE_BYTES + PROTOCOL_SESSION_BYTES;
+  command.session = length >= withSession
+                        ? getU32(data + fixed + PROTOCOL_SEQUENCE_BYTES)
+                        : 0;
+  return true;
+}
+
+size_t encodeHello(uint8_t *out, size_t size) {
+  if (size < PROTOCOL_HEADER_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_HELLO, 0);
+  return PROTOCOL_HEADER_BYTES;
+}
+
+size_t encodeSubscribe(uint8_t rateHz, uint8_t *out, size_t size) {
+  if (size < PROTOCOL_HEADER_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_SUBSCRIBE, rateHz);
+  return PROTOCOL_HEADER_BYTES;
+}
+
+bool decodeSubscribe(const uint8_t *data, size_t length, uint8_t &rateHz) {
+  if (getMessageType(data, length) != PROTOCOL_SUBSCRIBE)
+    return false;
+  rateHz = data[3];
+  return true;
+}
+
+size_t encodePosition(const PlatformPosition &position, uint8_t *out,
+                      size_t size) {
+  if (size < PROTOCOL_POSITION_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_POSITION, position.flags);
+  putU64(out + 4, position.timeMicros);
+  putU32(out + 12, (uint32_t)position.raPosition);
+  putU32(out + 16, (uint32_t)position.decPosition);
+  putU32(out + 20, (uint32_t)position.raSpeedInMilliHz);
+  putU32(out + 24, (uint32_t)position.decSpeedInMilliHz);
+  return PROTOCOL_POSITION_BYTES;
+}
+
+bool decodePosition(const uint8_t *data, size_t length,
+                    PlatformPosition &position) {
+  if (getMessageType(data, length) != PROTOCOL_POSITION ||
+      length < PROTOCOL_POSITION_BYTES)
+    return false;
+  position.flags = data[3];
+  position.timeMicros = getU64(data + 4);
+  position.raPosition = (int32_t)getU32(data + 12);
+  position.decPosition = (int32_t)getU32(data + 16);
+  position.raSpeedInMilliHz = (int32_t)getU32(data + 20);
+  position.decSpeedInMilliHz = (int32_t)getU32(data + 24);
+  return true;
+}
+
+size_t encodeTimeRequest(const TimeRequest &request, uint8_t *out,
+                         size_t size) {
+  if (size < PROTOCOL_TIME_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_TIME_REQUEST, 0);
+  putU64(out + 4, request.sendMicros);
+  putU64(out + 12, request.previousSendMicros);
+  putU64(out + 20, request.previousReceiveMicros);
+  return PROTOCOL_TIME_BYTES;
+}
+
+bool decodeTimeRequest(const uint8_t *data, size_t length,
+                       TimeRequest &request) {
+  if (getMessageType(data, length) != PROTOCOL_TIME_REQUEST ||
+      length < PROTOCOL_TIME_BYTES)
+    return false;
+  request.sendMicros = getU64(data + 4);
+  request.previousSendMicros = getU64(data + 12);
+  request.previousReceiveMicros = getU64(data + 20);
+  return true;
+}
+
+size_t encodeTimeResponse(const TimeResponse &response, uint8_t *out,
+                          size_t size) {
+  if (size < PROTOCOL_TIME_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_TIME_RESPONSE, 0);
+  putU64(out + 4, response.requestSendMicros);
+  putU64(out + 12, response.receiveMicros);
+  putU64(out + 20, response.replyMicros);
+  return PROTOCOL_TIME_BYTES;
+}
+
+bool decodeTimeResponse(const uint8_t *data, size_t length,
+                        TimeResponse &response) {
+  if (getMessageType(data, length) != PROTOCOL_TIME_RESPONSE ||
+      length < PROTOCOL_TIME_BYTES)
+    return false;
+  response.requestSendMicros = getU64(data + 4);
+  response.receiveMicros = getU64(data + 12);
+  response.replyMicros = getU64(data + 20);
+  return true;
+}
+
+size_t encodeAck(uint32_t sequence, AckResult result, uint8_t *out,
+                 size_t size) {
+  if (size < PROTOCOL_ACK_BYTES)
+    return 0;
+  putHeader(out, PROTOCOL_ACK, result);
+  putU32(out + 4, sequence);
+  return PROTOCOL_ACK_BYTES;
+}
+
+bool decodeAck(const uint8_t *data, size_t length, uint32_t &sequence,
+               AckResult &result) {
+  if (getMessageType(data, length) != PROTOCOL_ACK ||
+      length < PROTOCOL_ACK_BYTES || data[3] > ACK_UNSYNCED)
+    return false;
+  result = (AckResult)data[3];
+  sequence = getU32(data + 4);
+  return true;
+}
+
+size_t encodeJsonAck(uint32_t sequence, AckResult result, uint8_t *out,
+                     size_t size) {
+  int length =
+      snprintf((char *)out, size, "DSC:{\"ack\":%lu,\"result\":\"%s\"}",
+               (unsigned long)sequence, ackResultNames[result]);
+  if (length < 0 || (size_t)length >= size)
+    return 0;
+  return length;
+}
+
+PlatformCommandCode findPlatformCommand(const char *name) {
+  return findPlatformCommand(name, strlen(name));
+}
+
+PlatformCommandCode findPlatformCommand(const char *name, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+
+  // Case labels are hashed by the compiler, which also rejects two names
+  // with the same hash
+  PlatformCommandCode code;
+  switch (hash) {
+  case hashCommandName("home"):
+    code = PLATFORM_COMMAND_HOME;
+    break;
+  case hashCommandName("park"):
+    code = PLATFORM_COMMAND_PARK;
+    break;
+  case hashCommandName("track"):
+    code = PLATFORM_COMMAND_TRACK;
+    break;
+  case hashCommandName("moveaxis"):
+    code = PLATFORM_COMMAND_MOVE_AXIS;
+    break;
+  case hashCommandName("slewbydegrees"):
+    code = PLATFORM_COMMAND_SLEW_BY_DEGREES;
+    break;
+  case hashCommandName("moveaxispercentage"):
+    code = PLATFORM_COMMAND_MOVE_AXIS_PERCENTAGE;
+    break;
+  case hashCommandName("pulseguide"):
+    code = PLATFORM_COMMAND_PULSE_GUIDE;
+    break;
+  default:
+    return PLATFORM_COMMAND_NONE;
+  }
+  // a different name can share a hash
+  const char *expected = commandNames[code];
+  if (strlen(expected) != length || memcmp(expected, name, length) != 0)
+    return PLATFORM_COMMAND_NONE;
+  return code;
+}
+
+const char *getPlatformCommandName(PlatformCommandCode code) {
+  if (code < 0 || code >= PLATFORM_COMMAND_COUNT)
+    return "";
+  return commandNames[code];
+}
+
+// Cursor over an unterminated JSON buffer
+struct JsonScanner {
+  const char *p;
+  const char *end;
+
+  void skipSpace() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+      p++;
+  }
+
+  bool consume(char c) {
+    skipSpace();
+    if (p < end && *p == c) {
+      p++;
+      return true;
+    }
+    return false;
+  }
+
+  // A string without escapes, returned as a span of the buffer
+  bool string(const char *&start, size_t &length) {
+    if (!consume('"'))
+      return false;
+    start = p;
+    while (p < end && *p != '"') {
+      if (*p == '\\')
+        return false;
+      p++;
+    }
+    if (p == end)
+      return false;
+    length = p - start;
+    p++;
+    return true;
+  }
+
+  bool number(double &value) {
+    skipSpace();
+    char digits[32];
+    size_t n = 0;
+    while (p < end && n < sizeof(digits) - 1 &&
+           ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' ||
+            *p == '.' || *p == 'e' || *p == 'E'))
+      digits[n++] = *p++;
+    digits[n] = 0;
+    char *parsedTo;
+    value = strtod(digits, &parsedTo);
+    return n > 0 && parsedTo == digits + n;
+  }
+
+  // Skip any value, including nested objects and arrays
+  bool skipValue() {
+    skipSpace();
+    if (p == end)
+      return false;
+    if (*p == '"') {
+      const char *start;
+      size_t length;
+      return string(start, length);
+    }
+    if (*p == '{' || *p == '[') {
+      int depth = 0;
+      bool inString = false;
+      for (; p < end; p++) {
+        if (inString) {
+          if (*p == '\\')
+            p++;
+          else if (*p == '"')
+            inString = false;
+        } else if (*p == '"') {
+          inString = true;
+        } else if (*p == '{' || *p == '[') {
+          depth++;
+        } else if ((*p == '}' || *p == ']') && --depth == 0) {
+          p++;
+          return true;
+        }
+      }
+      return false;
+    }
+    // number, true, false or null
+    const char *start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ')
+      p++;
+    return p > start;
+  }
+};
+
+static bool keyIs(const char *key, size_t length, const char *name) {
+  return strlen(name) == length && memcmp(key, name, length) == 0;
+}
+
+// Sequence and session are uint32 on the wire. Anything else, eg -1,
+// 1.5 or 1e10, is bad rather than converted.
+static bool toUint32(double value, uint32_t &out) {
+  if (!(value >= 0 && value <= UINT32_MAX) || value != std::floor(value))
+    return false;
+  out = (uint32_t)value;
+  return true;
+}
+
+JsonCommandResult parseJsonCommand(const char *json, size_t length,
+                                   PlatformCommand &command) {
+  JsonScanner in = {json, json + length};
+  const char *name = nullptr;
+  size_t nameLength = 0;
+  bool haveParameter1 = false;
+  bool haveParameter2 = false;
+  bool badField = false;
+  command.parameter1 = 0;
+  command.parameter2 = 0;
+  command.executeAtMicros = 0;
+  command.sequence = 0;
+  command.session = 0;
+
+  if (!in.consume('{'))
+    return JSON_COMMAND_BAD_JSON;
+  if (!in.consume('}')) {
+    do {
+      const char *key;
+      size_t keyLength;
+      if (!in.string(key, keyLength) || !in.consume(':'))
+        return JSON_COMMAND_BAD_JSON;
+      in.skipSpace();
+      bool isNumber = in.p < in.end && *in.p != '"' && *in.p != '{' &&
+                      *in.p != '[' && *in.p != 't' && *in.p != 'f' &&
+                      *in.p != 'n';
+      bool ok;
+      if (keyIs(key, keyLength, "command") && in.p < in.end &&
+          *in.p == '"') {
+        ok = in.string(name, nameLength);
+      } else if (keyIs(key, keyLength, "parameter1") && isNumber) {
+        ok = haveParameter1 = in.number(command.parameter1);
+      } else if (keyIs(key, keyLength, "parameter2") && isNumber) {
+        ok = haveParameter2 = in.number(command.parameter2);
+      } else if (keyIs(key, keyLength, "sequence") && isNumber) {
+        double sequence;
+        ok = in.number(sequence);
+        if (ok && !toUint32(sequence, command.sequence))
+          badField = true;
+      } else if (keyIs(key, keyLength, "session") && isNumber) {
+        double session;
+        ok = in.number(session);
+        if (ok && !toUint32(session, command.session))
+          badField = true;
+      } else {
+        // ArduinoJson read other types as 0, so do the same
+        if (keyIs(key, keyLength, "parameter1"))
+          haveParameter1 = true;
+        if (keyIs(key, keyLength, "parameter2"))
+          haveParameter2 = true;
+        ok = in.skipValue();
+      }
+      if (!ok)
+        return JSON_COMMAND_BAD_JSON;
+    } while (in.consume(','));
+    if (!in.consume('}'))
+      return JSON_COMMAND_BAD_JSON;
+  }
+
+  if (name == nullptr || !haveParameter1 || !haveParameter2)
+    return JSON_COMMAND_MISSING_FIELDS;
+  if (badField)
+    return JSON_COMMAND_BAD_FIELD;
+  command.code = findPlatformCommand(name, nameLength);
+  if (command.code == PLATFORM_COMMAND_NONE)
+    return JSON_COMMAND_UNKNOWN;
+  return JSON_COMMAND_OK;
+}
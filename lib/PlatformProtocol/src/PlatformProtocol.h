@@ -0,0 +1,230 @@
+#ifndef __PLATFORMPROTOCOL_H__
+#define __PLATFORMPROTOCOL_H__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Fixed layout binary UDP messages, alongside the "DSC:"/"EQ:" JSON ones.
+ *
+ * Every binary message starts with PROTOCOL_MAGIC, which can't start a
+ * JSON message, so a listener can take either and old JSON clients keep
+ * working. Then version, message type, and a type specific byte. Numbers
+ * are little endian. Later versions may append fields; a change to
+ * existing fields bumps PROTOCOL_VERSION.
+ *
+ *   status    (32 bytes): header(flags), float32 timeToCenter,
+ *                         timeToEnd, guideMoveRate, trackingRate,
+ *                         axisMoveRateMax, axisMoveRateMin,
+ *                         uint32 generation
+ *   command   (20 bytes): header(code), float64 parameter1, parameter2,
+ *                         then optionally uint32 sequence (24 bytes),
+ *                         then optionally uint32 session (28 bytes)
+ *   hello     (4 bytes):  header(0). Asks for binary status broadcasts.
+ *   subscribe (4 bytes):  header(rate in Hz, 0 to stop). Asks for the
+ *                         position stream, sent straight to the asker.
+ *   position  (28 bytes): header(flags), uint64 timeMicros since boot,
+ *                         int32 raPosition, decPosition (steps),
+ *                         int32 raSpeed, decSpeed (milliHz, negative
+ *                         when stepping backwards)
+ *   time request  (28 bytes): header(0), uint64 sendMicros, and from the
+ *                         last exchange previousSendMicros and
+ *                         previousReceiveMicros (0 if none). DSC clock.
+ *   time response (28 bytes): header(0), uint64 requestSendMicros (as
+ *                         sent), receiveMicros, replyMicros (platform
+ *                         clock)
+ *   timed command (28 bytes): header(code), parameter1, parameter2,
+ *                         uint64 executeAtMicros in the sender's clock,
+ *                         then optionally uint32 sequence (32 bytes),
+ *                         then optionally uint32 session (36 bytes)
+ *   ack       (8 bytes):  header(AckResult), uint32 sequence. Sent back
+ *                         for each command with a sequence.
+ *
+ * JSON commands can carry "sequence" and "session" fields too, and are
+ * acked with "DSC:{"ack":<sequence>,"result":"<result>"}".
+ *
+ * No Arduino dependencies, so the DSC and native tests can share it.
+ */
+
+#define PROTOCOL_MAGIC 0xA5
+#define PROTOCOL_VERSION 1
+
+#define PROTOCOL_HEADER_BYTES 4
+#define PROTOCOL_STATUS_BYTES 32
+#define PROTOCOL_COMMAND_BYTES 20
+#define PROTOCOL_POSITION_BYTES 28
+#define PROTOCOL_TIME_BYTES 28
+#define PROTOCOL_TIMED_COMMAND_BYTES 28
+#define PROTOCOL_SEQUENCE_BYTES 4
+#define PROTOCOL_SESSION_BYTES 4
+#define PROTOCOL_ACK_BYTES 8
+// Big enough for any message
+#define PROTOCOL_MAX_MESSAGE_BYTES 36
+
+#define STATUS_FLAG_TRACKING 0x01
+#define STATUS_FLAG_SLEWING 0x02
+
+#define POSITION_FLAG_TRACKING 0x01
+#define POSITION_FLAG_RA_SLEWING 0x02
+#define POSITION_FLAG_DEC_SLEWING 0x04
+#define POSITION_FLAG_RA_PULSE 0x08
+#define POSITION_FLAG_DEC_PULSE 0x10
+
+enum ProtocolMessageType {
+  PROTOCOL_STATUS = 1,    // platform to DSC, broadcast
+  PROTOCOL_COMMAND = 2,   // DSC to platform
+  PROTOCOL_HELLO = 3,     // DSC to platform
+  PROTOCOL_SUBSCRIBE = 4, // DSC to platform
+  PROTOCOL_POSITION = 5,  // platform to subscribed DSC
+  PROTOCOL_TIME_REQUEST = 6,  // DSC to platform
+  PROTOCOL_TIME_RESPONSE = 7, // platform to DSC
+  PROTOCOL_TIMED_COMMAND = 8, // DSC to platform
+  PROTOCOL_ACK = 9            // platform to DSC
+};
+
+enum AckResult {
+  ACK_ACCEPTED = 0,
+  ACK_DUPLICATE, // already had it, not applied again
+  ACK_STALE,     // arrived after a newer one, dropped
+  ACK_REJECTED,  // bad command or parameters
+  ACK_BUSY,      // no room to queue it, not applied; resend
+  ACK_UNSYNCED   // timed, but the clock isn't synced; sync and resend
+};
+
+// Same commands as the JSON "command" field
+enum PlatformCommandCode {
+  PLATFORM_COMMAND_NONE = 0,
+  PLATFORM_COMMAND_HOME,
+  PLATFORM_COMMAND_PARK,
+  PLATFORM_COMMAND_TRACK,                // parameter1 > 0 turns on
+  PLATFORM_COMMAND_MOVE_AXIS,            // axis, degrees per second
+  PLATFORM_COMMAND_SLEW_BY_DEGREES,      // axis, degrees
+  PLATFORM_COMMAND_MOVE_AXIS_PERCENTAGE, // axis, -100 to 100
+  PLATFORM_COMMAND_PULSE_GUIDE,          // direction, duration ms
+  PLATFORM_COMMAND_COUNT
+};
+
+struct PlatformStatus {
+  double timeToCenter;
+  double timeToEnd;
+  bool isTracking;
+  bool slewing;
+  double guideMoveRate;
+  double trackingRate;
+  double axisMoveRateMax;
+  double axisMoveRateMin;
+  // Bumped each time the fields above (other than times) change
+  uint32_t generation;
+};
+
+// Where the platform is and how fast it's moving, for a DSC to
+// extrapolate from between packets
+struct PlatformPosition {
+  uint64_t timeMicros;
+  int32_t raPosition;
+  int32_t decPosition;
+  int32_t raSpeedInMilliHz;
+  int32_t decSpeedInMilliHz;
+  uint8_t flags; // POSITION_FLAG_*
+};
+
+struct PlatformCommand {
+  PlatformCommandCode code;
+  double parameter1;
+  double parameter2;
+  // When to run it, 0 for on arrival. Encoded as a timed command if set.
+  uint64_t executeAtMicros;
+  // Sender's sequence number, 0 for none. Sequenced commands are acked.
+  uint32_t sequence;
+  // Picked afresh each time the sender starts, 0 for none. Tells a sender
+  // that restarted its sequence from one that is replaying old commands.
+  // Only sent with a sequence.
+  uint32_t session;
+};
+
+// NTP style exchange: the DSC stamps its send time (t0), the platform its
+// receive (t1) and reply (t2) times, and the DSC its receive time (t3),
+// which it passes back in its next request so both ends get the sample.
+struct TimeRequest {
+  uint64_t sendMicros;
+  uint64_t previousSendMicros;
+  uint64_t previousReceiveMicros;
+};
+
+struct TimeResponse {
+  uint64_t requestSendMicros;
+  uint64_t receiveMicros;
+  uint64_t replyMicros;
+};
+
+// True if data is a binary message (of any version)
+bool isBinaryMessage(const uint8_t *data, size_t length);
+
+// Type of a binary message this version understands, or 0
+int getMessageType(const uint8_t *data, size_t length);
+
+// Encoders return bytes written, or 0 if out is too small
+size_t encodeStatus(const PlatformStatus &status, uint8_t *out, size_t size);
+size_t encodeCommand(const PlatformCommand &command, uint8_t *out,
+                     size_t size);
+size_t encodeHello(uint8_t *out, size_t size);
+size_t encodeSubscribe(uint8_t rateHz, uint8_t *out, size_t size);
+size_t encodePosition(const PlatformPosition &position, uint8_t *out,
+                      size_t size);
+size_t encodeTimeRequest(const TimeRequest &request, uint8_t *out,
+                         size_t size);
+size_t encodeTimeResponse(const TimeResponse &response, uint8_t *out,
+                          size_t size);
+size_t encodeAck(uint32_t sequence, AckResult result, uint8_t *out,
+                 size_t size);
+// "DSC:" JSON ack, for a JSON command. Needs a byte spare for the null.
+size_t encodeJsonAck(uint32_t sequence, AckResult result, uint8_t *out,
+                     size_t size);
+
+// Decoders return false for anything else, short or unknown messages
+bool decodeStatus(const uint8_t *data, size_t length, PlatformStatus &status);
+bool decodeCommand(const uint8_t *data, size_t length,
+                   PlatformCommand &command);
+bool decodeSubscribe(const uint8_t *data, size_t length, uint8_t &rateHz);
+bool decodePosition(const uint8_t *data, size_t length,
+                    PlatformPosition &position);
+bool decodeTimeRequest(const uint8_t *data, size_t length,
+                       TimeRequest &request);
+bool decodeTimeResponse(const uint8_t *data, size_t length,
+                        TimeResponse &response);
+bool decodeAck(const uint8_t *data, size_t length, uint32_t &sequence,
+               AckResult &result);
+
+enum JsonCommandResult {
+  JSON_COMMAND_OK = 0,
+  JSON_COMMAND_BAD_JSON,
+  JSON_COMMAND_MISSING_FIELDS, // needs command, parameter1 and parameter2
+  JSON_COMMAND_BAD_FIELD,      // sequence or session not a uint32
+  JSON_COMMAND_UNKNOWN         // command name not in the table
+};
+
+/**
+ * Parse a JSON command object ({"command":"home","parameter1":0,...},
+ * optionally with "sequence" and "session") straight from the packet
+ * buffer, which needn't be null terminated.
+ * Works on the stack only, so the receive path doesn't allocate. Fields
+ * can be in any order and unknown fields are skipped; strings with
+ * escapes aren't supported (no command needs them).
+ */
+JsonCommandResult parseJsonCommand(const char *json, size_t length,
+                                   PlatformCommand &command);
+
+// FNV-1a. constexpr so command names can be hashed at compile time.
+constexpr uint32_t hashCommandName(const char *name,
+                                   uint32_t hash = 2166136261u) {
+  return *name == 0 ? hash
+                    : hashCommandName(name + 1,
+                                      (hash ^ (uint8_t)*name) * 16777619u);
+}
+
+// JSON command names, eg "pulseguide". PLATFORM_COMMAND_NONE if unknown.
+PlatformCommandCode findPlatformCommand(const char *name);
+PlatformCommandCode findPlatformCommand(const char *name, size_t length);
+const char *getPlatformCommandName(PlatformCommandCode code);
+
+#endif // __PLATFORMPROTOCOL_H__
@@ -0,0 +1,62 @@
+#include "StatusDelta.h"
+#include <cmath>
+#include <cstdio>
+
+StatusDelta::StatusDelta() : count(0), next(0) {}
+
+void StatusDelta::begin() { next = 0; }
+
+void StatusDelta::set(const char *name, double value) {
+  if (next >= STATUS_DELTA_MAX_FIELDS)
+    return;
+  Field &field = fields[next];
+  if (next == count) {
+    field.name = name;
+    field.everSent = false;
+    count++;
+  }
+  field.value = value;
+  next++;
+}
+
+int StatusDelta::getFieldCount() { return count; }
+
+size_t StatusDelta::encode(bool full, char *out, size_t size) {
+  size_t length = 0;
+  int written = 0;
+  for (int i = 0; i < count; i++) {
+    Field &field = fields[i];
+    if (!full && field.everSent && field.value == field.sent)
+      continue;
+    char separator = written == 0 ? '{' : ',';
+    double value = field.value;
+    int n;
+    if (!std::isfinite(value)) {
+      // JSON has no NaN
+      n = snprintf(out + length, size - length, "%c\"%s\":null", separator,
+                   field.name);
+    } else if (std::fabs(value) < 1e15 &&
+               value == (double)(long long)value) {
+      // counters and settings, much quicker than %g
+      n = snprintf(out + length, size - length, "%c\"%s\":%lld", separator,
+                   field.name, (long long)value);
+    } else {
+      // 10 digits is as many as any field is good to
+      n = snprintf(out + length, size - length, "%c\"%s\":%.10g", separator,
+                   field.name, value);
+    }
+    if (n < 0 || (size_t)n >= size - length)
+      return 0;
+    length += n;
+    written++;
+  }
+  if (written == 0 || length + 2 > size)
+    return 0;
+  out[length++] = '}';
+  out[length] = 0;
+  for (int i = 0; i < count; i++) {
+    fields[i].sent = fields[i].value;
+    fields[i].everSent = true;
+  }
+  return length;
+}
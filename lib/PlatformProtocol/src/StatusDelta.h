@@ -0,0 +1,52 @@
+#ifndef __STATUSDELTA_H__
+#define __STATUSDELTA_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Fields a status can have
+#define STATUS_DELTA_MAX_FIELDS 40
+// Room for a full status object
+#define STATUS_DELTA_JSON_BYTES 1024
+
+/**
+ * The web page status as a flat JSON object of numbers, written without
+ * the heap, with only the fields that changed since the last one sent.
+ *
+ * Each sample, call begin then set every field, in the same order each
+ * time. encode then writes the changed fields, or all of them for a
+ * snapshot (a new browser has nothing to apply a delta to).
+ *
+ * Names aren't copied, so must be string literals. Not thread safe.
+ */
+class StatusDelta {
+public:
+  StatusDelta();
+
+  void begin();
+  void set(const char *name, double value);
+
+  /**
+   * Write {"name":value,...} of fields changed since the last encode, or
+   * all if full. They then count as sent. Returns the length, 0 if none
+   * changed (nothing is written) or out is too small (nothing counts as
+   * sent).
+   */
+  size_t encode(bool full, char *out, size_t size);
+
+  int getFieldCount();
+
+private:
+  struct Field {
+    const char *name;
+    double value;
+    double sent;
+    bool everSent;
+  };
+
+  Field fields[STATUS_DELTA_MAX_FIELDS];
+  int count;
+  int next;
+};
+
+#endif // __STATUSDELTA_H__
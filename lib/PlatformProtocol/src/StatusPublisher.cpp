@@ -0,0 +1,49 @@
+#include "StatusPublisher.h"
+
+StatusPublisher::StatusPublisher(unsigned long heartbeatMillis,
+                                 unsigned long minIntervalMillis)
+    : heartbeatMillis(heartbeatMillis), minIntervalMillis(minIntervalMillis),
+      published(false), pending(false), lastPublishMillis(0), last(),
+      generation(0), changesPublished(0), heartbeatsPublished(0) {}
+
+bool StatusPublisher::changed(const PlatformStatus &a,
+                              const PlatformStatus &b) {
+  return a.isTracking != b.isTracking || a.slewing != b.slewing ||
+         a.guideMoveRate != b.guideMoveRate ||
+         a.trackingRate != b.trackingRate ||
+         a.axisMoveRateMax != b.axisMoveRateMax ||
+         a.axisMoveRateMin != b.axisMoveRateMin;
+}
+
+bool StatusPublisher::isDue(const PlatformStatus &status,
+                            unsigned long nowMillis) {
+  if (!published || changed(status, last)) {
+    if (!pending)
+      generation++;
+    pending = true;
+    last = status;
+  }
+  // millis() is 32 bits on the ESP32, so wrap the same way everywhere
+  uint32_t sinceLast = (uint32_t)(nowMillis - lastPublishMillis);
+  if (pending && (!published || sinceLast >= minIntervalMillis))
+    return true;
+  return published && sinceLast >= heartbeatMillis;
+}
+
+void StatusPublisher::markSent(unsigned long nowMillis) {
+  if (pending)
+    changesPublished++;
+  else
+    heartbeatsPublished++;
+  published = true;
+  pending = false;
+  lastPublishMillis = nowMillis;
+}
+
+uint32_t StatusPublisher::getGeneration() { return generation; }
+
+uint32_t StatusPublisher::getChangesPublished() { return changesPublished; }
+
+uint32_t StatusPublisher::getHeartbeatsPublished() {
+  return heartbeatsPublished;
+}
@@ -0,0 +1,54 @@
+#ifndef __STATUSPUBLISHER_H__
+#define __STATUSPUBLISHER_H__
+
+#include "PlatformProtocol.h"
+#include <cstdint>
+
+// Resend an unchanged status this often, so a DSC that joins late or
+// missed a packet catches up
+#define STATUS_HEARTBEAT_MILLIS 5000
+// Changes closer together than this go out together
+#define STATUS_MIN_INTERVAL_MILLIS 100
+
+/**
+ * Decides when the status broadcast goes out: straight away when state
+ * changes (tracking toggled, slew started or ended, rates changed), else
+ * a slow heartbeat.
+ *
+ * Only the discrete fields are compared; the times to center and end
+ * always change, so are left for the caller to fill in when publishing.
+ * Each change bumps a generation counter, sent with the status so a DSC
+ * can tell a new state from a heartbeat.
+ */
+class StatusPublisher {
+public:
+  StatusPublisher(unsigned long heartbeatMillis = STATUS_HEARTBEAT_MILLIS,
+                  unsigned long minIntervalMillis = STATUS_MIN_INTERVAL_MILLIS);
+
+  // Call every loop with the current state. True if it should be sent
+  // now. It stays due until markSent, so a failed send is retried.
+  bool isDue(const PlatformStatus &status, unsigned long nowMillis);
+  // Call once the status due has gone out
+  void markSent(unsigned long nowMillis);
+
+  uint32_t getGeneration();
+  // Statuses sent because something changed, and as heartbeats
+  uint32_t getChangesPublished();
+  uint32_t getHeartbeatsPublished();
+
+private:
+  static bool changed(const PlatformStatus &a, const PlatformStatus &b);
+
+  unsigned long heartbeatMillis;
+  unsigned long minIntervalMillis;
+  bool published;
+  // Changed since the last publish, waiting for minIntervalMillis
+  bool pending;
+  unsigned long lastPublishMillis;
+  PlatformStatus last;
+  uint32_t generation;
+  uint32_t changesPublished;
+  uint32_t heartbeatsPublished;
+};
+
+#endif // __STATUSPUBLISHER_H__
@@ -0,0 +1,120 @@
+#include "AlpacaServer.h"
+#include "AsyncUDP.h"
+#include "EQWebServer.h"
+#include "Logging.h"
+#include "WiFi.h"
+#include <ESPAsyncWebServer.h>
+
+AsyncUDP alpacaDiscoveryUDP;
+// MAC address, identifies the platform to alpaca clients
+char alpacaUniqueId[18];
+
+// Query string and form fields. They point into the request, so only
+// last as long as it does.
+static int collectParameters(AsyncWebServerRequest *request,
+                             AlpacaParameter *parameters) {
+  int count = 0;
+  int params = request->params();
+  for (int i = 0; i < params && count < ALPACA_MAX_PARAMETERS; i++) {
+    AsyncWebParameter *param = request->getParam(i);
+    if (param->isFile())
+      continue;
+    parameters[count].name = param->name().c_str();
+    parameters[count].value = param->value().c_str();
+    count++;
+  }
+  return count;
+}
+
+static void send(AsyncWebServerRequest *request, int status,
+                 const char *body, size_t length) {
+  if (length == 0) {
+    LOG_ERROR(LOG_WEB, "Alpaca response too big for buffer");
+    request->send(500);
+    return;
+  }
+  request->send(status, status == 200 ? "application/json" : "text/plain",
+                body);
+}
+
+// /api/v1/telescope/0/<method>, GET or PUT
+void handleTelescope(AsyncWebServerRequest *request,
+                     AlpacaTelescope &telescope) {
+  const String &url = request->url();
+  size_t prefixLength = strlen(ALPACA_API_PREFIX);
+  const char *method =
+      url.length() > prefixLength ? url.c_str() + prefixLength : "";
+  AlpacaParameter parameters[ALPACA_MAX_PARAMETERS];
+  int count = collectParameters(request, parameters);
+  char body[ALPACA_RESPONSE_BYTES];
+  int status;
+  size_t length = telescope.handle(method, request->method() == HTTP_PUT,
+                                   parameters, count, micros(), body,
+                                   sizeof(body), status);
+  send(request, status, body, length);
+}
+
+void setupAlpacaServer(AlpacaTelescope &telescope, LoopMetrics &metrics) {
+  snprintf(alpacaUniqueId, sizeof(alpacaUniqueId), "%s",
+           WiFi.macAddress().c_str());
+
+  // Runs on the AsyncTCP task, so movement goes via the mailbox like the
+  // other web commands. Matches every method under the prefix.
+  timedOn(
+      "/api/v1/telescope/0", HTTP_GET | HTTP_PUT,
+      [&telescope](AsyncWebServerRequest *request) {
+        handleTelescope(request, telescope);
+      },
+      METRIC_ALPACA_HANDLER);
+
+  timedOn(
+      "/management/apiversions", HTTP_GET,
+      [&telescope](AsyncWebServerRequest *request) {
+        AlpacaParameter parameters[ALPACA_MAX_PARAMETERS];
+        int count = collectParameters(request, parameters);
+        char body[ALPACA_RESPONSE_BYTES];
+        send(request, 200, body,
+             telescope.getApiVersions(parameters, count, body,
+                                      sizeof(body)));
+      },
+      METRIC_ALPACA_HANDLER);
+
+  timedOn(
+      "/management/v1/description", HTTP_GET,
+      [&telescope](AsyncWebServerRequest *request) {
+        AlpacaParameter parameters[ALPACA_MAX_PARAMETERS];
+        int count = collectParameters(request, parameters);
+        char body[ALPACA_RESPONSE_BYTES];
+        send(request, 200, body,
+             telescope.getDescription(parameters, count, body,
+                                      sizeof(body)));
+      },
+      METRIC_ALPACA_HANDLER);
+
+  timedOn(
+      "/management/v1/configureddevices", HTTP_GET,
+      [&telescope](AsyncWebServerRequest *request) {
+        AlpacaParameter parameters[ALPACA_MAX_PARAMETERS];
+        int count = collectParameters(request, parameters);
+        char body[ALPACA_RESPONSE_BYTES];
+        send(request, 200, body,
+             telescope.getConfiguredDevices(parameters, count,
+                                            alpacaUniqueId, body,
+                                            sizeof(body)));
+      },
+      METRIC_ALPACA_HANDLER);
+
+  // Clients broadcast to find alpaca servers, and are sent our port
+  if (alpacaDiscoveryUDP.listen(ALPACA_DISCOVERY_PORT)) {
+    LOG_INFO(LOG_WEB, "Listening for alpaca discovery");
+    alpacaDiscoveryUDP.onPacket([&metrics](AsyncUDPPacket packet) {
+      // its own metric: histograms take one writer, and this is another task
+      MetricTimer timer(metrics, METRIC_ALPACA_DISCOVERY);
+      if (!isAlpacaDiscovery(packet.data(), packet.length()))
+        return;
+      char reply[32];
+      size_t length = encodeAlpacaDiscoveryResponse(reply, sizeof(reply));
+      packet.write((const uint8_t *)reply, length);
+    });
+  }
+}
@@ -0,0 +1,11 @@
+#ifndef ALPACASERVER
+#define ALPACASERVER
+
+#include "AlpacaTelescope.h"
+#include "LoopMetrics.h"
+
+// Serve the Alpaca telescope api on the web server, and answer discovery.
+// Call after setupWebServer.
+void setupAlpacaServer(AlpacaTelescope &telescope, LoopMetrics &metrics);
+
+#endif
@@ -0,0 +1,48 @@
+#include "BounceInputSource.h"
+#include <Arduino.h>
+
+#define fastForwardSwitchPin 22
+#define rewindSwitchPin 23
+#define playSwitchPin 27
+
+#define raLimitSwitchPin 21
+// TODO change
+#define decLimitSwitchPin 13
+
+void BounceInputSource::setupButtons() {
+  bounces[BUTTON_FAST_FORWARD].attach(fastForwardSwitchPin, INPUT_PULLUP);
+  bounces[BUTTON_REWIND].attach(rewindSwitchPin, INPUT_PULLUP);
+  bounces[BUTTON_PLAY].attach(playSwitchPin, INPUT_PULLUP);
+
+  bounces[LIMIT_SWITCH_RA].attach(raLimitSwitchPin, INPUT_PULLUP);
+  bounces[LIMIT_SWITCH_DEC].attach(decLimitSwitchPin, INPUT_PULLUP);
+
+  // DEBOUNCE INTERVAL IN MILLISECONDS
+  bounces[BUTTON_FAST_FORWARD].interval(100); // interval in ms
+  bounces[BUTTON_REWIND].interval(100);       // interval in ms
+  bounces[BUTTON_PLAY].interval(100);         // interval in ms
+
+  bounces[LIMIT_SWITCH_RA].interval(10); // interval in ms
+  // interval in ms. Longer as we had ghost pushes
+  bounces[LIMIT_SWITCH_DEC].interval(100);
+}
+
+void BounceInputSource::update() {
+  for (int i = 0; i < PLATFORM_INPUT_COUNT; i++) {
+    bounces[i].update();
+  }
+}
+
+// Note dec switch is wired the other way (high=on) as it was givng false
+// positives.
+static int pushedLevel(PlatformInput input) {
+  return input == LIMIT_SWITCH_DEC ? HIGH : LOW;
+}
+
+bool BounceInputSource::justPushed(PlatformInput input) {
+  return bounces[input].changed() && bounces[input].read() == pushedLevel(input);
+}
+
+bool BounceInputSource::justReleased(PlatformInput input) {
+  return bounces[input].changed() && bounces[input].read() != pushedLevel(input);
+}
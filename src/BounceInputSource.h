@@ -0,0 +1,22 @@
+#ifndef __BOUNCEINPUTSOURCE_H__
+#define __BOUNCEINPUTSOURCE_H__
+
+#include "InputSource.h"
+#include <Bounce2.h>
+
+/**
+ * Buttons and limit switches read from pins, debounced with Bounce2.
+ */
+class BounceInputSource : public InputSource {
+public:
+  void setupButtons();
+
+  void update() override;
+  bool justPushed(PlatformInput input) override;
+  bool justReleased(PlatformInput input) override;
+
+private:
+  Bounce bounces[PLATFORM_INPUT_COUNT];
+};
+
+#endif // __BOUNCEINPUTSOURCE_H__
@@ -2,12 +2,55 @@
 #include "Logging.h"
 // #define PREF_SAVED_POS_KEY "SavedPosition"
 #define STEPPER_MIN_SPEED_HZ 300
+
+static_assert(STEP_QUEUE_LEN == QUEUE_LEN, "StepQueue.h out of date");
+static_assert(STEP_QUEUE_TICKS_PER_S == TICKS_PER_S,
+              "StepQueue.h out of date");
+// Only cut straight over to streaming (no decel) from below this speed
+#define STREAM_TAKEOVER_MAX_MILLIHZ 1000000
+// Tracking speed drifts slowly. Only trace changes bigger than 1/1024.
+#define TRACE_SPEED_CHANGE_SHIFT 10
+
 ConcreteStepperWrapper::ConcreteStepperWrapper(Preferences &p, char *&pk)
-    : prefs(p), prefsKey(pk) {}
+    : prefs(p), prefsKey(pk) {
+  streaming = false;
+  streamSpeedInMillihz = 0;
+  streamUnderruns = 0;
+  streamDry = false;
+  motionTrace = nullptr;
+  traceAxis = MOTION_TRACE_NO_AXIS;
+  lastTraceType = MOTION_EVENT_LOST;
+  lastTraceTarget = 0;
+  lastTraceSpeed = 0;
+}
 
 void ConcreteStepperWrapper::setStepper(FastAccelStepper *s) { stepper = s; }
 
+void ConcreteStepperWrapper::setMotionTrace(MotionTrace *trace, uint8_t axis) {
+  motionTrace = trace;
+  traceAxis = axis;
+}
+
+void ConcreteStepperWrapper::traceChange(MotionEventType type, int32_t target,
+                                         uint32_t speedInMillihz) {
+  if (motionTrace == nullptr)
+    return;
+  uint32_t speedChange = speedInMillihz > lastTraceSpeed
+                             ? speedInMillihz - lastTraceSpeed
+                             : lastTraceSpeed - speedInMillihz;
+  if (type == lastTraceType && target == lastTraceTarget &&
+      speedChange <= (lastTraceSpeed >> TRACE_SPEED_CHANGE_SHIFT))
+    return;
+  lastTraceType = type;
+  lastTraceTarget = target;
+  lastTraceSpeed = speedInMillihz;
+  motionTrace->record(traceAxis, type, stepper->getCurrentPosition(), target,
+                      speedInMillihz);
+}
+
 void ConcreteStepperWrapper::resetPosition(int32_t position) {
+  streaming = false;
+  traceChange(MOTION_EVENT_RESET_POSITION, position, 0);
   stepper->forceStopAndNewPosition(position);
   // stepper->setCurrentPosition(position);
 }
@@ -17,12 +60,14 @@ void ConcreteStepperWrapper::resetPosition(int32_t position) {
 //   stepper->setPositionAfterCommandsCompleted(positionToResetTo);
 // }
 void ConcreteStepperWrapper::stop() {
+  stopStreaming();
+  traceChange(MOTION_EVENT_STOP, 0, 0);
   stepper->stopMove();
   // stops flash getting hammered by braking. Assumes stop called every loop.
   if (stepper->getCurrentSpeedInMilliHz() == 0) {
     int32_t currentPos = stepper->getCurrentPosition();
     if (lastSavedPos != currentPos) {
-      log("Saving position %ld", currentPos);
+      LOG_DEBUG(LOG_MOTOR, "Saving position %ld", (long)currentPos);
       prefs.putInt(prefsKey, currentPos);
       lastSavedPos = currentPos;
     }
@@ -34,23 +79,29 @@ int32_t ConcreteStepperWrapper::getPosition() {
 }
 
 uint32_t ConcreteStepperWrapper::getStepperSpeed() {
+  if (streaming)
+    return streamSpeedInMillihz;
   return stepper->getSpeedInMilliHz();
 }
 
 void ConcreteStepperWrapper::setStepperSpeed(uint32_t speedInMillihz) {
   // log("Setting speed");
+  stopStreaming();
+  traceChange(MOTION_EVENT_SET_SPEED, 0, speedInMillihz);
   stepper->setSpeedInMilliHz(speedInMillihz);
 
   stepper->applySpeedAcceleration();
 }
 
 void ConcreteStepperWrapper::moveTo(int32_t position, uint32_t speedInMillihz) {
-  log("Move called with target %ld  at speed %u for %s", position,
-      speedInMillihz, prefsKey);
+  LOG_DEBUG(LOG_MOTOR, "Move called with target %ld  at speed %lu for %s",
+            (long)position, (unsigned long)speedInMillihz, prefsKey);
+  stopStreaming();
+  traceChange(MOTION_EVENT_MOVE_TO, position, speedInMillihz);
   // Stepper does weird stuff at very slow speeds. Treat these as stops
   if (speedInMillihz < STEPPER_MIN_SPEED_HZ) {
     stepper->stopMove();
-    log("Speed below minimum speed for %s", prefsKey);
+    LOG_WARN(LOG_MOTOR, "Speed below minimum speed for %s", prefsKey);
   } else {
     stepper->setSpeedInMilliHz(speedInMillihz);
     // stepper->setSpeedInHz(5000);
@@ -61,4 +112,114 @@ void ConcreteStepperWrapper::moveTo(int32_t position, uint32_t speedInMillihz) {
 
 void ConcreteStepperWrapper::setAcceleration(unsigned long a) {
   stepper->setAcceleration(a);
-}
\ No newline at end of file
+}
+void ConcreteStepperWrapper::stopStreaming() {
+  if (streaming) {
+    // queued steps are raw commands the ramp generator knows nothing
+    // about, so they have to be dropped rather than decelerated. forceStop
+    // would still run what is queued; this empties the queue. A step
+    // taken between reading the position and stopping is lost, which
+    // tracking corrects from position anyway.
+    stepper->forceStopAndNewPosition(stepper->getCurrentPosition());
+    streaming = false;
+  }
+}
+
+bool ConcreteStepperWrapper::isStreaming() { return streaming; }
+
+uint32_t ConcreteStepperWrapper::getStreamUnderruns() {
+  // queueSteps never lets the queue empty, so an empty queue mid stream is
+  // one the loop didn't get back to in time
+  if (streaming && !streamDry && stepper->queueEntries() == 0) {
+    streamDry = true;
+    streamUnderruns++;
+    LOG_WARN(LOG_MOTOR, "Step queue ran dry for %s", prefsKey);
+  }
+  return streamUnderruns;
+}
+
+bool ConcreteStepperWrapper::addQueueEntry(struct stepper_command_s &cmd) {
+  int8_t result = stepper->addQueueEntry(&cmd);
+  if (result == AQE_OK)
+    return true;
+  if (result != AQE_QUEUE_FULL)
+    LOG_WARN(LOG_MOTOR, "Queueing steps for %s failed: %d", prefsKey, result);
+  return false;
+}
+
+int32_t ConcreteStepperWrapper::getQueueEndPosition() {
+  return stepper->getPositionAfterCommandsCompleted();
+}
+
+/**
+ * Queue entries hold up to 255 steps at a period of up to 65535 ticks
+ * (about 4ms). Slower steps (sidereal tracking is ~8ms) are queued one at
+ * a time as a step followed by pauses (see StepQueue.h).
+ */
+uint32_t ConcreteStepperWrapper::queueSteps(uint32_t steps,
+                                            uint32_t speedInMillihz,
+                                            bool forward) {
+  if (!streaming && stepper->isRampGeneratorActive()) {
+    // Take over from a move. Fine to cut over when slow (eg end of a
+    // pulseguide), otherwise slow down first and try again next call.
+    if (abs(stepper->getCurrentSpeedInMilliHz()) >
+        STREAM_TAKEOVER_MAX_MILLIHZ) {
+      stepper->stopMove();
+      return 0;
+    }
+    // drop what is left of the move's ramp, not just stop adding to it
+    stepper->forceStopAndNewPosition(stepper->getCurrentPosition());
+  }
+  if (speedInMillihz == 0)
+    return 0;
+
+  uint32_t ticks = stepQueueTicks(speedInMillihz);
+  uint32_t perStep = stepQueueEntriesPerStep(ticks);
+  uint32_t queued = 0;
+  struct stepper_command_s cmd;
+  cmd.count_up = forward;
+
+  while (queued < steps) {
+    uint32_t space = STEP_QUEUE_LEN - stepper->queueEntries();
+    if (space < perStep)
+      break;
+    if (perStep == 1) {
+      uint32_t n = steps - queued;
+      if (n > STEP_QUEUE_MAX_ENTRY_STEPS)
+        n = STEP_QUEUE_MAX_ENTRY_STEPS;
+      cmd.ticks = ticks;
+      cmd.steps = n;
+      if (!addQueueEntry(cmd))
+        break;
+      queued += n;
+    } else {
+      cmd.ticks = STEP_QUEUE_SLOW_STEP_TICKS;
+      cmd.steps = 1;
+      if (!addQueueEntry(cmd))
+        break;
+      uint32_t pauseTicks = ticks - STEP_QUEUE_SLOW_STEP_TICKS;
+      uint32_t pauses = perStep - 1;
+      bool paused = true;
+      for (uint32_t i = 0; i < pauses && paused; i++) {
+        cmd.steps = 0;
+        cmd.ticks = pauseTicks / pauses;
+        paused = addQueueEntry(cmd);
+      }
+      if (!paused) {
+        // the step would run early, hurrying everything behind it. Drop
+        // the stream; tracking starts a fresh one from where we are.
+        stepper->forceStopAndNewPosition(stepper->getCurrentPosition());
+        streaming = false;
+        return 0;
+      }
+      queued++;
+    }
+  }
+  if (queued > 0) {
+    traceChange(MOTION_EVENT_STREAM, 0, speedInMillihz);
+    streaming = true;
+    streamDry = false;
+    streamSpeedInMillihz = speedInMillihz;
+  }
+  return queued;
+}
@@ -2,6 +2,8 @@
 #define __CONCRETESTEPPERWRAPPER_H__
 
 #include "FastAccelStepper.h"
+#include "MotionTrace.h"
+#include "StepQueue.h"
 #include "StepperWrapper.h"
 #include <Preferences.h>
 
@@ -24,7 +26,39 @@ public:
   uint32_t getStepperSpeed() override;
   void setAcceleration(unsigned long a);
 
+  uint32_t queueSteps(uint32_t steps, uint32_t speedInMillihz,
+                      bool forward) override;
+  bool isStreaming() override;
+  int32_t getQueueEndPosition() override;
+  uint32_t getStreamUnderruns() override;
+
+  // Record commands sent to the stepper. Null turns it off.
+  void setMotionTrace(MotionTrace *trace, uint8_t axis);
+
 private:
+  // Drop any queued stream, before another command takes over.
+  void stopStreaming();
+  // Add to the queue, logging anything other than a full queue
+  bool addQueueEntry(struct stepper_command_s &cmd);
+  // Record unless it repeats the last event (stop and tracking speed are
+  // sent every loop)
+  void traceChange(MotionEventType type, int32_t target,
+                   uint32_t speedInMillihz);
+
+  bool streaming;
+  uint32_t streamSpeedInMillihz;
+  uint32_t streamUnderruns;
+  // stream has run dry since it was last topped up
+  bool streamDry;
+
+  MotionTrace *motionTrace;
+  uint8_t traceAxis;
+  // Only the loop task drives the stepper (pulse timers hand over to it),
+  // so the dedupe state needs no locking
+  MotionEventType lastTraceType;
+  int32_t lastTraceTarget;
+  uint32_t lastTraceSpeed;
+
   FastAccelStepper* stepper;
   Preferences &prefs;
   int32_t lastSavedPos;
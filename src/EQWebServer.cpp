@@ -2,221 +2,464 @@
 
 #include "Logging.h"
 #include "MotorUnit.h"
+#include "UDPListener.h"
 #include <ArduinoJson.h>
 #include <ESPAsyncWebServer.h>
 #include <LittleFS.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 AsyncWebServer server(80);
+LoopMetrics *webMetrics;
+
+// Status pushed to browsers, see pushStatus
+AsyncWebSocket statusSocket("/ws");
+unsigned long statusIntervalMillis = DEFAULT_STATUS_INTERVAL;
+unsigned long lastStatusPushMillis = 0;
+// Set when a browser connects or misses a push, so the next push is the
+// whole status
+std::atomic<bool> statusSnapshotWanted(false);
+// Browsers on the socket. Its own client list changes on the AsyncTCP task,
+// so loop sends through this copy instead, under the lock. A client is
+// taken out in its disconnect event, which runs before it's freed, so one
+// in here is safe to send to while the lock is held.
+std::mutex statusClientsLock;
+AsyncWebSocketClient *statusClients[STATUS_SOCKET_MAX_CLIENTS];
+int statusClientCount = 0;
+// Each only used from one task: pushed from loop, polled from AsyncTCP
+StatusDelta pushedStatus;
+char pushedStatusJson[STATUS_DELTA_JSON_BYTES];
+StatusDelta polledStatus;
+char polledStatusJson[STATUS_DELTA_JSON_BYTES];
 
 #define IPBROADCASTPORT 50375
 
 // TODO #8 add pulseguide speed here
 void setRaLimitToMiddleDistance(AsyncWebServerRequest *request,
                                 RAStatic &raStatic, Preferences &preferences) {
-  log("/setRaLimitToMiddle");
+  LOG_DEBUG(LOG_WEB, "/setRaLimitToMiddle");
   if (request->hasArg("value")) {
     String distance = request->arg("value");
 
     int distanceValue = distance.toInt();
     if (distanceValue == 0 && distance != "0") {
-      log("Could not parse limit to middle");
+      LOG_WARN(LOG_WEB, "Could not parse limit to middle");
       return;
     }
     raStatic.setLimitSwitchToMiddleDistance(distanceValue);
     preferences.putUInt(RA_PREF_MIDDLE_KEY, distanceValue);
     return;
   }
-  log("No distance arg found");
+  LOG_WARN(LOG_WEB, "No distance arg found");
 }
 
 void setDecLimitToMiddleDistance(AsyncWebServerRequest *request,
                                  DecStatic &decStatic,
                                  Preferences &preferences) {
-  log("/setDecLimitToMiddle");
+  LOG_DEBUG(LOG_WEB, "/setDecLimitToMiddle");
   if (request->hasArg("value")) {
     String distance = request->arg("value");
 
     int distanceValue = distance.toInt();
     if (distanceValue == 0 && distance != "0") {
-      log("Could not parse limit to middle");
+      LOG_WARN(LOG_WEB, "Could not parse limit to middle");
       return;
     }
     decStatic.setLimitSwitchToMiddleDistance(distanceValue);
     preferences.putUInt(DEC_PREF_MIDDLE_KEY, distanceValue);
     return;
   }
-  log("No distance arg found");
+  LOG_WARN(LOG_WEB, "No distance arg found");
 }
 
 void setNunChukMultiplier(AsyncWebServerRequest *request, RAStatic &raStatic,
                           Preferences &preferences) {
-  log("/setNunChukMultipler");
+  LOG_DEBUG(LOG_WEB, "/setNunChukMultipler");
   if (request->hasArg("value")) {
     String nunChuk = request->arg("value");
 
     int nunChukValue = nunChuk.toInt();
     if (nunChukValue == 0 && nunChuk != "0") {
-      log("Could not parse nunchuk multiplier");
+      LOG_WARN(LOG_WEB, "Could not parse nunchuk multiplier");
       return;
     }
     raStatic.setNunChukMultiplier(nunChukValue);
     preferences.putInt(NUNCHUK_MULIPLIER_KEY, nunChukValue);
     return;
   }
-  log("No Nunchuk multiplier");
+  LOG_WARN(LOG_WEB, "No Nunchuk multiplier");
 }
 
 void setRARewindFastFowardSpeedInHz(AsyncWebServerRequest *request,
                                   RAStatic &raStatic,
                                   Preferences &preferences) {
-  log("/setrarunbackSpeed");
+  LOG_DEBUG(LOG_WEB, "/setrarunbackSpeed");
   if (request->hasArg("value")) {
     String speed = request->arg("value");
     long speedValue = std::stoul(speed.c_str());
 
     if (speedValue == 0 && speed != "0") {
-      log("Could not parse speed");
+      LOG_WARN(LOG_WEB, "Could not parse speed");
       return;
     }
     raStatic.setRewindFastFowardSpeedInHz(speedValue);
     preferences.putUInt(RA_PREF_SPEED_KEY, speedValue);
     return;
   }
-  log("No speed arg found");
+  LOG_WARN(LOG_WEB, "No speed arg found");
 }
 
 void setDecRewindFastFowardSpeedInHz(AsyncWebServerRequest *request,
                                     DecStatic &decStatic,
                                     Preferences &preferences) {
-  log("/setdecrunbackSpeed");
+  LOG_DEBUG(LOG_WEB, "/setdecrunbackSpeed");
   if (request->hasArg("value")) {
     String speed = request->arg("value");
     long speedValue = std::stoul(speed.c_str());
 
     if (speedValue == 0 && speed != "0") {
-      log("Could not parse speed");
+      LOG_WARN(LOG_WEB, "Could not parse speed");
       return;
     }
     decStatic.setRewindFastFowardSpeedInHz(speedValue);
     preferences.putUInt(DEC_PREF_SPEED_KEY, speedValue);
     return;
   }
-  log("No speed arg found");
+  LOG_WARN(LOG_WEB, "No speed arg found");
 }
 
 void setAcceleration(AsyncWebServerRequest *request, Preferences &preferences,
                      MotorUnit &motor) {
-  log("/setAcceleration");
+  LOG_DEBUG(LOG_WEB, "/setAcceleration");
   if (request->hasArg("value")) {
     String accel = request->arg("value");
     try {
       unsigned long accelValue = std::stoul(accel.c_str());
       motor.setAcceleration(accelValue);
       preferences.putULong(ACCEL_KEY, accelValue);
-      log("Acceleration value set and saved");
+      LOG_INFO(LOG_WEB, "Acceleration value set and saved");
       return;
     } catch (const std::invalid_argument &ia) {
-      log("Invalid acceleration value: not a number");
+      LOG_WARN(LOG_WEB, "Invalid acceleration value: not a number");
     } catch (const std::out_of_range &oor) {
-      log("Invalid acceleration value: out of range");
+      LOG_WARN(LOG_WEB, "Invalid acceleration value: out of range");
     }
   }
-  log("No acceleration arg found");
+  LOG_WARN(LOG_WEB, "No acceleration arg found");
 }
 
 void setRAGuideRate(AsyncWebServerRequest *request, RAStatic &raStatic,
                     Preferences &preferences) {
 
-  log("/setRAGuideRate");
+  LOG_DEBUG(LOG_WEB, "/setRAGuideRate");
   if (request->hasArg("value")) {
     String rarate = request->arg("value");
 
     double rarateval = rarate.toDouble();
     if (rarateval == 0 && rarate != "0.0") {
-      log("Could not parse rarateval");
+      LOG_WARN(LOG_WEB, "Could not parse rarateval");
       return;
     }
     raStatic.setGuideRateMultiplier(rarateval);
     preferences.putDouble(RA_GUIDE_KEY, rarateval);
-    log("Saved new RA guide rate");
+    LOG_INFO(LOG_WEB, "Saved new RA guide rate");
     return;
   }
-  log("No guide rate found");
+  LOG_WARN(LOG_WEB, "No guide rate found");
 }
 
 void setRaLeadToPivotDistance(AsyncWebServerRequest *request,
                               RAStatic &raStatic, Preferences &preferences) {
 
-  log("/setRaLeadToPivotDistance");
+  LOG_DEBUG(LOG_WEB, "/setRaLeadToPivotDistance");
   if (request->hasArg("value")) {
     String radius = request->arg("value");
 
     double radValue = radius.toDouble();
     if (radValue == 0 && radius != "0.0") {
-      log("Could not parse radius");
+      LOG_WARN(LOG_WEB, "Could not parse radius");
       return;
     }
     raStatic.setScrewToPivotInMM(radValue);
     preferences.putDouble(RA_LEAD_TO_PIVOT_KEY, radValue);
     return;
   }
-  log("No pivot distance found");
+  LOG_WARN(LOG_WEB, "No pivot distance found");
 }
 
 void setDecLeadToPivotDistance(AsyncWebServerRequest *request,
                                DecStatic &decStatic, Preferences &preferences) {
 
-  log("/setDecLeadToPivotDistance");
+  LOG_DEBUG(LOG_WEB, "/setDecLeadToPivotDistance");
   if (request->hasArg("value")) {
     String radius = request->arg("value");
 
     double radValue = radius.toDouble();
     if (radValue == 0 && radius != "0.0") {
-      log("Could not parse radius");
+      LOG_WARN(LOG_WEB, "Could not parse radius");
       return;
     }
     decStatic.setScrewToPivotInMM(radValue);
     preferences.putDouble(DEC_LEAD_TO_PIVOT_KEY, radValue);
     return;
   }
-  log("No pivot distance found");
+  LOG_WARN(LOG_WEB, "No pivot distance found");
 }
 
-void getStatus(AsyncWebServerRequest *request, MotorUnit &motor,
-               RAStatic &raStatic, DecStatic &decStatic) {
-  // log("/getStatus");
+void setSpeedKernel(AsyncWebServerRequest *request, RAStatic &raStatic,
+                    DecStatic &decStatic, Preferences &preferences) {
+  LOG_DEBUG(LOG_WEB, "/speedKernel");
+  if (request->hasArg("value")) {
+    String kernel = request->arg("value");
+
+    int kernelValue = kernel.toInt();
+    if (kernelValue != SPEED_KERNEL_FINITE_DIFFERENCE &&
+        kernelValue != SPEED_KERNEL_ANALYTIC) {
+      LOG_WARN(LOG_WEB, "Could not parse speed kernel");
+      return;
+    }
+    raStatic.setSpeedKernel((SpeedKernel)kernelValue);
+    decStatic.setSpeedKernel((SpeedKernel)kernelValue);
+    preferences.putInt(SPEED_KERNEL_KEY, kernelValue);
+    return;
+  }
+  LOG_WARN(LOG_WEB, "No speed kernel arg found");
+}
 
-  const size_t capacity = JSON_OBJECT_SIZE(15);
+void setTrackingMode(AsyncWebServerRequest *request, CommandMailbox &mailbox,
+                     Preferences &preferences) {
+  LOG_DEBUG(LOG_WEB, "/trackingMode");
+  if (request->hasArg("value")) {
+    String mode = request->arg("value");
+
+    int modeValue = mode.toInt();
+    if ((modeValue == 0 && mode != "0") ||
+        modeValue < TRACKING_MODE_CONTINUOUS ||
+        modeValue > TRACKING_MODE_STREAM) {
+      LOG_WARN(LOG_WEB, "Could not parse tracking mode");
+      return;
+    }
+    // RADynamic belongs to the loop
+    mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::trackingMode(modeValue),
+                 micros());
+    preferences.putInt(TRACKING_MODE_KEY, modeValue);
+    return;
+  }
+  LOG_WARN(LOG_WEB, "No tracking mode arg found");
+}
 
-  DynamicJsonDocument doc(capacity);
-  // Populate the JSON object
-  doc["raRunbackSpeed"] = raStatic.getRewindFastFowardSpeed();
-  doc["decRunbackSpeed"] = decStatic.getRewindFastFowardSpeed();
-  doc["raLeadToPivotDistance"] = raStatic.getScrewToPivotInMM();
-  doc["raLimitToMiddleDistance"] = raStatic.getLimitSwitchToMiddleDistance();
+// Fill in the web page status
+void sampleStatus(StatusDelta &status, MotorUnit &motor, RAStatic &raStatic,
+                  DecStatic &decStatic, CommandMailbox &mailbox) {
+  status.begin();
+  status.set("raRunbackSpeed", raStatic.getRewindFastFowardSpeed());
+  status.set("decRunbackSpeed", decStatic.getRewindFastFowardSpeed());
+  status.set("raLeadToPivotDistance", raStatic.getScrewToPivotInMM());
+  status.set("raLimitToMiddleDistance",
+             raStatic.getLimitSwitchToMiddleDistance());
+
+  status.set("decLeadToPivotDistance", decStatic.getScrewToPivotInMM());
+  status.set("decLimitToMiddleDistance",
+             decStatic.getLimitSwitchToMiddleDistance());
+
+  status.set("raGuideRate", raStatic.getGuideRateMultiplier());
+  status.set("raPosition", motor.getRaPositionInMM());
+  status.set("decPosition", motor.getDecPositionInMM());
+  status.set("velocity", motor.getVelocityInMMPerMinute());
+  status.set("acceleration", motor.getAcceleration());
+  status.set("nunChukMultiplier", raStatic.getNunChukMultiplier());
+  status.set("speedKernel", (int)raStatic.getSpeedKernel());
+  status.set("trackingMode", (int)motor.getTrackingMode());
+  status.set("statusInterval", statusIntervalMillis);
+
+  status.set("raStepsMM", raStatic.getStepsPerMM());
+  status.set("decStepsMM", decStatic.getStepsPerMM());
+
+  status.set("commandLatencyMaxMicros", mailbox.getMaxLatencyMicros());
+  status.set("commandsDropped", mailbox.getCommandsDropped());
+  status.set("commandsCoalesced", mailbox.getCommandsCoalesced());
+  status.set("commandsScheduled", mailbox.getCommandsScheduled());
+  status.set("pulseStartErrorMaxMicros", motor.getPulseStartErrorMaxMicros());
+  status.set("pulseStopErrorMaxMicros", motor.getPulseStopErrorMaxMicros());
+  status.set("logsDropped", getLogsDropped());
+
+  DscLinkStats link;
+  getDscLinkStats(link);
+  status.set("udpCommandsAccepted", link.commandsAccepted);
+  status.set("udpDuplicates", link.duplicates);
+  status.set("udpStale", link.stale);
+  status.set("udpLost", link.lost);
+  status.set("udpRoundTripMicros", link.roundTripMicros);
+  status.set("udpRoundTripMaxMicros", link.roundTripMaxMicros);
+}
 
-  doc["decLeadToPivotDistance"] = decStatic.getScrewToPivotInMM();
-  doc["decLimitToMiddleDistance"] = decStatic.getLimitSwitchToMiddleDistance();
+// Polled status, for anything not on the websocket. Always sent whole.
+void getStatus(AsyncWebServerRequest *request, MotorUnit &motor,
+               RAStatic &raStatic, DecStatic &decStatic,
+               CommandMailbox &mailbox) {
+  sampleStatus(polledStatus, motor, raStatic, decStatic, mailbox);
+  size_t length =
+      polledStatus.encode(true, polledStatusJson, sizeof(polledStatusJson));
+  if (length == 0) {
+    LOG_ERROR(LOG_WEB, "Status too big for buffer");
+    request->send(500);
+    return;
+  }
+  request->send(200, "application/json", polledStatusJson);
+}
 
-  doc["raGuideRate"] = raStatic.getGuideRateMultiplier();
-  doc["raPosition"] = motor.getRaPositionInMM();
-  doc["decPosition"] = motor.getDecPositionInMM();
-  doc["velocity"] = motor.getVelocityInMMPerMinute();
-  doc["acceleration"] = motor.getAcceleration();
-  doc["nunChukMultiplier"] = raStatic.getNunChukMultiplier();
+/**
+ * Push status to browsers on the websocket, every statusIntervalMillis.
+ * Serialised once for all of them, and only the fields that changed,
+ * unless someone new connected or missed one. Called from loop.
+ */
+void pushStatus(MotorUnit &motor, RAStatic &raStatic, DecStatic &decStatic,
+                CommandMailbox &mailbox) {
+  unsigned long now = millis();
+  if (now - lastStatusPushMillis < statusIntervalMillis)
+    return;
+  lastStatusPushMillis = now;
+  std::lock_guard<std::mutex> lock(statusClientsLock);
+  if (statusClientCount == 0)
+    return;
+  bool full = statusSnapshotWanted.exchange(false);
+  sampleStatus(pushedStatus, motor, raStatic, decStatic, mailbox);
+  size_t length =
+      pushedStatus.encode(full, pushedStatusJson, sizeof(pushedStatusJson));
+  if (length == 0)
+    return;
+  for (int i = 0; i < statusClientCount; i++) {
+    AsyncWebSocketClient *client = statusClients[i];
+    // a slow phone skips updates rather than queueing them. The others
+    // have this delta and it doesn't, so next time everyone gets the lot.
+    if (client->status() == WS_CONNECTED && client->canSend())
+      client->text(pushedStatusJson, length);
+    else
+      statusSnapshotWanted = true;
+  }
+}
 
-  doc["raStepsMM"] = raStatic.getStepsPerMM();
-  doc["decStepsMM"] = decStatic.getStepsPerMM();
+void setStatusInterval(AsyncWebServerRequest *request,
+                       Preferences &preferences) {
+  LOG_DEBUG(LOG_WEB, "/statusInterval");
+  if (request->hasArg("value")) {
+    long interval = request->arg("value").toInt();
+    if (interval < STATUS_PUSH_MIN_INTERVAL_MILLIS) {
+      LOG_WARN(LOG_WEB, "Status interval too short");
+      return;
+    }
+    statusIntervalMillis = interval;
+    preferences.putULong(STATUS_INTERVAL_KEY, interval);
+    return;
+  }
+  LOG_WARN(LOG_WEB, "No status interval arg found");
+}
+
+/**
+ * Serve the loop and handler latency histograms. Times are in
+ * nanoseconds; bucket i counts times up to 2^i - 1 ns.
+ */
+void getMetrics(AsyncWebServerRequest *request, LoopMetrics &metrics) {
+  DynamicJsonDocument doc(
+      JSON_OBJECT_SIZE(METRIC_COUNT) +
+      METRIC_COUNT * (JSON_OBJECT_SIZE(5) +
+                      JSON_ARRAY_SIZE(LATENCY_HISTOGRAM_BUCKETS)));
+  for (int i = 0; i < METRIC_COUNT; i++) {
+    LoopMetric metric = (LoopMetric)i;
+    LatencyHistogram &h = metrics.get(metric);
+    JsonObject m = doc.createNestedObject(LoopMetrics::getName(metric));
+    m["count"] = h.getCount();
+    m["maxNs"] = h.getMax();
+    m["p50Ns"] = h.getPercentile(0.5);
+    m["p99Ns"] = h.getPercentile(0.99);
+    JsonArray buckets = m.createNestedArray("buckets");
+    int used = h.getUsedBuckets();
+    for (int b = 0; b < used; b++)
+      buckets.add(h.getBucketCount(b));
+  }
+  if (request->hasArg("reset"))
+    metrics.reset();
 
   String json;
   serializeJson(doc, json);
+  request->send(200, "application/json", json);
+}
 
+void getLogLevels(AsyncWebServerRequest *request) {
+  DynamicJsonDocument doc(JSON_OBJECT_SIZE(LOG_MODULE_COUNT + 1));
+  for (int m = 0; m < LOG_MODULE_COUNT; m++)
+    doc[getLogModuleName((LogModule)m)] =
+        getLogLevelName(getLogLevel((LogModule)m));
+  doc["compiled"] = getLogLevelName(LOG_COMPILE_LEVEL);
+  String json;
+  serializeJson(doc, json);
   request->send(200, "application/json", json);
 }
 
-void setupWebServer(MotorUnit &motor, RAStatic &raStatic, RADynamic &raDynamic,
-                    DecStatic &decStatic, DecDynamic &decDynamic,
+// Runtime log level, eg value=debug&module=RA. No module means all.
+// Levels below LOG_COMPILE_LEVEL are compiled out, so can't be turned on.
+void setLogLevels(AsyncWebServerRequest *request) {
+  LOG_DEBUG(LOG_WEB, "/logLevel");
+  if (!request->hasArg("value")) {
+    LOG_WARN(LOG_WEB, "No log level arg found");
+    request->send(400);
+    return;
+  }
+  int level = findLogLevel(request->arg("value").c_str());
+  if (level < 0) {
+    LOG_WARN(LOG_WEB, "Could not parse log level");
+    request->send(400);
+    return;
+  }
+  int module = LOG_MODULE_COUNT;
+  if (request->hasArg("module")) {
+    module = findLogModule(request->arg("module").c_str());
+    if (module < 0) {
+      LOG_WARN(LOG_WEB, "Unknown log module");
+      request->send(400);
+      return;
+    }
+  }
+  setLogLevel((LogModule)module, level);
+  LOG_INFO(LOG_WEB, "Log level for %s set to %s",
+           module == LOG_MODULE_COUNT ? "all"
+                                      : getLogModuleName((LogModule)module),
+           getLogLevelName(level));
+  getLogLevels(request);
+}
+
+/**
+ * Download the motion trace, see MotionTrace. Decode with
+ * tools/decode_trace.cpp. Streamed from the ring a chunk at a time.
+ */
+void getTrace(AsyncWebServerRequest *request, MotionTrace &trace) {
+  std::shared_ptr<MotionTraceReader> reader =
+      std::make_shared<MotionTraceReader>(trace);
+  AsyncWebServerResponse *response = request->beginResponse(
+      "application/octet-stream", reader->getSize(),
+      [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+        return reader->read(buffer, maxLen, index);
+      });
+  response->addHeader("Content-Disposition",
+                      "attachment; filename=\"trace.bin\"");
+  request->send(response);
+}
+
+void timedOn(const char *uri, WebRequestMethodComposite method,
+             ArRequestHandlerFunction handler, LoopMetric metric) {
+  server.on(uri, method,
+            [handler, metric](AsyncWebServerRequest *request) {
+              MetricTimer timer(*webMetrics, metric);
+              handler(request);
+            });
+}
+
+void setupWebServer(MotorUnit &motor, RAStatic &raStatic,
+                    DecStatic &decStatic, CommandMailbox &mailbox,
+                    LoopMetrics &metrics, MotionTrace &trace,
                     Preferences &preferences) {
+  webMetrics = &metrics;
 
   int raRewindFastFowardSpeed =
       preferences.getUInt(RA_PREF_SPEED_KEY, DEFAULT_SPEED);
@@ -242,15 +485,16 @@ void setupWebServer(MotorUnit &motor, RAStatic &raStatic, RADynamic &raDynamic,
   double raGuideSpeedMultiplier =
       preferences.getDouble(RA_GUIDE_KEY, DEFAULT_RA_GUIDE);
   unsigned long acceleration = preferences.getULong(ACCEL_KEY, DEFAULT_ACCEL);
-
-  log("Preferences loaded : rarewindspeed: %d decrewindspeed: %d limitToMiddle "
-      "%d "
-      "radius "
-      "%f NunChuk multiplier %f RA Guide multiplier %f Accel: %d",
-      raRewindFastFowardSpeed,
-      decRewindFastFowardSpeed, raLimitSwitchToMiddleDistance,
-      raLeadScrewToPivotMM, nunChukMultiplier, raGuideSpeedMultiplier,
-      acceleration);
+  SpeedKernel speedKernel =
+      (SpeedKernel)preferences.getInt(SPEED_KERNEL_KEY, DEFAULT_SPEED_KERNEL);
+
+  LOG_INFO(LOG_WEB,
+           "Preferences loaded : rarewindspeed: %d decrewindspeed: %d "
+           "limitToMiddle %d radius %f NunChuk multiplier %d RA Guide "
+           "multiplier %f Accel: %lu",
+           raRewindFastFowardSpeed, decRewindFastFowardSpeed,
+           raLimitSwitchToMiddleDistance, raLeadScrewToPivotMM,
+           nunChukMultiplier, raGuideSpeedMultiplier, acceleration);
   // order matters here: rewind fast forward speed uses previous sets
   // for calcs
   raStatic.setNunChukMultiplier(nunChukMultiplier);
@@ -258,86 +502,159 @@ void setupWebServer(MotorUnit &motor, RAStatic &raStatic, RADynamic &raDynamic,
   raStatic.setLimitSwitchToMiddleDistance(raLimitSwitchToMiddleDistance);
   raStatic.setScrewToPivotInMM(raLeadScrewToPivotMM);
   raStatic.setRewindFastFowardSpeedInHz(raRewindFastFowardSpeed);
+  raStatic.setSpeedKernel(speedKernel);
 
   decStatic.setNunChukMultiplier(nunChukMultiplier);
   decStatic.setGuideRateMultiplier(raGuideSpeedMultiplier);
   decStatic.setLimitSwitchToMiddleDistance(decLimitSwitchToMiddleDistance);
   decStatic.setScrewToPivotInMM(decLeadScrewToPivotMM);
   decStatic.setRewindFastFowardSpeedInHz(decRewindFastFowardSpeed);
+  decStatic.setSpeedKernel(speedKernel);
 
   motor.setAcceleration(acceleration);
-
-  server.on("/getStatus", HTTP_GET,
-            [&motor, &raStatic,&decStatic](AsyncWebServerRequest *request) {
-              getStatus(request, motor, raStatic,decStatic);
+  statusIntervalMillis =
+      preferences.getULong(STATUS_INTERVAL_KEY, DEFAULT_STATUS_INTERVAL);
+
+  // Runs on the AsyncTCP task
+  statusSocket.onEvent([](AsyncWebSocket *socket, AsyncWebSocketClient *client,
+                          AwsEventType type, void *arg, uint8_t *data,
+                          size_t length) {
+    if (type == WS_EVT_CONNECT) {
+      LOG_DEBUG(LOG_WEB, "Status socket client %lu connected",
+                (unsigned long)client->id());
+      std::lock_guard<std::mutex> lock(statusClientsLock);
+      if (statusClientCount == STATUS_SOCKET_MAX_CLIENTS) {
+        LOG_WARN(LOG_WEB, "Too many status sockets, closing %lu",
+                 (unsigned long)client->id());
+        client->close();
+        return;
+      }
+      statusClients[statusClientCount++] = client;
+      statusSnapshotWanted = true;
+    } else if (type == WS_EVT_DISCONNECT) {
+      std::lock_guard<std::mutex> lock(statusClientsLock);
+      for (int i = 0; i < statusClientCount; i++) {
+        if (statusClients[i] == client) {
+          statusClients[i] = statusClients[--statusClientCount];
+          break;
+        }
+      }
+    }
+  });
+  server.addHandler(&statusSocket);
+
+  timedOn("/getStatus", HTTP_GET,
+            [&motor, &raStatic, &decStatic,
+             &mailbox](AsyncWebServerRequest *request) {
+              getStatus(request, motor, raStatic, decStatic, mailbox);
+            },
+            METRIC_WEB_STATUS);
+
+  // not timed, so reading metrics doesn't show up in them
+  server.on("/metrics", HTTP_GET,
+            [&metrics](AsyncWebServerRequest *request) {
+              getMetrics(request, metrics);
             });
 
-  server.on("/rarunbackSpeed", HTTP_POST,
+  timedOn("/trace", HTTP_GET, [&trace](AsyncWebServerRequest *request) {
+    getTrace(request, trace);
+  });
+
+  timedOn("/logLevel", HTTP_GET,
+          [](AsyncWebServerRequest *request) { getLogLevels(request); });
+  timedOn("/logLevel", HTTP_POST,
+          [](AsyncWebServerRequest *request) { setLogLevels(request); });
+
+  timedOn("/rarunbackSpeed", HTTP_POST,
             [&raStatic, &preferences](AsyncWebServerRequest *request) {
               setRARewindFastFowardSpeedInHz(request, raStatic, preferences);
             });
 
-  server.on("/decrunbackSpeed", HTTP_POST,
+  timedOn("/decrunbackSpeed", HTTP_POST,
             [&decStatic, &preferences](AsyncWebServerRequest *request) {
               setDecRewindFastFowardSpeedInHz(request, decStatic, preferences);
             });
 
-  server.on("/raLeadToPivotDistance", HTTP_POST,
+  timedOn("/raLeadToPivotDistance", HTTP_POST,
             [&raStatic, &preferences](AsyncWebServerRequest *request) {
               setRaLeadToPivotDistance(request, raStatic, preferences);
             });
-  server.on("/raLimitToMiddleDistance", HTTP_POST,
+  timedOn("/raLimitToMiddleDistance", HTTP_POST,
             [&raStatic, &preferences](AsyncWebServerRequest *request) {
               setRaLimitToMiddleDistance(request, raStatic, preferences);
             });
-  server.on("/decLeadToPivotDistance", HTTP_POST,
+  timedOn("/decLeadToPivotDistance", HTTP_POST,
             [&decStatic, &preferences](AsyncWebServerRequest *request) {
               setDecLeadToPivotDistance(request, decStatic, preferences);
             });
-  server.on("/decLimitToMiddleDistance", HTTP_POST,
+  timedOn("/decLimitToMiddleDistance", HTTP_POST,
             [&decStatic, &preferences](AsyncWebServerRequest *request) {
               setDecLimitToMiddleDistance(request, decStatic, preferences);
             });
 
-  server.on("/nunChukMultiplier", HTTP_POST,
+  timedOn("/nunChukMultiplier", HTTP_POST,
             [&raStatic, &preferences](AsyncWebServerRequest *request) {
               setNunChukMultiplier(request, raStatic, preferences);
             });
-  server.on("/acceleration", HTTP_POST,
+  timedOn("/acceleration", HTTP_POST,
             [&motor, &preferences](AsyncWebServerRequest *request) {
               setAcceleration(request, preferences, motor);
             });
 
-  server.on("/raGuideRate", HTTP_POST,
+  timedOn("/speedKernel", HTTP_POST,
+            [&raStatic, &decStatic, &preferences](
+                AsyncWebServerRequest *request) {
+              setSpeedKernel(request, raStatic, decStatic, preferences);
+            });
+
+  timedOn("/trackingMode", HTTP_POST,
+          [&mailbox, &preferences](AsyncWebServerRequest *request) {
+            setTrackingMode(request, mailbox, preferences);
+          });
+
+  timedOn("/statusInterval", HTTP_POST,
+          [&preferences](AsyncWebServerRequest *request) {
+            setStatusInterval(request, preferences);
+          });
+
+  timedOn("/raGuideRate", HTTP_POST,
             [&raStatic, &preferences](AsyncWebServerRequest *request) {
               setRAGuideRate(request, raStatic, preferences);
             });
 
-  server.on("/homera", HTTP_POST, [&raDynamic](AsyncWebServerRequest *request) {
-    raDynamic.gotoStart();
+  // Motor commands run on the AsyncTCP task, so go via the mailbox for the
+  // motor loop to apply.
+  timedOn("/homera", HTTP_POST, [&mailbox](AsyncWebServerRequest *request) {
+    mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::gotoStart(AXIS_RA),
+                 micros());
   });
 
-  server.on("/parkra", HTTP_POST, [&raDynamic](AsyncWebServerRequest *request) {
-    raDynamic.gotoEndish();
+  timedOn("/parkra", HTTP_POST, [&mailbox](AsyncWebServerRequest *request) {
+    mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::gotoEnd(AXIS_RA), micros());
   });
 
-  server.on(
-      "/centerra", HTTP_POST,
-      [&raDynamic](AsyncWebServerRequest *request) { raDynamic.gotoMiddle(); });
+  timedOn("/centerra", HTTP_POST,
+            [&mailbox](AsyncWebServerRequest *request) {
+              mailbox.post(COMMAND_SOURCE_WEB,
+                           MotorCommand::gotoMiddle(AXIS_RA), micros());
+            });
 
-  server.on("/homedec", HTTP_POST,
-            [&decDynamic](AsyncWebServerRequest *request) {
-              decDynamic.gotoStart();
+  timedOn("/homedec", HTTP_POST,
+            [&mailbox](AsyncWebServerRequest *request) {
+              mailbox.post(COMMAND_SOURCE_WEB,
+                           MotorCommand::gotoStart(AXIS_DEC), micros());
             });
 
-  server.on("/parkdec", HTTP_POST,
-            [&decDynamic](AsyncWebServerRequest *request) {
-              decDynamic.gotoEndish();
+  timedOn("/parkdec", HTTP_POST,
+            [&mailbox](AsyncWebServerRequest *request) {
+              mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::gotoEnd(AXIS_DEC),
+                           micros());
             });
 
-  server.on("/centerdec", HTTP_POST,
-            [&decDynamic](AsyncWebServerRequest *request) {
-              decDynamic.gotoMiddle();
+  timedOn("/centerdec", HTTP_POST,
+            [&mailbox](AsyncWebServerRequest *request) {
+              mailbox.post(COMMAND_SOURCE_WEB,
+                           MotorCommand::gotoMiddle(AXIS_DEC), micros());
             });
   // TODO #2 implement tracking on off
   //  server.on("/trackingOn", HTTP_POST,
@@ -354,6 +671,6 @@ void setupWebServer(MotorUnit &motor, RAStatic &raStatic, RADynamic &raDynamic,
   // WebSerial is accessible at "<IP Address>/webserial" in browser
 
   server.begin();
-  log("Server started");
+  LOG_INFO(LOG_WEB, "Server started");
   return;
 }
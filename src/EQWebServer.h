@@ -2,11 +2,13 @@
 #define MYWEBSERVER_H
 #include <ESPAsyncWebServer.h>
 // #include "DigitalCaliper.h"
+#include "CommandMailbox.h"
+#include "LoopMetrics.h"
+#include "MotionTrace.h"
 #include "MotorUnit.h"
-#include "RADynamic.h"
 #include "RAStatic.h"
 #include "DecStatic.h"
-#include "DecDynamic.h"
+#include "StatusDelta.h"
 #include <Preferences.h>
 
 
@@ -29,9 +31,23 @@
 #define RA_GUIDE_KEY "raguide"
 #define ACCEL_KEY "accel"
 
+#define SPEED_KERNEL_KEY "spdkern"
+#define DEFAULT_SPEED_KERNEL SPEED_KERNEL_FINITE_DIFFERENCE
+
+// Schedule keeps tracking through loop stalls, see MotorHardware
+#define TRACKING_MODE_KEY "trkmode"
+#define DEFAULT_TRACKING_MODE TRACKING_MODE_SCHEDULE
+
 #define NUNCHUK_MULIPLIER_KEY "ncmult"
 #define DEFAULT_NUNCHUK_MULIPLIER 2
 
+// How often status is pushed to browsers, ms
+#define STATUS_INTERVAL_KEY "statint"
+#define DEFAULT_STATUS_INTERVAL 1000
+#define STATUS_PUSH_MIN_INTERVAL_MILLIS 100
+// Browsers that can watch status at once; more are closed
+#define STATUS_SOCKET_MAX_CLIENTS 4
+
 #define DEFAULT_ACCEL 100000
 #define DEFAULT_RA_GUIDE 0.5
 
@@ -48,7 +64,17 @@
 #define DEFAULT_DEC_LEAD_SCREW_TO_PIVOT 605 
 
 
-void setupWebServer(MotorUnit &motor, RAStatic &raStatic, RADynamic &raDynamic,
-                    DecStatic &decStatic, DecDynamic &decDynamic,
+// Register a handler on the web server, timed into one of the web metrics
+void timedOn(const char *uri, WebRequestMethodComposite method,
+             ArRequestHandlerFunction handler,
+             LoopMetric metric = METRIC_WEB_HANDLER);
+
+void setupWebServer(MotorUnit &motor, RAStatic &raStatic,
+                    DecStatic &decStatic, CommandMailbox &mailbox,
+                    LoopMetrics &metrics, MotionTrace &trace,
                     Preferences &prefs);
+
+// Send changed status to browsers on /ws. Call from loop.
+void pushStatus(MotorUnit &motor, RAStatic &raStatic, DecStatic &decStatic,
+                CommandMailbox &mailbox);
 #endif
@@ -1,9 +1,17 @@
+#include "AlpacaServer.h"
+#include "AlpacaTelescope.h"
+#include "CommandMailbox.h"
 #include "ConcreteStepperWrapper.h"
 #include "EQWebServer.h"
 #include "FS.h"
+#include "LoopMetrics.h"
 #include "Logging.h"
+#include "Lx200Server.h"
+#include "MotionTrace.h"
+#include "MotorHardware.h"
 #include "MotorUnit.h"
 #include "Network.h"
+#include "PositionStream.h"
 #include <SPI.h> //needed to make tcmstepper compile!
 // #include "OTA.h"
 #include "DecDynamic.h"
@@ -17,7 +25,8 @@
 #include <Preferences.h>
 
 // How long we delay the main loop.
-// Half of this time is the average pulsetime end error
+// Pulseguides are timed by esp_timer, and applied as soon as their timers
+// wake the loop (see MotorHardware::sleep), so this adds no pulse error
 #define MAINLOOPTIME 25 // ms
 
 RAStatic raStatic;
@@ -26,12 +35,23 @@ Preferences prefs;
 
 RADynamic raDynamic(raStatic);
 DecDynamic decDynamic(decStatic);
-MotorUnit motorUnit(raStatic, raDynamic, decStatic, decDynamic, prefs);
+CommandMailbox mailbox(raDynamic, decDynamic);
+LoopMetrics metrics;
+MotionTrace motionTrace;
+PositionStream positionStream;
+MotorUnit motorUnit(raStatic, raDynamic, decStatic, decDynamic, mailbox,
+                    metrics);
+MotorHardware motorHardware(motorUnit, raStatic, raDynamic, decStatic,
+                            decDynamic, motionTrace, prefs);
 Network network(prefs, WE_ARE_EQ);
+AlpacaTelescope alpacaTelescope(raStatic, raDynamic, decStatic, decDynamic,
+                                mailbox);
 
 void setup() {
   Serial.begin(115200);
   Serial.println("Booting");
+  // log() only queues lines, this prints them
+  startLogTask();
   LittleFS.begin();
 
   prefs.begin("Platform", false);
@@ -45,29 +65,53 @@ void setup() {
 
   delay(500);
   // order of setup matters here. Web server loads prefs
-  setupWebServer(motorUnit, raStatic, raDynamic, decStatic, decDynamic, prefs);
+  setupWebServer(motorUnit, raStatic, decStatic, mailbox, metrics,
+                 motionTrace, prefs);
 
-  motorUnit.setupMotors();
+  motorHardware.setupMotors();
 
-  setupUDPListener(motorUnit, raDynamic, decDynamic);
+  setupUDPListener(motorUnit, mailbox, metrics, positionStream);
+  // guiding software can talk to the platform directly, not via the dsc
+  setupAlpacaServer(alpacaTelescope, metrics);
+  setupLx200Server(raStatic, decStatic, mailbox, metrics);
 }
 
+// Cycle count at start of last loop, for loop period metric
+uint32_t lastLoopStart = 0;
+
 void loop() {
   try {
-    delay(MAINLOOPTIME);
-    // long now=millis();
-    // send status to dsc via udp (contains a timer to stop spamming each loop)
-    broadcastStatus(motorUnit, raStatic, raDynamic);
-    // long broadcast=millis();
+    motorHardware.sleep(MAINLOOPTIME);
+    uint32_t loopStart = readCycleCounter();
+    if (lastLoopStart != 0)
+      metrics.recordSince(METRIC_LOOP_PERIOD, lastLoopStart);
+    lastLoopStart = loopStart;
+
+    // send status to dsc via udp (only on change, or as a heartbeat)
+    {
+      MetricTimer timer(metrics, METRIC_BROADCAST_STATUS);
+      broadcastStatus(motorUnit, raStatic, raDynamic);
+    }
     // motor raDynamic loop
-    motorUnit.onLoop();
-    // long loop=millis();
-    // log("Main loop processing: broadcast time %ld, loop time %ld",broadcast-now,loop-broadcast);
+    {
+      MetricTimer timer(metrics, METRIC_MOTOR_UNIT);
+      motorUnit.onLoop();
+    }
+    // positions to subscribed dscs, after the loop so they're fresh
+    {
+      MetricTimer timer(metrics, METRIC_POSITION_STREAM);
+      streamPosition(motorUnit, positionStream);
+    }
+    // status to any browsers watching, serialised once for them all
+    {
+      MetricTimer timer(metrics, METRIC_WEB_PUSH);
+      pushStatus(motorUnit, raStatic, decStatic, mailbox);
+    }
   }
 
   catch (const std::exception &ex) {
-    log(ex.what());
+    LOG_ERROR(LOG_CORE, "Unhandled error %s", ex.what());
   } catch (const std::string &ex) {
-    log("Unhandled error %s",ex);
+    LOG_ERROR(LOG_CORE, "Unhandled error %s", ex.c_str());
   }
 }
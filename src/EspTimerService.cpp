@@ -0,0 +1,61 @@
+#include "EspTimerService.h"
+#include "Logging.h"
+
+EspTimerService::EspTimerService() {
+  timerCount = 0;
+  sleepingTask = nullptr;
+}
+
+void EspTimerService::dispatch(void *arg) {
+  EspTimer *timer = (EspTimer *)arg;
+  timer->callback(timer->arg);
+  TaskHandle_t task = timer->service->sleepingTask;
+  if (task != nullptr)
+    xTaskNotifyGive(task);
+}
+
+int EspTimerService::createTimer(TimerCallback callback, void *arg,
+                                 const char *name) {
+  if (timerCount >= ESP_TIMER_COUNT) {
+    LOG_ERROR(LOG_MOTOR, "No timers left to create %s", name);
+    return -1;
+  }
+  EspTimer &timer = timers[timerCount];
+  timer.callback = callback;
+  timer.arg = arg;
+  timer.service = this;
+  esp_timer_create_args_t args = {};
+  args.callback = dispatch;
+  args.arg = &timer;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = name;
+  esp_err_t err = esp_timer_create(&args, &timer.handle);
+  if (err != ESP_OK) {
+    LOG_ERROR(LOG_MOTOR, "Failed to create timer %s: %d", name, err);
+    return -1;
+  }
+  return timerCount++;
+}
+
+void EspTimerService::startOnce(int timer, uint64_t delayMicros) {
+  // esp_timer won't start a running timer
+  esp_timer_stop(timers[timer].handle);
+  esp_timer_start_once(timers[timer].handle, delayMicros);
+}
+
+void EspTimerService::stop(int timer) { esp_timer_stop(timers[timer].handle); }
+
+bool EspTimerService::sleepUntilTimer(uint64_t deadlineMicros) {
+  sleepingTask = xTaskGetCurrentTaskHandle();
+  uint64_t now = nowMicros();
+  if (now >= deadlineMicros)
+    return ulTaskNotifyTake(pdTRUE, 0) > 0;
+  // round up, so we never wake before the deadline
+  TickType_t ticks =
+      pdMS_TO_TICKS((uint32_t)((deadlineMicros - now + 999) / 1000));
+  if (ticks == 0)
+    ticks = 1;
+  return ulTaskNotifyTake(pdTRUE, ticks) > 0;
+}
+
+uint64_t EspTimerService::nowMicros() { return esp_timer_get_time(); }
@@ -0,0 +1,42 @@
+#ifndef __ESPTIMERSERVICE_H__
+#define __ESPTIMERSERVICE_H__
+
+#include "TimerService.h"
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define ESP_TIMER_COUNT 8
+
+/**
+ * TimerService on esp_timer. Callbacks are dispatched from the esp_timer
+ * task, which runs at high priority, so land within tens of microseconds
+ * whatever the main loop is doing. Each fire also notifies the task
+ * waiting in sleepUntilTimer, so the loop can act on it straight away.
+ */
+class EspTimerService : public TimerService {
+public:
+  EspTimerService();
+
+  int createTimer(TimerCallback callback, void *arg,
+                  const char *name) override;
+  void startOnce(int timer, uint64_t delayMicros) override;
+  void stop(int timer) override;
+  bool sleepUntilTimer(uint64_t deadlineMicros) override;
+  uint64_t nowMicros() override;
+
+private:
+  struct EspTimer {
+    esp_timer_handle_t handle;
+    TimerCallback callback;
+    void *arg;
+    EspTimerService *service;
+  };
+  static void dispatch(void *arg);
+
+  EspTimer timers[ESP_TIMER_COUNT];
+  int timerCount;
+  // task to notify when a timer fires
+  volatile TaskHandle_t sleepingTask;
+};
+
+#endif // __ESPTIMERSERVICE_H__
@@ -0,0 +1,77 @@
+#include "Lx200Server.h"
+#include "AsyncTCP.h"
+#include "Logging.h"
+#include "Lx200Session.h"
+
+// Clients served at once. More are refused.
+#define LX200_MAX_CLIENTS 2
+
+AsyncServer lx200Server(LX200_PORT);
+
+// A session per client slot, so connecting doesn't allocate one. Only
+// touched on the AsyncTCP task.
+struct Lx200Client {
+  AsyncClient *client; // null if free
+  Lx200Session *session;
+};
+Lx200Client lx200Clients[LX200_MAX_CLIENTS];
+
+static void onLx200Data(Lx200Client &slot, LoopMetrics &metrics, void *data,
+                        size_t length) {
+  MetricTimer timer(metrics, METRIC_LX200_HANDLER);
+  char reply[LX200_REPLY_BYTES];
+  size_t replyLength = slot.session->feed((const uint8_t *)data, length,
+                                          micros(), reply, sizeof(reply));
+  if (replyLength > 0) {
+    slot.client->add(reply, replyLength);
+    slot.client->send();
+  }
+}
+
+static void onLx200Client(AsyncClient *client, LoopMetrics &metrics) {
+  Lx200Client *slot = nullptr;
+  for (int i = 0; i < LX200_MAX_CLIENTS; i++) {
+    if (lx200Clients[i].client == nullptr)
+      slot = &lx200Clients[i];
+  }
+  if (slot == nullptr) {
+    LOG_WARN(LOG_NET, "LX200 client refused, %d connected",
+             LX200_MAX_CLIENTS);
+    client->close(true);
+    delete client;
+    return;
+  }
+  LOG_INFO(LOG_NET, "LX200 client connected from %s",
+           client->remoteIP().toString().c_str());
+  slot->client = client;
+  slot->session->reset();
+  // guide pulses are small and want to go now
+  client->setNoDelay(true);
+  client->onData(
+      [slot, &metrics](void *arg, AsyncClient *c, void *data, size_t len) {
+        onLx200Data(*slot, metrics, data, len);
+      });
+  client->onDisconnect([slot](void *arg, AsyncClient *c) {
+    LOG_INFO(LOG_NET, "LX200 client disconnected");
+    slot->session->disconnect(micros());
+    slot->client = nullptr;
+    delete c;
+  });
+}
+
+void setupLx200Server(RAStatic &raStatic, DecStatic &decStatic,
+                      CommandMailbox &mailbox, LoopMetrics &metrics) {
+  for (int i = 0; i < LX200_MAX_CLIENTS; i++) {
+    lx200Clients[i].client = nullptr;
+    lx200Clients[i].session = new Lx200Session(raStatic, decStatic, mailbox);
+  }
+  // Runs on the AsyncTCP task, like the web server, so commands are
+  // posted as web commands
+  lx200Server.onClient(
+      [&metrics](void *arg, AsyncClient *client) {
+        onLx200Client(client, metrics);
+      },
+      nullptr);
+  lx200Server.begin();
+  LOG_INFO(LOG_NET, "Listening for LX200 clients on port %d", LX200_PORT);
+}
@@ -0,0 +1,13 @@
+#ifndef LX200SERVER
+#define LX200SERVER
+
+#include "CommandMailbox.h"
+#include "DecStatic.h"
+#include "LoopMetrics.h"
+#include "RAStatic.h"
+
+// Accept LX200 guiding connections on LX200_PORT
+void setupLx200Server(RAStatic &raStatic, DecStatic &decStatic,
+                      CommandMailbox &mailbox, LoopMetrics &metrics);
+
+#endif
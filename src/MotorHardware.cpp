@@ -0,0 +1,163 @@
+#include "MotorHardware.h"
+
+#include "BounceInputSource.h"
+#include "EQWebServer.h"
+#include "EspTimerService.h"
+#include "Logging.h"
+#include <Arduino.h>
+#include <FastAccelStepper.h>
+#include <Preferences.h>
+
+#define raDirPinStepper 19
+#define raStepPinStepper 18
+#define decDirPinStepper 33
+#define decStepPinStepper 32
+
+// #define raDirPinStepper 33
+// #define raStepPinStepper 32
+// #define decDirPinStepper 19
+// #define decStepPinStepper 18
+
+#define RA_PREF_SAVED_POS_KEY (char *)"RASavedPosition"
+
+#define DEC_PREF_SAVED_POS_KEY (char *)"DCSavedPosition"
+
+// See
+// https://github.com/gin66/FastAccelStepper/blob/master/extras/doc/FastAccelStepper_API.md
+
+HardwareSerial &ra_serial_stream = Serial1;
+HardwareSerial &dec_serial_stream = Serial2;
+// const long SERIAL_BAUD_RATE = 115200;
+const long SERIAL_BAUD_RATE = 19200;
+
+const int RA_RX_PIN = 16; // not actually used
+const int RA_TX_PIN = 17;
+
+const int DEC_RX_PIN = 39; // not actually used
+const int DEC_TX_PIN = 4;
+
+// const int RA_RX_PIN = 39; // not actually used
+// const int RA_TX_PIN = 4;
+
+// const int DEC_RX_PIN =  16;// not actually used
+// const int DEC_TX_PIN = 17;
+
+const uint8_t RA_DRIVER_ADDRESS = 0;
+const uint8_t DEC_DRIVER_ADDRESS = 0;
+
+const float R_SENSE = 0.11; // Check your board's documentation. Typically it's
+                            // 0.11 or 0.22 for TMC2209 modules.
+const float HOLD_MULTIPLIER =
+    0.5; // Specifies the hold current as a fraction of the run current
+const int RA_MICROSTEPS = 16; // 1/16th microstepping
+const int DEC_MICROSTEPS = 16;
+
+// Initialize the driver instance
+TMC2209Stepper ra_stepper_driver =
+    TMC2209Stepper(&ra_serial_stream, R_SENSE, RA_DRIVER_ADDRESS);
+TMC2209Stepper dec_stepper_driver =
+    TMC2209Stepper(&dec_serial_stream, R_SENSE, DEC_DRIVER_ADDRESS);
+
+FastAccelStepperEngine engine = FastAccelStepperEngine();
+ConcreteStepperWrapper *rawrapper;
+ConcreteStepperWrapper *decwrapper;
+EspTimerService timerService;
+BounceInputSource bounceInputs;
+
+MotorHardware::MotorHardware(MotorUnit &mu, RAStatic &rs, RADynamic &rd,
+                             DecStatic &ds, DecDynamic &dd, MotionTrace &mt,
+                             Preferences &p)
+    : motorUnit(mu), raStatic(rs), raDynamic(rd), decStatic(ds),
+      decDynamic(dd), motionTrace(mt), preferences(p) {}
+
+void MotorHardware::sleep(unsigned long millis) {
+  uint64_t wakeAt = timerService.nowMicros() + (uint64_t)millis * 1000;
+  while (timerService.sleepUntilTimer(wakeAt))
+    motorUnit.applyPulseTimers();
+}
+
+void MotorHardware::setUpTMCDriver(TMC2209Stepper &driver, int microsteps) {
+  driver.begin();
+  // Set motor current
+  driver.microsteps(microsteps);
+
+  // StealthChop configuration
+  driver.toff(5);
+  driver.intpol(true);
+  driver.rms_current(1700, 0.1);
+  driver.en_spreadCycle(false); // This enables StealthChop
+  driver.pwm_autograd(1);       // This enables automatic gradient adaptation
+  driver.pwm_autoscale(1);      // This enables automatic current scaling
+}
+ConcreteStepperWrapper *
+MotorHardware::setUpFastAccelStepper(int32_t savedPosition, int stepPin,
+                                     int dirPin, char *prefsKey) {
+  FastAccelStepper *stepper = engine.stepperConnectToPin(stepPin);
+  if (stepper) {
+    stepper->setDirectionPin(dirPin);
+    stepper->setAutoEnable(true);
+    stepper->setAcceleration(motorUnit.getAcceleration()); // 100 steps/s²
+    stepper->setCurrentPosition(savedPosition);
+    ConcreteStepperWrapper *wrapper =
+        new ConcreteStepperWrapper(preferences, prefsKey);
+    wrapper->setStepper(stepper);
+    return wrapper;
+
+  } else {
+    LOG_ERROR(LOG_MOTOR, "Stepper not initalised (step pin: %d dir pin: %d)",
+              stepPin, dirPin);
+    return nullptr;
+  }
+}
+void MotorHardware::setupMotors() {
+  bounceInputs.setupButtons();
+
+  ra_serial_stream.begin(SERIAL_BAUD_RATE, SERIAL_8N1, RA_RX_PIN, RA_TX_PIN);
+  dec_serial_stream.begin(SERIAL_BAUD_RATE, SERIAL_8N1, DEC_RX_PIN, DEC_TX_PIN);
+  setUpTMCDriver(ra_stepper_driver, RA_MICROSTEPS);
+  setUpTMCDriver(dec_stepper_driver, DEC_MICROSTEPS);
+
+  engine.init();
+
+  int32_t raSavedPosition =
+      preferences.getInt(RA_PREF_SAVED_POS_KEY, INT32_MAX);
+  LOG_INFO(LOG_MOTOR, "Loaded saved ra position %ld", (long)raSavedPosition);
+  if (raSavedPosition > raStatic.getLimitPosition()) {
+    raDynamic.setSafetyMode(true);
+    raSavedPosition = 0;
+  }
+  rawrapper = setUpFastAccelStepper(raSavedPosition, raStepPinStepper,
+                                    raDirPinStepper, RA_PREF_SAVED_POS_KEY);
+  raDynamic.setStepperWrapper(rawrapper);
+  raDynamic.setTimerService(&timerService);
+  // Defaults to following the speed schedule. FastAccelStepper's own task
+  // keeps the stepper running between speed changes, so a loop stall
+  // costs nothing. Streaming can only queue ~85ms ahead at sidereal (see
+  // StepQueue.h), so a longer stall stops the motor until the loop
+  // catches up.
+  raDynamic.setTrackingMode((TrackingMode)preferences.getInt(
+      TRACKING_MODE_KEY, DEFAULT_TRACKING_MODE));
+
+  int32_t decSavedPosition =
+      preferences.getInt(DEC_PREF_SAVED_POS_KEY, INT32_MAX);
+  LOG_INFO(LOG_MOTOR, "Loaded saved dec position %ld",
+           (long)decSavedPosition);
+  if (decSavedPosition > decStatic.getLimitPosition()) {
+    decDynamic.setSafetyMode(true);
+    decSavedPosition = 0;
+  }
+  decwrapper = setUpFastAccelStepper(decSavedPosition, decStepPinStepper,
+                                     decDirPinStepper, DEC_PREF_SAVED_POS_KEY);
+  decDynamic.setStepperWrapper(decwrapper);
+  decDynamic.setTimerService(&timerService);
+
+  // timer service doubles as the loop clock, same time base as micros()
+  motorUnit.setup(rawrapper, decwrapper, &bounceInputs, &timerService);
+
+  motionTrace.setClock(&timerService);
+  if (rawrapper != nullptr)
+    rawrapper->setMotionTrace(&motionTrace, AXIS_RA);
+  if (decwrapper != nullptr)
+    decwrapper->setMotionTrace(&motionTrace, AXIS_DEC);
+  motorUnit.setMotionTrace(&motionTrace);
+}
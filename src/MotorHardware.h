@@ -0,0 +1,43 @@
+#ifndef MOTORHARDWARE_H
+#define MOTORHARDWARE_H
+
+#include "ConcreteStepperWrapper.h"
+#include "DecDynamic.h"
+#include "DecStatic.h"
+#include "MotionTrace.h"
+#include "MotorUnit.h"
+#include "RADynamic.h"
+#include "RAStatic.h"
+#include <Preferences.h>
+#include <TMCStepper.h>
+
+/**
+ * ESP32 side of MotorUnit: sets up the TMC drivers, FastAccelStepper,
+ * buttons and pulse timers, then hands them to MotorUnit.
+ */
+class MotorHardware {
+public:
+  MotorHardware(MotorUnit &motorUnit, RAStatic &rastatic, RADynamic &radynamic,
+                DecStatic &decstatic, DecDynamic &decdynamic,
+                MotionTrace &trace, Preferences &p);
+
+  void setupMotors();
+  // Sleep out the loop period, starting and stopping pulses as soon as
+  // their timers fire rather than waiting for the next loop.
+  void sleep(unsigned long millis);
+
+private:
+  MotorUnit &motorUnit;
+  RAStatic &raStatic;
+  RADynamic &raDynamic;
+  DecStatic &decStatic;
+  DecDynamic &decDynamic;
+  MotionTrace &motionTrace;
+  Preferences &preferences;
+
+  void setUpTMCDriver(TMC2209Stepper &driver, int microsteps);
+  ConcreteStepperWrapper *setUpFastAccelStepper(int32_t savedPosition,
+                                                int stepPin, int dirPin,char* prefsKey);
+};
+
+#endif
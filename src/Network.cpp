@@ -62,7 +62,7 @@ Network::Network(Preferences &p, int whoarewe)
     espNetwork.local_IP = IPAddress(192, 168, 10, 6);
     break;
   default:
-    log("Invalid who we are passed");
+    LOG_ERROR(LOG_NET, "Invalid who we are passed");
   }
 }
 
@@ -89,13 +89,13 @@ void Network::connectToWiFi(WiFiNetwork &network) {
   String password = preferences.getString(network.passwordKey);
 
   if (ssid.length() == 0 || password.length() == 0) {
-    log("SSID or password not stored on ESP32, please set");
+    LOG_WARN(LOG_NET, "SSID or password not stored on ESP32, please set");
     return;
   }
 
   if (!WiFi.config(network.local_IP, network.gateway, network.subnet,
                    network.primaryDNS)) {
-    log("WIFI Failed to configure");
+    LOG_ERROR(LOG_NET, "WIFI Failed to configure");
     return;
   }
 
@@ -103,13 +103,13 @@ void Network::connectToWiFi(WiFiNetwork &network) {
 
   while (WiFi.status() != WL_CONNECTED) {
     delay(1000);
-    log("Waiting for connection to %s...", ssid.c_str());
+    LOG_DEBUG(LOG_NET, "Waiting for connection to %s...", ssid.c_str());
   }
 
   // Once connected, log the IP address
   IPAddress ip = WiFi.localIP();
-  log("Connected to %s! IP address: %d.%d.%d.%d", ssid.c_str(), ip[0], ip[1],
-      ip[2], ip[3]);
+  LOG_INFO(LOG_NET, "Connected to %s! IP address: %d.%d.%d.%d", ssid.c_str(),
+           ip[0], ip[1], ip[2], ip[3]);
 }
 
 /*
@@ -118,7 +118,7 @@ void Network::connectToWiFi(WiFiNetwork &network) {
  * store*creds()
  */
 void Network::setupWifi() {
-  log("Scanning for networks...");
+  LOG_INFO(LOG_NET, "Scanning for networks...");
 
   int n = WiFi.scanNetworks();
   bool espFound = false;
@@ -127,7 +127,7 @@ void Network::setupWifi() {
 
   for (int i = 0; i < n; i++) {
     String foundSSID = WiFi.SSID(i);
-    log("Found network %s", foundSSID.c_str());
+    LOG_INFO(LOG_NET, "Found network %s", foundSSID.c_str());
 
     if (foundSSID == preferences.getString(espNetwork.ssidKey)) {
       espFound = true;
@@ -139,16 +139,16 @@ void Network::setupWifi() {
   }
 
   if (espFound) {
-    log("Connecting to ESP32 hotspot...");
+    LOG_INFO(LOG_NET, "Connecting to ESP32 hotspot...");
     connectToWiFi(espNetwork);
   } else if (phoneFound) {
-    log("Connecting to Phone hotspot...");
+    LOG_INFO(LOG_NET, "Connecting to Phone hotspot...");
     connectToWiFi(phoneNetwork);
   } else if (homeFound) {
-    log("Connecting to Home WiFi...");
+    LOG_INFO(LOG_NET, "Connecting to Home WiFi...");
     connectToWiFi(homeNetwork);
   } else {
-    log("No known networks found.");
+    LOG_WARN(LOG_NET, "No known networks found.");
   }
 }
 
@@ -161,6 +161,7 @@ void Network::setUpAccessPoint() {
   WiFi.softAPConfig(espNetwork.gateway, espNetwork.gateway, espNetwork.subnet);
   WiFi.softAP(preferences.getString(espNetwork.ssidKey).c_str(),
               preferences.getString(espNetwork.passwordKey).c_str());
-  log("Access Point set up with IP address: %d.%d.%d.%d", espNetwork.gateway[0],
-      espNetwork.gateway[1], espNetwork.gateway[2], espNetwork.gateway[3]);
+  LOG_INFO(LOG_NET, "Access Point set up with IP address: %d.%d.%d.%d",
+           espNetwork.gateway[0], espNetwork.gateway[1], espNetwork.gateway[2],
+           espNetwork.gateway[3]);
 }
\ No newline at end of file
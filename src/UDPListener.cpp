@@ -1,116 +1,75 @@
 #include "UDPListener.h"
 #include "AsyncUDP.h"
+#include "ClockSync.h"
+#include "CommandDispatch.h"
+#include "CommandWindow.h"
 #include "Logging.h"
-#include <ArduinoJson.h>
+#include <esp_timer.h>
 
 AsyncUDP dscUDP;
 #define IPBROADCASTPORT 50375
-/**
- * Listen for UDP broadcasts from Digital Setting Circles.
- * This is used for alpaca commands passed from DSC.
- */
-void setupUDPListener(MotorUnit &motor, RADynamic &raDynamic,
-                      DecDynamic &decDynamic) {
-  if (dscUDP.listen(IPBROADCASTPORT)) {
-    log("Listening for dsc platform broadcasts");
-    dscUDP.onPacket([&motor, &raDynamic, &decDynamic](AsyncUDPPacket packet) {
-      unsigned long now = millis();
-      String start = packet.readStringUntil(':');
-      // log("UDP Broadcast received: %s", msg.c_str());
-
-      // Check if the broadcast is from EQ Platform
-      if (start == "EQ") {
-        // msg = msg.substring(4);
-        log("Got payload from dsc");
-
-        // Create a JSON document to hold the payload
-        const size_t capacity = JSON_OBJECT_SIZE(5) +
-                                40; // Reserve some memory for the JSON document
-        StaticJsonDocument<capacity> doc;
-
-        // Deserialize the JSON payload
-        DeserializationError error = deserializeJson(doc, packet);
-        if (error) {
-          log("Failed to parse payload with error %s", error.c_str());
-          return;
-        }
+// Keep sending binary status this long after the last binary packet
+#define BINARY_PEER_TIMEOUT 30000 // ms
 
-        if (doc.containsKey("command") && doc.containsKey("parameter1") &&
-            doc.containsKey("parameter2")) {
+// millis() of the last binary packet, 0 for never
+volatile unsigned long lastBinaryPacketMillis = 0;
 
-          String command = doc["command"];
-          double parameter1 = doc["parameter1"];
-          double parameter2 = doc["parameter2"];
+// Per DSC clock offsets and command windows. Only used on the AsyncUDP
+// task, apart from their stats.
+ClockSync clockSync;
+CommandWindow commandWindow;
 
-          if (command == "home") {
-            raDynamic.gotoStart();
-            decDynamic.gotoMiddle();
-            return;
-          }
-          if (command == "park") {
-            raDynamic.gotoEndish();
-            decDynamic.gotoMiddle();
-            return;
-          }
-          if (command == "track") {
-            raDynamic.setTrackingOnOff(parameter1 > 0 ? true : false);
-            return;
-          }
-          if (command == "moveaxis") {
-            int axis = parameter1;
-            double degreesPerSecond = parameter2;
-            if (axis == 0)
-              raDynamic.moveAxis(degreesPerSecond);
-            if (axis == 1)
-              decDynamic.moveAxis(degreesPerSecond);
-            return;
-          }
+bool isBinaryPeerActive() {
+  unsigned long last = lastBinaryPacketMillis;
+  return last != 0 && millis() - last < BINARY_PEER_TIMEOUT;
+}
 
-          if (command == "slewbydegrees") {
-            int axis = parameter1;
-            double degreesToSlew = parameter2;
-            if (axis == 0)
-              raDynamic.slewByDegrees(degreesToSlew);
-            if (axis == 1)
-              decDynamic.slewByDegrees(degreesToSlew);
-            return;
-          }
+void getDscLinkStats(DscLinkStats &stats) {
+  stats.commandsAccepted = commandWindow.getAccepted();
+  stats.duplicates = commandWindow.getDuplicates();
+  stats.stale = commandWindow.getStale();
+  stats.lost = commandWindow.getLost();
+  stats.roundTripMicros = clockSync.getRoundTripAverageMicros();
+  stats.roundTripMaxMicros = clockSync.getRoundTripMaxMicros();
+}
 
-          if (command == "moveaxispercentage") {
-            int axis = parameter1;
-            double percentageOfSpeed = parameter2;
-            log("Move axis percentage received %i %f", axis,percentageOfSpeed);
-            if (axis == 0)
-              raDynamic.moveAxisPercentage(percentageOfSpeed);
-            if (axis == 1)
-              decDynamic.moveAxisPercentage(percentageOfSpeed);
-            return;
-          }
-          if (command == "pulseguide") {
-            int direction = parameter1;
-            long duration = parameter2;
-
-            if (direction == 2 || direction == 3) {
-              raDynamic.pulseGuide(direction, duration);
-              return;
-            } else if (direction == 0 || direction == 1) {
-              decDynamic.pulseGuide(direction, duration);
-              return;
-            }
-            log("Unknown pulseguide direction %d", direction);
-            return;
-          }
-
-          log("Unknown command %s", command.c_str());
-          return;
-
-        } else {
-          log("Payload missing required fields.");
-          return;
-        }
-      } else {
-        log("Message has bad starting chars");
+/**
+ * Listen for UDP broadcasts from Digital Setting Circles.
+ * This is used for alpaca commands passed from DSC.
+ */
+void setupUDPListener(MotorUnit &motor, CommandMailbox &mailbox,
+                      LoopMetrics &metrics, PositionStream &positionStream) {
+  if (dscUDP.listen(IPBROADCASTPORT)) {
+    LOG_INFO(LOG_UDP, "Listening for dsc platform broadcasts");
+    // Runs on the AsyncUDP task: commands are posted to the mailbox for the
+    // motor loop to apply.
+    dscUDP.onPacket([&motor, &mailbox, &metrics,
+                     &positionStream](AsyncUDPPacket packet) {
+      MetricTimer timer(metrics, METRIC_UDP_HANDLER);
+      // same clock as the motor loop, but all 64 bits
+      uint64_t nowMicros = esp_timer_get_time();
+      DscSender sender;
+      sender.address = (uint32_t)packet.remoteIP();
+      sender.port = packet.remotePort();
+      sender.clockSync = &clockSync;
+      sender.window = &commandWindow;
+      DscPacketResult result = handleDscPacket(
+          packet.data(), packet.length(), mailbox, nowMicros, &sender);
+      if (result == DSC_PACKET_SUBSCRIBE) {
+        uint8_t rateHz;
+        decodeSubscribe(packet.data(), packet.length(), rateHz);
+        positionStream.subscribe((uint32_t)packet.remoteIP(),
+                                 packet.remotePort(), rateHz, millis());
       }
+      // time response or ack, straight back to the sender
+      if (sender.replyLength > 0)
+        packet.write(sender.reply, sender.replyLength);
+      if (isBinaryMessage(packet.data(), packet.length()) &&
+          (result == DSC_PACKET_COMMAND || result == DSC_PACKET_HELLO ||
+           result == DSC_PACKET_SUBSCRIBE ||
+           result == DSC_PACKET_TIME_REQUEST ||
+           result == DSC_PACKET_DROPPED))
+        lastBinaryPacketMillis = millis();
     });
   }
 }
\ No newline at end of file
@@ -1,8 +1,24 @@
 #ifndef UDPLISTENER
 #define UDPLISTENER
+#include "CommandMailbox.h"
+#include "LoopMetrics.h"
 #include "MotorUnit.h"
-#include "RADynamic.h"
-#include "DecDynamic.h"
+#include "PositionStream.h"
 
-void setupUDPListener(MotorUnit &motor, RADynamic &raDynamic,DecDynamic &decDynamic);
+void setupUDPListener(MotorUnit &motor, CommandMailbox &mailbox,
+                      LoopMetrics &metrics, PositionStream &positionStream);
+
+// True while a DSC is sending binary messages, so wants binary status
+bool isBinaryPeerActive();
+
+// Link quality to the DSCs, from sequence numbers and clock sync
+struct DscLinkStats {
+  uint32_t commandsAccepted;
+  uint32_t duplicates;
+  uint32_t stale;
+  uint32_t lost;
+  uint32_t roundTripMicros; // smoothed
+  uint32_t roundTripMaxMicros;
+};
+void getDscLinkStats(DscLinkStats &stats);
 #endif
@@ -1,51 +1,89 @@
 #include "UDPSender.h"
 #include "AsyncUDP.h"
 #include "Logging.h"
+#include "PlatformProtocol.h"
+#include "StatusPublisher.h"
+#include "UDPListener.h"
 #include "WiFi.h"
 #include <ArduinoJson.h>
-#define IPBROADCASTPERIOD 1000
 #define IPBROADCASTPORT 50375
 AsyncUDP udp;
-unsigned long lastIPBroadcastTime;
+StatusPublisher statusPublisher;
 
-// every x second, send whether platform is tracking,
-// and how many seconds it will take to reach center.
-//(can be negative is center passed)
+// Sends whether platform is tracking, and how many seconds it will take
+// to reach center (can be negative if center passed), as soon as
+// tracking or slewing changes, else every STATUS_HEARTBEAT_MILLIS.
 // AxixMoveRate is max speed in degrees per second
 void broadcastStatus(MotorUnit &motorUnit, RAStatic &raStatic,
                      RADynamic &raDynamic) {
 
-  long now = millis();
-  if ((now - lastIPBroadcastTime) > IPBROADCASTPERIOD) {
-    lastIPBroadcastTime = now;
-    // Check if the device is connected to the WiFi
-    if (WiFi.status() != WL_CONNECTED) {
-      return;
-    }
-    if (udp.connect(
-            IPAddress(255, 255, 255, 255),
-            IPBROADCASTPORT)) { // Choose any available port, e.g., 12345
-
-      // Estimate JSON capacity
-      const size_t capacity = JSON_OBJECT_SIZE(15);
-
-      DynamicJsonDocument doc(capacity);
-      // Populate the JSON object
-      doc["timeToCenter"] = raDynamic.getTimeToEndOfRunInSeconds();
-      doc["timeToEnd"] = raDynamic.getTimeToEndOfRunInSeconds();
-      doc["isTracking"] = raDynamic.isTrackingOn();
-      doc["slewing"] = raDynamic.isSlewing();
-      doc["guideMoveRate"] = raStatic.getGuideRateDegreesSec();
-      doc["trackingRate"] = raStatic.getTrackingRateArcsSecondsSec();
-      doc["axisMoveRateMax"] = raStatic.getMaxAxisMoveRateDegreesSec();
-      doc["axisMoveRateMin"] = raStatic.getMinAxisMoveRateDegreesSec();
-
-      String json;
-      serializeJson(doc, json);
-      json = "DSC:" + json;
-      udp.print(json.c_str());
-
-      // log("Status Packet sent\r\n %s", response);
+  PlatformStatus status;
+  status.isTracking = raDynamic.isTrackingOn();
+  status.slewing = raDynamic.isSlewing();
+  status.guideMoveRate = raStatic.getGuideRateDegreesSec();
+  status.trackingRate = raStatic.getTrackingRateArcsSecondsSec();
+  status.axisMoveRateMax = raStatic.getMaxAxisMoveRateDegreesSec();
+  status.axisMoveRateMin = raStatic.getMinAxisMoveRateDegreesSec();
+  if (!statusPublisher.isDue(status, millis()))
+    return;
+
+  // Check if the device is connected to the WiFi
+  if (WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+  if (udp.connect(IPAddress(255, 255, 255, 255),
+                  IPBROADCASTPORT)) { // Choose any available port, e.g., 12345
+    // Only worked out when sending. timeToCenter has always been sent as
+    // time to end of run.
+    double timeToEnd = raDynamic.getTimeToEndOfRunInSeconds();
+    status.timeToCenter = timeToEnd;
+    status.timeToEnd = timeToEnd;
+    status.generation = statusPublisher.getGeneration();
+
+    // Binary only once a DSC has asked for it, JSON always so older
+    // clients keep working
+    if (isBinaryPeerActive()) {
+      uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+      size_t length = encodeStatus(status, buffer, sizeof(buffer));
+      udp.write(buffer, length);
     }
+
+    // Estimate JSON capacity
+    const size_t capacity = JSON_OBJECT_SIZE(15);
+
+    DynamicJsonDocument doc(capacity);
+    // Populate the JSON object
+    doc["timeToCenter"] = status.timeToCenter;
+    doc["timeToEnd"] = status.timeToEnd;
+    doc["isTracking"] = status.isTracking;
+    doc["slewing"] = status.slewing;
+    doc["guideMoveRate"] = status.guideMoveRate;
+    doc["trackingRate"] = status.trackingRate;
+    doc["axisMoveRateMax"] = status.axisMoveRateMax;
+    doc["axisMoveRateMin"] = status.axisMoveRateMin;
+    doc["generation"] = status.generation;
+
+    String json;
+    serializeJson(doc, json);
+    json = "DSC:" + json;
+    // JSON is the copy every client reads. If it didn't go out, the
+    // status stays due and goes again next loop.
+    if (udp.print(json.c_str()) > 0)
+      statusPublisher.markSent(millis());
+
+    // log("Status Packet sent\r\n %s", response);
   }
-}
\ No newline at end of file
+}
+
+void streamPosition(MotorUnit &motorUnit, PositionStream &positionStream) {
+  PositionSubscriber due[POSITION_STREAM_MAX_SUBSCRIBERS];
+  int count = positionStream.collectDue(millis(), due);
+  if (count == 0 || WiFi.status() != WL_CONNECTED)
+    return;
+  // one sample and encode, however many are due
+  PlatformPosition position = motorUnit.getPlatformPosition();
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t length = encodePosition(position, buffer, sizeof(buffer));
+  for (int i = 0; i < count; i++)
+    udp.writeTo(buffer, length, IPAddress(due[i].address), due[i].port);
+}
@@ -2,9 +2,12 @@
 #define UDPSENDER
 
 #include "MotorUnit.h"
+#include "PositionStream.h"
 #include "RADynamic.h"
 #include "RAStatic.h"
 void broadcastStatus(MotorUnit &motorUnit, RAStatic &raStatic,
                      RADynamic &raDynamic);
+// Send positions to subscribed DSCs that are due one. Call from loop.
+void streamPosition(MotorUnit &motorUnit, PositionStream &positionStream);
 
 #endif
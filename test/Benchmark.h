@@ -0,0 +1,30 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdint>
+
+// Written to by benchmarks so the compiler can't drop the work.
+static volatile uint32_t benchmarkSink;
+
+/**
+ * Time fn over a number of iterations and return nanoseconds per call.
+ * fn is passed the iteration number, so it can vary its input.
+ * Native only: used to compare implementations, not as on-device timings.
+ */
+template <typename F> double benchmarkNsPerCall(F fn, long iterations) {
+  // warm up caches
+  for (long i = 0; i < iterations / 10; i++) {
+    benchmarkSink = fn(i);
+  }
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (long i = 0; i < iterations; i++) {
+    benchmarkSink = fn(i);
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         iterations;
+}
+
+#endif
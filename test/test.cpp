@@ -1,4 +1,5 @@
 
+#include "LogBuffer.h"
 #include "Logging.h"
 #include "RADynamic.h"
 #include "RAStatic.h"
@@ -7,11 +8,67 @@
 
 #include <cstdint>
 
+#include "AlpacaTelescope.h"
+#include "ClockSync.h"
+#include "CommandWindow.h"
+#include "CommandDispatch.h"
+#include "CommandMailbox.h"
+#include "LatencyHistogram.h"
+#include "LatestValue.h"
+#include "LoopMetrics.h"
+#include "Lx200Session.h"
+#include "MotionTraceDecoder.h"
+#include "MotorUnit.h"
+#include "PlatformProtocol.h"
+#include "PositionStream.h"
+#include "SPSCQueue.h"
+#include "SimulatedInputSource.h"
+#include "SimulatedStepper.h"
+#include "SimulatedTimerService.h"
+#include "StatusDelta.h"
+#include "StatusPublisher.h"
 #include "StepperWrapper.h"
+#include "TangentGeometry.h"
 #include "cpp_mock.h"
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <new>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 #include <unity.h>
 
+// Heap allocations since start. Counted by the operator new below, so
+// tests can check a path doesn't allocate.
+static unsigned long allocationCount = 0;
+
+void *operator new(size_t size) {
+  allocationCount++;
+  void *p = malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+
+// The operator new above gets its memory from malloc, so free is the right
+// pairing. GCC only sees a pointer from operator new going to free.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
 void test_timetomiddle_calc(void) {
   int runTotal = 130;                         // mm
   int limitToMiddle = 62;                     // mm
@@ -115,6 +172,332 @@ void test_speed_calc(void) {
       "If limit switch is closer to middle, speed should be faster at limit "
       "than  62mm value of 119461");
 }
+// Run too long for one table entry per mm, and not a whole number of
+// entries
+class LongRunRAStatic : public RAStatic {
+public:
+  LongRunRAStatic() { limitSwitchToEndDistance = 401; }
+};
+
+void test_speed_table_error(void) {
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+
+  // walk whole run, comparing table to exact calc. Odd step size so we
+  // land between table entries.
+  double rate = model.getTrackingRateArcsSecondsSec();
+  long maxError = 0;
+  for (int32_t pos = 0; pos <= model.getLimitPosition(); pos += 997) {
+    long exact = model.calculateSpeedInMilliHz(pos, rate);
+    long table = model.lookupSpeedInMilliHz(pos, rate);
+    long error = labs(exact - table);
+    if (error > maxError)
+      maxError = error;
+  }
+  log("RA speed table max error %ld millihz", maxError);
+  TEST_ASSERT_TRUE_MESSAGE(maxError <= 2,
+                           "RA table should be within 2 millihz of exact");
+
+  // table should be rebuilt when geometry changes
+  model.setScrewToPivotInMM(600);
+  int32_t pos = model.getLimitPosition() - 1234;
+  TEST_ASSERT_FLOAT_WITHIN_MESSAGE(
+      2, model.calculateSpeedInMilliHz(pos, rate),
+      model.calculateTrackingSpeedInMilliHz(pos),
+      "Table should follow new pivot distance");
+
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setGuideRateMultiplier(0.5);
+  rate = decModel.getGuideRateArcSecondsSecond();
+  maxError = 0;
+  for (int32_t pos = 0; pos <= decModel.getLimitPosition(); pos += 997) {
+    long exact = decModel.calculateSpeedInMilliHz(pos, rate);
+    long table = decModel.lookupSpeedInMilliHz(pos, rate);
+    long error = labs(exact - table);
+    if (error > maxError)
+      maxError = error;
+  }
+  log("Dec speed table max error %ld millihz", maxError);
+  TEST_ASSERT_TRUE_MESSAGE(maxError <= 2,
+                           "Dec table should be within 2 millihz of exact");
+
+  // entries are 2mm apart on a long run, and the last sits on the limit
+  // rather than a whole entry short of it
+  LongRunRAStatic longModel;
+  longModel.setScrewToPivotInMM(448);
+  longModel.setLimitSwitchToMiddleDistance(200);
+  rate = longModel.getTrackingRateArcsSecondsSec();
+  int32_t limit = longModel.getLimitPosition();
+  TEST_ASSERT_FLOAT_WITHIN_MESSAGE(
+      1, longModel.calculateSpeedInMilliHz(limit, rate),
+      longModel.lookupSpeedInMilliHz(limit, rate),
+      "Table should reach the limit");
+  maxError = 0;
+  for (int32_t pos = limit - 2 * longModel.getStepsPerMM(); pos <= limit;
+       pos += 97) {
+    long error = labs((long)longModel.calculateSpeedInMilliHz(pos, rate) -
+                      (long)longModel.lookupSpeedInMilliHz(pos, rate));
+    if (error > maxError)
+      maxError = error;
+  }
+  log("Long run speed table max error near limit %ld millihz", maxError);
+  TEST_ASSERT_TRUE_MESSAGE(maxError <= 2,
+                           "Last gap should interpolate to the limit");
+
+  // off the ends falls back to exact calc
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      decModel.calculateSpeedInMilliHz(-500, rate),
+      decModel.lookupSpeedInMilliHz(-500, rate),
+      "Positions past end should use exact calc");
+}
+
+// Most error a numeric backend may add, in arc seconds. Angle error is
+// how far the backend's platform angle (or slew target) is from double.
+// Drift is how far tracking would wander over a minute at its speed.
+#define BACKEND_ERROR_BUDGET_ARCSEC 1.0
+// Most tracking drift the backend the firmware is built with may add over
+// an hour. A minute's budget is fine for a report, but it compounds.
+#define SHIPPED_DRIFT_BUDGET_ARCSEC_PER_HOUR 1.0
+
+struct BackendError {
+  double angleArcSec;
+  double driftArcSecPerMinute;
+};
+
+template <typename T>
+BackendError measureBackendError(MotorStatic &model, double rate) {
+  TangentGeometry<double> reference;
+  TangentGeometry<T> backend;
+  model.configureGeometry(reference);
+  model.configureGeometry(backend);
+
+  double arcSecPerRadian = 180.0 / M_PI * 3600.0;
+  double arcSecPerStep = arcSecPerRadian / model.getStepsPerMM() /
+                         model.getScrewToPivotInMM();
+  int32_t middle = model.getMiddlePosition();
+  BackendError worst = {0, 0};
+  for (int32_t pos = 0; pos <= model.getLimitPosition(); pos += 499) {
+    int32_t stepsFromMiddle = pos - middle;
+
+    double angleError =
+        fabs((double)backend.angleFromCenterInRadians(stepsFromMiddle) -
+             reference.angleFromCenterInRadians(stepsFromMiddle)) *
+        arcSecPerRadian;
+    double shiftError =
+        fabs((double)(backend.stepsFromMiddleAfterShift(stepsFromMiddle, -1) -
+                      reference.stepsFromMiddleAfterShift(stepsFromMiddle, -1))) *
+        arcSecPerStep;
+
+    double referenceSpeed = reference.speedInMilliHz(-stepsFromMiddle, rate);
+    double speed = backend.speedInMilliHz(-stepsFromMiddle, rate);
+    double drift = fabs(speed - referenceSpeed) / referenceSpeed * rate * 60;
+
+    worst.angleArcSec = fmax(worst.angleArcSec, fmax(angleError, shiftError));
+    worst.driftArcSecPerMinute = fmax(worst.driftArcSecPerMinute, drift);
+  }
+  return worst;
+}
+
+void reportBackendError(const char *name, BackendError raError,
+                        BackendError decError) {
+  log("%-8s RA angle %8.4lf\" drift %8.4lf\"/min | Dec angle %8.4lf\" "
+      "drift %8.4lf\"/min",
+      name, raError.angleArcSec, raError.driftArcSecPerMinute,
+      decError.angleArcSec, decError.driftArcSecPerMinute);
+}
+
+/**
+ * Accuracy report for the numeric backends PlatformScalar can be built
+ * with. Compares each against double over the full RA and Dec runs.
+ */
+void test_numeric_backend_accuracy(void) {
+  RAStatic ra;
+  ra.setScrewToPivotInMM(448);
+  ra.setLimitSwitchToMiddleDistance(62);
+  DecStatic dec;
+  dec.setScrewToPivotInMM(605);
+  dec.setLimitSwitchToMiddleDistance(32);
+  dec.setGuideRateMultiplier(0.5);
+
+  double raRate = ra.getTrackingRateArcsSecondsSec();
+  double decRate = dec.getGuideRateArcSecondsSecond();
+
+  log("====Numeric backend error vs double (budget %.1lf\")====",
+      BACKEND_ERROR_BUDGET_ARCSEC);
+
+  BackendError raFloat = measureBackendError<float>(ra, raRate);
+  BackendError decFloat = measureBackendError<float>(dec, decRate);
+  reportBackendError("float", raFloat, decFloat);
+
+  BackendError raFixed = measureBackendError<PlatformFixed>(ra, raRate);
+  BackendError decFixed = measureBackendError<PlatformFixed>(dec, decRate);
+  reportBackendError("Q33.30", raFixed, decFixed);
+
+  // what MotorStatic actually runs with
+  BackendError raShipped = measureBackendError<PlatformScalar>(ra, raRate);
+  BackendError decShipped = measureBackendError<PlatformScalar>(dec, decRate);
+  log("Shipped backend drift: RA %.4lf\"/h, Dec %.4lf\"/h (float RA %.1lf\"/h)",
+      raShipped.driftArcSecPerMinute * 60, decShipped.driftArcSecPerMinute * 60,
+      raFloat.driftArcSecPerMinute * 60);
+  TEST_ASSERT_TRUE_MESSAGE(raShipped.driftArcSecPerMinute * 60 <=
+                               SHIPPED_DRIFT_BUDGET_ARCSEC_PER_HOUR,
+                           "Shipped backend RA drift over an hour");
+  TEST_ASSERT_TRUE_MESSAGE(decShipped.driftArcSecPerMinute * 60 <=
+                               SHIPPED_DRIFT_BUDGET_ARCSEC_PER_HOUR,
+                           "Shipped backend Dec drift over an hour");
+
+  BackendError budgets[] = {raFloat, decFloat, raFixed, decFixed};
+  for (BackendError e : budgets) {
+    TEST_ASSERT_TRUE_MESSAGE(e.angleArcSec <= BACKEND_ERROR_BUDGET_ARCSEC,
+                             "Backend angle error over budget");
+    TEST_ASSERT_TRUE_MESSAGE(e.driftArcSecPerMinute <=
+                                 BACKEND_ERROR_BUDGET_ARCSEC,
+                             "Backend drift over budget");
+  }
+}
+
+// Checks analytic kernel against finite difference over a whole run, at
+// rates from slow guiding up to nunchuk speeds.
+void checkAnalyticSpeedMatches(MotorStatic &model, const char *axis) {
+  double rates[] = {sideRealArcSecondsPerSec * 0.1,
+                    sideRealArcSecondsPerSec * 0.5, sideRealArcSecondsPerSec,
+                    sideRealArcSecondsPerSec * 2};
+  TangentGeometry<double> geometry;
+  model.configureGeometry(geometry);
+  int32_t middle = model.getMiddlePosition();
+  double worstRelativeError = 0;
+  for (double rate : rates) {
+    for (int32_t pos = 0; pos <= model.getLimitPosition(); pos += 1009) {
+      double finite = geometry.speedInMilliHz(middle - pos, rate);
+      double analytic = geometry.analyticSpeedInMilliHz(middle - pos, rate);
+      // finite difference is the average over the next second, so differs
+      // by about tan(angle) * radians per second, plus truncation.
+      TEST_ASSERT_FLOAT_WITHIN_MESSAGE(finite * 5e-5 + 1, finite, analytic,
+                                       "Analytic speed should match");
+      worstRelativeError =
+          fmax(worstRelativeError, fabs(finite - analytic) / finite);
+    }
+  }
+  log("%s analytic vs finite difference worst relative error %.2e", axis,
+      worstRelativeError);
+}
+
+void test_analytic_speed_matches_finite_difference(void) {
+  RAStatic ra;
+  ra.setScrewToPivotInMM(448);
+  ra.setLimitSwitchToMiddleDistance(62);
+  checkAnalyticSpeedMatches(ra, "RA");
+
+  DecStatic dec;
+  dec.setScrewToPivotInMM(605);
+  dec.setLimitSwitchToMiddleDistance(32);
+  checkAnalyticSpeedMatches(dec, "Dec");
+
+  // model and tracking should follow the selected kernel
+  ra.setSpeedKernel(SPEED_KERNEL_ANALYTIC);
+  TEST_ASSERT_FLOAT_WITHIN_MESSAGE(
+      1, 117606, ra.calculateSpeedInMilliHz(ra.getMiddlePosition(),
+                                            ra.getTrackingRateArcsSecondsSec()),
+      "Analytic speed in middle should match finite difference");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      ra.calculateSpeedInMilliHz(ra.getLimitPosition(),
+                                 ra.getTrackingRateArcsSecondsSec()),
+      ra.calculateTrackingSpeedInMilliHz(ra.getLimitPosition()),
+      "Tracking table should use analytic kernel");
+}
+
+void test_speed_schedule(void) {
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+
+  int segments = model.getTrackingSegmentCount();
+  log("Speed schedule: %d segments, max error %lf arc seconds", segments,
+      model.getScheduleMaxErrorInArcSeconds());
+  TEST_ASSERT_TRUE_MESSAGE(segments > 1, "Run should need several segments");
+  TEST_ASSERT_TRUE_MESSAGE(model.getScheduleMaxErrorInArcSeconds() <=
+                               DEFAULT_SCHEDULE_ERROR_ARCSECONDS,
+                           "Schedule should stay inside error bound");
+
+  // segments should cover whole run with no gaps
+  TEST_ASSERT_EQUAL_INT_MESSAGE(model.getLimitPosition(),
+                                model.getTrackingSegment(0).startPosition,
+                                "Schedule should start at limit");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      0, model.getTrackingSegment(segments - 1).endPosition,
+      "Schedule should end at 0");
+  for (int i = 1; i < segments; i++) {
+    TEST_ASSERT_EQUAL_INT_MESSAGE(model.getTrackingSegment(i - 1).endPosition,
+                                  model.getTrackingSegment(i).startPosition,
+                                  "Segments should be contiguous");
+  }
+
+  // segment speed should be close to the exact speed inside it
+  for (int i = 0; i < segments; i++) {
+    const SpeedSegment &segment = model.getTrackingSegment(i);
+    int32_t mid = (segment.startPosition + segment.endPosition) / 2;
+    TEST_ASSERT_EQUAL_INT_MESSAGE(i, model.findTrackingSegment(mid),
+                                  "Should find segment from its middle");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        i, model.findTrackingSegment(segment.startPosition),
+        "Segment should include its start");
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(
+        50, model.calculateTrackingSpeedInMilliHz(mid), segment.speedInMilliHz,
+        "Segment speed should be close to exact speed");
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(-1, model.findTrackingSegment(0),
+                                "End of run is not in a segment");
+
+  // bound is worked out analytically when building, so walk each segment
+  // finely to make sure it really holds
+  TangentGeometry<double> geometry;
+  model.configureGeometry(geometry);
+  double radiansPerSecond =
+      model.getTrackingRateArcsSecondsSec() * M_PI / 180.0 / 3600.0;
+  double worst = 0;
+  for (int i = 0; i < segments; i++) {
+    const SpeedSegment &segment = model.getTrackingSegment(i);
+    int32_t middle = model.getMiddlePosition();
+    double startAngle =
+        geometry.angleFromCenterInRadians(middle - segment.startPosition);
+    for (int32_t pos = segment.startPosition; pos >= segment.endPosition;
+         pos -= 101) {
+      double seconds =
+          (segment.startPosition - pos) / (segment.speedInMilliHz / 1000.0);
+      double error = fabs(seconds * radiansPerSecond -
+                          (geometry.angleFromCenterInRadians(middle - pos) -
+                           startAngle)) *
+                     180.0 / M_PI * 3600.0;
+      if (error > worst)
+        worst = error;
+    }
+  }
+  log("Speed schedule worst error walking every segment %lf arc seconds",
+      worst);
+  TEST_ASSERT_TRUE_MESSAGE(worst <= model.getScheduleMaxErrorInArcSeconds(),
+                           "Schedule error should hold inside segments");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      -1, model.findTrackingSegment(model.getLimitPosition() + 1),
+      "Past limit is not in a segment");
+
+  // tighter bound needs more segments, and still holds
+  model.setScheduleErrorBoundInArcSeconds(0.25);
+  TEST_ASSERT_TRUE_MESSAGE(model.getTrackingSegmentCount() > segments,
+                           "Tighter bound should need more segments");
+  TEST_ASSERT_TRUE_MESSAGE(model.getScheduleMaxErrorInArcSeconds() <= 0.25,
+                           "Schedule should stay inside tighter bound");
+
+  // geometry change rebuilds
+  uint32_t version = model.getScheduleVersion();
+  model.setScrewToPivotInMM(600);
+  model.findTrackingSegment(1000);
+  TEST_ASSERT_TRUE_MESSAGE(model.getScheduleVersion() != version,
+                           "Schedule should rebuild when geometry changes");
+}
+
 void test_rewind_fast_forward_speed_calc() {
   RAStatic model;
   model.setScrewToPivotInMM(448);
@@ -152,6 +535,10 @@ public:
   MockMethod(void, setStepperSpeed, (uint32_t));
   MockMethod(uint32_t, getStepperSpeed, ());
   MockMethod(void, setAcceleration, (unsigned long));
+  MockMethod(uint32_t, queueSteps, (uint32_t, uint32_t, bool));
+  MockMethod(bool, isStreaming, ());
+  MockMethod(int32_t, getQueueEndPosition, ());
+  MockMethod(uint32_t, getStreamUnderruns, ());
 };
 
 void testRAGotoMiddleBasic() {
@@ -169,7 +556,7 @@ void testRAGotoMiddleBasic() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   When(stepper.getPosition).Return(model.getMiddlePosition() - 100);
@@ -210,7 +597,7 @@ void testDecGotoMiddleBasic() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  DecDynamic control = DecDynamic(model);
+  DecDynamic control(model);
   control.setStepperWrapper(&stepper);
 
   When(stepper.getPosition).Return(model.getMiddlePosition() - 100);
@@ -253,7 +640,7 @@ void testGotoMiddleAtMiddle() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to middle, when at middle
@@ -293,7 +680,7 @@ void testGotoMiddleAtMiddleResumeTracking() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to middle, when at middle. Tracking should restart
@@ -330,7 +717,7 @@ void testGotoStartBasic() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to start
@@ -371,7 +758,7 @@ void testGotoStartLimit() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to start when limit hit
@@ -409,7 +796,7 @@ void testGotoStartLimitTracking() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to start when limit hit
@@ -463,7 +850,7 @@ void testGotoEndBasic() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to end
@@ -503,7 +890,7 @@ void testGotoEndLimitHit() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to end at same time as ff hit
@@ -547,7 +934,7 @@ void testGotoEndAtEndWithTracking() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to end
@@ -610,6 +997,1899 @@ void testCalculateMoveByDegrees() {
                                    "Target should be  to limit as off end");
 }
 
+void testRAScheduleTracking() {
+  MockStepper stepper;
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+  model.setRewindFastFowardSpeedInHz(30000);
+
+  RADynamic control(model);
+  control.setStepperWrapper(&stepper);
+  control.setTrackingMode(TRACKING_MODE_SCHEDULE);
+
+  // stepper reports back whatever speed it was last given
+  uint32_t stepperSpeed = 0;
+  When(stepper.moveTo).Do([&](int32_t, uint32_t speed) { stepperSpeed = speed; });
+  When(stepper.getStepperSpeed).Do([&]() { return stepperSpeed; });
+
+  int segment = model.findTrackingSegment(model.getMiddlePosition());
+  const SpeedSegment &current = model.getTrackingSegment(segment);
+  int32_t pos = current.startPosition;
+  When(stepper.getPosition).Do([&]() { return pos; });
+
+  control.setTrackingOnOff(true);
+  control.onLoop();
+
+  try {
+    Verify(stepper.moveTo).Times(1);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, control.getTargetPosition(),
+                                  "Target Position should be end");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(current.speedInMilliHz,
+                                  control.getTargetSpeedInMilliHz(),
+                                  "Speed should come from schedule");
+
+    // moving within segment should not touch motor
+    pos = current.endPosition + 1;
+    control.onLoop();
+    control.onLoop();
+    Verify(stepper.moveTo).Times(1);
+
+    // next segment should
+    pos = current.endPosition;
+    control.onLoop();
+    Verify(stepper.moveTo).Times(2);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        model.getTrackingSegment(segment + 1).speedInMilliHz,
+        control.getTargetSpeedInMilliHz(), "Speed should be next segment's");
+
+    // something else changing the speed should cause a resend
+    stepperSpeed = 1;
+    control.onLoop();
+    Verify(stepper.moveTo).Times(3);
+
+    // as should turning tracking off and on
+    control.setTrackingOnOff(false);
+    control.onLoop();
+    control.setTrackingOnOff(true);
+    control.onLoop();
+    Verify(stepper.moveTo).Times(4);
+    Verify(stepper.stop).Times(1);
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+}
+
+struct QueuedSteps {
+  int32_t from;
+  uint32_t steps;
+  uint32_t speedInMilliHz;
+};
+
+void testRAStreamTracking() {
+  MockStepper stepper;
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+  model.setRewindFastFowardSpeedInHz(30000);
+
+  RADynamic control(model);
+  control.setStepperWrapper(&stepper);
+  control.setTrackingMode(TRACKING_MODE_STREAM);
+
+  // stepper queue that holds a fixed number of steps
+  std::vector<QueuedSteps> queue;
+  bool streaming = false;
+  uint32_t space = 100;
+  int32_t pos = model.getLimitPosition();
+  int32_t queueEnd = pos;
+  When(stepper.queueSteps).Do([&](uint32_t steps, uint32_t speed, bool) {
+    uint32_t n = steps < space ? steps : space;
+    if (n > 0) {
+      queue.push_back({queueEnd, n, speed});
+      queueEnd -= n;
+      space -= n;
+      streaming = true;
+    }
+    return n;
+  });
+  When(stepper.isStreaming).Do([&]() { return streaming; });
+  When(stepper.getQueueEndPosition).Do([&]() { return queueEnd; });
+  When(stepper.getPosition).Do([&]() { return pos; });
+
+  control.setTrackingOnOff(true);
+  control.onLoop();
+
+  try {
+    Verify(stepper.moveTo).Times(0);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(100, model.getLimitPosition() - queueEnd,
+                                  "Should fill queue");
+
+    // run the queue out and top it up, a few times
+    for (int i = 0; i < 10; i++) {
+      pos = queueEnd;
+      space = 100;
+      control.fillStepQueue();
+    }
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1100, model.getLimitPosition() - queueEnd,
+                                  "Should keep topping up queue");
+
+    // now let it queue the rest of the run in one go
+    space = UINT32_MAX;
+    control.fillStepQueue();
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, queueEnd, "Should queue to end of run");
+    Verify(stepper.moveTo).Times(0);
+
+    // queued steps should be contiguous, and at the tracking speed
+    // wherever they run
+    int32_t expectedFrom = model.getLimitPosition();
+    long maxError = 0;
+    for (size_t i = 0; i < queue.size(); i++) {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(expectedFrom, queue[i].from,
+                                    "Queued steps should be contiguous");
+      int32_t ends[] = {queue[i].from,
+                        queue[i].from - (int32_t)queue[i].steps + 1};
+      for (int32_t p : ends) {
+        long error = labs((long)model.calculateTrackingSpeedInMilliHz(p) -
+                          (long)queue[i].speedInMilliHz);
+        if (error > maxError)
+          maxError = error;
+      }
+      expectedFrom -= queue[i].steps;
+    }
+    log("Streamed tracking: %d queue calls, max speed error %ld millihz",
+        (int)queue.size(), maxError);
+    // half a chunk of speed change, plus speed table error
+    TEST_ASSERT_TRUE_MESSAGE(maxError <= 4,
+                             "Queued speed should be within 4 millihz");
+
+    // once something else takes the motor, topping up should stop
+    streaming = false;
+    size_t calls = queue.size();
+    pos = model.getMiddlePosition();
+    queueEnd = pos;
+    control.fillStepQueue();
+    TEST_ASSERT_EQUAL_INT_MESSAGE(calls, queue.size(),
+                                  "Should not queue when not streaming");
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+}
+
+void test_spsc_queue_two_threads() {
+  // producer pushes a counting sequence as fast as it can, consumer checks
+  // it comes out complete and in order
+  SPSCQueue<uint32_t, 16> queue;
+  const uint32_t count = 200000;
+
+  std::thread producer([&]() {
+    for (uint32_t i = 0; i < count; i++) {
+      while (!queue.push(i)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint32_t expected = 0;
+  uint32_t outOfOrder = 0;
+  while (expected < count) {
+    uint32_t value;
+    if (queue.pop(value)) {
+      if (value != expected)
+        outOfOrder++;
+      expected = value + 1;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, outOfOrder,
+                                "Queue should keep every item in order");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, queue.size(), "Queue should be empty");
+  TEST_ASSERT_TRUE_MESSAGE(queue.getDropped() > 0,
+                           "Producer should have seen queue full");
+
+  uint32_t value;
+  TEST_ASSERT_FALSE_MESSAGE(queue.pop(value), "Empty queue should not pop");
+  for (uint32_t i = 0; i < 16; i++) {
+    TEST_ASSERT_TRUE_MESSAGE(queue.push(i), "Should fill to size");
+  }
+  TEST_ASSERT_FALSE_MESSAGE(queue.push(16), "Full queue should reject");
+}
+
+void test_deferred_log() {
+  setLogAutoFlush(false);
+  logFlush();
+  char line[256];
+
+  // arguments are captured at log time, formatted at pop time
+  char name[16];
+  strcpy(name, "hello");
+  log("int %d long %ld ulong %lu double %.2lf str %s pct %% char %c", -5,
+      123456789L, 4000000000UL, 2.5, name, 'x');
+  strcpy(name, "changed");
+  TEST_ASSERT_TRUE_MESSAGE(logPop(line, sizeof(line)), "Should queue line");
+  TEST_ASSERT_EQUAL_STRING_MESSAGE(
+      "int -5 long 123456789 ulong 4000000000 double 2.50 str hello pct % "
+      "char x",
+      line, "Should format captured arguments");
+  TEST_ASSERT_FALSE_MESSAGE(logPop(line, sizeof(line)), "Queue empty");
+
+  // strings are copied up to the record's string space
+  std::string longString(200, 'a');
+  log("%s|%s", longString.c_str(), "b");
+  logPop(line, sizeof(line));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LOG_STRING_BYTES - 1 + 1, strlen(line),
+                                "Long string truncated, later one empty");
+
+  // * widths and precisions are captured too. A precision bounds the
+  // copy, so a buffer that isn't terminated can be logged.
+  char packet[4] = {'a', 'b', 'c', 'd'};
+  log("[%.*s] [%*d] [%-*.*s] %d", 3, packet, 4, 7, 5, 2, "xyz", 9);
+  TEST_ASSERT_TRUE(logPop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING_MESSAGE("[abc] [   7] [xy   ] 9", line,
+                                   "Should apply captured * values");
+
+  // a full queue drops lines rather than blocking
+  uint32_t droppedBefore = getLogsDropped();
+  for (int i = 0; i < LOG_QUEUE_SIZE + 10; i++)
+    log("line %d", i);
+  TEST_ASSERT_EQUAL_INT(10, getLogsDropped() - droppedBefore);
+  logPop(line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("line 0", line);
+  int popped = 1;
+  while (logPop(line, sizeof(line)))
+    popped++;
+  TEST_ASSERT_EQUAL_INT(LOG_QUEUE_SIZE, popped);
+
+  // several tasks logging while the log task prints
+  const int producers = 4;
+  const int perProducer = 5000;
+  droppedBefore = getLogsDropped();
+  std::atomic<int> running(producers);
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.push_back(std::thread([p, &running]() {
+      for (int i = 0; i < perProducer; i++) {
+        log("producer %d line %d", p, i);
+        std::this_thread::yield();
+      }
+      running--;
+    }));
+  }
+  int received = 0;
+  int lastSeen[producers] = {-1, -1, -1, -1};
+  bool inOrder = true;
+  while (true) {
+    bool done = running == 0;
+    int p, i;
+    while (logPop(line, sizeof(line))) {
+      received++;
+      if (sscanf(line, "producer %d line %d", &p, &i) != 2 ||
+          i <= lastSeen[p])
+        inOrder = false;
+      else
+        lastSeen[p] = i;
+    }
+    if (done)
+      break;
+  }
+  for (std::thread &t : threads)
+    t.join();
+  log("Deferred log: %d lines received, %u dropped", received,
+      getLogsDropped() - droppedBefore);
+  setLogAutoFlush(true);
+  logFlush();
+  TEST_ASSERT_TRUE_MESSAGE(inOrder, "Each producer's lines should be in order");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(producers * perProducer,
+                                received + getLogsDropped() - droppedBefore,
+                                "Every line received or counted as dropped");
+}
+
+int logArgumentsEvaluated = 0;
+int countedLogArgument() { return ++logArgumentsEvaluated; }
+
+void test_log_levels() {
+  setLogAutoFlush(false);
+  logFlush();
+  char line[256];
+
+  // tagged lines carry module and (for warn and error) level
+  LOG_INFO(LOG_RA, "tracking %d", 1);
+  TEST_ASSERT_TRUE(logPop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("RA: tracking 1", line);
+  LOG_WARN(LOG_UDP, "bad %s", "packet");
+  logPop(line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("UDP warn: bad packet", line);
+  LOG_ERROR(LOG_CORE, "oops");
+  logPop(line, sizeof(line));
+  TEST_ASSERT_EQUAL_STRING("error: oops", line);
+
+  // native builds compile everything in, and start with it all on
+  TEST_ASSERT_EQUAL_INT(LOG_LEVEL_TRACE, LOG_COMPILE_LEVEL);
+  TEST_ASSERT_EQUAL_INT(LOG_LEVEL_TRACE, getLogLevel(LOG_DEC));
+
+  // raising one module's level filters only that module, and skips
+  // evaluating the arguments
+  setLogLevel(LOG_DEC, LOG_LEVEL_WARN);
+  logArgumentsEvaluated = 0;
+  LOG_DEBUG(LOG_DEC, "filtered %d", countedLogArgument());
+  LOG_INFO(LOG_DEC, "filtered %d", countedLogArgument());
+  TEST_ASSERT_FALSE_MESSAGE(logPop(line, sizeof(line)),
+                            "Dec below warn should be filtered");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, logArgumentsEvaluated,
+                                "Filtered arguments not evaluated");
+  LOG_DEBUG(LOG_RA, "kept %d", countedLogArgument());
+  LOG_WARN(LOG_DEC, "kept %d", countedLogArgument());
+  TEST_ASSERT_TRUE(logPop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("RA: kept 1", line);
+  TEST_ASSERT_TRUE(logPop(line, sizeof(line)));
+  TEST_ASSERT_EQUAL_STRING("Dec warn: kept 2", line);
+
+  // the web server sets levels by name; no module means all of them
+  TEST_ASSERT_EQUAL_INT(LOG_NET, findLogModule("net"));
+  TEST_ASSERT_EQUAL_INT(-1, findLogModule("foo"));
+  TEST_ASSERT_EQUAL_INT(LOG_LEVEL_NONE, findLogLevel("NONE"));
+  TEST_ASSERT_EQUAL_INT(-1, findLogLevel("loud"));
+  setLogLevel(LOG_MODULE_COUNT, LOG_LEVEL_NONE);
+  LOG_ERROR(LOG_WEB, "silenced");
+  TEST_ASSERT_FALSE(logPop(line, sizeof(line)));
+  setLogLevel(LOG_RA, 99);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(LOG_LEVEL_NONE, getLogLevel(LOG_RA),
+                                "Bad level ignored");
+
+  setLogLevel(LOG_MODULE_COUNT, LOG_COMPILE_LEVEL);
+  setLogAutoFlush(true);
+}
+
+void test_platform_protocol() {
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+
+  PlatformStatus status;
+  status.timeToCenter = -1234.5;
+  status.timeToEnd = 3600;
+  status.isTracking = true;
+  status.slewing = false;
+  status.guideMoveRate = 0.0041780746;
+  status.trackingRate = 15.041;
+  status.axisMoveRateMax = 2.5;
+  status.axisMoveRateMin = 0.0001;
+  status.generation = 70000;
+  TEST_ASSERT_EQUAL_INT(0, encodeStatus(status, buffer, 10));
+  size_t length = encodeStatus(status, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_STATUS_BYTES, length);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0xA5, buffer[0], "Magic first");
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_STATUS, getMessageType(buffer, length));
+
+  PlatformStatus decoded;
+  TEST_ASSERT_TRUE(decodeStatus(buffer, length, decoded));
+  TEST_ASSERT_TRUE(decoded.isTracking);
+  TEST_ASSERT_FALSE(decoded.slewing);
+  // status goes as float32
+  TEST_ASSERT_FLOAT_WITHIN(0.01, -1234.5, decoded.timeToCenter);
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 3600, decoded.timeToEnd);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, 0.0041780746, decoded.guideMoveRate);
+  TEST_ASSERT_FLOAT_WITHIN(1e-5, 15.041, decoded.trackingRate);
+  TEST_ASSERT_FLOAT_WITHIN(1e-6, 2.5, decoded.axisMoveRateMax);
+  TEST_ASSERT_FLOAT_WITHIN(1e-10, 0.0001, decoded.axisMoveRateMin);
+  TEST_ASSERT_EQUAL_INT(70000, decoded.generation);
+  TEST_ASSERT_FALSE_MESSAGE(decodeStatus(buffer, length - 1, decoded),
+                            "Short status rejected");
+
+  // command parameters keep full precision
+  PlatformCommand command;
+  command.code = PLATFORM_COMMAND_SLEW_BY_DEGREES;
+  command.parameter1 = AXIS_DEC;
+  command.parameter2 = -0.123456789012;
+  command.executeAtMicros = 0;
+  command.sequence = 0;
+  command.session = 0;
+  length = encodeCommand(command, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_COMMAND_BYTES, length);
+  PlatformCommand decodedCommand;
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length, decodedCommand));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_SLEW_BY_DEGREES,
+                        decodedCommand.code);
+  TEST_ASSERT_TRUE(decodedCommand.parameter1 == AXIS_DEC);
+  TEST_ASSERT_TRUE(decodedCommand.parameter2 == -0.123456789012);
+  TEST_ASSERT_FALSE_MESSAGE(decodeStatus(buffer, length, decoded),
+                            "Command is not a status");
+
+  // unknown command code, newer version
+  buffer[3] = PLATFORM_COMMAND_COUNT;
+  TEST_ASSERT_FALSE(decodeCommand(buffer, length, decodedCommand));
+  buffer[3] = PLATFORM_COMMAND_PULSE_GUIDE;
+  buffer[1] = PROTOCOL_VERSION + 1;
+  TEST_ASSERT_TRUE_MESSAGE(isBinaryMessage(buffer, length),
+                           "Still binary, so not parsed as JSON");
+  TEST_ASSERT_EQUAL_INT(0, getMessageType(buffer, length));
+  TEST_ASSERT_FALSE(decodeCommand(buffer, length, decodedCommand));
+
+  // JSON messages are never binary
+  const char *json = "EQ:{\"command\":\"home\"}";
+  TEST_ASSERT_FALSE(isBinaryMessage((const uint8_t *)json, strlen(json)));
+  json = "DSC:{}";
+  TEST_ASSERT_FALSE(isBinaryMessage((const uint8_t *)json, strlen(json)));
+  TEST_ASSERT_FALSE(isBinaryMessage(buffer, 0));
+
+  length = encodeHello(buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_HEADER_BYTES, length);
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_HELLO, getMessageType(buffer, length));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, getMessageType(buffer, length - 1),
+                                "Short header");
+
+  // JSON command names map to the same codes
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_PULSE_GUIDE,
+                        findPlatformCommand("pulseguide"));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_MOVE_AXIS_PERCENTAGE,
+                        findPlatformCommand("moveaxispercentage"));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_NONE, findPlatformCommand("moveaxi"));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_NONE, findPlatformCommand(""));
+  TEST_ASSERT_EQUAL_STRING("home",
+                           getPlatformCommandName(PLATFORM_COMMAND_HOME));
+}
+
+// What the sender does: send if due, and count it as sent
+static bool publish(StatusPublisher &publisher, const PlatformStatus &status,
+                    unsigned long nowMillis) {
+  if (!publisher.isDue(status, nowMillis))
+    return false;
+  publisher.markSent(nowMillis);
+  return true;
+}
+
+void test_status_publisher() {
+  StatusPublisher publisher(5000, 100);
+  PlatformStatus status = PlatformStatus();
+  status.trackingRate = 15.041;
+
+  TEST_ASSERT_TRUE_MESSAGE(publish(publisher, status, 1000), "First goes out");
+  TEST_ASSERT_EQUAL_INT(1, publisher.getGeneration());
+  // times to center/end aren't compared
+  status.timeToEnd = 1234;
+  TEST_ASSERT_FALSE_MESSAGE(publish(publisher, status, 1500),
+                            "Nothing changed");
+  TEST_ASSERT_FALSE(publish(publisher, status, 5999));
+  TEST_ASSERT_TRUE_MESSAGE(publish(publisher, status, 6000), "Heartbeat");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, publisher.getGeneration(),
+                                "Heartbeat is the same generation");
+
+  // a change goes out straight away
+  status.isTracking = true;
+  TEST_ASSERT_TRUE_MESSAGE(publish(publisher, status, 6200), "Tracking on");
+  TEST_ASSERT_EQUAL_INT(2, publisher.getGeneration());
+
+  // changes right after a publish wait for the minimum interval, and
+  // go out together
+  status.slewing = true;
+  TEST_ASSERT_FALSE(publish(publisher, status, 6250));
+  status.isTracking = false;
+  TEST_ASSERT_FALSE(publish(publisher, status, 6280));
+  TEST_ASSERT_TRUE_MESSAGE(publish(publisher, status, 6300),
+                           "Pending change sent");
+  TEST_ASSERT_EQUAL_INT(3, publisher.getGeneration());
+  TEST_ASSERT_FALSE(publish(publisher, status, 6400));
+
+  status.axisMoveRateMax = 3;
+  TEST_ASSERT_TRUE_MESSAGE(publish(publisher, status, 7000), "Rate changed");
+  TEST_ASSERT_EQUAL_INT(4, publisher.getChangesPublished());
+  TEST_ASSERT_EQUAL_INT(1, publisher.getHeartbeatsPublished());
+
+  // a status that fails to send stays due, as the same generation
+  status.slewing = false;
+  TEST_ASSERT_TRUE(publisher.isDue(status, 7200));
+  TEST_ASSERT_TRUE_MESSAGE(publisher.isDue(status, 7300),
+                           "Unsent change still due");
+  TEST_ASSERT_EQUAL_INT(5, publisher.getGeneration());
+  TEST_ASSERT_EQUAL_INT(4, publisher.getChangesPublished());
+  publisher.markSent(7300);
+  TEST_ASSERT_EQUAL_INT(5, publisher.getChangesPublished());
+  TEST_ASSERT_FALSE(publisher.isDue(status, 7400));
+
+  // heartbeat timing survives millis() wrapping
+  StatusPublisher wrapping(5000, 100);
+  TEST_ASSERT_TRUE(publish(wrapping, status, 0xFFFFF000ul));
+  TEST_ASSERT_FALSE(publish(wrapping, status, 100));
+  TEST_ASSERT_TRUE(publish(wrapping, status, 5000));
+}
+
+void test_position_stream() {
+  PositionStream stream;
+  PositionSubscriber due[POSITION_STREAM_MAX_SUBSCRIBERS];
+  unsigned long t = 1000;
+
+  stream.subscribe(0x0100A8C0, 50375, 10, t);
+  stream.subscribe(0x0200A8C0, 50375, 100, t);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, stream.collectDue(t, due),
+                                "First position goes out straight away");
+  TEST_ASSERT_EQUAL_INT(2, stream.getSubscriberCount());
+  TEST_ASSERT_EQUAL_INT(0, stream.collectDue(t + 25, due));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, stream.collectDue(t + 50, due),
+                                "100 Hz held to 20 Hz");
+  TEST_ASSERT_EQUAL_INT(0x0200A8C0, due[0].address);
+  TEST_ASSERT_EQUAL_INT(2, stream.collectDue(t + 100, due));
+
+  // resubscribing changes rate rather than adding a subscriber
+  stream.subscribe(0x0100A8C0, 50375, 20, t + 100);
+  TEST_ASSERT_EQUAL_INT(2, stream.collectDue(t + 150, due));
+  TEST_ASSERT_EQUAL_INT(2, stream.getSubscriberCount());
+
+  // table full
+  for (uint32_t peer = 3; peer < 6; peer++)
+    stream.subscribe(peer, 50375, 1, t + 200);
+  stream.collectDue(t + 200, due);
+  TEST_ASSERT_EQUAL_INT(POSITION_STREAM_MAX_SUBSCRIBERS,
+                        stream.getSubscriberCount());
+  TEST_ASSERT_EQUAL_INT(1, stream.getRejected());
+
+  // rate 0 unsubscribes, and subscriptions lapse unless renewed
+  stream.subscribe(0x0200A8C0, 50375, 0, t + 300);
+  stream.collectDue(t + 300, due);
+  TEST_ASSERT_EQUAL_INT(3, stream.getSubscriberCount());
+  stream.subscribe(0x0100A8C0, 50375, 20, t + 20000);
+  stream.collectDue(t + 20000, due);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      1, stream.collectDue(t + 200 + POSITION_STREAM_TIMEOUT_MILLIS, due),
+      "Only the renewed subscriber left");
+  TEST_ASSERT_EQUAL_INT(0x0100A8C0, due[0].address);
+
+  // wire format
+  PlatformPosition position;
+  position.timeMicros = 0x123456789ull;
+  position.raPosition = 400000;
+  position.decPosition = -12;
+  position.raSpeedInMilliHz = -4512;
+  position.decSpeedInMilliHz = 30000000;
+  position.flags = POSITION_FLAG_TRACKING | POSITION_FLAG_DEC_PULSE;
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t length = encodePosition(position, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_POSITION_BYTES, length);
+  PlatformPosition decoded;
+  TEST_ASSERT_TRUE(decodePosition(buffer, length, decoded));
+  TEST_ASSERT_TRUE(decoded.timeMicros == 0x123456789ull);
+  TEST_ASSERT_EQUAL_INT(400000, decoded.raPosition);
+  TEST_ASSERT_EQUAL_INT(-12, decoded.decPosition);
+  TEST_ASSERT_EQUAL_INT(-4512, decoded.raSpeedInMilliHz);
+  TEST_ASSERT_EQUAL_INT(30000000, decoded.decSpeedInMilliHz);
+  TEST_ASSERT_EQUAL_INT(position.flags, decoded.flags);
+  uint8_t rateHz;
+  length = encodeSubscribe(15, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(decodeSubscribe(buffer, length, rateHz));
+  TEST_ASSERT_EQUAL_INT(15, rateHz);
+  TEST_ASSERT_FALSE(decodePosition(buffer, length, decoded));
+}
+
+void test_clock_sync() {
+  // DSC sends at 1000, the reply takes longer coming back than going,
+  // which shows up as half the difference in offset
+  ClockSample sample;
+  uint64_t offset = 5000000;
+  TEST_ASSERT_TRUE(computeClockSample(1000, 3000 + offset, 3100 + offset,
+                                      6100, sample));
+  TEST_ASSERT_TRUE(sample.roundTripMicros == 5000);
+  TEST_ASSERT_TRUE(sample.offsetMicros == 4999500);
+  TEST_ASSERT_FALSE_MESSAGE(
+      computeClockSample(0, offset, offset,
+                         CLOCK_SYNC_MAX_ROUND_TRIP_MICROS + 1, sample),
+      "Slow exchange dropped");
+  TEST_ASSERT_FALSE_MESSAGE(computeClockSample(1000, 0, 0, 999, sample),
+                            "Reply before request");
+
+  // a DSC that booted 7s after the platform, syncing over the wire with
+  // 1.5ms each way, except one exchange held up in a queue
+  const uint64_t dscBehind = 7000000;
+  const uint32_t address = 0x0100A8C0;
+  const uint16_t port = 50376;
+  ClockSyncClient client;
+  ClockSync sync;
+  uint64_t now = 10000000; // platform clock
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+  for (int i = 0; i < 5; i++) {
+    TimeRequest request;
+    client.makeRequest(now - dscBehind, request);
+    size_t length = encodeTimeRequest(request, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_INT(PROTOCOL_TIME_BYTES, length);
+    now += i == 2 ? 40000 : 1500;
+    TEST_ASSERT_TRUE(decodeTimeRequest(buffer, length, request));
+    TimeResponse response;
+    sync.handleRequest(address, port, request, now, response);
+    length = encodeTimeResponse(response, buffer, sizeof(buffer));
+    now += 1500;
+    TEST_ASSERT_TRUE(decodeTimeResponse(buffer, length, response));
+    TEST_ASSERT_TRUE(client.handleResponse(response, now - dscBehind));
+    TEST_ASSERT_FALSE_MESSAGE(client.handleResponse(response, now),
+                              "Duplicate response ignored");
+    now += 1000000;
+  }
+  TEST_ASSERT_TRUE(client.getEstimate(sample));
+  TEST_ASSERT_TRUE_MESSAGE(sample.offsetMicros == (int64_t)dscBehind,
+                           "Queued exchange filtered out");
+  TEST_ASSERT_TRUE(sample.roundTripMicros == 3000);
+  uint64_t converted;
+  TEST_ASSERT_TRUE(client.toPlatformMicros(500, converted));
+  TEST_ASSERT_TRUE(converted == 500 + dscBehind);
+
+  // the platform learns the same offset from the times passed back
+  TEST_ASSERT_TRUE(sync.getEstimate(address, port, now, sample));
+  TEST_ASSERT_TRUE(sample.offsetMicros == (int64_t)dscBehind);
+  TEST_ASSERT_TRUE(sync.toLocalMicros(address, port, 500, now, converted));
+  TEST_ASSERT_TRUE(converted == 500 + dscBehind);
+  TEST_ASSERT_FALSE_MESSAGE(
+      sync.toLocalMicros(address, port + 1, 500, now, converted),
+      "Each peer has its own offset");
+  TEST_ASSERT_FALSE_MESSAGE(
+      sync.getEstimate(address, port, now + CLOCK_SYNC_TIMEOUT_MICROS,
+                       sample),
+      "Old estimate dropped");
+  TEST_ASSERT_EQUAL_INT(3000, sync.getRoundTripLastMicros());
+  TEST_ASSERT_EQUAL_INT(41500, sync.getRoundTripMaxMicros());
+  TEST_ASSERT_TRUE(sync.getRoundTripAverageMicros() > 3000 &&
+                   sync.getRoundTripAverageMicros() < 41500);
+
+  // table full: the quietest peer makes way
+  TimeRequest request = {1, 0, 0};
+  TimeResponse response;
+  for (uint32_t peer = 2; peer < 2 + CLOCK_SYNC_MAX_PEERS; peer++)
+    sync.handleRequest(peer, port, request, now + peer, response);
+  TEST_ASSERT_EQUAL_INT(CLOCK_SYNC_MAX_PEERS, sync.getPeerCount());
+  TEST_ASSERT_FALSE(sync.getEstimate(address, port, now, sample));
+
+  // timed commands carry their time, untimed ones stay short
+  PlatformCommand command;
+  command.code = PLATFORM_COMMAND_PULSE_GUIDE;
+  command.parameter1 = 1;
+  command.parameter2 = 250;
+  command.executeAtMicros = 0x123456789abcull;
+  command.sequence = 0;
+  command.session = 0;
+  size_t length = encodeCommand(command, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_TIMED_COMMAND_BYTES, length);
+  PlatformCommand decoded;
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length, decoded));
+  TEST_ASSERT_TRUE(decoded.executeAtMicros == 0x123456789abcull);
+  TEST_ASSERT_FALSE(decodeCommand(buffer, length - 1, decoded));
+  command.executeAtMicros = 0;
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_COMMAND_BYTES,
+                        encodeCommand(command, buffer, sizeof(buffer)));
+}
+
+void test_command_window() {
+  CommandWindow window;
+  const uint32_t dsc = 0x0100A8C0;
+  uint64_t t = 1000;
+
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 1, 10, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 1, 11, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_DUPLICATE, window.check(dsc, 1, 11, t));
+  // 12 and 13 held up, 14 gets there first
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 1, 14, t));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(SEQUENCE_STALE, window.check(dsc, 1, 12, t),
+                                "Older than one applied");
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_DUPLICATE, window.check(dsc, 1, 12, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_DUPLICATE, window.check(dsc, 1, 10, t));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(SEQUENCE_ACCEPTED, window.check(dsc, 2, 1, t),
+                                "Each peer has its own window");
+  TEST_ASSERT_EQUAL_INT(0, window.getLost());
+
+  // 13 never arrives: lost once the window moves past it
+  window.check(dsc, 1, 13 + COMMAND_WINDOW_BITS - 1, t);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, window.getLost(),
+                                "13 still in the window");
+  window.check(dsc, 1, 13 + COMMAND_WINDOW_BITS, t);
+  TEST_ASSERT_EQUAL_INT(1, window.getLost());
+  TEST_ASSERT_EQUAL_INT(6, window.getAccepted());
+  TEST_ASSERT_EQUAL_INT(3, window.getDuplicates());
+  TEST_ASSERT_EQUAL_INT(1, window.getStale());
+
+  // a restarted DSC starts again from low numbers, as does one that went
+  // quiet
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 2, 5000, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 2, 1, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 1, 1,
+                                     t + COMMAND_WINDOW_TIMEOUT_MICROS + 1));
+  // and sequences wrap
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 3, 0xfffffffe, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.check(dsc, 3, 2, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_STALE, window.check(dsc, 3, 0xffffffff, t));
+
+  // a DSC that sends a session can restart at once, without looking like
+  // a replay
+  const uint32_t session = 0x1234;
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 4, 50, t, session));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(SEQUENCE_STALE,
+                                window.check(dsc, 4, 1, t, session),
+                                "Same session going back is a replay");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(SEQUENCE_ACCEPTED,
+                                window.check(dsc, 4, 1, t, session + 1),
+                                "New session starts a new window");
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_DUPLICATE,
+                        window.check(dsc, 4, 1, t, session + 1));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 4, 2, t, session + 1));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(SEQUENCE_STALE,
+                                window.check(dsc, 4, 51, t, session),
+                                "Late packet from the old session replayed");
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 4, 1, t, session + 2));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_STALE,
+                        window.check(dsc, 4, 3, t, session + 1));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_STALE, window.check(dsc, 4, 52, t, session));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED,
+                        window.check(dsc, 4, 2, t, session + 2));
+
+  // classify alone leaves a sequence free until it's recorded
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.classify(dsc, 5, 9, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.classify(dsc, 5, 9, t));
+  window.record(dsc, 5, 9, t);
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_DUPLICATE, window.classify(dsc, 5, 9, t));
+  TEST_ASSERT_EQUAL_INT(SEQUENCE_ACCEPTED, window.classify(dsc, 5, 10, t));
+
+  // acks on the wire
+  uint8_t buffer[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t length = encodeAck(77, ACK_STALE, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_ACK_BYTES, length);
+  uint32_t sequence;
+  AckResult result;
+  TEST_ASSERT_TRUE(decodeAck(buffer, length, sequence, result));
+  TEST_ASSERT_EQUAL_INT(77, sequence);
+  TEST_ASSERT_EQUAL_INT(ACK_STALE, result);
+  length = encodeAck(78, ACK_BUSY, buffer, sizeof(buffer));
+  TEST_ASSERT_TRUE(decodeAck(buffer, length, sequence, result));
+  TEST_ASSERT_EQUAL_INT(ACK_BUSY, result);
+  PlatformCommand command;
+  command.code = PLATFORM_COMMAND_TRACK;
+  command.parameter1 = 1;
+  command.parameter2 = 0;
+  command.executeAtMicros = 0;
+  command.sequence = 123456;
+  command.session = 0;
+  length = encodeCommand(command, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_COMMAND_BYTES + PROTOCOL_SEQUENCE_BYTES,
+                        length);
+  PlatformCommand decoded;
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_INT(123456, decoded.sequence);
+  TEST_ASSERT_EQUAL_INT(0, decoded.session);
+  command.executeAtMicros = 99;
+  length = encodeCommand(command, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_TIMED_COMMAND_BYTES + PROTOCOL_SEQUENCE_BYTES,
+                        length);
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_INT(123456, decoded.sequence);
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length - 4, decoded));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, decoded.sequence,
+                                "Sequence is optional");
+  command.session = 0xdeadbeef;
+  length = encodeCommand(command, buffer, sizeof(buffer));
+  TEST_ASSERT_EQUAL_INT(PROTOCOL_MAX_MESSAGE_BYTES, length);
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length, decoded));
+  TEST_ASSERT_EQUAL_INT(123456, decoded.sequence);
+  TEST_ASSERT_TRUE(decoded.session == 0xdeadbeef);
+  TEST_ASSERT_TRUE(decodeCommand(buffer, length - 4, decoded));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, decoded.session, "Session is optional");
+}
+
+/**
+ * A DSC extrapolating from one streamed position should land where the
+ * next one says the platform is.
+ */
+void testPlatformPositionExtrapolates() {
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(448);
+  decModel.setLimitSwitchToMiddleDistance(62);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+
+  SimulatedTimerService timers;
+  SimulatedStepper raStepper(timers);
+  SimulatedStepper decStepper(timers);
+  SimulatedInputSource inputs;
+  RADynamic raDynamic(raModel);
+  DecDynamic decDynamic(decModel);
+  raDynamic.setStepperWrapper(&raStepper);
+  raDynamic.setTimerService(&timers);
+  raDynamic.setTrackingMode(TRACKING_MODE_STREAM);
+  decDynamic.setStepperWrapper(&decStepper);
+  decDynamic.setTimerService(&timers);
+  CommandMailbox mailbox(raDynamic, decDynamic);
+  LoopMetrics metrics;
+  MotorUnit motorUnit(raModel, raDynamic, decModel, decDynamic, mailbox,
+                      metrics);
+  motorUnit.setup(&raStepper, &decStepper, &inputs, &timers);
+  motorUnit.setAcceleration(20000);
+  raStepper.setPhysicalPosition(raModel.getMiddlePosition());
+  decStepper.setPhysicalPosition(decModel.getMiddlePosition());
+
+  auto runFor = [&](double seconds) {
+    long loops = seconds * 40;
+    for (long i = 0; i < loops; i++) {
+      timers.advanceMicros(25000);
+      motorUnit.onLoop();
+    }
+  };
+
+  inputs.press(BUTTON_PLAY);
+  runFor(2);
+  PlatformPosition before = motorUnit.getPlatformPosition();
+  TEST_ASSERT_TRUE_MESSAGE(before.flags & POSITION_FLAG_TRACKING,
+                           "Tracking flag");
+  TEST_ASSERT_FALSE(before.flags & POSITION_FLAG_RA_SLEWING);
+  TEST_ASSERT_TRUE_MESSAGE(before.raSpeedInMilliHz < 0,
+                           "Tracking runs towards 0");
+  TEST_ASSERT_EQUAL_INT(0, before.decSpeedInMilliHz);
+
+  runFor(0.1); // two 20 Hz packets apart
+  PlatformPosition after = motorUnit.getPlatformPosition();
+  double seconds = (after.timeMicros - before.timeMicros) / 1000000.0;
+  double predicted =
+      before.raPosition + before.raSpeedInMilliHz / 1000.0 * seconds;
+  TEST_ASSERT_FLOAT_WITHIN_MESSAGE(2, predicted, after.raPosition,
+                                   "Extrapolated position");
+
+  // slew on dec shows up with its direction
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::gotoStart(AXIS_DEC),
+               timers.nowMicros());
+  runFor(1);
+  after = motorUnit.getPlatformPosition();
+  TEST_ASSERT_TRUE(after.flags & POSITION_FLAG_DEC_SLEWING);
+  TEST_ASSERT_TRUE_MESSAGE(after.decSpeedInMilliHz != 0, "Dec moving");
+}
+
+static DscPacketResult handleJson(const char *packet, CommandMailbox &mailbox) {
+  return handleDscPacket((const uint8_t *)packet, strlen(packet), mailbox, 0);
+}
+
+void test_dsc_packet_dispatch() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(0);
+  CommandMailbox mailbox(ra, dec);
+
+  uint8_t binary[PROTOCOL_MAX_MESSAGE_BYTES];
+  PlatformCommand pulse;
+  pulse.code = PLATFORM_COMMAND_PULSE_GUIDE;
+  pulse.parameter1 = 2;
+  pulse.parameter2 = 300;
+  pulse.executeAtMicros = 0;
+  pulse.sequence = 0;
+  pulse.session = 0;
+  size_t binaryLength = encodeCommand(pulse, binary, sizeof(binary));
+  uint8_t hello[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t helloLength = encodeHello(hello, sizeof(hello));
+
+  // the whole receive path, for both protocols, without the heap
+  unsigned long allocationsBefore = allocationCount;
+  TEST_ASSERT_EQUAL_INT(
+      DSC_PACKET_COMMAND,
+      handleJson("EQ:{\"command\":\"moveaxispercentage\",\"parameter1\":1,"
+                 "\"parameter2\":-42.5}",
+                 mailbox));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      DSC_PACKET_COMMAND,
+      handleJson("EQ: { \"parameter2\" : 0 , \"parameter1\" : 1.0,\n"
+                 "\"command\" : \"track\" }",
+                 mailbox),
+      "Any field order and spacing");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      DSC_PACKET_COMMAND,
+      handleJson("EQ:{\"command\":\"home\",\"parameter1\":0,"
+                 "\"extra\":[1,{\"a\":\"}\"}],\"parameter2\":null}",
+                 mailbox),
+      "Unknown fields skipped");
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_COMMAND,
+                        handleDscPacket(binary, binaryLength, mailbox, 0));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_HELLO,
+                        handleDscPacket(hello, helloLength, mailbox, 0));
+  helloLength = encodeSubscribe(10, hello, sizeof(hello));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_SUBSCRIBE,
+                        handleDscPacket(hello, helloLength, mailbox, 0));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocationCount - allocationsBefore,
+                                "Receive path allocated");
+
+  // home posts two
+  TEST_ASSERT_EQUAL_INT(5, mailbox.drain(0));
+  TEST_ASSERT_TRUE_MESSAGE(ra.isTrackingOn(), "Tracking should be on");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(decModel.getMiddlePosition(),
+                                dec.getTargetPosition(),
+                                "Dec should target middle");
+
+  // rejected packets post nothing
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED, handleJson("DSC:{}", mailbox));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleJson("EQ:{\"command\":\"home\"}", mailbox));
+  TEST_ASSERT_EQUAL_INT(
+      DSC_PACKET_REJECTED,
+      handleJson("EQ:{\"command\":\"pulseguide\",\"parameter1\":7,"
+                 "\"parameter2\":100}",
+                 mailbox));
+  TEST_ASSERT_EQUAL_INT(
+      DSC_PACKET_REJECTED,
+      handleJson("EQ:{\"command\":\"moveaxis\",\"parameter1\":5,"
+                 "\"parameter2\":1}",
+                 mailbox));
+  binary[3] = PLATFORM_COMMAND_COUNT;
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(binary, binaryLength, mailbox, 0));
+
+  // parameters out of range for what they're converted to
+  const char *badParameters[] = {
+      "EQ:{\"command\":\"pulseguide\",\"parameter1\":1,"
+      "\"parameter2\":-100}",
+      "EQ:{\"command\":\"pulseguide\",\"parameter1\":1,"
+      "\"parameter2\":1e300}",
+      "EQ:{\"command\":\"pulseguide\",\"parameter1\":1.5,"
+      "\"parameter2\":100}",
+      "EQ:{\"command\":\"moveaxis\",\"parameter1\":0.5,"
+      "\"parameter2\":1}",
+      "EQ:{\"command\":\"moveaxispercentage\",\"parameter1\":1,"
+      "\"parameter2\":1e12}"};
+  for (const char *packet : badParameters)
+    TEST_ASSERT_EQUAL_INT_MESSAGE(DSC_PACKET_REJECTED,
+                                  handleJson(packet, mailbox), packet);
+  // binary can carry what JSON can't
+  PlatformCommand notFinite = pulse;
+  notFinite.code = PLATFORM_COMMAND_MOVE_AXIS;
+  notFinite.parameter1 = AXIS_DEC;
+  notFinite.parameter2 = NAN;
+  size_t notFiniteLength = encodeCommand(notFinite, binary, sizeof(binary));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(binary, notFiniteLength, mailbox, 0));
+  notFinite.code = PLATFORM_COMMAND_SLEW_BY_DEGREES;
+  notFinite.parameter2 = INFINITY;
+  notFiniteLength = encodeCommand(notFinite, binary, sizeof(binary));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(binary, notFiniteLength, mailbox, 0));
+  notFinite.code = PLATFORM_COMMAND_PULSE_GUIDE;
+  notFinite.parameter1 = NAN;
+  notFinite.parameter2 = 100;
+  notFiniteLength = encodeCommand(notFinite, binary, sizeof(binary));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(binary, notFiniteLength, mailbox, 0));
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(0));
+
+  // why the parser rejected them
+  PlatformCommand command;
+  const char *json = "{\"command\":\"homer\",\"parameter1\":0,"
+                     "\"parameter2\":0}";
+  TEST_ASSERT_EQUAL_INT(JSON_COMMAND_UNKNOWN,
+                        parseJsonCommand(json, strlen(json), command));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(
+      JSON_COMMAND_BAD_JSON, parseJsonCommand(json, strlen(json) - 1, command),
+      "Stops at length, not a null");
+  json = "{\"command\":\"park\",\"parameter1\":}";
+  TEST_ASSERT_EQUAL_INT(JSON_COMMAND_BAD_JSON,
+                        parseJsonCommand(json, strlen(json), command));
+  json = "{\"command\":\"park\",\"parameter1\":1}";
+  TEST_ASSERT_EQUAL_INT(JSON_COMMAND_MISSING_FIELDS,
+                        parseJsonCommand(json, strlen(json), command));
+  json = "{\"parameter2\":-1.5e2,\"command\":\"slewbydegrees\","
+         "\"parameter1\":1}";
+  TEST_ASSERT_EQUAL_INT(JSON_COMMAND_OK,
+                        parseJsonCommand(json, strlen(json), command));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_SLEW_BY_DEGREES, command.code);
+  TEST_ASSERT_FLOAT_WITHIN(1e-9, -150, command.parameter2);
+  // sequence and session must fit a uint32 as they are
+  const char *badNumbers[] = {"-1", "1e10", "1.5", "1e999", "4294967296"};
+  char badJson[96];
+  for (size_t i = 0; i < sizeof(badNumbers) / sizeof(badNumbers[0]); i++) {
+    snprintf(badJson, sizeof(badJson),
+             "{\"command\":\"park\",\"parameter1\":0,"
+             "\"parameter2\":0,\"sequence\":%s}",
+             badNumbers[i]);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        JSON_COMMAND_BAD_FIELD,
+        parseJsonCommand(badJson, strlen(badJson), command), badNumbers[i]);
+    snprintf(badJson, sizeof(badJson),
+             "{\"command\":\"park\",\"parameter1\":0,"
+             "\"parameter2\":0,\"session\":%s}",
+             badNumbers[i]);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        JSON_COMMAND_BAD_FIELD,
+        parseJsonCommand(badJson, strlen(badJson), command), badNumbers[i]);
+  }
+  json = "{\"command\":\"park\",\"parameter1\":0,\"parameter2\":0,"
+         "\"sequence\":4294967295,\"session\":0}";
+  TEST_ASSERT_EQUAL_INT(JSON_COMMAND_OK,
+                        parseJsonCommand(json, strlen(json), command));
+  TEST_ASSERT_EQUAL_UINT32(4294967295u, command.sequence);
+
+  // hashed lookup still checks the name
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_HOME,
+                        findPlatformCommand("homex", 4));
+  TEST_ASSERT_EQUAL_INT(PLATFORM_COMMAND_NONE, findPlatformCommand("hom", 3));
+
+  // sequenced commands are acked in their own protocol, and a repeat
+  // isn't posted again
+  CommandWindow window;
+  DscSender sender = {0x0100A8C0, 50376, nullptr, &window, {}, 0};
+  const char *sequenced = "EQ:{\"command\":\"pulseguide\",\"parameter1\":0,"
+                          "\"parameter2\":100,\"sequence\":7}";
+  allocationsBefore = allocationCount;
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_COMMAND,
+                        handleDscPacket((const uint8_t *)sequenced,
+                                        strlen(sequenced), mailbox, 0,
+                                        &sender));
+  const char *acceptedAck = "DSC:{\"ack\":7,\"result\":\"accepted\"}";
+  TEST_ASSERT_EQUAL_INT(strlen(acceptedAck), sender.replyLength);
+  TEST_ASSERT_EQUAL_STRING_LEN(acceptedAck, (const char *)sender.reply,
+                               sender.replyLength);
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_DROPPED,
+                        handleDscPacket((const uint8_t *)sequenced,
+                                        strlen(sequenced), mailbox, 0,
+                                        &sender));
+  const char *duplicateAck = "DSC:{\"ack\":7,\"result\":\"duplicate\"}";
+  TEST_ASSERT_EQUAL_INT(strlen(duplicateAck), sender.replyLength);
+  TEST_ASSERT_EQUAL_STRING_LEN(duplicateAck, (const char *)sender.reply,
+                               sender.replyLength);
+  pulse.sequence = 6;
+  binaryLength = encodeCommand(pulse, binary, sizeof(binary));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_DROPPED,
+                        handleDscPacket(binary, binaryLength, mailbox, 0,
+                                        &sender));
+  uint32_t ackSequence;
+  AckResult ackResult;
+  TEST_ASSERT_TRUE(
+      decodeAck(sender.reply, sender.replyLength, ackSequence, ackResult));
+  TEST_ASSERT_EQUAL_INT(6, ackSequence);
+  TEST_ASSERT_EQUAL_INT(ACK_STALE, ackResult);
+  const char *negativePulse = "EQ:{\"command\":\"pulseguide\","
+                              "\"parameter1\":0,\"parameter2\":-5,"
+                              "\"sequence\":8}";
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket((const uint8_t *)negativePulse,
+                                        strlen(negativePulse), mailbox, 0,
+                                        &sender));
+  const char *rejectedAck = "DSC:{\"ack\":8,\"result\":\"rejected\"}";
+  TEST_ASSERT_EQUAL_STRING_LEN(rejectedAck, (const char *)sender.reply,
+                               sender.replyLength);
+  // rejecting it didn't use up the sequence
+  const char *fixedPulse = "EQ:{\"command\":\"pulseguide\","
+                           "\"parameter1\":0,\"parameter2\":5,"
+                           "\"sequence\":8}";
+  TEST_ASSERT_EQUAL_INT_MESSAGE(DSC_PACKET_COMMAND,
+                                handleDscPacket((const uint8_t *)fixedPulse,
+                                                strlen(fixedPulse), mailbox,
+                                                0, &sender),
+                                "Corrected resend taken as duplicate");
+  // the DSC reboots and numbers from 1 again, in a new session
+  const char *restarted = "EQ:{\"command\":\"track\",\"parameter1\":1,"
+                          "\"parameter2\":0,\"sequence\":1,"
+                          "\"session\":77}";
+  TEST_ASSERT_EQUAL_INT_MESSAGE(DSC_PACKET_COMMAND,
+                                handleDscPacket((const uint8_t *)restarted,
+                                                strlen(restarted), mailbox,
+                                                0, &sender),
+                                "Restarted DSC not dropped as stale");
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_SUBSCRIBE,
+                        handleDscPacket(hello, helloLength, mailbox, 0,
+                                        &sender));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, sender.replyLength, "Nothing to ack");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocationCount - allocationsBefore,
+                                "Acking allocated");
+  TEST_ASSERT_EQUAL_INT(3, mailbox.drain(0));
+
+  // a full queue is acked busy, and the resend taken once there's room.
+  // Home is two commands, so with room for one neither is posted.
+  for (int i = 0; i < COMMAND_QUEUE_SIZE - 1; i++)
+    mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::track(true), 0);
+  const char *home = "EQ:{\"command\":\"home\",\"parameter1\":0,"
+                     "\"parameter2\":0,\"sequence\":2,\"session\":77}";
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_DROPPED,
+                        handleDscPacket((const uint8_t *)home, strlen(home),
+                                        mailbox, 0, &sender));
+  const char *busyAck = "DSC:{\"ack\":2,\"result\":\"busy\"}";
+  TEST_ASSERT_EQUAL_STRING_LEN(busyAck, (const char *)sender.reply,
+                               sender.replyLength);
+  TEST_ASSERT_EQUAL_INT(COMMAND_QUEUE_SIZE - 1, mailbox.drain(0));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(DSC_PACKET_COMMAND,
+                                handleDscPacket((const uint8_t *)home,
+                                                strlen(home), mailbox, 0,
+                                                &sender),
+                                "Resend after busy taken as duplicate");
+  const char *homeAck = "DSC:{\"ack\":2,\"result\":\"accepted\"}";
+  TEST_ASSERT_EQUAL_STRING_LEN(homeAck, (const char *)sender.reply,
+                               sender.replyLength);
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(0));
+  TEST_ASSERT_EQUAL_INT(4, window.getAccepted());
+}
+
+// Call an alpaca method at nowMicros, returning the body
+static std::string callAlpaca(AlpacaTelescope &telescope, const char *method,
+                              bool put, const AlpacaParameter *parameters,
+                              int count, unsigned long nowMicros,
+                              int &status) {
+  char body[ALPACA_RESPONSE_BYTES];
+  size_t length = telescope.handle(method, put, parameters, count, nowMicros,
+                                   body, sizeof(body), status);
+  return std::string(body, length);
+}
+
+static std::string getAlpaca(AlpacaTelescope &telescope, const char *method) {
+  int status;
+  std::string body = callAlpaca(telescope, method, false, nullptr, 0, 0,
+                                status);
+  TEST_ASSERT_EQUAL_INT(200, status);
+  return body;
+}
+
+static bool hasText(const std::string &body, const char *text) {
+  return body.find(text) != std::string::npos;
+}
+
+void test_alpaca_telescope() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(0);
+  CommandMailbox mailbox(ra, dec);
+  AlpacaTelescope telescope(raModel, ra, decModel, dec, mailbox);
+
+  // parameter names are case insensitive, and the client's id echoed
+  int status;
+  AlpacaParameter id[] = {{"clienttransactionid", "5"}};
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"Value\":true,\"ClientTransactionID\":5,\"ServerTransactionID\":1,"
+      "\"ErrorNumber\":0,\"ErrorMessage\":\"\"}",
+      callAlpaca(telescope, "canpulseguide", false, id, 1, 0, status)
+          .c_str());
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "interfaceversion"),
+                           "\"Value\":3,"));
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "canslew"), "false"));
+  TEST_ASSERT_TRUE_MESSAGE(
+      hasText(getAlpaca(telescope, "declination"), "\"ErrorNumber\":1024"),
+      "No coordinates, so not implemented");
+  callAlpaca(telescope, "warpdrive", false, nullptr, 0, 0, status);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(400, status, "Unknown method");
+  callAlpaca(telescope, "moveaxis", false, nullptr, 0, 0, status);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(400, status, "moveaxis is PUT only");
+
+  AlpacaParameter axis[] = {{"Axis", "0"}};
+  std::string rates =
+      callAlpaca(telescope, "axisrates", false, axis, 1, 0, status);
+  char expected[100];
+  snprintf(expected, sizeof(expected), "\"Maximum\":%.9g}",
+           raModel.getMaxAxisMoveRateDegreesSec());
+  TEST_ASSERT_TRUE_MESSAGE(hasText(rates, expected), rates.c_str());
+
+  // movement needs a connection, and bad values post nothing
+  char halfMax[20];
+  snprintf(halfMax, sizeof(halfMax), "%f",
+           decModel.getMaxAxisMoveRateDegreesSec() / 2);
+  AlpacaParameter move[] = {{"Axis", "1"}, {"Rate", halfMax}};
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "moveaxis", true, move, 2, 0, status),
+      "\"ErrorNumber\":1031"));
+  AlpacaParameter connect[] = {{"Connected", "True"}};
+  callAlpaca(telescope, "connected", true, connect, 1, 0, status);
+  TEST_ASSERT_TRUE(telescope.isConnected());
+  AlpacaParameter tooFast[] = {{"Axis", "0"}, {"Rate", "1000"}};
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "moveaxis", true, tooFast, 2, 0, status),
+      "\"ErrorNumber\":1025"));
+  char belowMin[20];
+  snprintf(belowMin, sizeof(belowMin), "%g",
+           -raModel.getMinAxisMoveRateDegreesSec() / 2);
+  AlpacaParameter tooSlow[] = {{"Axis", "0"}, {"Rate", belowMin}};
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "moveaxis", true, tooSlow, 2, 0, status),
+      "\"ErrorNumber\":1025"));
+  AlpacaParameter noRate[] = {{"Axis", "0"}};
+  callAlpaca(telescope, "moveaxis", true, noRate, 1, 0, status);
+  TEST_ASSERT_EQUAL_INT(400, status);
+  AlpacaParameter badDirection[] = {{"Direction", "4"}, {"Duration", "100"}};
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "pulseguide", true, badDirection, 2, 0, status),
+      "\"ErrorNumber\":1025"));
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(0));
+
+  // until the loop applies them, report what was asked for
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "moveaxis", true, move, 2, 0, status),
+      "\"ErrorNumber\":0,"));
+  AlpacaParameter track[] = {{"Tracking", "true"}};
+  callAlpaca(telescope, "tracking", true, track, 1, 0, status);
+  AlpacaParameter pulse[] = {{"Direction", "2"}, {"Duration", "300"}};
+  callAlpaca(telescope, "pulseguide", true, pulse, 2, 0, status);
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "slewing"), "true"));
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "tracking"), "true"));
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "ispulseguiding"), "true"));
+  TEST_ASSERT_FALSE(ra.isTrackingOn());
+  TEST_ASSERT_EQUAL_INT(3, mailbox.drain(0));
+  TEST_ASSERT_TRUE(ra.isTrackingOn());
+  TEST_ASSERT_TRUE(dec.isSlewing());
+
+  // abortslew stops both axes
+  TEST_ASSERT_TRUE(hasText(
+      callAlpaca(telescope, "abortslew", true, nullptr, 0, 0, status),
+      "\"ErrorNumber\":0,"));
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(0));
+  TEST_ASSERT_FALSE(dec.isSlewing());
+  TEST_ASSERT_TRUE(hasText(getAlpaca(telescope, "slewing"), "false"));
+
+  // management and discovery
+  char devices[ALPACA_RESPONSE_BYTES];
+  size_t length = telescope.getConfiguredDevices(nullptr, 0, "AB:CD", devices,
+                                                 sizeof(devices));
+  TEST_ASSERT_TRUE(hasText(std::string(devices, length),
+                           "\"DeviceType\":\"Telescope\",\"DeviceNumber\":0,"
+                           "\"UniqueID\":\"AB:CD\""));
+  const char *discovery = ALPACA_DISCOVERY_MESSAGE;
+  TEST_ASSERT_TRUE(
+      isAlpacaDiscovery((const uint8_t *)discovery, strlen(discovery)));
+  TEST_ASSERT_FALSE(isAlpacaDiscovery((const uint8_t *)discovery, 5));
+  char reply[32];
+  length = encodeAlpacaDiscoveryResponse(reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_STRING_LEN("{\"AlpacaPort\":80}", reply, length);
+}
+
+// Feed an LX200 stream a byte at a time, returning the replies
+static std::string feedLx200(Lx200Session &session, const char *stream) {
+  std::string replies;
+  for (const char *c = stream; *c != 0; c++) {
+    char reply[LX200_REPLY_BYTES];
+    size_t length =
+        session.feed((const uint8_t *)c, 1, 0, reply, sizeof(reply));
+    replies.append(reply, length);
+  }
+  return replies;
+}
+
+void test_lx200_session() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(decModel.getMiddlePosition());
+  CommandMailbox mailbox(ra, dec);
+  Lx200Session session(raModel, decModel, mailbox);
+
+  // queries on connect, split anywhere, without the heap
+  std::string replies = feedLx200(session, "\x06:GVP#:GR#");
+  unsigned long allocationsBefore = allocationCount;
+  char reply[LX200_REPLY_BYTES];
+  const char *stream = ":GD#junk:RG#:Te#:Mgn0250#:Mgw0100#";
+  size_t length = session.feed((const uint8_t *)stream, strlen(stream), 0,
+                               reply, sizeof(reply));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocationCount - allocationsBefore,
+                                "Parsing allocated");
+  replies.append(reply, length);
+  TEST_ASSERT_EQUAL_STRING("PFrankenDob#00:00:00#+00*00:00#1",
+                           replies.c_str());
+  TEST_ASSERT_EQUAL_INT(LX200_RATE_GUIDE, session.getRate());
+  // tracking, then the two pulses
+  TEST_ASSERT_EQUAL_INT(3, mailbox.drain(0));
+  TEST_ASSERT_TRUE(ra.isTrackingOn());
+  TEST_ASSERT_TRUE(dec.isPulseGuideInProgress());
+
+  // unknown, malformed and overlong commands are skipped
+  TEST_ASSERT_EQUAL_STRING("", feedLx200(session, ":Mgx0100#:Mgn12a4#:Mg#"
+                                                  ":CM#:Mgn00000000000000001#")
+                                   .c_str());
+  TEST_ASSERT_EQUAL_INT(5, session.getUnknown());
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(0));
+
+  // moves run at the selected rate until stopped
+  feedLx200(session, ":RS#:Ms#:Me");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1, mailbox.drain(0), "Last move unfinished");
+  TEST_ASSERT_TRUE(dec.isSlewing());
+  feedLx200(session, "#:Qs#");
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(0));
+  TEST_ASSERT_FALSE(dec.isSlewing());
+  TEST_ASSERT_TRUE(ra.isSlewing());
+
+  // a client that goes while moving stops what it started
+  session.disconnect(0);
+  TEST_ASSERT_EQUAL_INT(1, mailbox.drain(0));
+  TEST_ASSERT_FALSE(ra.isSlewing());
+  TEST_ASSERT_EQUAL_INT(LX200_RATE_CENTER, session.getRate());
+  session.disconnect(0);
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(0));
+  TEST_ASSERT_EQUAL_INT(12, session.getCommands());
+}
+
+void test_status_delta() {
+  StatusDelta status;
+  char json[STATUS_DELTA_JSON_BYTES];
+
+  // first encode has everything
+  status.begin();
+  status.set("raPosition", 12.5);
+  status.set("commandsDropped", 4294967295.0);
+  status.set("velocity", 0);
+  size_t length = status.encode(false, json, sizeof(json));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"raPosition\":12.5,\"commandsDropped\":4294967295,\"velocity\":0}",
+      json);
+  TEST_ASSERT_EQUAL_INT(strlen(json), length);
+  TEST_ASSERT_EQUAL_INT(3, status.getFieldCount());
+
+  // then only what changed
+  unsigned long allocationsBefore = allocationCount;
+  status.begin();
+  status.set("raPosition", 12.75);
+  status.set("commandsDropped", 4294967295.0);
+  status.set("velocity", 0);
+  length = status.encode(false, json, sizeof(json));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, allocationCount - allocationsBefore,
+                                "Encoding allocated");
+  TEST_ASSERT_EQUAL_STRING("{\"raPosition\":12.75}", json);
+
+  // nothing changed, nothing to send
+  status.begin();
+  status.set("raPosition", 12.75);
+  status.set("commandsDropped", 4294967295.0);
+  status.set("velocity", 0);
+  json[0] = 0;
+  TEST_ASSERT_EQUAL_INT(0, status.encode(false, json, sizeof(json)));
+  TEST_ASSERT_EQUAL_STRING("", json);
+
+  // a snapshot for a new browser has everything anyway
+  length = status.encode(true, json, sizeof(json));
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"raPosition\":12.75,\"commandsDropped\":4294967295,\"velocity\":0}",
+      json);
+
+  // too small: nothing, and the change is still pending
+  status.begin();
+  status.set("raPosition", 13);
+  status.set("commandsDropped", 4294967295.0);
+  status.set("velocity", NAN);
+  TEST_ASSERT_EQUAL_INT(0, status.encode(false, json, 10));
+  length = status.encode(false, json, sizeof(json));
+  TEST_ASSERT_EQUAL_STRING("{\"raPosition\":13,\"velocity\":null}", json);
+}
+
+void test_latency_histogram() {
+  LatencyHistogram h;
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, h.getPercentile(0.99),
+                                "Empty histogram has no percentiles");
+
+  TEST_ASSERT_EQUAL_INT(0, LatencyHistogram::bucketFor(0));
+  TEST_ASSERT_EQUAL_INT(1, LatencyHistogram::bucketFor(1));
+  TEST_ASSERT_EQUAL_INT(2, LatencyHistogram::bucketFor(3));
+  TEST_ASSERT_EQUAL_INT(3, LatencyHistogram::bucketFor(4));
+  TEST_ASSERT_EQUAL_INT(32, LatencyHistogram::bucketFor(UINT32_MAX));
+
+  // 98 fast loops, two slow ones
+  for (int i = 0; i < 98; i++)
+    h.record(1100 + i);
+  h.record(50000);
+  h.record(3000000);
+
+  TEST_ASSERT_EQUAL_INT(100, h.getCount());
+  TEST_ASSERT_EQUAL_INT(3000000, h.getMax());
+  TEST_ASSERT_EQUAL_INT_MESSAGE(98, h.getBucketCount(11),
+                                "1100-1197 fall in 1024-2047");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2047, h.getPercentile(0.5),
+                                "p50 is top of the fast bucket");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(65535, h.getPercentile(0.99),
+                                "p99 is top of the 50000 bucket");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(3000000, h.getPercentile(1),
+                                "p100 is capped at max");
+  TEST_ASSERT_EQUAL_INT(LatencyHistogram::bucketFor(3000000) + 1,
+                        h.getUsedBuckets());
+
+  LoopMetrics metrics;
+  {
+    MetricTimer timer(metrics, METRIC_MOTOR_UNIT);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  TEST_ASSERT_EQUAL_INT(1, metrics.get(METRIC_MOTOR_UNIT).getCount());
+  TEST_ASSERT_TRUE_MESSAGE(metrics.get(METRIC_MOTOR_UNIT).getMax() >= 2000000,
+                           "Timer should record nanoseconds");
+  metrics.reset();
+  TEST_ASSERT_EQUAL_INT(0, metrics.get(METRIC_MOTOR_UNIT).getCount());
+}
+
+void testCommandMailbox() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(0);
+
+  CommandMailbox mailbox(ra, dec);
+
+  // posting should not touch dynamic state until drained
+  mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::gotoStart(AXIS_RA), 1000);
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::gotoMiddle(AXIS_DEC), 1500);
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::track(true), 1500);
+  TEST_ASSERT_FALSE_MESSAGE(ra.isSlewing(), "Should not apply before drain");
+
+  TEST_ASSERT_EQUAL_INT_MESSAGE(3, mailbox.drain(2000),
+                                "Should apply all commands");
+  TEST_ASSERT_TRUE_MESSAGE(ra.isSlewing(), "RA should be going to start");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(raModel.getLimitSwitchSafetyStandoffPosition(),
+                                ra.getTargetPosition(),
+                                "RA should target limit standoff");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(decModel.getMiddlePosition(),
+                                dec.getTargetPosition(),
+                                "Dec should target middle");
+  TEST_ASSERT_TRUE_MESSAGE(ra.isTrackingOn(), "Tracking should be on");
+
+  TEST_ASSERT_EQUAL_INT_MESSAGE(1000, mailbox.getMaxLatencyMicros(),
+                                "Max latency should be oldest command");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(666, mailbox.getAverageLatencyMicros(),
+                                "Average latency");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, mailbox.drain(3000),
+                                "Nothing left to apply");
+
+  // tracking mode is loop state too
+  mailbox.post(COMMAND_SOURCE_WEB,
+               MotorCommand::trackingMode(TRACKING_MODE_SCHEDULE), 3000);
+  TEST_ASSERT_EQUAL_INT(TRACKING_MODE_CONTINUOUS, ra.getTrackingMode());
+  mailbox.drain(3000);
+  TEST_ASSERT_EQUAL_INT(TRACKING_MODE_SCHEDULE, ra.getTrackingMode());
+
+  // pulseguide goes to axis by direction
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::pulseGuide(0, 500), 3000);
+  mailbox.drain(3000);
+  dec.onLoop();
+  try {
+    Verify(decStepper.setStepperSpeed).Times(1);
+    Verify(raStepper.setStepperSpeed).Times(0);
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+
+  // full queue drops rather than blocks
+  for (int i = 0; i < COMMAND_QUEUE_SIZE + 2; i++) {
+    mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::slewByDegrees(AXIS_RA, 0),
+                 0);
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, mailbox.getCommandsDropped(),
+                                "Overflow should be counted");
+}
+
+void testCommandCoalescing() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(decModel.getMiddlePosition());
+
+  CommandMailbox mailbox(ra, dec);
+
+  // a nunchuk stream: only the last of each axis gets applied, and never
+  // fills the queue
+  for (int i = 0; i < COMMAND_QUEUE_SIZE * 4; i++) {
+    mailbox.post(COMMAND_SOURCE_UDP,
+                 MotorCommand::moveAxis(AXIS_DEC, -0.01 * (i + 1)), i);
+  }
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::moveAxis(AXIS_DEC, 0.5),
+               100);
+  mailbox.post(COMMAND_SOURCE_WEB, MotorCommand::moveAxis(AXIS_RA, 0), 100);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(COMMAND_QUEUE_SIZE * 4,
+                                mailbox.getCommandsCoalesced(),
+                                "Overwritten rates counted");
+  TEST_ASSERT_EQUAL_INT(0, mailbox.getCommandsDropped());
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, mailbox.drain(200),
+                                "One rate per axis per drain");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(INT32_MAX, dec.getTargetPosition(),
+                                "Last rate wins");
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(300));
+
+  // rates keep their order with the same source's queued commands
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::moveAxis(AXIS_DEC, 0.5),
+               400);
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::gotoMiddle(AXIS_DEC), 400);
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(500));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(decModel.getMiddlePosition(),
+                                dec.getTargetPosition(),
+                                "Goto after rate should win");
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::gotoMiddle(AXIS_DEC), 600);
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::moveAxis(AXIS_DEC, 0.5),
+               600);
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(700));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(INT32_MAX, dec.getTargetPosition(),
+                                "Rate after goto should win");
+
+  // a rate and a command, posted from another task while loop drains:
+  // however the posts land against the drain, they apply in order
+  const int rounds = 40000;
+  std::atomic<int> posted(0);
+  std::atomic<int> checked(0);
+  std::thread poster([&]() {
+    for (int round = 1; round <= rounds; round++) {
+      if (round & 1)
+        mailbox.post(COMMAND_SOURCE_UDP,
+                     MotorCommand::moveAxis(AXIS_DEC, 0.5), 800);
+      mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::gotoMiddle(AXIS_DEC),
+                   800);
+      if (!(round & 1))
+        mailbox.post(COMMAND_SOURCE_UDP,
+                     MotorCommand::moveAxis(AXIS_DEC, 0.5), 800);
+      posted = round;
+      while (checked < round)
+        std::this_thread::yield();
+    }
+  });
+  int reordered = 0;
+  for (int round = 1; round <= rounds; round++) {
+    while (posted < round)
+      mailbox.drain(900);
+    mailbox.drain(900);
+    int32_t last = round & 1 ? decModel.getMiddlePosition() : INT32_MAX;
+    if (dec.getTargetPosition() != last)
+      reordered++;
+    checked = round;
+  }
+  poster.join();
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, reordered,
+                                "Rate applied after a later command");
+
+  // producer and consumer on their own threads: values only move forward
+  // and the last one always arrives
+  LatestValue<uint32_t> latest;
+  const uint32_t count = 200000;
+  std::thread producer([&]() {
+    for (uint32_t i = 1; i <= count; i++)
+      latest.write(i);
+  });
+  uint32_t last = 0;
+  uint32_t backwards = 0;
+  uint32_t taken = 0;
+  while (last < count) {
+    uint32_t value;
+    if (latest.take(value)) {
+      if (value <= last)
+        backwards++;
+      last = value;
+      taken++;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  producer.join();
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, backwards, "Values in order");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(count, taken + latest.getOverwritten(),
+                                "Every write taken or overwritten");
+  uint32_t value;
+  TEST_ASSERT_FALSE_MESSAGE(latest.take(value), "Nothing new to take");
+}
+
+void testTimedPulseGuide() {
+  MockStepper stepper;
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+  model.setRewindFastFowardSpeedInHz(30000);
+  model.setGuideRateMultiplier(.9);
+
+  SimulatedTimerService timers;
+  timers.setDispatchLatencyMicros(40);
+
+  RADynamic control(model);
+  control.setStepperWrapper(&stepper);
+  control.setTimerService(&timers);
+
+  control.setTrackingOnOff(true);
+  When(stepper.getPosition).Return(model.getMiddlePosition());
+  When(stepper.getStepperSpeed).Return(117606);
+  control.onLoop();
+
+  try {
+    Verify(stepper.moveTo).Times(1);
+
+    // a pulse due now starts straight away, without waiting for a timer
+    control.pulseGuide(3, 300); // west for 300ms
+    Verify(stepper.setStepperSpeed).Times(1);
+    Verify(stepper.moveTo).Times(2);
+    TEST_ASSERT_TRUE_MESSAGE(control.getTargetSpeedInMilliHz() > 117606,
+                             "West pulse should speed up");
+
+    // loop should leave pulse alone
+    control.onLoop();
+    Verify(stepper.moveTo).Times(2);
+
+    // the stop timer wakes the loop, which stops the pulse. The timer
+    // itself never touches the stepper.
+    uint64_t wakeAt = timers.nowMicros() + 299000;
+    TEST_ASSERT_FALSE(timers.sleepUntilTimer(wakeAt));
+    TEST_ASSERT_TRUE(timers.sleepUntilTimer(wakeAt + 25000));
+    Verify(stepper.setStepperSpeed).Times(1);
+    control.applyPulseTimers();
+    Verify(stepper.setStepperSpeed).Times(2);
+    Verify(stepper.setStepperSpeed).With(117606).Times(1);
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        0, control.getPulseStartErrorStats().getLast(),
+        "Immediate start should be exact");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(40, control.getPulseStopErrorStats().getMax(),
+                                  "Stop error should be dispatch latency");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, control.getPulseStopErrorStats().getCount(),
+                                  "One pulse timed");
+
+    // next loop resumes tracking
+    control.onLoop();
+    Verify(stepper.moveTo).Times(3);
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+}
+
+/**
+ * A pulse timed by a synced DSC should start at the instant it asked for,
+ * not when the packet or the next loop happened to arrive.
+ */
+void testTimedCommands() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  raModel.setGuideRateMultiplier(.9);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+
+  SimulatedTimerService timers;
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  ra.setTimerService(&timers);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(raStepper.getStepperSpeed).Return(117606);
+  When(decStepper.getPosition).Return(0);
+  ra.setTrackingOnOff(true);
+  ra.onLoop();
+  CommandMailbox mailbox(ra, dec);
+
+  // sync a DSC whose clock is 2s behind, with 500us each way
+  const uint64_t dscBehind = 2000000;
+  timers.advanceMicros(dscBehind + 10000);
+  ClockSync sync;
+  DscSender sender = {0x0100A8C0, 50376, &sync, nullptr, {}, 0};
+  TimeRequest request = {timers.nowMicros() - dscBehind - 500, 0, 0};
+  TimeResponse response;
+  sync.handleRequest(sender.address, sender.port, request,
+                     timers.nowMicros(), response);
+  request.previousSendMicros = request.sendMicros;
+  request.previousReceiveMicros = timers.nowMicros() - dscBehind + 500;
+  request.sendMicros = request.previousReceiveMicros;
+  sync.handleRequest(sender.address, sender.port, request,
+                     timers.nowMicros(), response);
+
+  // west pulse for 300ms, 200ms from now in the DSC's clock
+  uint64_t startAt = timers.nowMicros() + 200000;
+  PlatformCommand pulse;
+  pulse.code = PLATFORM_COMMAND_PULSE_GUIDE;
+  pulse.parameter1 = 3;
+  pulse.parameter2 = 300;
+  pulse.executeAtMicros = startAt - dscBehind;
+  pulse.sequence = 0;
+  pulse.session = 0;
+  uint8_t packet[PROTOCOL_MAX_MESSAGE_BYTES];
+  size_t length = encodeCommand(pulse, packet, sizeof(packet));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_COMMAND,
+                        handleDscPacket(packet, length, mailbox,
+                                        timers.nowMicros(), &sender));
+
+  try {
+    // held by the mailbox, then handed to the pulse timer ahead of time
+    TEST_ASSERT_EQUAL_INT(0, mailbox.drain(timers.nowMicros()));
+    TEST_ASSERT_EQUAL_INT(1, mailbox.getCommandsScheduled());
+    timers.advanceMicros(100000);
+    TEST_ASSERT_EQUAL_INT(0, mailbox.drain(timers.nowMicros()));
+    timers.advanceMicros(70000);
+    TEST_ASSERT_EQUAL_INT(1, mailbox.drain(timers.nowMicros()));
+    TEST_ASSERT_TRUE(ra.isPulseGuideInProgress());
+    Verify(raStepper.setStepperSpeed).Times(0);
+    uint32_t pulseSpeed = ra.getTargetSpeedInMilliHz();
+    TEST_ASSERT_TRUE_MESSAGE(pulseSpeed > 117606, "West pulse speeds up");
+
+    // loop retargeting tracking meanwhile doesn't change the pulse
+    ra.onLoop();
+    timers.advanceMicros(29999);
+    ra.applyPulseTimers();
+    Verify(raStepper.setStepperSpeed).Times(0);
+    timers.advanceMicros(1);
+    ra.applyPulseTimers();
+    Verify(raStepper.setStepperSpeed).With(pulseSpeed).Times(1);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        0, ra.getPulseStartErrorStats().getLast(),
+        "Started at the requested instant");
+    timers.advanceMicros(300000);
+    ra.applyPulseTimers();
+    Verify(raStepper.setStepperSpeed).With(117606).Times(1);
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+
+  // other commands apply on the first drain at or after their time
+  unsigned long now = timers.nowMicros();
+  MotorCommand middle = MotorCommand::gotoMiddle(AXIS_DEC);
+  middle.executeAtMicros = now + 30000;
+  mailbox.post(COMMAND_SOURCE_WEB, middle, now);
+  TEST_ASSERT_EQUAL_INT(0, mailbox.drain(now + 29999));
+  TEST_ASSERT_FALSE(dec.getTargetPosition() == decModel.getMiddlePosition());
+  TEST_ASSERT_EQUAL_INT(1, mailbox.drain(now + 30000));
+  TEST_ASSERT_EQUAL_INT(decModel.getMiddlePosition(),
+                        dec.getTargetPosition());
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, mailbox.getLastLatencyMicros(),
+                                "Latency counted from the time asked for");
+
+  // too far ahead or in the past: run on arrival
+  MotorCommand track = MotorCommand::track(false);
+  track.executeAtMicros = now + COMMAND_MAX_SCHEDULE_MICROS + 1;
+  mailbox.post(COMMAND_SOURCE_WEB, track, now);
+  track.executeAtMicros = now - 1;
+  mailbox.post(COMMAND_SOURCE_WEB, track, now);
+  // from an unsynced DSC: not run at all, and acked so it syncs first
+  sender.port++;
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(packet, length, mailbox, now, &sender));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, sender.replyLength, "Unsequenced, no ack");
+  pulse.sequence = 5;
+  length = encodeCommand(pulse, packet, sizeof(packet));
+  TEST_ASSERT_EQUAL_INT(DSC_PACKET_REJECTED,
+                        handleDscPacket(packet, length, mailbox, now, &sender));
+  uint32_t ackSequence;
+  AckResult ackResult;
+  TEST_ASSERT_TRUE(
+      decodeAck(sender.reply, sender.replyLength, ackSequence, ackResult));
+  TEST_ASSERT_EQUAL_INT(5, ackSequence);
+  TEST_ASSERT_EQUAL_INT(ACK_UNSYNCED, ackResult);
+  TEST_ASSERT_EQUAL_INT(2, mailbox.drain(now));
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, mailbox.getCommandsScheduled(),
+                                "Only the pulse and goto were held");
+}
+
+void testOverlappingPulseGuides() {
+  MockStepper raStepper;
+  MockStepper decStepper;
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  raModel.setGuideRateMultiplier(.9);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(605);
+  decModel.setLimitSwitchToMiddleDistance(32);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  decModel.setGuideRateMultiplier(.9);
+
+  SimulatedTimerService timers;
+  RADynamic ra(raModel);
+  ra.setStepperWrapper(&raStepper);
+  ra.setTimerService(&timers);
+  DecDynamic dec(decModel);
+  dec.setStepperWrapper(&decStepper);
+  dec.setTimerService(&timers);
+
+  When(raStepper.getPosition).Return(raModel.getMiddlePosition());
+  When(decStepper.getPosition).Return(decModel.getMiddlePosition());
+  ra.setTrackingOnOff(true);
+
+  // run both loops every 25ms of simulated time, waking for pulse timers
+  // in between, like the main loop
+  auto runLoopFor = [&](int millis) {
+    for (int t = 0; t < millis; t += 25) {
+      ra.onLoop();
+      dec.onLoop();
+      uint64_t wakeAt = timers.nowMicros() + 25000;
+      while (timers.sleepUntilTimer(wakeAt)) {
+        ra.applyPulseTimers();
+        dec.applyPulseTimers();
+      }
+    }
+  };
+
+  try {
+    // RA west for 300ms, then Dec north for 250ms 100ms later
+    ra.pulseGuide(3, 300);
+    runLoopFor(100);
+    TEST_ASSERT_TRUE_MESSAGE(ra.isPulseGuideInProgress(), "RA pulsing");
+    dec.pulseGuide(0, 250);
+    runLoopFor(100);
+    TEST_ASSERT_TRUE_MESSAGE(ra.isPulseGuideInProgress(),
+                             "RA still pulsing with dec");
+    TEST_ASSERT_TRUE_MESSAGE(dec.isPulseGuideInProgress(), "Dec pulsing");
+
+    runLoopFor(100);
+    TEST_ASSERT_FALSE_MESSAGE(ra.isPulseGuideInProgress(),
+                              "RA should stop at 300ms");
+    TEST_ASSERT_TRUE_MESSAGE(dec.isPulseGuideInProgress(),
+                             "Dec should run its own 250ms");
+    runLoopFor(100);
+    TEST_ASSERT_FALSE_MESSAGE(dec.isPulseGuideInProgress(),
+                              "Dec should stop 250ms from its start");
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, ra.getPulseStopErrorStats().getMax(),
+                                  "RA stop should be exact");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, dec.getPulseStopErrorStats().getMax(),
+                                  "Dec stop should be exact");
+
+    // limit switch is still handled during a pulse, and ends it
+    dec.pulseGuide(1, 1000);
+    runLoopFor(50);
+    TEST_ASSERT_TRUE_MESSAGE(dec.isPulseGuideInProgress(), "Dec pulsing");
+    dec.setLimitJustHit();
+    runLoopFor(25);
+    TEST_ASSERT_FALSE_MESSAGE(dec.isPulseGuideInProgress(),
+                              "Limit should cancel pulse");
+    Verify(decStepper.moveTo)
+        .With(0, decModel.getRewindFastFowardSpeedInMilliHz() / SAFETY_RATIO)
+        .Times(1);
+    // stop timer should not fire into the limit move
+    runLoopFor(1000);
+    TEST_ASSERT_EQUAL_INT_MESSAGE(1, dec.getPulseStopErrorStats().getCount(),
+                                  "Cancelled pulse should not be timed");
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+}
+
 void testDecPulseGuide() {
   // setup
   MockStepper stepper;
@@ -626,7 +2906,7 @@ void testDecPulseGuide() {
   model.setRewindFastFowardSpeedInHz(30000);
   model.setGuideRateMultiplier(.9);
 
-  DecDynamic control = DecDynamic(model);
+  DecDynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test pulseguide
@@ -703,7 +2983,7 @@ void testRAPulseGuide() {
   model.setRewindFastFowardSpeedInHz(30000);
   model.setGuideRateMultiplier(.9);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test pulseguide
@@ -784,7 +3064,7 @@ void testMoveAxisPositive() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test moveaxis
@@ -875,7 +3155,7 @@ void testGotoStartSafety() {
   model.setLimitSwitchToMiddleDistance(limitToMiddle);
   model.setRewindFastFowardSpeedInHz(30000);
 
-  RADynamic control = RADynamic(model);
+  RADynamic control(model);
   control.setStepperWrapper(&stepper);
 
   // test going to start
@@ -899,10 +3179,572 @@ void testGotoStartSafety() {
   }
 }
 
+void testSimulatedStepperRamps() {
+  SimulatedTimerService timers;
+  SimulatedStepper stepper(timers);
+  stepper.setAcceleration(20000);
+
+  // 30kHz at 20000 steps/s/s: 1.5s and 22500 steps to reach full speed
+  stepper.moveTo(100000, 30000000);
+  int32_t furthest = 0;
+  double peakSpeed = 0;
+  long arrivalMillis = -1;
+  for (long ms = 1; ms <= 6000; ms++) {
+    timers.advanceMicros(1000);
+    int32_t pos = stepper.getPosition();
+    if (pos > furthest)
+      furthest = pos;
+    double speed = stepper.getCurrentSpeedInStepsPerSecond();
+    if (speed > peakSpeed)
+      peakSpeed = speed;
+    if (arrivalMillis < 0 && !stepper.isRunning())
+      arrivalMillis = ms;
+  }
+  TEST_ASSERT_EQUAL_INT_MESSAGE(100000, furthest, "Should not overshoot");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(100000, stepper.getPosition(),
+                                "Should land on target");
+  TEST_ASSERT_EQUAL_FLOAT_MESSAGE(30000, peakSpeed, "Should reach full speed");
+  // ramp up, 55000 steps at full speed, ramp down
+  TEST_ASSERT_EQUAL_INT_MESSAGE(4834, arrivalMillis,
+                                "Should arrive after 4.833 seconds");
+
+  // stop from full speed takes the ramp distance
+  stepper.moveTo(1000000, 30000000);
+  timers.advanceMicros(3000000);
+  int32_t stopFrom = stepper.getPosition();
+  stepper.stop();
+  timers.advanceMicros(3000000);
+  TEST_ASSERT_FALSE_MESSAGE(stepper.isRunning(), "Should have stopped");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(22500, stepper.getPosition() - stopFrom,
+                                "Should take 22500 steps to stop");
+
+  // new target behind us: slow down, then come back
+  stepper.moveTo(1000000, 30000000);
+  timers.advanceMicros(3000000);
+  int32_t turnFrom = stepper.getPosition();
+  stepper.moveTo(turnFrom - 10000, 30000000);
+  timers.advanceMicros(100000);
+  TEST_ASSERT_TRUE_MESSAGE(stepper.getPosition() > turnFrom,
+                           "Should still be slowing down");
+  timers.advanceMicros(5000000);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(turnFrom - 10000, stepper.getPosition(),
+                                "Should come back to target");
+
+  // force stop is immediate
+  stepper.moveTo(0, 30000000);
+  timers.advanceMicros(1000000);
+  stepper.resetPosition(5000);
+  timers.advanceMicros(1000000);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(5000, stepper.getPosition(),
+                                "Reset should stop dead");
+}
+
+/**
+ * The stream queue holds what FastAccelStepper's does: at sidereal each
+ * step takes 3 of its 32 entries, so only 10 steps (85ms) fit.
+ */
+void testSimulatedStepQueueDepth() {
+  SimulatedTimerService timers;
+  SimulatedStepper stepper(timers);
+  stepper.setPhysicalPosition(10000);
+
+  TEST_ASSERT_EQUAL_INT_MESSAGE(10, stepper.queueSteps(1000, 117606, false),
+                                "Sidereal steps take 3 entries each");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(0, stepper.queueSteps(1000, 117606, false),
+                                "Queue full");
+  TEST_ASSERT_EQUAL_INT(9990, stepper.getQueueEndPosition());
+
+  // a step runs every 8.5ms, each freeing 3 entries
+  timers.advanceMicros(17100);
+  TEST_ASSERT_EQUAL_INT(9998, stepper.getPosition());
+  TEST_ASSERT_EQUAL_INT_MESSAGE(2, stepper.queueSteps(1000, 117606, false),
+                                "Room for the steps that ran");
+
+  // runs dry 85ms after the last top up
+  timers.advanceMicros(80000);
+  TEST_ASSERT_TRUE(stepper.isRunning());
+  timers.advanceMicros(10000);
+  TEST_ASSERT_FALSE_MESSAGE(stepper.isRunning(), "Queue should run dry");
+  TEST_ASSERT_EQUAL_INT(9988, stepper.getPosition());
+
+  // under 4ms a step, one entry holds up to 255 steps
+  TEST_ASSERT_EQUAL_INT(32 * 255, stepper.queueSteps(10000, 2000000, true));
+}
+
+void testGotoStartTrajectory() {
+  RAStatic model;
+  model.setScrewToPivotInMM(448);
+  model.setLimitSwitchToMiddleDistance(62);
+  model.setRewindFastFowardSpeedInHz(30000);
+
+  SimulatedTimerService timers;
+  SimulatedStepper stepper(timers);
+  stepper.setAcceleration(20000);
+  stepper.setPhysicalPosition(model.getMiddlePosition());
+
+  RADynamic control(model);
+  control.setStepperWrapper(&stepper);
+
+  int32_t limit = model.getLimitPosition();
+  control.gotoStart();
+  bool switchOn = false;
+  long limitHitMillis = -1;
+  int32_t furthest = 0;
+  // loop runs dynamics every 250ms, as MotorUnit does
+  for (long ms = 0; ms < 20000; ms += 250) {
+    bool on = stepper.getPhysicalPosition() > limit;
+    if (on && !switchOn)
+      control.setLimitJustHit();
+    if (!on && switchOn)
+      control.setLimitJustReleased();
+    switchOn = on;
+    control.onLoop();
+    for (int i = 0; i < 250; i++) {
+      timers.advanceMicros(1000);
+      int32_t pos = stepper.getPhysicalPosition();
+      if (pos > furthest)
+        furthest = pos;
+      if (limitHitMillis < 0 && pos > limit)
+        limitHitMillis = ms + i + 1;
+    }
+  }
+
+  // full speed to standoff (8.7s with ramps), the next loop notices, then
+  // half speed for the last 2mm (0.855s)
+  log("Goto start: limit reached after %ld ms, overshoot %d steps",
+      limitHitMillis, furthest - limit);
+  TEST_ASSERT_INT_WITHIN_MESSAGE(5, 9605, limitHitMillis,
+                                 "Time to reach limit");
+  // a loop of travel at half speed, plus stopping distance at half speed
+  TEST_ASSERT_TRUE_MESSAGE(furthest - limit <= 3750 + 5625,
+                           "Overshoot past limit");
+  TEST_ASSERT_FALSE_MESSAGE(stepper.isRunning(), "Should stop after limit");
+  TEST_ASSERT_EQUAL_INT_MESSAGE(limit, stepper.getPosition(),
+                                "Position should reset to limit");
+}
+
+void testTrackingErrorByMode() {
+  TrackingMode modes[] = {TRACKING_MODE_CONTINUOUS, TRACKING_MODE_SCHEDULE,
+                          TRACKING_MODE_STREAM};
+  const char *names[] = {"continuous", "schedule", "stream"};
+  for (int m = 0; m < 3; m++) {
+    RAStatic model;
+    model.setScrewToPivotInMM(448);
+    model.setLimitSwitchToMiddleDistance(62);
+    model.setRewindFastFowardSpeedInHz(30000);
+
+    SimulatedTimerService timers;
+    SimulatedStepper stepper(timers);
+    stepper.setAcceleration(20000);
+    stepper.setPhysicalPosition(model.getLimitPosition() - 3600);
+
+    RADynamic control(model);
+    control.setStepperWrapper(&stepper);
+    control.setTrackingMode(modes[m]);
+    control.setTrackingOnOff(true);
+
+    // first loop starts tracking
+    control.onLoop();
+    double start =
+        model.calculateTimeToCenterInSeconds(stepper.getPosition()) * 15;
+    double worst = 0;
+    // 20 minutes, loop every 25ms, recalc every 250ms
+    for (long loop = 1; loop <= 48000; loop++) {
+      timers.advanceMicros(25000);
+      control.fillStepQueue();
+      if (loop % 10 == 0)
+        control.onLoop();
+      if (loop % 40 == 0) {
+        double tracked =
+            start -
+            model.calculateTimeToCenterInSeconds(stepper.getPosition()) * 15;
+        double sky = loop * 0.025 * model.getTrackingRateArcsSecondsSec();
+        double error = fabs(tracked - sky);
+        if (error > worst)
+          worst = error;
+      }
+    }
+    log("Tracking error over 20 minutes, %s: %.2f arc seconds", names[m],
+        worst);
+    TEST_ASSERT_TRUE_MESSAGE(worst < 2, "Tracking within 2 arc seconds");
+  }
+}
+
+/**
+ * A loop stall longer than the stream queue lets it run dry. Streaming
+ * should pick up again and make up the missed steps; following the
+ * schedule, the stepper keeps going by itself.
+ */
+void testStreamUnderrunRecovery() {
+  TrackingMode modes[] = {TRACKING_MODE_STREAM, TRACKING_MODE_SCHEDULE};
+  for (TrackingMode mode : modes) {
+    RAStatic model;
+    model.setScrewToPivotInMM(448);
+    model.setLimitSwitchToMiddleDistance(62);
+    model.setRewindFastFowardSpeedInHz(30000);
+
+    SimulatedTimerService timers;
+    SimulatedStepper stepper(timers);
+    stepper.setAcceleration(20000);
+    stepper.setPhysicalPosition(model.getLimitPosition() - 3600);
+
+    RADynamic control(model);
+    control.setStepperWrapper(&stepper);
+    control.setTimerService(&timers);
+    control.setTrackingMode(mode);
+    control.setTrackingOnOff(true);
+    control.onLoop();
+
+    double start =
+        model.calculateTimeToCenterInSeconds(stepper.getPosition()) * 15;
+    auto trackingError = [&]() {
+      double tracked =
+          start -
+          model.calculateTimeToCenterInSeconds(stepper.getPosition()) * 15;
+      double sky = timers.nowMicros() / 1000000.0 *
+                   model.getTrackingRateArcsSecondsSec();
+      return tracked - sky;
+    };
+    long loop = 0;
+    auto runFor = [&](double seconds) {
+      for (long i = 0; i < seconds * 40; i++) {
+        timers.advanceMicros(25000);
+        control.fillStepQueue();
+        if (++loop % 10 == 0)
+          control.onLoop();
+      }
+    };
+
+    runFor(10);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, trackingError());
+    // a 300ms stall, eg flash write
+    timers.advanceMicros(300000);
+    if (mode == TRACKING_MODE_STREAM) {
+      TEST_ASSERT_FALSE_MESSAGE(stepper.isRunning(), "Stream ran dry");
+      TEST_ASSERT_TRUE_MESSAGE(trackingError() < -3,
+                               "Stall leaves tracking behind");
+      runFor(0.025);
+      TEST_ASSERT_EQUAL_INT(1, stepper.getStreamUnderruns());
+      TEST_ASSERT_TRUE_MESSAGE(
+          stepper.getQueueEndPosition() < stepper.getPosition(),
+          "Stream restarted");
+    } else {
+      TEST_ASSERT_TRUE_MESSAGE(stepper.isRunning(), "Schedule rides it out");
+    }
+    // catch up at twice tracking speed takes as long as the stall
+    runFor(1);
+    TEST_ASSERT_FLOAT_WITHIN_MESSAGE(1, 0, trackingError(),
+                                     "Should catch up after stall");
+    runFor(10);
+    TEST_ASSERT_FLOAT_WITHIN(1, 0, trackingError());
+    TEST_ASSERT_EQUAL_INT_MESSAGE(mode == TRACKING_MODE_STREAM ? 1 : 0,
+                                  stepper.getStreamUnderruns(),
+                                  "Only the stall should underrun");
+  }
+}
+
+/**
+ * MotorUnit against simulated steppers, buttons and clock: a night of
+ * tracking runs, rewinds and guide pulses, run faster than real time.
+ */
+int countMotionEvents(const std::vector<MotionEvent> &events, int axis,
+                      MotionEventType type) {
+  int n = 0;
+  for (const MotionEvent &e : events)
+    if (e.axis == axis && e.type == type)
+      n++;
+  return n;
+}
+
+std::vector<MotionEvent> downloadMotionTrace(MotionTrace &trace,
+                                             size_t chunk) {
+  MotionTraceReader reader(trace);
+  std::vector<uint8_t> data(reader.getSize());
+  size_t offset = 0;
+  while (size_t n = reader.read(data.data() + offset, chunk, offset))
+    offset += n;
+  TEST_ASSERT_EQUAL_INT_MESSAGE(data.size(), offset, "Whole trace read");
+  std::vector<MotionEvent> events;
+  TEST_ASSERT_TRUE_MESSAGE(decodeMotionTrace(data.data(), data.size(), events),
+                           "Download should decode");
+  return events;
+}
+
+void testMotionTrace() {
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(448);
+  decModel.setLimitSwitchToMiddleDistance(62);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+
+  SimulatedTimerService timers;
+  SimulatedStepper raStepper(timers);
+  SimulatedStepper decStepper(timers);
+  SimulatedInputSource inputs;
+  RADynamic raDynamic(raModel);
+  DecDynamic decDynamic(decModel);
+  raDynamic.setStepperWrapper(&raStepper);
+  raDynamic.setTimerService(&timers);
+  decDynamic.setStepperWrapper(&decStepper);
+  decDynamic.setTimerService(&timers);
+  CommandMailbox mailbox(raDynamic, decDynamic);
+  LoopMetrics metrics;
+  MotorUnit motorUnit(raModel, raDynamic, decModel, decDynamic, mailbox,
+                      metrics);
+  motorUnit.setup(&raStepper, &decStepper, &inputs, &timers);
+  motorUnit.setAcceleration(20000);
+  raStepper.setPhysicalPosition(raModel.getMiddlePosition());
+  decStepper.setPhysicalPosition(decModel.getMiddlePosition());
+
+  MotionTrace trace;
+  trace.setClock(&timers);
+  motorUnit.setMotionTrace(&trace);
+
+  // start just before the 32 bit microsecond clock wraps
+  timers.advanceMicros(0x100000000ull - 2000000);
+  auto runFor = [&](double seconds) {
+    for (long i = 0; i < seconds * 40; i++) {
+      timers.advanceMicros(25000);
+      motorUnit.onLoop();
+    }
+  };
+
+  // fast forward for a couple of seconds, then guide
+  inputs.press(BUTTON_FAST_FORWARD);
+  runFor(2);
+  inputs.release(BUTTON_FAST_FORWARD);
+  runFor(5);
+  inputs.press(BUTTON_PLAY);
+  runFor(1);
+  mailbox.post(COMMAND_SOURCE_UDP, MotorCommand::pulseGuide(3, 300),
+               timers.nowMicros());
+  runFor(1);
+
+  // odd chunk sizes split records across reads
+  std::vector<MotionEvent> events = downloadMotionTrace(trace, 7);
+  TEST_ASSERT_EQUAL_INT(trace.getRecorded(), events.size());
+  TEST_ASSERT_EQUAL_INT(2, countMotionEvents(events, MOTION_TRACE_NO_AXIS,
+                                             MOTION_EVENT_BUTTON_PUSHED));
+  TEST_ASSERT_EQUAL_INT(1, countMotionEvents(events, MOTION_TRACE_NO_AXIS,
+                                             MOTION_EVENT_BUTTON_RELEASED));
+  TEST_ASSERT_EQUAL_INT(1, countMotionEvents(events, AXIS_RA,
+                                             MOTION_EVENT_GOTO));
+  TEST_ASSERT_EQUAL_INT(1, countMotionEvents(events, AXIS_DEC,
+                                             MOTION_EVENT_GOTO));
+  TEST_ASSERT_EQUAL_INT(1, countMotionEvents(events, AXIS_RA,
+                                             MOTION_EVENT_PULSE_START));
+  TEST_ASSERT_EQUAL_INT(1, countMotionEvents(events, AXIS_RA,
+                                             MOTION_EVENT_PULSE_END));
+
+  std::vector<uint64_t> times = unwrapMotionTraceTimes(events);
+  for (size_t i = 0; i < events.size(); i++) {
+    const MotionEvent &e = events[i];
+    TEST_ASSERT_EQUAL_INT_MESSAGE(i, e.sequence, "Events in order");
+    if (i > 0)
+      TEST_ASSERT_TRUE_MESSAGE(times[i] >= times[i - 1],
+                               "Time unwrapped across the 32 bit wrap");
+    if (e.type == MOTION_EVENT_PULSE_START) {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(300, e.target, "Pulse duration");
+      TEST_ASSERT_TRUE_MESSAGE(e.speedInMilliHz > 0, "Pulse speed");
+    }
+    if (e.type == MOTION_EVENT_PULSE_END)
+      TEST_ASSERT_INT_WITHIN_MESSAGE(1000, 300000,
+                                     times[i] - times[i - 1],
+                                     "Pulse ended after its duration");
+  }
+  TEST_ASSERT_TRUE_MESSAGE(times.back() > 2000000, "Ran past the wrap");
+
+  std::string csv = motionTraceToCsv(events);
+  TEST_ASSERT_TRUE_MESSAGE(csv.find("timeMicros,sequence,axis,event") == 0,
+                           "CSV header");
+  TEST_ASSERT_TRUE_MESSAGE(csv.find(",RA,pulseStart,") != std::string::npos,
+                           "CSV names events");
+  std::string json = motionTraceToChromeJson(events);
+  TEST_ASSERT_TRUE_MESSAGE(json.find("\"ph\":\"B\"") != std::string::npos &&
+                               json.find("\"ph\":\"E\"") !=
+                                   std::string::npos,
+                           "Pulse shown as a span");
+
+  // a full ring keeps the newest events
+  for (int i = 0; i < MOTION_TRACE_EVENTS + 10; i++)
+    trace.record(AXIS_DEC, MOTION_EVENT_STOP, i, 0, 0);
+  events = downloadMotionTrace(trace, 1460);
+  TEST_ASSERT_EQUAL_INT(MOTION_TRACE_EVENTS, events.size());
+  TEST_ASSERT_EQUAL_INT(10, events.front().position);
+  TEST_ASSERT_EQUAL_INT(MOTION_TRACE_EVENTS + 9, events.back().position);
+
+  // a record overwritten mid download comes out as lost
+  MotionTraceReader reader(trace);
+  trace.record(AXIS_DEC, MOTION_EVENT_STOP, -1, 0, 0);
+  std::vector<uint8_t> data(reader.getSize());
+  reader.read(data.data(), data.size(), 0);
+  decodeMotionTrace(data.data(), data.size(), events);
+  TEST_ASSERT_EQUAL_INT(MOTION_EVENT_LOST, events[0].type);
+  TEST_ASSERT_EQUAL_INT(MOTION_EVENT_STOP, events[1].type);
+
+  uint8_t junk[32] = {'E', 'Q', 'T', 'X'};
+  TEST_ASSERT_FALSE(decodeMotionTrace(junk, sizeof(junk), events));
+}
+
+void testSimulatedNight() {
+  RAStatic raModel;
+  raModel.setScrewToPivotInMM(448);
+  raModel.setLimitSwitchToMiddleDistance(62);
+  raModel.setRewindFastFowardSpeedInHz(30000);
+  raModel.setGuideRateMultiplier(.9);
+  DecStatic decModel;
+  decModel.setScrewToPivotInMM(448);
+  decModel.setLimitSwitchToMiddleDistance(62);
+  decModel.setRewindFastFowardSpeedInHz(30000);
+  decModel.setGuideRateMultiplier(.9);
+
+  SimulatedTimerService timers;
+  SimulatedStepper raStepper(timers);
+  SimulatedStepper decStepper(timers);
+  SimulatedInputSource inputs;
+
+  RADynamic raDynamic(raModel);
+  DecDynamic decDynamic(decModel);
+  raDynamic.setStepperWrapper(&raStepper);
+  raDynamic.setTimerService(&timers);
+  raDynamic.setTrackingMode(TRACKING_MODE_STREAM);
+  decDynamic.setStepperWrapper(&decStepper);
+  decDynamic.setTimerService(&timers);
+
+  CommandMailbox mailbox(raDynamic, decDynamic);
+  LoopMetrics metrics;
+  MotorUnit motorUnit(raModel, raDynamic, decModel, decDynamic, mailbox,
+                      metrics);
+  motorUnit.setup(&raStepper, &decStepper, &inputs, &timers);
+  motorUnit.setAcceleration(20000);
+
+  int32_t limit = raModel.getLimitPosition();
+  raStepper.setPhysicalPosition(limit);
+  decStepper.setPhysicalPosition(decModel.getMiddlePosition());
+
+  // main loop every 25ms, with the ra limit switch just past the limit.
+  // Pulse timers wake it in between, as MotorHardware::sleep does.
+  auto runFor = [&](double seconds) {
+    long loops = seconds * 40;
+    for (long i = 0; i < loops; i++) {
+      uint64_t wakeAt = timers.nowMicros() + 25000;
+      while (timers.sleepUntilTimer(wakeAt))
+        motorUnit.applyPulseTimers();
+      if (raStepper.getPhysicalPosition() > limit)
+        inputs.press(LIMIT_SWITCH_RA);
+      else
+        inputs.release(LIMIT_SWITCH_RA);
+      motorUnit.onLoop();
+    }
+  };
+
+  std::chrono::steady_clock::time_point wallStart =
+      std::chrono::steady_clock::now();
+  double simulatedSeconds = 0;
+  int pulses = 0;
+
+  try {
+    for (int run = 0; run < 6; run++) {
+      // track for half an hour, and check we kept up with the sky
+      inputs.press(BUTTON_PLAY);
+      runFor(1);
+      int32_t startPos = raStepper.getPosition();
+      double startTime = raModel.calculateTimeToCenterInSeconds(startPos);
+      runFor(1800);
+      // time to center counts 15 arc seconds per second
+      double trackedArcSeconds =
+          (startTime - raModel.calculateTimeToCenterInSeconds(
+                           raStepper.getPosition())) *
+          15;
+      double errorArcSeconds = fabs(
+          trackedArcSeconds - 1800 * raModel.getTrackingRateArcsSecondsSec());
+      log("Run %d: tracking error after 30 minutes %.2f arc seconds", run,
+          errorArcSeconds);
+      TEST_ASSERT_TRUE_MESSAGE(errorArcSeconds < 15,
+                               "Tracking should stay within 15 arc seconds");
+
+      // guide a while, both axes at once
+      for (int i = 0; i < 20; i++) {
+        mailbox.post(COMMAND_SOURCE_UDP,
+                     MotorCommand::pulseGuide(i % 2 ? 2 : 3, 300),
+                     timers.nowMicros());
+        mailbox.post(COMMAND_SOURCE_UDP,
+                     MotorCommand::pulseGuide(i % 2 ? 0 : 1, 200),
+                     timers.nowMicros());
+        pulses++;
+        runFor(2);
+      }
+      TEST_ASSERT_TRUE_MESSAGE(raStepper.isStreaming(),
+                               "Should be back to streaming after pulses");
+
+      // track to the end of the run
+      runFor(raModel.calculateTimeToEndOfRunInSeconds(
+                 raStepper.getPosition()) +
+             10);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(0, raStepper.getPosition(),
+                                    "Should track to end of run");
+      TEST_ASSERT_FALSE_MESSAGE(raDynamic.isTrackingOn(),
+                                "Tracking should stop at end");
+      inputs.release(BUTTON_PLAY);
+
+      // rewind from the end stops at the middle, so hold it twice: the
+      // second time until the platform has found the limit and backed off
+      inputs.press(BUTTON_REWIND);
+      runFor(30);
+      inputs.release(BUTTON_REWIND);
+      runFor(1);
+      TEST_ASSERT_EQUAL_INT_MESSAGE(raModel.getMiddlePosition(),
+                                    raStepper.getPosition(),
+                                    "First rewind should stop at middle");
+      inputs.press(BUTTON_REWIND);
+      runFor(60);
+      inputs.release(BUTTON_REWIND);
+      runFor(1);
+      TEST_ASSERT_FALSE_MESSAGE(raStepper.isRunning(),
+                                "Should stop after rewind");
+      TEST_ASSERT_EQUAL_INT_MESSAGE(limit, raStepper.getPosition(),
+                                    "Rewind should reset position to limit");
+      // switch is only read every recalc period, so the platform keeps
+      // moving a little after it is released
+      int32_t drift = raStepper.getPhysicalPosition() - limit;
+      log("Rewind %d: reset position is %d steps off", run, drift);
+      TEST_ASSERT_INT_WITHIN_MESSAGE(2 * raModel.getStepsPerMM(), 0, drift,
+                                     "Rewind should end near limit");
+      simulatedSeconds = timers.nowMicros() / 1000000.0;
+    }
+
+    TEST_ASSERT_EQUAL_INT_MESSAGE(
+        pulses * 2,
+        raDynamic.getPulseStopErrorStats().getCount() +
+            decDynamic.getPulseStopErrorStats().getCount(),
+        "Every pulse should be timed");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, motorUnit.getPulseStopErrorMaxMicros(),
+                                  "Pulses should stop on time");
+    TEST_ASSERT_EQUAL_INT_MESSAGE(0, mailbox.getCommandsDropped(),
+                                  "No commands dropped");
+    TEST_ASSERT_TRUE_MESSAGE(metrics.get(METRIC_RA_DYNAMIC).getCount() > 0,
+                             "RA loop should be timed");
+  } catch (std::runtime_error e) {
+    TEST_FAIL_MESSAGE(e.what());
+  }
+  double wallSeconds = std::chrono::duration<double>(
+                           std::chrono::steady_clock::now() - wallStart)
+                           .count();
+  log("Simulated %.1f hours in %.2f seconds (%.0fx real time)",
+      simulatedSeconds / 3600, wallSeconds, simulatedSeconds / wallSeconds);
+}
+
 void setup() {
 
   UNITY_BEGIN(); // IMPORTANT LINE!
   RUN_TEST(test_speed_calc);
+  RUN_TEST(test_speed_table_error);
+  RUN_TEST(test_numeric_backend_accuracy);
+  RUN_TEST(test_analytic_speed_matches_finite_difference);
+  RUN_TEST(test_speed_schedule);
   RUN_TEST(test_rewind_fast_forward_speed_calc);
   RUN_TEST(test_timetomiddle_calc);
   RUN_TEST(testRAGotoMiddleBasic);
@@ -919,6 +3761,34 @@ void setup() {
   RUN_TEST(testMoveAxisPositive);
   RUN_TEST(testCalculateMoveByDegrees);
   RUN_TEST(testRAPulseGuide);
+  RUN_TEST(testRAScheduleTracking);
+  RUN_TEST(testRAStreamTracking);
+  RUN_TEST(test_spsc_queue_two_threads);
+  RUN_TEST(testCommandMailbox);
+  RUN_TEST(testCommandCoalescing);
+  RUN_TEST(test_latency_histogram);
+  RUN_TEST(test_deferred_log);
+  RUN_TEST(test_log_levels);
+  RUN_TEST(test_platform_protocol);
+  RUN_TEST(test_dsc_packet_dispatch);
+  RUN_TEST(test_alpaca_telescope);
+  RUN_TEST(test_lx200_session);
+  RUN_TEST(test_status_delta);
+  RUN_TEST(test_status_publisher);
+  RUN_TEST(test_position_stream);
+  RUN_TEST(test_clock_sync);
+  RUN_TEST(test_command_window);
+  RUN_TEST(testTimedPulseGuide);
+  RUN_TEST(testTimedCommands);
+  RUN_TEST(testOverlappingPulseGuides);
+  RUN_TEST(testSimulatedStepperRamps);
+  RUN_TEST(testSimulatedStepQueueDepth);
+  RUN_TEST(testGotoStartTrajectory);
+  RUN_TEST(testTrackingErrorByMode);
+  RUN_TEST(testStreamUnderrunRecovery);
+  RUN_TEST(testMotionTrace);
+  RUN_TEST(testPlatformPositionExtrapolates);
+  RUN_TEST(testSimulatedNight);
   RUN_TEST(testDecPulseGuide);
   UNITY_END(); // IMPORTANT LINE!
 }
@@ -0,0 +1,40 @@
+/**
+ * Decode a motion trace downloaded from the platform.
+ *
+ *   curl -o trace.bin http://<platform>/trace
+ *   pio run -e decode_trace
+ *   .pio/build/decode_trace/program trace.bin csv > trace.csv
+ *   .pio/build/decode_trace/program trace.bin chrome > trace.json
+ *
+ * Load the json in chrome://tracing or https://ui.perfetto.dev
+ */
+#include "MotionTraceDecoder.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s trace.bin [csv|chrome]\n", argv[0]);
+    return 2;
+  }
+  std::ifstream in(argv[1], std::ios::binary);
+  if (!in) {
+    fprintf(stderr, "Could not open %s\n", argv[1]);
+    return 1;
+  }
+  std::vector<uint8_t> data((std::istreambuf_iterator<char>(in)),
+                            std::istreambuf_iterator<char>());
+  std::vector<MotionEvent> events;
+  if (!decodeMotionTrace(data.data(), data.size(), events)) {
+    fprintf(stderr, "%s is not a version %d motion trace\n", argv[1],
+            MOTION_TRACE_VERSION);
+    return 1;
+  }
+  bool chrome = argc > 2 && strcmp(argv[2], "chrome") == 0;
+  std::string out =
+      chrome ? motionTraceToChromeJson(events) : motionTraceToCsv(events);
+  fwrite(out.data(), 1, out.size(), stdout);
+  return 0;
+}